@@ -0,0 +1,244 @@
+// Feeds synthetic questions for the same events, worded three venues' ways,
+// through EventMatcher: discovery time per contract against scoring every
+// known question, and how many contracts land in the right event at each
+// threshold. Near-misses are built in: the same asset at other price
+// levels, the same race with other candidates. Then pairs of opposite
+// questions on two venues, none of which may end up in one event.
+//
+//   ./bench_event_matcher
+
+#include "event_matcher.h"
+#include "symbol_table.h"
+#include "types.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <random>
+
+static const size_t BRUTE_FORCE_QUERIES = 50;
+
+static const char* SYLLABLES[] = {
+    "ka", "ro", "mi", "len", "dar", "vo", "stel", "quin", "bar", "tho", "nex", "ula", "zen", "gor", "pri", "sa"
+};
+
+static const char* MONTH_NAMES[][2] = {
+    {"January", "Jan"}, {"March", "Mar"}, {"June", "Jun"}, {"September", "Sep"}, {"December", "Dec"}
+};
+
+static const char* OFFICES[] = {"Governor", "Senate", "Mayor", "House"};
+
+// Same subject, number and date, opposite sides
+static const char* OPPOSITES[][2] = {
+    {"Will Bitcoin be above $100,000 on December 31, 2025?", "Will Bitcoin be below $100,000 on December 31, 2025?"},
+    {"Will Trump win the 2028 election?", "Will Trump not win the 2028 election?"},
+    {"Will Trump win the 2028 election?", "Trump won't win the 2028 election?"},
+    {"Will Trump win the 2028 election?", "Will Trump lose the 2028 election?"},
+    {"ETH over $5,000 on June 30, 2026?", "ETH under $5,000 on June 30, 2026?"},
+    {"Will ETH reach $5,000 by June 30, 2026?", "Will ETH dip to $5,000 by June 30, 2026?"},
+    {"Will the Fed cut rates in March 2026?", "Will the Fed hike rates in March 2026?"},
+    {"Will the Fed cut rates in March 2026?", "Will the Fed not cut rates in March 2026?"},
+    {"Will a ceasefire be signed before July 1, 2026?", "Will a ceasefire be signed after July 1, 2026?"},
+    {"Will CPI be more than 3% in May 2026?", "Will CPI be less than 3% in May 2026?"}
+};
+
+struct Contract {
+    int venue;
+    size_t truth;   // index of the event it belongs to
+    std::string question;
+};
+
+static double elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+static std::string made_up_name(std::mt19937_64& rng) {
+    std::string name;
+    size_t parts = 2 + rng() % 2;
+    for (size_t i = 0; i < parts; i++) {
+        name += SYLLABLES[rng() % (sizeof(SYLLABLES) / sizeof(SYLLABLES[0]))];
+    }
+    name[0] = (char)toupper((unsigned char)name[0]);
+    return name;
+}
+
+static std::string thousands(int value) {
+    std::string digits = std::to_string(value);
+    for (int i = (int)digits.size() - 3; i > 0; i -= 3) {
+        digits.insert((size_t)i, ",");
+    }
+    return digits;
+}
+
+// One event, worded by Polymarket, Kalshi and PredictIt. Every third
+// event's group shares its subject with the one before, so similar
+// questions with other numbers or candidates are always in the index.
+static void make_event(std::mt19937_64& rng, size_t index, std::string& subject, std::vector<Contract>& out) {
+    if (index % 3 == 0) {
+        subject = made_up_name(rng);
+    }
+    std::string wordings[3];
+    int year = 2026 + (int)(rng() % 3);
+    int month = (int)(rng() % (sizeof(MONTH_NAMES) / sizeof(MONTH_NAMES[0])));
+    
+    switch (index % 3 == 0 ? rng() % 3 : index % 3) {
+    case 0: {
+        int level = (int)(50 + rng() % 200) * 1000;
+        wordings[0] = "Will " + subject + " reach $" + thousands(level) + " by " + MONTH_NAMES[month][0] + " 31, " + std::to_string(year) + "?";
+        wordings[1] = subject + " above " + std::to_string(level / 1000) + "k on " + MONTH_NAMES[month][1] + " 31, " + std::to_string(year) + "?";
+        wordings[2] = "Will " + subject + " hit $" + std::to_string(level / 1000) + "K by the end of " + MONTH_NAMES[month][0] + " " + std::to_string(year) + "?";
+        break;
+    }
+    case 1: {
+        std::string candidate = made_up_name(rng) + " " + made_up_name(rng);
+        std::string office = OFFICES[rng() % (sizeof(OFFICES) / sizeof(OFFICES[0]))];
+        wordings[0] = "Will " + candidate + " win the " + std::to_string(year) + " " + subject + " " + office + " election?";
+        wordings[1] = "Who will win the " + subject + " " + office + " race in " + std::to_string(year) + "? - " + candidate;
+        wordings[2] = "Which candidate will win the " + std::to_string(year) + " " + subject + " " + office + " election? - " + candidate;
+        break;
+    }
+    default: {
+        int bps = 25 * (int)(1 + rng() % 3);
+        wordings[0] = "Will the " + subject + " central bank cut rates by " + std::to_string(bps) + " bps in " + MONTH_NAMES[month][0] + " " + std::to_string(year) + "?";
+        wordings[1] = subject + " central bank rate cut of " + std::to_string(bps) + "bps at the " + MONTH_NAMES[month][1] + " " + std::to_string(year) + " meeting?";
+        wordings[2] = "Will the " + subject + " central bank cut its rate " + std::to_string(bps) + " bps in " + MONTH_NAMES[month][0] + " " + std::to_string(year) + "?";
+        break;
+    }
+    }
+    
+    for (int venue = 0; venue < 3; venue++) {
+        Contract contract;
+        contract.venue = venue;
+        contract.truth = index;
+        contract.question = wordings[venue];
+        out.push_back(contract);
+    }
+}
+
+static void run(size_t events, double threshold, bool time_brute_force) {
+    std::mt19937_64 rng(7);
+    std::vector<Contract> by_event;
+    std::string subject;
+    for (size_t e = 0; e < events; e++) {
+        make_event(rng, e, subject, by_event);
+    }
+    
+    // Each venue discovers its whole list in one go, as the feeds do
+    std::vector<Contract> contracts;
+    for (int venue = 0; venue < 3; venue++) {
+        for (size_t i = 0; i < by_event.size(); i++) {
+            if (by_event[i].venue == venue) {
+                contracts.push_back(by_event[i]);
+            }
+        }
+    }
+    std::vector<SymbolId> market_ids(contracts.size());
+    for (size_t i = 0; i < contracts.size(); i++) {
+        market_ids[i] = market_symbols().intern("bench-" + std::to_string(events) + "-" + std::to_string(i));
+    }
+    
+    EventMatcher matcher;
+    matcher.set_threshold(threshold);
+    std::vector<SymbolId> assigned(contracts.size());
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < contracts.size(); i++) {
+        assigned[i] = matcher.match(contracts[i].venue, market_ids[i], contracts[i].question);
+    }
+    double indexed = elapsed_ns(start) / contracts.size();
+    
+    // Scoring against every question the matcher has seen, as a matcher
+    // without the index would, for a sample of the last venue's contracts
+    double brute = 0.0;
+    if (time_brute_force) {
+        double sink = 0.0;
+        size_t queries = std::min(BRUTE_FORCE_QUERIES, events);
+        start = std::chrono::steady_clock::now();
+        for (size_t q = 0; q < queries; q++) {
+            const std::string& query = contracts[contracts.size() - 1 - q].question;
+            for (size_t i = 0; i < contracts.size() - events; i++) {
+                sink += matcher.similarity(query, contracts[i].question);
+            }
+        }
+        brute = elapsed_ns(start) / queries;
+        if (sink == 42.0) {
+            std::cout << " ";
+        }
+    }
+    
+    // Kalshi and PredictIt contracts against their Polymarket twin; an
+    // event is wrong for a contract when it was started for another truth
+    std::vector<SymbolId> polymarket_event(events);
+    for (size_t i = 0; i < events; i++) {
+        polymarket_event[contracts[i].truth] = assigned[i];
+    }
+    std::unordered_map<SymbolId, size_t> started_for;
+    for (size_t i = 0; i < contracts.size(); i++) {
+        started_for.insert(std::make_pair(assigned[i], contracts[i].truth));
+    }
+    size_t joined = 0;
+    size_t wrong = 0;
+    for (size_t i = events; i < contracts.size(); i++) {
+        if (assigned[i] == polymarket_event[contracts[i].truth]) {
+            joined++;
+        } else if (started_for[assigned[i]] != contracts[i].truth) {
+            wrong++;
+        }
+    }
+    size_t pairs = contracts.size() - events;
+    EventMatcherStats stats = matcher.stats();
+    
+    std::cout << std::setw(8) << events << std::setw(8) << std::setprecision(2) << threshold
+              << std::setprecision(1) << std::setw(12) << indexed / 1000.0;
+    if (time_brute_force) {
+        std::cout << std::setw(12) << brute / 1000.0;
+    } else {
+        std::cout << std::setw(12) << "-";
+    }
+    std::cout << std::setw(10) << 100.0 * joined / pairs << "%"
+              << std::setw(10) << 100.0 * wrong / pairs << "%"
+              << std::setw(10) << stats.events << std::endl;
+}
+
+// Each pair on its own matcher, first question on Polymarket, second on
+// Kalshi: the second must start an event of its own
+static void run_opposites() {
+    size_t joined = 0;
+    size_t count = sizeof(OPPOSITES) / sizeof(OPPOSITES[0]);
+    for (size_t i = 0; i < count; i++) {
+        EventMatcher matcher;
+        SymbolId first = matcher.match(MARKET_POLYMARKET, market_symbols().intern("bench-opposite-a-" + std::to_string(i)),
+                                       OPPOSITES[i][0]);
+        SymbolId second = matcher.match(MARKET_KALSHI, market_symbols().intern("bench-opposite-b-" + std::to_string(i)),
+                                        OPPOSITES[i][1]);
+        joined += first == second;
+        std::cout << std::setw(6) << std::setprecision(2) << matcher.similarity(OPPOSITES[i][0], OPPOSITES[i][1])
+                  << (first == second ? "  JOINED  " : "  apart   ") << OPPOSITES[i][0] << " / " << OPPOSITES[i][1] << std::endl;
+    }
+    std::cout << joined << " of " << count << " opposite pairs joined" << std::endl;
+}
+
+int main() {
+    std::cout << std::fixed;
+    std::cout << "us per contract; recall = Kalshi/PredictIt contracts joined to their Polymarket twin, "
+              << "wrong = joined to another event" << std::endl;
+    std::cout << std::setw(8) << "events" << std::setw(8) << "thresh"
+              << std::setw(12) << "indexed" << std::setw(12) << "all-pairs"
+              << std::setw(11) << "recall" << std::setw(11) << "wrong" << std::setw(10) << "made" << std::endl;
+    
+    size_t sizes[] = {1000, 5000, 20000};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        run(sizes[i], 0.6, true);
+    }
+    double thresholds[] = {0.4, 0.5, 0.7, 0.8};
+    for (size_t i = 0; i < sizeof(thresholds) / sizeof(thresholds[0]); i++) {
+        run(5000, thresholds[i], false);
+    }
+    
+    std::cout << std::endl << "score, verdict and pair for questions that must stay apart" << std::endl;
+    run_opposites();
+    return 0;
+}
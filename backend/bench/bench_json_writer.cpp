@@ -0,0 +1,219 @@
+// Messages per second for the server's market_data and opportunity JSON,
+// JsonWriter against the ostringstream code it replaced. Also checks that
+// format_double round-trips over random doubles and that the writer's
+// output, including awkward event names, parses back with jsoncpp to the
+// exact values that went in.
+//
+//   ./bench_json_writer [messages]
+
+#include "json_writer.h"
+#include "websocket_server.h"
+#include "symbol_table.h"
+#include <json/json.h>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstring>
+#include <stdlib.h>
+
+// Previous implementations, kept verbatim as the baseline
+static std::string legacy_opportunity_json(ArbitrageOpportunity* opp) {
+    std::ostringstream oss;
+    oss << "{\"type\":\"opportunity\",\"data\":{"
+        << "\"event_id\":\"" << event_symbols().name(opp->event_id) << "\","
+        << "\"buy_market\":" << opp->buy_market << ","
+        << "\"sell_market\":" << opp->sell_market << ","
+        << "\"buy_price\":" << opp->buy_price << ","
+        << "\"sell_price\":" << opp->sell_price << ","
+        << "\"profit_percentage\":" << (opp->profit_percentage * 100.0) << ","
+        << "\"max_size\":" << opp->max_size << ","
+        << "\"avg_buy_price\":" << opp->avg_buy_price << ","
+        << "\"avg_sell_price\":" << opp->avg_sell_price
+        << "}}";
+    return oss.str();
+}
+
+static std::string legacy_market_data_json(MarketData* data) {
+    std::ostringstream oss;
+    oss << "{\"type\":\"market_data\",\"data\":{"
+        << "\"market_id\":\"" << market_symbols().name(data->market_id) << "\","
+        << "\"market\":" << data->market << ","
+        << "\"event_name\":\"" << event_symbols().name(data->event_id) << "\","
+        << "\"best_bid\":" << data->best_bid << ","
+        << "\"best_ask\":" << data->best_ask << ","
+        << "\"bid_size\":" << data->bid_size << ","
+        << "\"ask_size\":" << data->ask_size
+        << "}}";
+    return oss.str();
+}
+
+static long long now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool check_round_trip(std::mt19937_64& rng, int count) {
+    std::uniform_real_distribution<double> price(0.0, 1.0);
+    for (int i = 0; i < count; i++) {
+        double values[4];
+        uint64_t bits = rng();
+        memcpy(&values[0], &bits, sizeof(double));    // anything at all
+        values[1] = price(rng);                       // long mantissas
+        values[2] = (double)(rng() % 1000) / 1000.0;  // tick prices
+        values[3] = (double)(rng() % 10000000) / 100.0;
+        
+        for (int v = 0; v < 4; v++) {
+            char text[MAX_DOUBLE_CHARS + 1];
+            size_t length = format_double(values[v], text);
+            if (length == 0) {
+                if (values[v] == values[v] && values[v] - values[v] == 0.0) {
+                    std::cerr << "finite value not formatted" << std::endl;
+                    return false;
+                }
+                continue;
+            }
+            text[length] = '\0';
+            if (strtod(text, NULL) != values[v]) {
+                std::cerr << "round-trip failed: " << std::setprecision(17) << values[v]
+                          << " -> " << text << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool check_parse(const std::vector<MarketData>& updates, const std::vector<ArbitrageOpportunity>& opps) {
+    JsonWriter out;
+    Json::Reader reader;
+    for (size_t i = 0; i < updates.size(); i++) {
+        const MarketData& data = updates[i];
+        out.clear();
+        write_market_data_json(out, &data, i + 1);
+        Json::Value root;
+        if (!reader.parse(out.str(), root)) {
+            std::cerr << "unparseable: " << out.str() << std::endl;
+            return false;
+        }
+        const Json::Value& d = root["data"];
+        if (d["event_name"].asString() != event_symbols().name(data.event_id) ||
+            d["market_id"].asString() != market_symbols().name(data.market_id) ||
+            d["market"].asInt() != data.market ||
+            d["best_bid"].asDouble() != data.best_bid || d["best_ask"].asDouble() != data.best_ask ||
+            d["bid_size"].asDouble() != data.bid_size || d["ask_size"].asDouble() != data.ask_size) {
+            std::cerr << "mismatch: " << out.str() << std::endl;
+            return false;
+        }
+    }
+    for (size_t i = 0; i < opps.size(); i++) {
+        const ArbitrageOpportunity& opp = opps[i];
+        out.clear();
+        write_opportunity_json(out, &opp, i + 1);
+        Json::Value root;
+        if (!reader.parse(out.str(), root)) {
+            std::cerr << "unparseable: " << out.str() << std::endl;
+            return false;
+        }
+        const Json::Value& d = root["data"];
+        if (d["event_id"].asString() != event_symbols().name(opp.event_id) ||
+            d["buy_price"].asDouble() != opp.buy_price || d["sell_price"].asDouble() != opp.sell_price ||
+            d["profit_percentage"].asDouble() != opp.profit_percentage * 100.0 ||
+            d["max_size"].asDouble() != opp.max_size ||
+            d["avg_buy_price"].asDouble() != opp.avg_buy_price ||
+            d["avg_sell_price"].asDouble() != opp.avg_sell_price) {
+            std::cerr << "mismatch: " << out.str() << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    int messages = argc > 1 ? atoi(argv[1]) : 1000000;
+    std::mt19937_64 rng(42);
+    
+    // Event names as the feeds deliver them, a few with characters the old
+    // code emitted unescaped
+    const char* names[] = {
+        "Will the Fed cut rates in December?",
+        "Who will win the \"Best Picture\" award?",
+        "Path C:\\temp\\odds",
+        "Line one\nline two\ttabbed",
+        "Bitcoin above $100k on Dec 31? \xe2\x9c\x93",
+        "Control \x01 byte"
+    };
+    const size_t name_count = sizeof(names) / sizeof(names[0]);
+    
+    std::vector<MarketData> updates(1024);
+    std::vector<ArbitrageOpportunity> opps(1024);
+    for (size_t i = 0; i < updates.size(); i++) {
+        std::string market = "0x" + std::to_string(rng() % 1000000007ULL);
+        MarketData& data = updates[i];
+        data.market_id = market_symbols().intern(market);
+        data.market = MARKET_POLYMARKET;
+        data.event_id = event_symbols().intern(names[i % name_count]);
+        data.best_bid = (double)(1 + rng() % 989) / 1000.0;
+        data.best_ask = data.best_bid + 0.01;
+        data.bid_size = (double)(rng() % 100000) / 100.0;
+        data.ask_size = (double)(rng() % 100000) / 100.0;
+        
+        ArbitrageOpportunity& opp = opps[i];
+        opp.event_id = data.event_id;
+        opp.buy_price = data.best_bid;
+        opp.sell_price = data.best_ask;
+        opp.profit_percentage = (opp.sell_price - opp.buy_price) / opp.buy_price;
+        opp.max_size = data.bid_size;
+        opp.avg_buy_price = opp.buy_price + (double)(rng() % 100) / 7000.0;
+        opp.avg_sell_price = opp.sell_price - (double)(rng() % 100) / 7000.0;
+    }
+    
+    bool ok = check_round_trip(rng, 1000000) && check_parse(updates, opps);
+    std::cout << "round-trip and parse checks: " << (ok ? "ok" : "FAILED") << std::endl;
+    
+    std::cout << "legacy market_data: " << legacy_market_data_json(&updates[1]) << std::endl;
+    JsonWriter sample;
+    write_market_data_json(sample, &updates[1], 1);
+    std::cout << "writer market_data: " << sample.str() << std::endl;
+    
+    // Both paths hand the caller a message it can frame; the sink keeps the
+    // compiler from discarding the work
+    size_t sink = 0;
+    std::cout << std::fixed << std::setprecision(2);
+    for (int kind = 0; kind < 2; kind++) {
+        const char* label = kind == 0 ? "market_data" : "opportunity";
+        
+        long long start = now_ns();
+        for (int i = 0; i < messages; i++) {
+            size_t slot = i & (updates.size() - 1);
+            std::string message = kind == 0 ? legacy_market_data_json(&updates[slot])
+                                            : legacy_opportunity_json(&opps[slot]);
+            sink += message.size();
+        }
+        double legacy_seconds = (now_ns() - start) / 1e9;
+        
+        JsonWriter out;
+        start = now_ns();
+        for (int i = 0; i < messages; i++) {
+            size_t slot = i & (updates.size() - 1);
+            out.clear();
+            if (kind == 0) {
+                write_market_data_json(out, &updates[slot], i + 1);
+            } else {
+                write_opportunity_json(out, &opps[slot], i + 1);
+            }
+            sink += out.size();
+        }
+        double writer_seconds = (now_ns() - start) / 1e9;
+        
+        std::cout << label << ": ostringstream " << (messages / legacy_seconds / 1e6) << " M msg/s, "
+                  << "JsonWriter " << (messages / writer_seconds / 1e6) << " M msg/s ("
+                  << (legacy_seconds / writer_seconds) << "x)" << std::endl;
+    }
+    
+    std::cout << "(" << sink << " bytes)" << std::endl;
+    return ok ? 0 : 1;
+}
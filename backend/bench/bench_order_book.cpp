@@ -0,0 +1,195 @@
+// Times L2 book maintenance and the depth sweep at realistic depths.
+// Deltas are checked against a std::map book (what the streaming client
+// used to keep) and sweeps against a level-by-level reference.
+//
+//   ./bench_order_book
+
+#include "order_book.h"
+#include "pricing_kernel.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <map>
+#include <random>
+#include <cmath>
+
+static const double TICK = 0.001;
+static const LegFee FEE = {0.0, 0.02, 0.0};
+static const double MIN_PROFIT = 0.01;
+
+static double elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+// One side of a book on a 0.001 tick grid, in wire order (best last)
+static std::vector<PriceLevel> make_side(std::mt19937_64& rng, double best, int direction, size_t depth) {
+    std::uniform_real_distribution<double> size(10.0, 2000.0);
+    std::vector<PriceLevel> levels(depth);
+    for (size_t i = 0; i < depth; i++) {
+        levels[depth - 1 - i].price = std::round((best + direction * (double)i * TICK) / TICK) * TICK;
+        levels[depth - 1 - i].size = std::floor(size(rng));
+    }
+    return levels;
+}
+
+struct Delta {
+    int side;
+    double price;
+    double size;
+};
+
+// Mostly size changes near the touch, with some adds and removes, the way
+// a live price_change stream looks
+static std::vector<Delta> make_deltas(std::mt19937_64& rng, double best_bid, double best_ask, size_t depth, size_t count) {
+    std::uniform_int_distribution<int> coin(0, 1);
+    std::exponential_distribution<double> distance(0.2);
+    std::uniform_real_distribution<double> size(10.0, 2000.0);
+    std::uniform_int_distribution<int> action(0, 9);
+    
+    std::vector<Delta> deltas(count);
+    for (size_t i = 0; i < count; i++) {
+        Delta& d = deltas[i];
+        d.side = coin(rng) ? BOOK_BID : BOOK_ASK;
+        size_t offset = std::min((size_t)distance(rng), depth + 5);
+        d.price = d.side == BOOK_BID ? best_bid - offset * TICK : best_ask + offset * TICK;
+        d.price = std::round(d.price / TICK) * TICK;
+        d.size = action(rng) < 2 ? 0.0 : std::floor(size(rng));
+    }
+    return deltas;
+}
+
+static bool same_side(const PriceLevel* levels, size_t count, const std::map<double, double>& reference, bool bids) {
+    if (count != reference.size()) {
+        return false;
+    }
+    size_t i = 0;
+    if (bids) {
+        for (std::map<double, double>::const_iterator it = reference.begin(); it != reference.end(); ++it, i++) {
+            if (levels[i].price != it->first || levels[i].size != it->second) {
+                return false;
+            }
+        }
+    } else {
+        for (std::map<double, double>::const_reverse_iterator it = reference.rbegin(); it != reference.rend(); ++it, i++) {
+            if (levels[i].price != it->first || levels[i].size != it->second) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Unrolls both ladders into one entry per whole unit of size and pairs
+// them off in order: slow, but obviously right for integer sizes
+static double reference_sweep(const OrderBook& buy, const OrderBook& sell) {
+    std::vector<double> asks;
+    std::vector<double> bids;
+    for (size_t i = buy.ask_count(); i-- > 0;) {
+        asks.insert(asks.end(), (size_t)buy.asks()[i].size, buy.asks()[i].price);
+    }
+    for (size_t i = sell.bid_count(); i-- > 0;) {
+        bids.insert(bids.end(), (size_t)sell.bids()[i].size, sell.bids()[i].price);
+    }
+    
+    double size = 0.0;
+    for (size_t i = 0; i < asks.size() && i < bids.size(); i++) {
+        if (pair_profit(asks[i], bids[i], leg_fee(asks[i], FEE), leg_fee(bids[i], FEE)) <= MIN_PROFIT) {
+            break;
+        }
+        size += 1.0;
+    }
+    return size;
+}
+
+static bool run(size_t depth) {
+    std::mt19937_64 rng(depth);
+    const double best_bid = 0.450;
+    const double best_ask = 0.452;
+    
+    std::vector<PriceLevel> bids = make_side(rng, best_bid, -1, depth);
+    std::vector<PriceLevel> asks = make_side(rng, best_ask, 1, depth);
+    
+    // Snapshot load from wire order
+    OrderBook book;
+    size_t rounds = std::max<size_t>(1, 2000000 / depth);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; r++) {
+        book.set_snapshot(&bids[0], bids.size(), &asks[0], asks.size());
+    }
+    double snapshot_ns = elapsed_ns(start) / rounds;
+    
+    // Deltas, against the std::map book they replace
+    std::map<double, double> ref_bids;
+    std::map<double, double> ref_asks;
+    for (size_t i = 0; i < depth; i++) {
+        ref_bids[bids[i].price] = bids[i].size;
+        ref_asks[asks[i].price] = asks[i].size;
+    }
+    std::map<double, double> map_bids = ref_bids;
+    std::map<double, double> map_asks = ref_asks;
+    
+    std::vector<Delta> deltas = make_deltas(rng, best_bid, best_ask, depth, 1000000);
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < deltas.size(); i++) {
+        book.apply_delta(deltas[i].side, deltas[i].price, deltas[i].size);
+    }
+    double delta_ns = elapsed_ns(start) / deltas.size();
+    
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < deltas.size(); i++) {
+        std::map<double, double>& side = deltas[i].side == BOOK_BID ? map_bids : map_asks;
+        if (deltas[i].size > 0.0) {
+            side[deltas[i].price] = deltas[i].size;
+        } else {
+            side.erase(deltas[i].price);
+        }
+    }
+    double map_ns = elapsed_ns(start) / deltas.size();
+    
+    bool ok = same_side(book.bids(), book.bid_count(), map_bids, true) &&
+              same_side(book.asks(), book.ask_count(), map_asks, false);
+    
+    // Sweep a crossed pair of books: the seller's bids sit a few cents
+    // above the buyer's asks, so profit runs out partway down the ladders
+    OrderBook buy_book;
+    OrderBook sell_book;
+    std::vector<PriceLevel> crossed_bids = make_side(rng, best_ask + 0.04, -1, depth);
+    buy_book.set_snapshot(NULL, 0, &asks[0], asks.size());
+    sell_book.set_snapshot(&crossed_bids[0], crossed_bids.size(), NULL, 0);
+    
+    SweepResult sweep;
+    rounds = std::max<size_t>(1, 20000000 / depth);
+    start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; r++) {
+        sweep_books(buy_book, sell_book, FEE, FEE, MIN_PROFIT, sweep);
+    }
+    double sweep_ns = elapsed_ns(start) / rounds;
+    
+    ok = ok && sweep.size == reference_sweep(buy_book, sell_book);
+    
+    std::cout << std::setw(8) << depth
+              << std::setw(14) << snapshot_ns
+              << std::setw(12) << delta_ns << std::setw(12) << map_ns
+              << std::setw(12) << sweep_ns << std::setw(10) << sweep.levels
+              << std::setw(12) << sweep.size
+              << std::setw(8) << (ok ? "ok" : "FAIL") << std::endl;
+    return ok;
+}
+
+int main() {
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "ns per operation; delta columns compare against a std::map book" << std::endl;
+    std::cout << std::setw(8) << "depth" << std::setw(14) << "snapshot"
+              << std::setw(12) << "delta" << std::setw(12) << "map delta"
+              << std::setw(12) << "sweep" << std::setw(10) << "levels"
+              << std::setw(12) << "size" << std::setw(8) << "check" << std::endl;
+    
+    bool ok = true;
+    size_t depths[] = {10, 50, 100, 250};
+    for (size_t i = 0; i < sizeof(depths) / sizeof(depths[0]); i++) {
+        ok = run(depths[i]) && ok;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,285 @@
+// Throughput of parse_orderbook against the find/substr parser it replaced,
+// over CLOB /book payloads at several depths. Payloads follow the shape of
+// captured responses: string-quoted numbers, bids ascending, asks
+// descending, plus market/asset/hash metadata. Also checks every parsed
+// number against strtod.
+//
+//   ./bench_orderbook_parser
+
+#include "orderbook_parser.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstring>
+#include <stdlib.h>
+
+// Previous implementation, kept verbatim as the baseline
+static bool legacy_parse_orderbook(const std::string& json, double& best_bid, double& best_ask, double& bid_size, double& ask_size) {
+    best_bid = 0.0;
+    best_ask = 0.0;
+    bid_size = 0.0;
+    ask_size = 0.0;
+    
+    // Parse bids array - get first bid
+    size_t bids_pos = json.find("\"bids\"");
+    if (bids_pos != std::string::npos) {
+        size_t array_start = json.find("[", bids_pos);
+        if (array_start != std::string::npos && json[array_start + 1] != ']') {
+            // Has bids - try quoted string first, then numeric
+            size_t price_pos = json.find("\"price\":\"", array_start);
+            if (price_pos != std::string::npos) {
+                // Quoted string format: "price":"0.5"
+                price_pos += 9; // Skip "price":"
+                size_t price_end = json.find("\"", price_pos);
+                std::string bid_price_str = json.substr(price_pos, price_end - price_pos);
+                best_bid = atof(bid_price_str.c_str());
+            } else {
+                // Numeric format: "price":0.5
+                price_pos = json.find("\"price\":", array_start);
+                if (price_pos != std::string::npos) {
+                    price_pos += 8; // Skip "price":
+                    // Find end of number (comma, }, or whitespace)
+                    size_t price_end = price_pos;
+                    while (price_end < json.length() && 
+                           json[price_end] != ',' && 
+                           json[price_end] != '}' && 
+                           json[price_end] != ' ' &&
+                           json[price_end] != '\n' &&
+                           json[price_end] != '\r') {
+                        price_end++;
+                    }
+                    std::string bid_price_str = json.substr(price_pos, price_end - price_pos);
+                    best_bid = atof(bid_price_str.c_str());
+                }
+            }
+            
+            if (best_bid > 0.0) {
+                // Parse size - try quoted string first, then numeric
+                size_t size_pos = json.find("\"size\":\"", array_start);
+                if (size_pos != std::string::npos && size_pos > array_start) {
+                    // Quoted string format
+                    size_pos += 8; // Skip "size":"
+                    size_t size_end = json.find("\"", size_pos);
+                    std::string bid_size_str = json.substr(size_pos, size_end - size_pos);
+                    bid_size = atof(bid_size_str.c_str());
+                } else {
+                    // Numeric format: "size":100.0
+                    size_pos = json.find("\"size\":", array_start);
+                    if (size_pos != std::string::npos && size_pos > array_start) {
+                        size_pos += 7; // Skip "size":
+                        size_t size_end = size_pos;
+                        while (size_end < json.length() && 
+                               json[size_end] != ',' && 
+                               json[size_end] != '}' && 
+                               json[size_end] != ' ' &&
+                               json[size_end] != '\n' &&
+                               json[size_end] != '\r') {
+                            size_end++;
+                        }
+                        std::string bid_size_str = json.substr(size_pos, size_end - size_pos);
+                        bid_size = atof(bid_size_str.c_str());
+                    }
+                }
+            }
+        }
+    }
+    
+    // Parse asks array - get first ask
+    size_t asks_pos = json.find("\"asks\"");
+    if (asks_pos != std::string::npos) {
+        size_t array_start = json.find("[", asks_pos);
+        if (array_start != std::string::npos && json[array_start + 1] != ']') {
+            // Has asks - try quoted string first, then numeric
+            size_t price_pos = json.find("\"price\":\"", array_start);
+            if (price_pos != std::string::npos) {
+                // Quoted string format: "price":"0.5"
+                price_pos += 9; // Skip "price":"
+                size_t price_end = json.find("\"", price_pos);
+                std::string ask_price_str = json.substr(price_pos, price_end - price_pos);
+                best_ask = atof(ask_price_str.c_str());
+            } else {
+                // Numeric format: "price":0.5
+                price_pos = json.find("\"price\":", array_start);
+                if (price_pos != std::string::npos) {
+                    price_pos += 8; // Skip "price":
+                    // Find end of number (comma, }, or whitespace)
+                    size_t price_end = price_pos;
+                    while (price_end < json.length() && 
+                           json[price_end] != ',' && 
+                           json[price_end] != '}' && 
+                           json[price_end] != ' ' &&
+                           json[price_end] != '\n' &&
+                           json[price_end] != '\r') {
+                        price_end++;
+                    }
+                    std::string ask_price_str = json.substr(price_pos, price_end - price_pos);
+                    best_ask = atof(ask_price_str.c_str());
+                }
+            }
+            
+            if (best_ask > 0.0) {
+                // Parse size - try quoted string first, then numeric
+                size_t size_pos = json.find("\"size\":\"", array_start);
+                if (size_pos != std::string::npos && size_pos > array_start) {
+                    // Quoted string format
+                    size_pos += 8; // Skip "size":"
+                    size_t size_end = json.find("\"", size_pos);
+                    std::string ask_size_str = json.substr(size_pos, size_end - size_pos);
+                    ask_size = atof(ask_size_str.c_str());
+                } else {
+                    // Numeric format: "size":100.0
+                    size_pos = json.find("\"size\":", array_start);
+                    if (size_pos != std::string::npos && size_pos > array_start) {
+                        size_pos += 7; // Skip "size":
+                        size_t size_end = size_pos;
+                        while (size_end < json.length() && 
+                               json[size_end] != ',' && 
+                               json[size_end] != '}' && 
+                               json[size_end] != ' ' &&
+                               json[size_end] != '\n' &&
+                               json[size_end] != '\r') {
+                            size_end++;
+                        }
+                        std::string ask_size_str = json.substr(size_pos, size_end - size_pos);
+                        ask_size = atof(ask_size_str.c_str());
+                    }
+                }
+            }
+        }
+    }
+    
+    return (best_bid > 0.0 || best_ask > 0.0);
+}
+
+static double elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+static std::string decimal(std::mt19937_64& rng, int whole_max, int places) {
+    std::string s = std::to_string(rng() % (whole_max + 1)) + ".";
+    for (int i = 0; i < places; i++) {
+        s += (char)('0' + rng() % 10);
+    }
+    return s;
+}
+
+static std::string make_book(std::mt19937_64& rng, int depth) {
+    std::string json = "{\"market\":\"0x5f65177b394277fd294cd75650044e32ba009a95022d88a0c1d565897d72f8f1\","
+                       "\"asset_id\":\"93233117327291618289066315828674286787516183725243918731390800170422815079307\","
+                       "\"timestamp\":\"1729084877448\","
+                       "\"hash\":\"3cd4d61e042c81560c9037ece0c61f3b1a8fbbdd\",\"bids\":[";
+    // Bids ascending, best (highest) last
+    for (int i = 0; i < depth; i++) {
+        int cents = 1 + i * 48 / depth;
+        json += std::string(i ? "," : "") + "{\"price\":\"0." + (cents < 10 ? "0" : "") + std::to_string(cents) +
+                "\",\"size\":\"" + decimal(rng, 20000, 2) + "\"}";
+    }
+    json += "],\"asks\":[";
+    // Asks descending, best (lowest) last
+    for (int i = 0; i < depth; i++) {
+        int cents = 99 - i * 48 / depth;
+        json += std::string(i ? "," : "") + "{\"price\":\"0." + std::to_string(cents) +
+                "\",\"size\":\"" + decimal(rng, 20000, 2) + "\"}";
+    }
+    json += "],\"min_order_size\":\"5\",\"tick_size\":\"0.01\",\"neg_risk\":false}";
+    return json;
+}
+
+// Every level kept must equal strtod of the same text, bit for bit. A
+// ladder deeper than MAX_BOOK_LEVELS keeps its last (best) levels.
+static size_t check_exact(const std::string& json, int depth, const ParsedBook& book) {
+    size_t dropped = (size_t)depth > MAX_BOOK_LEVELS ? (size_t)depth - MAX_BOOK_LEVELS : 0;
+    size_t mismatches = 0;
+    size_t bid = 0;
+    size_t ask = 0;
+    size_t asks_pos = json.find("\"asks\"");
+    size_t pos = 0;
+    while ((pos = json.find("\"price\":\"", pos)) != std::string::npos) {
+        double price = strtod(json.c_str() + pos + 9, NULL);
+        size_t size_pos = json.find("\"size\":\"", pos);
+        double size = strtod(json.c_str() + size_pos + 8, NULL);
+        size_t& index = pos < asks_pos ? bid : ask;
+        if (index++ >= dropped) {
+            const PriceLevel& level = pos < asks_pos ? book.bids[index - 1 - dropped] : book.asks[index - 1 - dropped];
+            if (memcmp(&price, &level.price, sizeof(double)) != 0 || memcmp(&size, &level.size, sizeof(double)) != 0) {
+                mismatches++;
+            }
+        }
+        pos = size_pos;
+    }
+    return mismatches;
+}
+
+static bool run(int depth) {
+    std::mt19937_64 rng(depth);
+    std::vector<std::string> books;
+    size_t bytes = 0;
+    for (int i = 0; i < 64; i++) {
+        books.push_back(make_book(rng, depth));
+        bytes += books.back().size();
+    }
+    
+    size_t rounds = std::max<size_t>(1, 400000 / (depth * 4));
+    double sink = 0.0;
+    
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < books.size(); i++) {
+            double best_bid, best_ask, bid_size, ask_size;
+            legacy_parse_orderbook(books[i], best_bid, best_ask, bid_size, ask_size);
+            sink += best_bid;
+        }
+    }
+    double legacy_ns = elapsed_ns(start) / (rounds * books.size());
+    
+    ParsedBook* book = new ParsedBook();
+    start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < books.size(); i++) {
+            double best_bid, best_ask, bid_size, ask_size;
+            parse_orderbook(books[i].data(), books[i].size(), *book);
+            top_of_book(*book, best_bid, best_ask, bid_size, ask_size);
+            sink += best_bid;
+        }
+    }
+    double parser_ns = elapsed_ns(start) / (rounds * books.size());
+    
+    size_t mismatches = 0;
+    for (size_t i = 0; i < books.size(); i++) {
+        size_t kept = std::min((size_t)depth, MAX_BOOK_LEVELS);
+        if (!parse_orderbook(books[i].data(), books[i].size(), *book) ||
+            book->bid_count != kept || book->ask_count != kept) {
+            mismatches++;
+            continue;
+        }
+        mismatches += check_exact(books[i], depth, *book);
+    }
+    delete book;
+    
+    double avg_bytes = (double)bytes / books.size();
+    std::cout << std::setw(6) << depth << std::setw(10) << (size_t)avg_bytes
+              << std::setw(14) << legacy_ns << std::setw(10) << (avg_bytes / legacy_ns * 1000.0)
+              << std::setw(14) << parser_ns << std::setw(10) << (avg_bytes / parser_ns * 1000.0)
+              << std::setw(12) << mismatches << (sink == 42.0 ? " " : "") << std::endl;
+    return mismatches == 0;
+}
+
+int main() {
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "legacy parser reads the first level only; new parser reads both full ladders" << std::endl;
+    std::cout << std::setw(6) << "depth" << std::setw(10) << "bytes"
+              << std::setw(14) << "legacy ns" << std::setw(10) << "MB/s"
+              << std::setw(14) << "parser ns" << std::setw(10) << "MB/s"
+              << std::setw(12) << "mismatches" << std::endl;
+    
+    bool ok = true;
+    int depths[] = {5, 25, 100, 250, 1000};
+    for (size_t i = 0; i < sizeof(depths) / sizeof(depths[0]); i++) {
+        ok = run(depths[i]) && ok;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,150 @@
+// Ticks the outcomes of one venue's outcome set (YES + NO, or every
+// candidate of a multi-outcome event) through the engine, which keeps the
+// set's cost as running sums, against re-summing every member's ask from
+// the quote store on each tick. Also counts ticks where the two disagree
+// on whether the set is an opportunity.
+//
+//   ./bench_outcome_sets
+
+#include "arbitrage_engine.h"
+#include "quote_store.h"
+#include "pricing_kernel.h"
+#include "fee_model.h"
+#include "symbol_table.h"
+#include "types.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <random>
+
+static const size_t TICKS = 1000000;
+
+static double elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+// Asks wander within 5% of an even split of $1, so the set is sometimes
+// cheap enough to clear fees and the threshold
+static void make_ticks(size_t outcomes, std::vector<MarketData>& ticks, std::vector<size_t>& member,
+                       const std::vector<SymbolId>& market_ids, const std::vector<SymbolId>& event_ids, SymbolId group_id) {
+    std::mt19937_64 rng(11);
+    std::uniform_real_distribution<double> noise(0.95, 1.05);
+    ticks.resize(TICKS + outcomes);
+    member.resize(ticks.size());
+    for (size_t t = 0; t < ticks.size(); t++) {
+        size_t i = t < outcomes ? t : rng() % outcomes;
+        member[t] = i;
+        MarketData& data = ticks[t];
+        data.market = MARKET_POLYMARKET;
+        data.market_id = market_ids[i];
+        data.event_id = event_ids[i];
+        data.group_id = group_id;
+        data.group_size = (int)outcomes;
+        data.best_ask = noise(rng) / outcomes;
+        data.best_bid = data.best_ask - 0.01 / outcomes;
+        data.ask_size = 50.0 + rng() % 500;
+        data.bid_size = data.ask_size;
+        data.is_valid = true;
+    }
+}
+
+static void run(size_t outcomes) {
+    std::vector<SymbolId> market_ids(outcomes);
+    std::vector<SymbolId> event_ids(outcomes);
+    std::string prefix = "bench-set-" + std::to_string(outcomes) + "-";
+    for (size_t i = 0; i < outcomes; i++) {
+        market_ids[i] = market_symbols().intern(prefix + std::to_string(i));
+        event_ids[i] = event_symbols().intern(prefix + std::to_string(i));
+    }
+    SymbolId group_id = event_symbols().intern(prefix + "set");
+    
+    std::vector<MarketData> ticks;
+    std::vector<size_t> member;
+    make_ticks(outcomes, ticks, member, market_ids, event_ids, group_id);
+    
+    Config config;
+    config.depth_sizing = false;
+    config.fees[MARKET_POLYMARKET].taker_rate = 0.01;
+    LegFee fee = buy_leg_fee(config.fees[MARKET_POLYMARKET]);
+    
+    // Incremental: the engine's own store and detection
+    ArbitrageEngine engine(&config);
+    std::vector<char> incremental_verdict(ticks.size());
+    std::vector<ArbitrageOpportunity> found;
+    size_t incremental_found = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < ticks.size(); t++) {
+        found.clear();
+        engine.store_market_data(&ticks[t]);
+        engine.find_opportunities(ticks[t].market_id, found);
+        incremental_verdict[t] = !found.empty();
+        incremental_found += found.size();
+    }
+    double incremental = elapsed_ns(start) / ticks.size();
+    
+    // The same ticks with no set attached: what the engine spends anyway
+    ArbitrageEngine plain(&config);
+    for (size_t t = 0; t < ticks.size(); t++) {
+        ticks[t].group_id = INVALID_SYMBOL;
+    }
+    start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < ticks.size(); t++) {
+        found.clear();
+        plain.store_market_data(&ticks[t]);
+        plain.find_opportunities(ticks[t].market_id, found);
+    }
+    double baseline = elapsed_ns(start) / ticks.size();
+    
+    // Recompute: write the tick, then read and sum every member's ask.
+    // The members sit in one event's block, as favourable a layout as the
+    // store offers.
+    QuoteStore store(outcomes);
+    std::vector<uint32_t> slots(outcomes);
+    for (size_t i = 0; i < outcomes; i++) {
+        slots[i] = store.allocate(group_id);
+    }
+    size_t disagree = 0;
+    size_t recompute_found = 0;
+    Quote quote;
+    start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < ticks.size(); t++) {
+        store.write(slots[member[t]], &ticks[t]);
+        if (t + 1 < outcomes) {
+            continue;
+        }
+        double asks = 0.0;
+        double cost = 0.0;
+        for (size_t i = 0; i < outcomes; i++) {
+            store.read(slots[i], quote);
+            asks += quote.best_ask;
+            cost += quote.best_ask + leg_fee(quote.best_ask, fee);
+        }
+        bool profitable = cost < 1.0 && (1.0 - cost) / asks > config.min_profit_threshold;
+        recompute_found += profitable;
+        disagree += profitable != (incremental_verdict[t] != 0);
+    }
+    double recompute = elapsed_ns(start) / ticks.size();
+    
+    std::cout << std::setw(10) << outcomes << std::setw(12) << baseline
+              << std::setw(14) << incremental - baseline << std::setw(12) << recompute
+              << std::setw(12) << incremental_found << std::setw(12) << recompute_found
+              << std::setw(10) << disagree << std::endl;
+}
+
+int main() {
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "ns per tick; engine = store and detect with no set, +sums = what the set adds to that, "
+              << "recompute = write and re-sum every member" << std::endl;
+    std::cout << std::setw(10) << "outcomes" << std::setw(12) << "engine" << std::setw(14) << "+sums"
+              << std::setw(12) << "recompute" << std::setw(12) << "found" << std::setw(12) << "recomputed"
+              << std::setw(10) << "disagree" << std::endl;
+    
+    size_t sizes[] = {2, 10, 30, 100, 300};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        run(sizes[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,401 @@
+// The feed -> engine -> publisher pipeline against the old inline path,
+// where each feed thread ran detection and publishing in its update
+// callback. Feeds submit paced ticks (with books) for their own events;
+// some ticks cross another venue's quote. Reported: time the feed thread
+// spends per tick, and tick-to-opportunity latency to detection and to the
+// end of publishing. Publishing serializes each message and burns a fixed
+// extra cost standing in for broadcast and logging.
+//
+// Also measures the rings on their own against a mutex-guarded deque, and
+// checks they deliver everything, per producer in order.
+//
+//   ./bench_pipeline [ticks_per_feed] [feeds] [ticks_per_sec_per_feed]
+
+#include "pipeline.h"
+#include "ring_buffer.h"
+#include "arbitrage_engine.h"
+#include "order_book.h"
+#include "orderbook_parser.h"
+#include "websocket_server.h"
+#include "json_writer.h"
+#include "symbol_table.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <deque>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <atomic>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sched.h>
+
+static const size_t EVENTS_PER_FEED = 200;
+static const int VENUES = 3;
+static const size_t BOOK_LEVELS = 5;
+static const long long QUOTE_PUBLISH_NS = 300;
+static const long long OPPORTUNITY_PUBLISH_NS = 5000;
+static const size_t RING_ITEMS = 4000000;
+
+static long long now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void burn(long long ns) {
+    long long until = now_ns() + ns;
+    while (now_ns() < until) {
+    }
+}
+
+static double percentile(std::vector<long long>& samples, double q) {
+    if (samples.empty()) {
+        return 0;
+    }
+    size_t rank = (size_t)(q * (double)(samples.size() - 1));
+    std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+    return (double)samples[rank] / 1000.0;
+}
+
+// ---- rings on their own ----
+
+struct RingItem {
+    uint32_t producer;
+    uint32_t seq;
+};
+
+class LockedQueue {
+public:
+    LockedQueue() { pthread_mutex_init(&lock, NULL); }
+    ~LockedQueue() { pthread_mutex_destroy(&lock); }
+    
+    bool push(const RingItem& item) {
+        pthread_mutex_lock(&lock);
+        items.push_back(item);
+        pthread_mutex_unlock(&lock);
+        return true;
+    }
+    
+    bool pop(RingItem& item) {
+        pthread_mutex_lock(&lock);
+        bool ok = !items.empty();
+        if (ok) {
+            item = items.front();
+            items.pop_front();
+        }
+        pthread_mutex_unlock(&lock);
+        return ok;
+    }
+    
+private:
+    pthread_mutex_t lock;
+    std::deque<RingItem> items;
+};
+
+template <typename Queue>
+struct RingRun {
+    Queue* queue;
+    uint32_t producer;
+    size_t count;
+};
+
+template <typename Queue>
+static void* ring_producer(void* arg) {
+    RingRun<Queue>* run = (RingRun<Queue>*)arg;
+    RingItem item;
+    item.producer = run->producer;
+    for (size_t i = 0; i < run->count; i++) {
+        item.seq = (uint32_t)i;
+        while (!run->queue->push(item)) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+template <typename Queue>
+static bool ring_case(const char* name, Queue& queue, int producers) {
+    size_t per = RING_ITEMS / producers;
+    std::vector<RingRun<Queue> > runs(producers);
+    std::vector<pthread_t> threads(producers);
+    
+    long long start = now_ns();
+    for (int p = 0; p < producers; p++) {
+        runs[p].queue = &queue;
+        runs[p].producer = p;
+        runs[p].count = per;
+        pthread_create(&threads[p], NULL, ring_producer<Queue>, &runs[p]);
+    }
+    
+    std::vector<uint32_t> next(producers, 0);
+    bool ok = true;
+    size_t received = 0;
+    RingItem item;
+    while (received < per * producers) {
+        if (!queue.pop(item)) {
+            sched_yield();
+            continue;
+        }
+        if (item.producer >= (uint32_t)producers || item.seq != next[item.producer]) {
+            ok = false;
+        } else {
+            next[item.producer]++;
+        }
+        received++;
+    }
+    long long elapsed = now_ns() - start;
+    for (int p = 0; p < producers; p++) {
+        pthread_join(threads[p], NULL);
+    }
+    
+    std::cout << std::left << std::setw(28) << name << std::right << std::setw(3) << producers
+              << std::setw(12) << std::setprecision(1) << (double)received * 1000.0 / elapsed
+              << "M/s" << std::setw(8) << (ok ? "ok" : "FAILED") << std::endl;
+    return ok;
+}
+
+static bool bench_rings() {
+    std::cout << std::left << std::setw(28) << "queue" << std::right << std::setw(3) << "P"
+              << std::setw(14) << "items/s" << std::setw(8) << "order" << std::endl;
+    bool ok = true;
+    {
+        SpscRing<RingItem> ring(4096);
+        ok = ring_case("SpscRing", ring, 1) && ok;
+    }
+    int producer_counts[] = {1, 2, 4};
+    for (size_t i = 0; i < 3; i++) {
+        MpscRing<RingItem> ring(4096);
+        ok = ring_case("MpscRing", ring, producer_counts[i]) && ok;
+    }
+    for (size_t i = 0; i < 3; i++) {
+        LockedQueue queue;
+        ok = ring_case("mutex + std::deque", queue, producer_counts[i]) && ok;
+    }
+    return ok;
+}
+
+// ---- end to end ----
+
+struct Feed {
+    int index;
+    size_t ticks;
+    double rate;
+    std::vector<SymbolId> events;
+    std::vector<SymbolId> markets;   // VENUES per event
+    std::vector<long long> feed_ns;  // time in the update call, per tick
+    std::vector<long long> detect_ns;
+    std::vector<long long> publish_ns;
+};
+
+static bool use_pipeline = false;
+static ArbitrageEngine* bench_engine = NULL;
+static Pipeline* bench_pipeline = NULL;
+static std::atomic<unsigned long long> quotes_published(0);
+static std::atomic<unsigned long long> opportunities_published(0);
+static std::atomic<bool> out_of_order(false);
+static std::vector<long long> last_timestamp;   // per market, publisher thread only
+
+// Inline mode: when the current tick started, and whose samples to add to
+static thread_local long long tick_start = 0;
+static thread_local Feed* current_feed = NULL;
+
+static void publish_quote(MarketData* data) {
+    static thread_local JsonWriter writer;
+    writer.clear();
+    write_market_data_json(writer, data, 1);
+    burn(QUOTE_PUBLISH_NS);
+    
+    if (use_pipeline) {
+        if (data->timestamp <= last_timestamp[data->market_id]) {
+            out_of_order = true;
+        }
+        last_timestamp[data->market_id] = data->timestamp;
+    }
+    quotes_published.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void publish_opportunity(ArbitrageOpportunity* opp) {
+    long long detected = now_ns();
+    static thread_local JsonWriter writer;
+    writer.clear();
+    write_opportunity_json(writer, opp, 1);
+    burn(OPPORTUNITY_PUBLISH_NS);
+    opportunities_published.fetch_add(1, std::memory_order_relaxed);
+    
+    if (current_feed != NULL) {
+        current_feed->detect_ns.push_back(detected - tick_start);
+        current_feed->publish_ns.push_back(now_ns() - tick_start);
+    }
+}
+
+static void* feed_thread(void* arg) {
+    Feed* feed = (Feed*)arg;
+    current_feed = use_pipeline ? NULL : feed;
+    std::mt19937_64 rng(1000 + feed->index);
+    std::vector<double> mid(feed->events.size(), 0.5);
+    OrderBook book;
+    PriceLevel bids[BOOK_LEVELS];
+    PriceLevel asks[BOOK_LEVELS];
+    
+    long long interval = (long long)(1e9 / feed->rate);
+    long long next = now_ns();
+    for (size_t i = 0; i < feed->ticks; i++) {
+        size_t e = rng() % feed->events.size();
+        int venue = (int)(rng() % VENUES);
+        mid[e] += ((double)(rng() % 3) - 1.0) * 0.001;
+        mid[e] = std::min(0.9, std::max(0.1, mid[e]));
+        
+        // Mostly a tight market around the event's mid; now and then one
+        // venue's bid jumps well past the others' asks
+        double bid = mid[e] - 0.005;
+        if (rng() % 100 < 2) {
+            bid = mid[e] + 0.08;
+        }
+        double ask = std::max(bid + 0.01, mid[e] + 0.005);
+        for (size_t l = 0; l < BOOK_LEVELS; l++) {
+            bids[l].price = bid - 0.01 * l;
+            bids[l].size = 100.0 + 50.0 * l;
+            asks[l].price = ask + 0.01 * l;
+            asks[l].size = 100.0 + 50.0 * l;
+        }
+        book.set_snapshot(bids, BOOK_LEVELS, asks, BOOK_LEVELS);
+        
+        MarketData data;
+        data.market_id = feed->markets[e * VENUES + venue];
+        data.event_id = feed->events[e];
+        data.market = venue;
+        data.best_bid = bid;
+        data.best_ask = ask;
+        data.bid_size = bids[0].size;
+        data.ask_size = asks[0].size;
+        data.timestamp = (long long)i + 1;
+        data.is_valid = true;
+        data.book = &book;
+        
+        while (now_ns() < next) {
+            sched_yield();
+        }
+        next += interval;
+        
+        tick_start = now_ns();
+        if (use_pipeline) {
+            bench_pipeline->submit(&data);
+        } else {
+            bench_engine->update_market_data(&data);
+            publish_quote(&data);
+        }
+        feed->feed_ns.push_back(now_ns() - tick_start);
+    }
+    return NULL;
+}
+
+static bool run_end_to_end(bool pipelined, size_t ticks, int feed_count, double rate) {
+    Config config;
+    ArbitrageEngine engine(&config);
+    Pipeline pipeline(&config, &engine);
+    bench_engine = &engine;
+    bench_pipeline = &pipeline;
+    use_pipeline = pipelined;
+    quotes_published = 0;
+    opportunities_published = 0;
+    out_of_order = false;
+    
+    if (pipelined) {
+        pipeline.set_quote_function(publish_quote);
+        pipeline.set_opportunity_function(publish_opportunity);
+        pipeline.start();
+    } else {
+        engine.set_opportunity_function(publish_opportunity);
+    }
+    
+    std::vector<Feed> feeds(feed_count);
+    for (int f = 0; f < feed_count; f++) {
+        feeds[f].index = f;
+        feeds[f].ticks = ticks;
+        feeds[f].rate = rate;
+        feeds[f].feed_ns.reserve(ticks);
+        for (size_t e = 0; e < EVENTS_PER_FEED; e++) {
+            std::string event = "feed " + std::to_string(f) + " event " + std::to_string(e);
+            feeds[f].events.push_back(event_symbols().intern(event));
+            for (int v = 0; v < VENUES; v++) {
+                feeds[f].markets.push_back(market_symbols().intern(event + " venue " + std::to_string(v)));
+            }
+        }
+    }
+    last_timestamp.assign(market_symbols().size() + 1, 0);
+    
+    std::vector<pthread_t> threads(feed_count);
+    for (int f = 0; f < feed_count; f++) {
+        pthread_create(&threads[f], NULL, feed_thread, &feeds[f]);
+    }
+    for (int f = 0; f < feed_count; f++) {
+        pthread_join(threads[f], NULL);
+    }
+    pipeline.stop();
+    
+    std::vector<long long> feed_ns;
+    std::vector<long long> detect_ns;
+    std::vector<long long> publish_ns;
+    for (int f = 0; f < feed_count; f++) {
+        feed_ns.insert(feed_ns.end(), feeds[f].feed_ns.begin(), feeds[f].feed_ns.end());
+        detect_ns.insert(detect_ns.end(), feeds[f].detect_ns.begin(), feeds[f].detect_ns.end());
+        publish_ns.insert(publish_ns.end(), feeds[f].publish_ns.begin(), feeds[f].publish_ns.end());
+    }
+    
+    double detect_p50, detect_p99, publish_p50, publish_p99;
+    unsigned long long found = opportunities_published.load();
+    if (pipelined) {
+        PipelineStats s = pipeline.stats();
+        detect_p50 = s.detect_p50_us;
+        detect_p99 = s.detect_p99_us;
+        publish_p50 = s.publish_p50_us;
+        publish_p99 = s.publish_p99_us;
+        std::cout << "  engine queue: " << s.engine.items << " ticks, peak " << s.engine.peak_depth
+                  << ", " << s.engine.stalls << " stalls, wait p50 " << s.engine.wait_p50_us
+                  << "us p99 " << s.engine.wait_p99_us << "us" << std::endl;
+        std::cout << "  publisher queue: " << s.publisher.items << " items, peak " << s.publisher.peak_depth
+                  << ", " << s.publisher.stalls << " stalls, wait p50 " << s.publisher.wait_p50_us
+                  << "us p99 " << s.publisher.wait_p99_us << "us" << std::endl;
+    } else {
+        detect_p50 = percentile(detect_ns, 0.50);
+        detect_p99 = percentile(detect_ns, 0.99);
+        publish_p50 = percentile(publish_ns, 0.50);
+        publish_p99 = percentile(publish_ns, 0.99);
+    }
+    
+    std::cout << std::left << std::setw(10) << (pipelined ? "pipeline" : "inline") << std::right
+              << std::setw(10) << percentile(feed_ns, 0.50) << std::setw(10) << percentile(feed_ns, 0.99)
+              << std::setw(9) << found
+              << std::setw(10) << detect_p50 << std::setw(10) << detect_p99
+              << std::setw(10) << publish_p50 << std::setw(10) << publish_p99 << std::endl;
+    
+    bool ok = quotes_published.load() == ticks * feed_count && !out_of_order;
+    if (!ok) {
+        std::cerr << "published " << quotes_published.load() << " of " << ticks * feed_count
+                  << " quotes" << (out_of_order ? ", out of order" : "") << std::endl;
+    }
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    size_t ticks = argc > 1 ? (size_t)atol(argv[1]) : 200000;
+    int feeds = argc > 2 ? atoi(argv[2]) : 2;
+    double rate = argc > 3 ? atof(argv[3]) : 100000.0;
+    
+    std::cout << std::fixed << std::setprecision(2);
+    bool ok = bench_rings();
+    
+    std::cout << std::endl << feeds << " feeds x " << ticks << " ticks at " << std::setprecision(0) << rate
+              << "/s, " << VENUES << " venues per event" << std::setprecision(2) << std::endl;
+    std::cout << "latencies in us; tick-to-opportunity from the feed handing the tick over" << std::endl;
+    std::cout << std::left << std::setw(10) << "mode" << std::right << std::setw(10) << "feed p50"
+              << std::setw(10) << "feed p99" << std::setw(9) << "opps" << std::setw(10) << "det p50"
+              << std::setw(10) << "det p99" << std::setw(10) << "pub p50" << std::setw(10) << "pub p99" << std::endl;
+    ok = run_end_to_end(false, ticks, feeds, rate) && ok;
+    ok = run_end_to_end(true, ticks, feeds, rate) && ok;
+    
+    std::cout << std::endl << "delivery: " << (ok ? "ok" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
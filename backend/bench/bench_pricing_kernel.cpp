@@ -0,0 +1,186 @@
+// Times the batch pricing kernel against the scalar loop and checks that
+// both produce bit-identical profit and size for every pair. Also timed
+// against the flat-rate loop fees used to be (one proportional rate per
+// leg, applied inside the kernel), and the engine's per-tick check with
+// venue fee curves against the constant 2% it used to charge.
+//
+//   ./bench_pricing_kernel
+
+#include "pricing_kernel.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <random>
+#include <cstring>
+
+static const int VENUES = 3;
+static const double FLAT_FEE_RATE = 0.02;
+
+struct PairFees {
+    LegFee buy;
+    LegFee sell;
+};
+
+// pair_profit when every leg paid a flat proportional rate
+static inline double flat_pair_profit(double buy_price, double sell_price, double buy_fee_rate, double sell_fee_rate) {
+    if (buy_price >= sell_price) {
+        return 0.0;
+    }
+    
+    double buy_fee = buy_price * buy_fee_rate;
+    double sell_fee = sell_price * sell_fee_rate;
+    
+    double net_profit = sell_price - buy_price - buy_fee - sell_fee;
+    
+    if (net_profit <= 0.0) {
+        return 0.0;
+    }
+    
+    return net_profit / buy_price;
+}
+
+static void evaluate_pairs_flat(const PairBatch& batch, const double* buy_fee_rate, const double* sell_fee_rate, double* profit, double* max_size) {
+    for (size_t i = 0; i < batch.count; i++) {
+        profit[i] = flat_pair_profit(batch.buy_ask[i], batch.sell_bid[i], buy_fee_rate[i], sell_fee_rate[i]);
+        max_size[i] = pair_max_size(batch.ask_size[i], batch.bid_size[i]);
+    }
+}
+
+static LegFee random_leg_fee(std::mt19937_64& rng) {
+    std::uniform_real_distribution<double> rate(0.0, 0.05);
+    LegFee fee;
+    fee.fixed = rate(rng);
+    fee.linear = rate(rng);
+    fee.quadratic = -rate(rng);
+    return fee;
+}
+
+static double elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+static bool run(size_t count) {
+    std::mt19937_64 rng(7);
+    std::uniform_real_distribution<double> price(0.01, 0.99);
+    std::uniform_real_distribution<double> size(0.0, 5000.0);
+    std::uniform_real_distribution<double> fee(0.0, 0.05);
+    
+    std::vector<double> buy_ask(count), sell_bid(count), ask_size(count), bid_size(count);
+    std::vector<double> buy_fee(count), sell_fee(count);
+    std::vector<double> buy_fee_rate(count), sell_fee_rate(count);
+    for (size_t i = 0; i < count; i++) {
+        buy_ask[i] = price(rng);
+        sell_bid[i] = price(rng);
+        ask_size[i] = size(rng);
+        bid_size[i] = size(rng);
+        buy_fee_rate[i] = fee(rng);
+        sell_fee_rate[i] = fee(rng);
+        buy_fee[i] = buy_ask[i] * buy_fee_rate[i];
+        sell_fee[i] = sell_bid[i] * sell_fee_rate[i];
+    }
+    PairFees table[VENUES][VENUES];
+    for (int b = 0; b < VENUES; b++) {
+        for (int s = 0; s < VENUES; s++) {
+            table[b][s].buy = random_leg_fee(rng);
+            table[b][s].sell = random_leg_fee(rng);
+        }
+    }
+    // Edge cases the masks have to agree on
+    if (count >= 8) {
+        buy_ask[0] = sell_bid[0];
+        buy_ask[1] = 0.0;
+        ask_size[2] = bid_size[2];
+        buy_ask[3] = -0.0;
+    }
+    
+    PairBatch batch;
+    batch.buy_ask = &buy_ask[0];
+    batch.sell_bid = &sell_bid[0];
+    batch.ask_size = &ask_size[0];
+    batch.bid_size = &bid_size[0];
+    batch.buy_fee = &buy_fee[0];
+    batch.sell_fee = &sell_fee[0];
+    batch.count = count;
+    
+    std::vector<double> profit_scalar(count), size_scalar(count);
+    std::vector<double> profit_batch(count), size_batch(count);
+    
+    size_t rounds = std::max<size_t>(1, 20000000 / count);
+    
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; r++) {
+        evaluate_pairs_flat(batch, &buy_fee_rate[0], &sell_fee_rate[0], &profit_scalar[0], &size_scalar[0]);
+    }
+    double flat_ns = elapsed_ns(start) / (rounds * count);
+    
+    start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; r++) {
+        evaluate_pairs_scalar(batch, &profit_scalar[0], &size_scalar[0]);
+    }
+    double scalar_ns = elapsed_ns(start) / (rounds * count);
+    
+    start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; r++) {
+        evaluate_pairs(batch, &profit_batch[0], &size_batch[0]);
+    }
+    double batch_ns = elapsed_ns(start) / (rounds * count);
+    
+    // The engine's per-tick check, one pair at a time: fee curves looked up
+    // by venue pair against the constant rate it used to apply. Venues come
+    // with the quotes there, so here they cost no memory traffic either.
+    double sink = 0.0;
+    start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < count; i++) {
+            sink += flat_pair_profit(buy_ask[i], sell_bid[i], FLAT_FEE_RATE, FLAT_FEE_RATE);
+        }
+    }
+    double tick_flat_ns = elapsed_ns(start) / (rounds * count);
+    
+    start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < count; i++) {
+            const PairFees& pair = table[i % VENUES][(i + 1 + (i / VENUES) % 2) % VENUES];
+            sink += pair_profit(buy_ask[i], sell_bid[i], leg_fee(buy_ask[i], pair.buy), leg_fee(sell_bid[i], pair.sell));
+        }
+    }
+    double tick_table_ns = elapsed_ns(start) / (rounds * count);
+    
+    // The reference is the per-pair helper the engine calls on every tick
+    size_t mismatches = 0;
+    for (size_t i = 0; i < count; i++) {
+        double profit = pair_profit(buy_ask[i], sell_bid[i], buy_fee[i], sell_fee[i]);
+        double max_size = pair_max_size(ask_size[i], bid_size[i]);
+        if (memcmp(&profit, &profit_batch[i], sizeof(double)) != 0 ||
+            memcmp(&profit, &profit_scalar[i], sizeof(double)) != 0 ||
+            memcmp(&max_size, &size_batch[i], sizeof(double)) != 0 ||
+            memcmp(&max_size, &size_scalar[i], sizeof(double)) != 0) {
+            mismatches++;
+        }
+    }
+    
+    std::cout << std::setw(10) << count
+              << std::setw(12) << flat_ns << std::setw(12) << scalar_ns << std::setw(12) << batch_ns
+              << std::setw(12) << (scalar_ns / batch_ns) << "x"
+              << std::setw(12) << tick_flat_ns << std::setw(12) << tick_table_ns
+              << std::setw(12) << mismatches << (sink == 42.0 ? " " : "") << std::endl;
+    return mismatches == 0;
+}
+
+int main() {
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "kernel: " << pricing_kernel_name() << ", ns per pair" << std::endl;
+    std::cout << std::setw(10) << "pairs" << std::setw(12) << "flat fee" << std::setw(12) << "scalar"
+              << std::setw(12) << "batch" << std::setw(13) << "speedup"
+              << std::setw(12) << "tick flat" << std::setw(12) << "tick curve"
+              << std::setw(12) << "mismatches" << std::endl;
+    
+    bool ok = true;
+    size_t sizes[] = {1003, 10000, 100000, 1000000};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        ok = run(sizes[i]) && ok;
+    }
+    return ok ? 0 : 1;
+}
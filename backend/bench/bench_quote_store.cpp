@@ -0,0 +1,189 @@
+// Compares the flat QuoteStore against the std::map<std::string, MarketData>
+// layout it replaced, for random quote updates and per-event walks.
+//
+//   ./bench_quote_store
+
+#include "quote_store.h"
+#include "symbol_table.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <random>
+
+// Layout of MarketData before IDs were interned
+struct LegacyMarketData {
+    std::string market_id;
+    int market;
+    std::string event_name;
+    double best_bid;
+    double best_ask;
+    double bid_size;
+    double ask_size;
+    bool is_valid;
+};
+
+static const size_t MARKETS_PER_EVENT = 3;
+static const size_t UPDATES = 2000000;
+
+static double elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+static std::string token_id(std::mt19937_64& rng) {
+    // Polymarket token IDs are ~78 decimal digits
+    std::string id;
+    while (id.size() < 78) {
+        id += std::to_string(rng());
+    }
+    id.resize(78);
+    return id;
+}
+
+static void run(size_t count) {
+    std::mt19937_64 rng(42);
+    SymbolTable markets;
+    SymbolTable events;
+    
+    std::vector<std::string> tokens(count);
+    std::vector<std::string> questions(count);
+    std::vector<SymbolId> market_ids(count);
+    std::vector<SymbolId> event_ids(count);
+    for (size_t i = 0; i < count; i++) {
+        tokens[i] = token_id(rng);
+        questions[i] = "Will event " + std::to_string(i / MARKETS_PER_EVENT) + " resolve YES?";
+        market_ids[i] = markets.intern(tokens[i]);
+        event_ids[i] = events.intern(questions[i]);
+    }
+    
+    // Legacy: insertion order shuffled so nodes scatter like they do live
+    std::map<std::string, LegacyMarketData> legacy;
+    std::map<std::string, std::vector<LegacyMarketData*> > legacy_events;
+    std::vector<size_t> order(count);
+    for (size_t i = 0; i < count; i++) {
+        order[i] = i;
+    }
+    std::shuffle(order.begin(), order.end(), rng);
+    for (size_t n = 0; n < count; n++) {
+        size_t i = order[n];
+        LegacyMarketData md;
+        md.market_id = tokens[i];
+        md.market = (int)(i % MARKETS_PER_EVENT);
+        md.event_name = questions[i];
+        md.best_bid = 0.45;
+        md.best_ask = 0.47;
+        md.bid_size = 100.0;
+        md.ask_size = 100.0;
+        md.is_valid = true;
+        LegacyMarketData* stored = &(legacy[md.market_id] = md);
+        legacy_events[md.event_name].push_back(stored);
+    }
+    
+    QuoteStore store(count + count / 2);
+    std::vector<uint32_t> slots(count);
+    std::vector<std::vector<uint32_t> > event_slots(events.size());
+    for (size_t n = 0; n < count; n++) {
+        size_t i = order[n];
+        MarketData md;
+        md.market_id = market_ids[i];
+        md.market = (int)(i % MARKETS_PER_EVENT);
+        md.event_id = event_ids[i];
+        md.best_bid = 0.45;
+        md.best_ask = 0.47;
+        md.bid_size = 100.0;
+        md.ask_size = 100.0;
+        md.is_valid = true;
+        slots[i] = store.allocate(md.event_id);
+        store.write(slots[i], &md);
+        event_slots[md.event_id].push_back(slots[i]);
+    }
+    for (size_t e = 0; e < event_slots.size(); e++) {
+        std::sort(event_slots[e].begin(), event_slots[e].end());
+    }
+    
+    std::vector<size_t> picks(UPDATES);
+    for (size_t u = 0; u < UPDATES; u++) {
+        picks[u] = rng() % count;
+    }
+    
+    // Random updates: string key lookup + copy vs ID -> slot + seqlock write
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t u = 0; u < UPDATES; u++) {
+        LegacyMarketData& md = legacy[tokens[picks[u]]];
+        md.best_bid = 0.40 + (u & 7) * 0.01;
+        md.best_ask = md.best_bid + 0.02;
+    }
+    double legacy_update = elapsed_ns(start) / UPDATES;
+    
+    MarketData update;
+    update.is_valid = true;
+    start = std::chrono::steady_clock::now();
+    for (size_t u = 0; u < UPDATES; u++) {
+        size_t i = picks[u];
+        update.market_id = market_ids[i];
+        update.market = (int)(i % MARKETS_PER_EVENT);
+        update.event_id = event_ids[i];
+        update.best_bid = 0.40 + (u & 7) * 0.01;
+        update.best_ask = update.best_bid + 0.02;
+        store.write(slots[i], &update);
+    }
+    double store_update = elapsed_ns(start) / UPDATES;
+    
+    // Full sweep: every event, best cross-venue spread among its markets
+    double sink = 0.0;
+    size_t rounds = std::max<size_t>(1, 2000000 / count);
+    start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; r++) {
+        for (std::map<std::string, std::vector<LegacyMarketData*> >::iterator it = legacy_events.begin();
+             it != legacy_events.end(); ++it) {
+            const std::vector<LegacyMarketData*>& group = it->second;
+            for (size_t a = 0; a < group.size(); a++) {
+                for (size_t b = 0; b < group.size(); b++) {
+                    sink += group[b]->best_bid - group[a]->best_ask;
+                }
+            }
+        }
+    }
+    double legacy_sweep = elapsed_ns(start) / (rounds * count);
+    
+    start = std::chrono::steady_clock::now();
+    Quote quotes[16];
+    for (size_t r = 0; r < rounds; r++) {
+        for (size_t e = 0; e < event_slots.size(); e++) {
+            const std::vector<uint32_t>& group = event_slots[e];
+            size_t k = std::min<size_t>(group.size(), 16);
+            for (size_t a = 0; a < k; a++) {
+                store.read(group[a], quotes[a]);
+            }
+            for (size_t a = 0; a < k; a++) {
+                for (size_t b = 0; b < k; b++) {
+                    sink += quotes[b].best_bid - quotes[a].best_ask;
+                }
+            }
+        }
+    }
+    double store_sweep = elapsed_ns(start) / (rounds * count);
+    
+    std::cout << std::setw(8) << count
+              << std::setw(16) << legacy_update << std::setw(16) << store_update
+              << std::setw(16) << legacy_sweep << std::setw(16) << store_sweep
+              << (sink == 42.0 ? " " : "") << std::endl;
+}
+
+int main() {
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "ns per market (" << MARKETS_PER_EVENT << " markets per event)" << std::endl;
+    std::cout << std::setw(8) << "markets"
+              << std::setw(16) << "map update" << std::setw(16) << "store update"
+              << std::setw(16) << "map sweep" << std::setw(16) << "store sweep" << std::endl;
+    
+    size_t sizes[] = {1000, 10000, 100000};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        run(sizes[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,457 @@
+// Fuzzes and times WebSocketDecoder.
+//
+// Fuzzing: random message streams (every length encoding, fragmented
+// messages with control frames between the pieces) are fed in random chunk
+// sizes and must decode to exactly what was sent; malformed frames must fail
+// with the right close code; randomly corrupted streams must never crash or
+// yield a message over the limit; and websocket_apply_mask must match the
+// byte loop at every length and alignment.
+//
+// Timing: unmasking throughput against the byte loop, and client messages
+// per second against the server's previous frame loop.
+//
+//   ./bench_ws_decoder [fuzz_rounds]
+
+#include "websocket_decoder.h"
+#include "websocket_protocol.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstring>
+#include <stdlib.h>
+
+static const size_t MAX_MESSAGE = 1 << 20;
+
+static long long now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void mask_bytes(char* data, size_t length, const unsigned char* mask) {
+    for (size_t i = 0; i < length; i++) {
+        data[i] ^= mask[i & 3];
+    }
+}
+
+// A client frame: masked with a random key
+static void encode_frame(std::string& out, bool fin, int opcode, int reserved, const std::string& payload,
+                         std::mt19937_64& rng) {
+    out += (char)((fin ? 0x80 : 0) | reserved | opcode);
+    size_t n = payload.size();
+    if (n < 126) {
+        out += (char)(0x80 | n);
+    } else if (n < 65536) {
+        out += (char)(0x80 | 126);
+        out += (char)(n >> 8);
+        out += (char)(n & 0xFF);
+    } else {
+        out += (char)(0x80 | 127);
+        for (int i = 7; i >= 0; i--) {
+            out += (char)(((uint64_t)n >> (8 * i)) & 0xFF);
+        }
+    }
+    unsigned char mask[4];
+    for (int i = 0; i < 4; i++) {
+        mask[i] = (unsigned char)rng();
+    }
+    out.append((const char*)mask, 4);
+    size_t offset = out.size();
+    out += payload;
+    mask_bytes(&out[offset], n, mask);
+}
+
+static std::string random_payload(std::mt19937_64& rng) {
+    // Mostly small, with every header length encoding and its boundaries
+    static const size_t edges[] = {0, 1, 125, 126, 127, 65535, 65536, 65537};
+    size_t length;
+    int pick = rng() % 10;
+    if (pick < 2) {
+        length = edges[rng() % 8];
+    } else if (pick < 8) {
+        length = rng() % 400;
+    } else {
+        length = rng() % 200000;
+    }
+    std::string payload(length, '\0');
+    for (size_t i = 0; i < length; i++) {
+        payload[i] = (char)rng();
+    }
+    return payload;
+}
+
+struct Expected {
+    int opcode;
+    std::string payload;
+};
+
+static void build_stream(std::mt19937_64& rng, int messages, std::string& stream, std::vector<Expected>& expected) {
+    for (int m = 0; m < messages; m++) {
+        Expected message;
+        message.opcode = rng() % 2 ? WS_TEXT : WS_BINARY;
+        message.payload = random_payload(rng);
+        
+        // Split into up to five pieces, some empty, with pings and pongs
+        // between them, which come out first
+        size_t pieces = 1 + rng() % 5;
+        size_t start = 0;
+        for (size_t p = 0; p < pieces; p++) {
+            size_t end = p + 1 == pieces ? message.payload.size()
+                                         : start + rng() % (message.payload.size() - start + 1);
+            encode_frame(stream, p + 1 == pieces, p == 0 ? message.opcode : WS_CONTINUATION, 0,
+                         message.payload.substr(start, end - start), rng);
+            start = end;
+            if (p + 1 < pieces && rng() % 4 == 0) {
+                Expected control;
+                control.opcode = rng() % 2 ? WS_PING : WS_PONG;
+                control.payload = std::string(rng() % 126, 'p');
+                encode_frame(stream, true, control.opcode, 0, control.payload, rng);
+                expected.push_back(control);
+            }
+        }
+        expected.push_back(message);
+    }
+}
+
+// Feeds the stream in random chunks, from single bytes up to 64K
+static bool decode_stream(std::mt19937_64& rng, const std::string& stream, std::vector<Expected>& decoded) {
+    WebSocketDecoder decoder(true, MAX_MESSAGE);
+    WebSocketMessage message;
+    size_t pos = 0;
+    while (pos < stream.size()) {
+        size_t chunk = rng() % 3 == 0 ? 1 + rng() % 3 : 1 + rng() % 65536;
+        chunk = std::min(chunk, stream.size() - pos);
+        decoder.feed(stream.data() + pos, chunk);
+        pos += chunk;
+        
+        int result;
+        while ((result = decoder.next(message)) == DECODE_MESSAGE) {
+            Expected out;
+            out.opcode = message.opcode;
+            out.payload = message.payload;
+            decoded.push_back(out);
+        }
+        if (result == DECODE_ERROR) {
+            std::cerr << "valid stream rejected with " << decoder.error_code() << std::endl;
+            return false;
+        }
+    }
+    return decoder.buffered() == 0;
+}
+
+static bool fuzz_valid(std::mt19937_64& rng, int rounds) {
+    for (int r = 0; r < rounds; r++) {
+        std::string stream;
+        std::vector<Expected> expected;
+        std::vector<Expected> decoded;
+        build_stream(rng, 1 + rng() % 20, stream, expected);
+        if (!decode_stream(rng, stream, decoded) || decoded.size() != expected.size()) {
+            std::cerr << "round " << r << ": " << decoded.size() << " of " << expected.size() << " messages" << std::endl;
+            return false;
+        }
+        for (size_t i = 0; i < expected.size(); i++) {
+            if (decoded[i].opcode != expected[i].opcode || decoded[i].payload != expected[i].payload) {
+                std::cerr << "round " << r << ": message " << i << " differs" << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+struct Violation {
+    const char* name;
+    std::string bytes;
+    int code;
+    bool compression;
+};
+
+static bool check_violations(std::mt19937_64& rng) {
+    std::vector<Violation> cases;
+    Violation v;
+    v.compression = false;
+    
+    v.name = "unmasked client frame";
+    v.bytes = std::string("\x81\x02hi", 4);
+    v.code = WS_CLOSE_PROTOCOL_ERROR;
+    cases.push_back(v);
+    
+    v.name = "RSV1 without compression";
+    v.bytes.clear();
+    encode_frame(v.bytes, true, WS_TEXT, WS_RSV1, "x", rng);
+    cases.push_back(v);
+    
+    v.name = "RSV1 on a continuation";
+    v.bytes.clear();
+    v.compression = true;
+    encode_frame(v.bytes, false, WS_TEXT, WS_RSV1, "x", rng);
+    encode_frame(v.bytes, true, WS_CONTINUATION, WS_RSV1, "y", rng);
+    cases.push_back(v);
+    v.compression = false;
+    
+    v.name = "RSV2";
+    v.bytes.clear();
+    encode_frame(v.bytes, true, WS_TEXT, 0x20, "x", rng);
+    cases.push_back(v);
+    
+    v.name = "control frame over 125 bytes";
+    v.bytes.clear();
+    encode_frame(v.bytes, true, WS_PING, 0, std::string(126, 'x'), rng);
+    cases.push_back(v);
+    
+    v.name = "fragmented ping";
+    v.bytes.clear();
+    encode_frame(v.bytes, false, WS_PING, 0, "x", rng);
+    cases.push_back(v);
+    
+    v.name = "continuation with nothing to continue";
+    v.bytes.clear();
+    encode_frame(v.bytes, true, WS_CONTINUATION, 0, "x", rng);
+    cases.push_back(v);
+    
+    v.name = "text inside a fragmented message";
+    v.bytes.clear();
+    encode_frame(v.bytes, false, WS_TEXT, 0, "x", rng);
+    encode_frame(v.bytes, true, WS_TEXT, 0, "y", rng);
+    cases.push_back(v);
+    
+    v.name = "reserved opcode";
+    v.bytes.clear();
+    encode_frame(v.bytes, true, 0x3, 0, "x", rng);
+    cases.push_back(v);
+    
+    v.name = "64-bit length with the top bit set";
+    v.bytes = std::string("\x82\xff\x80\x00\x00\x00\x00\x00\x00\x01", 10);
+    cases.push_back(v);
+    
+    // Only the header is fed: the limit must trip without the payload
+    v.name = "message over the limit";
+    v.bytes = std::string("\x82\xff\x00\x00\x00\x00\x00\x10\x00\x01", 10);
+    v.code = WS_CLOSE_TOO_BIG;
+    cases.push_back(v);
+    
+    v.name = "fragments adding up to over the limit";
+    v.bytes.clear();
+    encode_frame(v.bytes, false, WS_BINARY, 0, std::string(MAX_MESSAGE / 2 + 1, 'a'), rng);
+    encode_frame(v.bytes, true, WS_CONTINUATION, 0, std::string(MAX_MESSAGE / 2, 'b'), rng);
+    cases.push_back(v);
+    
+    bool ok = true;
+    for (size_t i = 0; i < cases.size(); i++) {
+        WebSocketDecoder decoder(true, MAX_MESSAGE);
+        decoder.allow_compression(cases[i].compression);
+        decoder.feed(cases[i].bytes.data(), cases[i].bytes.size());
+        WebSocketMessage message;
+        int result;
+        while ((result = decoder.next(message)) == DECODE_MESSAGE) {
+        }
+        if (result != DECODE_ERROR || decoder.error_code() != cases[i].code) {
+            std::cerr << cases[i].name << ": expected close " << cases[i].code << ", got "
+                      << (result == DECODE_ERROR ? decoder.error_code() : 0) << std::endl;
+            ok = false;
+        }
+    }
+    
+    // And from the other side: a server frame must not be masked
+    WebSocketDecoder client(false, MAX_MESSAGE);
+    std::string masked;
+    encode_frame(masked, true, WS_TEXT, 0, "x", rng);
+    client.feed(masked.data(), masked.size());
+    WebSocketMessage message;
+    if (client.next(message) != DECODE_ERROR || client.error_code() != WS_CLOSE_PROTOCOL_ERROR) {
+        std::cerr << "masked server frame accepted" << std::endl;
+        ok = false;
+    }
+    return ok;
+}
+
+// Corrupted streams: any outcome but a crash or an oversized message is fine
+static bool fuzz_corrupt(std::mt19937_64& rng, int rounds) {
+    for (int r = 0; r < rounds; r++) {
+        std::string stream;
+        std::vector<Expected> expected;
+        build_stream(rng, 1 + rng() % 5, stream, expected);
+        int flips = 1 + rng() % 8;
+        for (int f = 0; f < flips; f++) {
+            stream[rng() % stream.size()] ^= (char)(1 << (rng() % 8));
+        }
+        
+        WebSocketDecoder decoder(true, MAX_MESSAGE);
+        decoder.allow_compression(rng() % 2 == 0);
+        WebSocketMessage message;
+        size_t pos = 0;
+        int result = DECODE_MORE;
+        while (pos < stream.size() && result != DECODE_ERROR) {
+            size_t chunk = std::min((size_t)(1 + rng() % 4096), stream.size() - pos);
+            decoder.feed(stream.data() + pos, chunk);
+            pos += chunk;
+            while ((result = decoder.next(message)) == DECODE_MESSAGE) {
+                if (message.payload.size() > MAX_MESSAGE) {
+                    std::cerr << "oversized message from corrupt input" << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+static bool check_mask(std::mt19937_64& rng) {
+    std::vector<char> a(600);
+    std::vector<char> b(600);
+    for (size_t align = 0; align < 16; align++) {
+        for (size_t length = 0; length + align <= 580; length++) {
+            unsigned char mask[4];
+            for (int i = 0; i < 4; i++) {
+                mask[i] = (unsigned char)rng();
+            }
+            for (size_t i = 0; i < a.size(); i++) {
+                a[i] = b[i] = (char)rng();
+            }
+            mask_bytes(&a[align], length, mask);
+            websocket_apply_mask(&b[align], length, mask);
+            if (a != b) {
+                std::cerr << "mask mismatch at length " << length << ", offset " << align << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// The server's frame loop before the decoder, kept as the baseline: one
+// substr and a byte-at-a-time unmask per frame, consumed input erased after
+// each read. Returns the messages found.
+static size_t legacy_frames(std::string& in, size_t& sink) {
+    size_t pos = 0;
+    size_t found = 0;
+    while (true) {
+        const unsigned char* p = (const unsigned char*)in.data() + pos;
+        size_t avail = in.size() - pos;
+        if (avail < 2) {
+            break;
+        }
+        uint64_t length = p[1] & 0x7F;
+        size_t header = 2;
+        if (length == 126) {
+            if (avail < 4) {
+                break;
+            }
+            length = ((uint64_t)p[2] << 8) | p[3];
+            header = 4;
+        } else if (length == 127) {
+            if (avail < 10) {
+                break;
+            }
+            length = 0;
+            for (int i = 0; i < 8; i++) {
+                length = (length << 8) | p[2 + i];
+            }
+            header = 10;
+        }
+        header += 4;
+        if (avail < header + length) {
+            break;
+        }
+        const unsigned char* mask = p + header - 4;
+        std::string payload((const char*)p + header, (size_t)length);
+        for (size_t i = 0; i < payload.size(); i++) {
+            payload[i] ^= mask[i & 3];
+        }
+        pos += header + (size_t)length;
+        sink += payload.size();
+        found++;
+    }
+    in.erase(0, pos);
+    return found;
+}
+
+static void bench_mask() {
+    size_t sizes[] = {32, 256, 4096, 65536};
+    std::vector<char> data(65536, 'x');
+    unsigned char mask[4] = {0x12, 0x34, 0x56, 0x78};
+    for (size_t s = 0; s < 4; s++) {
+        size_t size = sizes[s];
+        size_t reps = (256 << 20) / size;
+        long long start = now_ns();
+        for (size_t r = 0; r < reps; r++) {
+            mask_bytes(&data[0], size, mask);
+        }
+        double bytes_seconds = (now_ns() - start) / 1e9;
+        start = now_ns();
+        for (size_t r = 0; r < reps; r++) {
+            websocket_apply_mask(&data[0], size, mask);
+        }
+        double words_seconds = (now_ns() - start) / 1e9;
+        double gb = (double)size * reps / 1e9;
+        std::cout << "unmask " << std::setw(5) << size << " B: byte loop " << std::setw(6) << gb / bytes_seconds
+                  << " GB/s, apply_mask " << std::setw(6) << gb / words_seconds << " GB/s" << std::endl;
+    }
+}
+
+static void bench_decode(std::mt19937_64& rng, const char* label, size_t payload_size, int fragments, int count) {
+    std::string stream;
+    for (int i = 0; i < count; i++) {
+        std::string payload(payload_size, 'a' + i % 26);
+        size_t piece = payload_size / fragments;
+        for (int f = 0; f < fragments; f++) {
+            size_t start = f * piece;
+            size_t end = f + 1 == fragments ? payload_size : start + piece;
+            encode_frame(stream, f + 1 == fragments, f == 0 ? WS_TEXT : WS_CONTINUATION, 0,
+                         payload.substr(start, end - start), rng);
+        }
+    }
+    const size_t chunk = 16384;  // what one recv() hands over
+    size_t sink = 0;
+    
+    // The old loop can't reassemble, so it is timed on frames
+    std::string in;
+    size_t frames = 0;
+    long long start = now_ns();
+    for (size_t pos = 0; pos < stream.size(); pos += chunk) {
+        in.append(stream, pos, chunk);
+        frames += legacy_frames(in, sink);
+    }
+    double legacy_seconds = (now_ns() - start) / 1e9;
+    
+    WebSocketDecoder decoder(true, MAX_MESSAGE);
+    WebSocketMessage message;
+    size_t messages = 0;
+    start = now_ns();
+    for (size_t pos = 0; pos < stream.size(); pos += chunk) {
+        decoder.feed(stream.data() + pos, std::min(chunk, stream.size() - pos));
+        while (decoder.next(message) == DECODE_MESSAGE) {
+            sink += message.payload.size();
+            messages++;
+        }
+    }
+    double decoder_seconds = (now_ns() - start) / 1e9;
+    
+    std::cout << label << ": previous loop " << std::setw(7) << frames / legacy_seconds / 1e6 << " M frames/s, decoder "
+              << std::setw(7) << messages / decoder_seconds / 1e6 << " M msg/s, "
+              << stream.size() / decoder_seconds / 1e9 << " GB/s (" << sink % 10 << ")" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 2000;
+    std::mt19937_64 rng(19);
+    
+    bool ok = check_mask(rng);
+    std::cout << "apply_mask against the byte loop: " << (ok ? "ok" : "FAILED") << std::endl;
+    bool valid = fuzz_valid(rng, rounds);
+    std::cout << "random streams, random chunking (" << rounds << " rounds): " << (valid ? "ok" : "FAILED") << std::endl;
+    bool violations = check_violations(rng);
+    std::cout << "protocol violations: " << (violations ? "ok" : "FAILED") << std::endl;
+    bool corrupt = fuzz_corrupt(rng, rounds * 5);
+    std::cout << "corrupted streams (" << rounds * 5 << " rounds): " << (corrupt ? "ok" : "FAILED") << std::endl;
+    ok = ok && valid && violations && corrupt;
+    
+    std::cout << std::fixed << std::setprecision(2);
+    bench_mask();
+    bench_decode(rng, "120 B messages      ", 120, 1, 1000000);
+    bench_decode(rng, "4 KB messages       ", 4096, 1, 100000);
+    bench_decode(rng, "64 KB in 4 fragments", 65536, 4, 4000);
+    return ok ? 0 : 1;
+}
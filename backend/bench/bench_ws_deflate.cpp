@@ -0,0 +1,196 @@
+// Bytes on the wire and compression CPU per market_data message under
+// permessage-deflate: uncompressed, standalone messages (no context
+// takeover; one compression serves every client) and a running context
+// (takeover; one compression per shared-context group), at several zlib
+// levels. Every compressed message is inflated again and compared, the
+// takeover stream through one long-lived inflater as a client would.
+//
+//   ./bench_ws_deflate [messages]
+
+#include "permessage_deflate.h"
+#include "websocket_server.h"
+#include "websocket_protocol.h"
+#include "symbol_table.h"
+#include "json_writer.h"
+#include <zlib.h>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstring>
+#include <stdlib.h>
+
+static long long now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static size_t frame_bytes(size_t payload) {
+    unsigned char header[WS_MAX_HEADER];
+    return websocket_frame_header(header, WS_TEXT, payload) + payload;
+}
+
+// A client's inflater under context takeover: one stream for the whole
+// connection, fed each message plus the stripped flush trailer
+class StreamInflater {
+public:
+    StreamInflater() {
+        memset(&zs, 0, sizeof(zs));
+        inflateInit2(&zs, -15);
+    }
+    
+    ~StreamInflater() {
+        inflateEnd(&zs);
+    }
+    
+    bool inflate_message(const std::string& in, std::string& out) {
+        std::string input = in;
+        input.append("\x00\x00\xff\xff", 4);
+        out.clear();
+        zs.next_in = (Bytef*)&input[0];
+        zs.avail_in = (uInt)input.size();
+        char buffer[4096];
+        while (zs.avail_in > 0) {
+            zs.next_out = (Bytef*)buffer;
+            zs.avail_out = sizeof(buffer);
+            int rc = inflate(&zs, Z_SYNC_FLUSH);
+            if (rc != Z_OK && rc != Z_BUF_ERROR) {
+                return false;
+            }
+            out.append(buffer, sizeof(buffer) - zs.avail_out);
+            if (rc == Z_BUF_ERROR) {
+                break;
+            }
+        }
+        return true;
+    }
+    
+private:
+    z_stream zs;
+};
+
+struct Result {
+    double bytes;       // framed, per message
+    double ns;          // compression time per message
+    bool ok;
+};
+
+static Result run(const std::vector<std::string>& messages, int level, bool takeover) {
+    MessageDeflater deflater(level, !takeover);
+    std::vector<std::string> compressed(messages.size());
+    
+    // Into one reused buffer, as the server does; keeping the output for the
+    // check is timed too but costs little next to deflate itself
+    std::string scratch;
+    long long start = now_ns();
+    for (size_t i = 0; i < messages.size(); i++) {
+        scratch.clear();
+        deflater.compress(messages[i].data(), messages[i].size(), scratch, !takeover || i == 0);
+        compressed[i] = scratch;
+    }
+    long long elapsed = now_ns() - start;
+    
+    Result result;
+    result.ok = true;
+    result.bytes = 0;
+    MessageInflater standalone;
+    StreamInflater stream;
+    std::string out;
+    for (size_t i = 0; i < messages.size(); i++) {
+        result.bytes += frame_bytes(compressed[i].size());
+        bool ok = takeover ? stream.inflate_message(compressed[i], out)
+                           : standalone.decompress(compressed[i].data(), compressed[i].size(), out, 1 << 20);
+        if (!ok || out != messages[i]) {
+            std::cerr << "message " << i << " did not round-trip" << std::endl;
+            result.ok = false;
+            break;
+        }
+    }
+    result.bytes /= messages.size();
+    result.ns = (double)elapsed / messages.size();
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    int count = argc > 1 ? atoi(argv[1]) : 200000;
+    std::mt19937_64 rng(7);
+    
+    // Polymarket-style payloads: 77-digit token IDs, two outcomes per event,
+    // long event names, tick prices and round-ish sizes
+    const char* names[] = {
+        "Will the Federal Reserve cut interest rates at the December 2026 FOMC meeting?",
+        "Will Bitcoin close above $150,000 on December 31, 2026?",
+        "Who will win the 2026 NBA Finals?",
+        "Will the S&P 500 finish 2026 higher than it started?",
+        "Will there be a government shutdown before October 1?",
+        "Which party will control the House after the 2026 midterm elections?",
+        "Will OpenAI release a new flagship model before the end of Q3?",
+        "Will the average US gas price exceed $4.00 per gallon in July?"
+    };
+    const size_t name_count = sizeof(names) / sizeof(names[0]);
+    
+    std::vector<MarketData> markets;
+    for (size_t e = 0; e < 200; e++) {
+        std::string event = std::string(names[e % name_count]) + (e < name_count ? "" : " #" + std::to_string(e));
+        for (int outcome = 0; outcome < 2; outcome++) {
+            std::string token;
+            for (int d = 0; d < 77; d++) {
+                token += (char)('0' + (d == 0 ? 1 + rng() % 9 : rng() % 10));
+            }
+            MarketData data;
+            data.market_id = market_symbols().intern(token);
+            data.event_id = event_symbols().intern(event);
+            data.market = MARKET_POLYMARKET;
+            markets.push_back(data);
+        }
+    }
+    
+    std::vector<std::string> messages(count);
+    size_t plain_bytes = 0;
+    size_t payload_bytes = 0;
+    JsonWriter out;
+    for (int i = 0; i < count; i++) {
+        MarketData data = markets[rng() % markets.size()];
+        data.best_bid = (double)(1 + rng() % 980) / 1000.0;
+        data.best_ask = data.best_bid + (double)(1 + rng() % 3) / 100.0;
+        data.bid_size = (double)(rng() % 50000) / 10.0;
+        data.ask_size = (double)(rng() % 50000) / 10.0;
+        out.clear();
+        write_market_data_json(out, &data, i + 1);
+        messages[i] = out.str();
+        payload_bytes += messages[i].size();
+        plain_bytes += frame_bytes(messages[i].size());
+    }
+    
+    double plain = (double)plain_bytes / count;
+    std::cout << count << " market_data messages, " << std::fixed << std::setprecision(1)
+              << (double)payload_bytes / count << " byte payload on average" << std::endl;
+    std::cout << "sample: " << messages[0] << std::endl << std::endl;
+    
+    // Per client, with the one compression shared by 100 clients; a server
+    // compressing separately for each client pays the full ns/msg each
+    std::cout << std::left << std::setw(22) << "mode" << std::right << std::setw(6) << "level"
+              << std::setw(12) << "bytes/msg" << std::setw(9) << "ratio" << std::setw(10) << "ns/msg"
+              << std::setw(22) << "ns/client @100" << std::endl;
+    std::cout << std::left << std::setw(22) << "uncompressed" << std::right << std::setw(6) << "-"
+              << std::setw(12) << plain << std::setw(9) << "1.00" << std::setw(10) << "-"
+              << std::setw(22) << "-" << std::endl;
+    
+    bool ok = true;
+    int levels[] = {1, 3, 6, 9};
+    for (int mode = 0; mode < 2; mode++) {
+        for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+            Result r = run(messages, levels[l], mode == 1);
+            ok = ok && r.ok;
+            std::cout << std::left << std::setw(22) << (mode == 0 ? "standalone" : "context takeover")
+                      << std::right << std::setw(6) << levels[l] << std::setw(12) << r.bytes
+                      << std::setw(9) << std::setprecision(2) << (r.bytes / plain) << std::setprecision(1) << std::setw(10) << r.ns
+                      << std::setw(22) << (r.ns / 100.0) << std::endl;
+        }
+    }
+    
+    std::cout << std::endl << "round-trip: " << (ok ? "ok" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
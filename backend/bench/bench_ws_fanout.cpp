@@ -0,0 +1,284 @@
+// Load generator for WebSocketServer fan-out. Runs the server in-process,
+// opens many local WebSocket clients from a single thread and measures how
+// long a broadcast takes to reach each of them, first one message at a
+// time (latency) and then as a back-to-back burst (throughput).
+//
+// Optionally some extra clients connect and then never read, to show that
+// stalled consumers don't hold up the rest; the server's queue and drop
+// counters are printed at the end. policy: drop, coalesce or disconnect.
+//
+//   ./bench_ws_fanout [clients] [messages] [io_threads] [stalled] [policy] [port]
+
+#include "websocket_server.h"
+#include "event_poller.h"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const size_t MESSAGE_SIZE = 200;
+
+static long long now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int thread_count() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 8, "Threads:") == 0) {
+            return atoi(line.c_str() + 8);
+        }
+    }
+    return -1;
+}
+
+// Blocking connect + upgrade; the socket is left non-blocking afterwards
+static int open_client(int port, bool stalled) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    
+    // A small receive window makes a stalled client back up quickly
+    if (stalled) {
+        int window = 4096;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &window, sizeof(window));
+    }
+    
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        close(fd);
+        return -1;
+    }
+    
+    std::string request = "GET / HTTP/1.1\r\n"
+                          "Host: localhost\r\n"
+                          "Upgrade: websocket\r\n"
+                          "Connection: Upgrade\r\n"
+                          "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                          "Sec-WebSocket-Version: 13\r\n"
+                          "\r\n";
+    if (send(fd, request.data(), request.size(), 0) != (ssize_t)request.size()) {
+        close(fd);
+        return -1;
+    }
+    
+    // Read the response head one byte at a time so no frame bytes are consumed
+    std::string response;
+    char c;
+    while (response.size() < 4096 && recv(fd, &c, 1, 0) == 1) {
+        response += c;
+        if (response.size() >= 4 && response.compare(response.size() - 4, 4, "\r\n\r\n") == 0) {
+            break;
+        }
+    }
+    if (response.compare(0, 12, "HTTP/1.1 101") != 0) {
+        close(fd);
+        return -1;
+    }
+    
+    int opt = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+}
+
+struct Client {
+    int fd;
+    size_t received;  // bytes since the start of the run
+};
+
+// Reads until every client holds `target` bytes; records the time each one
+// crossed `mark` (the end of the message being timed) relative to start
+static bool drain_until(EventPoller& poller, std::map<int, Client*>& clients, size_t mark, size_t target,
+                        long long start, std::vector<double>* latencies_us) {
+    size_t done = 0;
+    for (std::map<int, Client*>::iterator it = clients.begin(); it != clients.end(); ++it) {
+        if (it->second->received >= target) {
+            done++;
+        }
+    }
+    
+    std::vector<PollEvent> ready;
+    char buffer[65536];
+    while (done < clients.size()) {
+        if (poller.wait(ready, 5000) <= 0) {
+            std::cerr << "timed out with " << (clients.size() - done) << " clients short" << std::endl;
+            return false;
+        }
+        long long now = now_ns();
+        for (size_t i = 0; i < ready.size(); i++) {
+            Client* client = clients[ready[i].fd];
+            while (true) {
+                ssize_t n = recv(client->fd, buffer, sizeof(buffer), 0);
+                if (n <= 0) {
+                    if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                        std::cerr << "client disconnected" << std::endl;
+                        return false;
+                    }
+                    break;
+                }
+                size_t before = client->received;
+                client->received += n;
+                if (latencies_us != NULL && before < mark && client->received >= mark) {
+                    latencies_us->push_back((now - start) / 1000.0);
+                }
+                if (before < target && client->received >= target) {
+                    done++;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+static double percentile(std::vector<double>& values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(p * (values.size() - 1));
+    return values[index];
+}
+
+int main(int argc, char* argv[]) {
+    int client_count = argc > 1 ? atoi(argv[1]) : 1000;
+    int messages = argc > 2 ? atoi(argv[2]) : 200;
+    int io_threads = argc > 3 ? atoi(argv[3]) : 1;
+    int stalled_count = argc > 4 ? atoi(argv[4]) : 0;
+    std::string policy = argc > 5 ? argv[5] : "coalesce";
+    int port = argc > 6 ? atoi(argv[6]) : 18090;
+    
+    Config config;
+    config.server_io_threads = io_threads;
+    if (policy == "drop") {
+        config.server_slow_policy = SLOW_DROP_OLDEST;
+    } else if (policy == "disconnect") {
+        config.server_slow_policy = SLOW_DISCONNECT;
+    }
+    
+    WebSocketServer server(port, &config);
+    if (!server.start()) {
+        return 1;
+    }
+    
+    std::vector<int> stalled;
+    for (int i = 0; i < stalled_count; i++) {
+        int fd = open_client(port, true);
+        if (fd >= 0) {
+            stalled.push_back(fd);
+        }
+    }
+    
+    EventPoller poller;
+    std::map<int, Client*> clients;
+    for (int i = 0; i < client_count; i++) {
+        int fd = open_client(port, false);
+        if (fd < 0) {
+            std::cerr << "could only open " << i << " clients: " << strerror(errno) << std::endl;
+            break;
+        }
+        Client* client = new Client();
+        client->fd = fd;
+        client->received = 0;
+        clients[fd] = client;
+        poller.add(fd, POLL_READABLE);
+    }
+    
+    // Upgrades are acknowledged before the connection joins the broadcast
+    // list, so wait until the server has registered everyone
+    while (server.client_count() < clients.size() + stalled.size()) {
+        usleep(1000);
+    }
+    
+    std::string message = "{\"type\":\"market_data\",\"data\":{\"market_id\":\"bench\",\"event_name\":\"";
+    message.append(MESSAGE_SIZE - message.size() - 3, 'x');
+    message += "\"}}";
+    size_t frame_size = message.size() + 4;  // 126..65535 bytes: 4-byte header
+    
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << clients.size() << " clients + " << stalled.size() << " stalled ("
+              << policy << "), " << io_threads << " " << EventPoller::backend()
+              << " reactor(s), " << thread_count() << " threads in process, "
+              << message.size() << "-byte messages" << std::endl;
+    
+    // Latency: one broadcast at a time, wait for every client to get it
+    std::vector<double> latencies_us;
+    std::vector<double> completion_us;
+    size_t target = 0;
+    bool ok = true;
+    for (int m = 0; m < messages && ok; m++) {
+        target += frame_size;
+        long long start = now_ns();
+        server.broadcast_text(message);
+        ok = drain_until(poller, clients, target, target, start, &latencies_us);
+        completion_us.push_back((now_ns() - start) / 1000.0);
+    }
+    
+    if (ok) {
+        std::cout << "per-client delivery us: p50 " << percentile(latencies_us, 0.50)
+                  << "  p99 " << percentile(latencies_us, 0.99)
+                  << "  max " << percentile(latencies_us, 1.0) << std::endl;
+        std::cout << "full fan-out us:        p50 " << percentile(completion_us, 0.50)
+                  << "  p99 " << percentile(completion_us, 0.99)
+                  << "  max " << percentile(completion_us, 1.0) << std::endl;
+    }
+    
+    // Throughput: queue a burst, then drain. The burst is capped at the
+    // queue limit so healthy clients never hit the slow-consumer policy.
+    if (ok) {
+        int burst = std::min(messages, (int)config.server_queue_limit);
+        long long start = now_ns();
+        for (int m = 0; m < burst; m++) {
+            server.broadcast_text(message);
+        }
+        target += frame_size * burst;
+        ok = drain_until(poller, clients, target, target, start, NULL);
+        double seconds = (now_ns() - start) / 1e9;
+        if (ok) {
+            std::cout << "burst of " << burst << ": " << (burst * clients.size() / seconds)
+                      << " deliveries/s, " << (burst * clients.size() * frame_size / seconds / 1e6)
+                      << " MB/s" << std::endl;
+        }
+    }
+    
+    ServerStats stats = server.stats();
+    std::cout << "server: " << stats.clients << " clients, " << stats.queued << " queued, deepest "
+              << stats.max_queue_depth << ", peak " << stats.peak_queue_depth << ", "
+              << stats.messages_dropped << " dropped, " << stats.messages_coalesced << " coalesced, "
+              << stats.slow_disconnects << " slow clients closed" << std::endl;
+    if (stats.write_calls > 0) {
+        std::cout << "server: " << stats.write_calls << " sendmsg calls, "
+                  << (stats.bytes_sent / stats.write_calls) << " bytes and "
+                  << ((double)stats.bytes_sent / frame_size / stats.write_calls) << " frames per call" << std::endl;
+    }
+    
+    for (std::map<int, Client*>::iterator it = clients.begin(); it != clients.end(); ++it) {
+        close(it->first);
+        delete it->second;
+    }
+    for (size_t i = 0; i < stalled.size(); i++) {
+        close(stalled[i]);
+    }
+    server.stop();
+    return ok ? 0 : 1;
+}
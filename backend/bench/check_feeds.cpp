@@ -0,0 +1,414 @@
+// Runs the feeds against MockVenues serving the recorded venue payloads in
+// bench/fixtures and checks the updates they hand on: prices against the
+// recorded books, and the fetch engine's parallelism, concurrency limit
+// and rate limit against the mock's request log; the market channel
+// client against a replayed stream (deltas in both formats, fragmented
+// messages, pings, a dropped connection); Kalshi and PredictIt against
+// their recorded payloads (cents and dollar prices, NO bids as YES asks,
+// rate limiting and outages, contracts that close or drop out). Exits 1
+// if any check fails.
+//
+//   ./check_feeds                 run the checks
+//   ./check_feeds serve [port]    only serve the fixtures, to run the
+//                                 platform against, e.g. with
+//       POLYMARKET_GAMMA_URL=http://127.0.0.1:<port>/gamma
+//       POLYMARKET_CLOB_URL=http://127.0.0.1:<port>/clob
+//       POLYMARKET_WS_URL=ws://127.0.0.1:<port>/ws/market
+//       KALSHI_URL=http://127.0.0.1:<port>/kalshi/trade-api/v2
+//       PREDICTIT_URL=http://127.0.0.1:<port>/predictit/api/marketdata/all/
+
+#include "mock_venues.h"
+#include "market_data_client.h"
+#include "symbol_table.h"
+#include "event_matcher.h"
+#include "types.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <functional>
+#include <cmath>
+#include <algorithm>
+#include <cstdlib>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <json/json.h>
+
+static const int FEED_TIMEOUT_MS = 10000;
+
+static pthread_mutex_t updates_lock = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<MarketData> updates;
+static int failures = 0;
+
+static long long now_us() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+// The feeds' update function; the depth is only lent for the call
+static void record(MarketData* data) {
+    MarketData copy = *data;
+    copy.book = NULL;
+    pthread_mutex_lock(&updates_lock);
+    updates.push_back(copy);
+    pthread_mutex_unlock(&updates_lock);
+}
+
+static std::vector<MarketData> recorded() {
+    pthread_mutex_lock(&updates_lock);
+    std::vector<MarketData> copy = updates;
+    pthread_mutex_unlock(&updates_lock);
+    return copy;
+}
+
+static size_t distinct_markets(const std::vector<MarketData>& seen) {
+    std::set<SymbolId> markets;
+    for (size_t i = 0; i < seen.size(); i++) {
+        markets.insert(seen[i].market_id);
+    }
+    return markets.size();
+}
+
+static void check(bool ok, const std::string& what) {
+    std::cout << (ok ? "  ok    " : "  FAIL  ") << what << std::endl;
+    if (!ok) {
+        failures++;
+    }
+}
+
+static bool same_price(double a, double b) {
+    return std::fabs(a - b) < 1e-9;
+}
+
+// Runs a feed until what it has reported satisfies `done`, or the
+// timeout, and returns everything it reported
+static std::vector<MarketData> run_feed(MarketDataClient& client, MockVenues& mock,
+                                        std::function<bool(const std::vector<MarketData>&)> done) {
+    pthread_mutex_lock(&updates_lock);
+    updates.clear();
+    pthread_mutex_unlock(&updates_lock);
+    mock.reset();
+    
+    client.set_update_function(record);
+    client.connect();
+    long long deadline = now_us() + FEED_TIMEOUT_MS * 1000LL;
+    while (!done(recorded()) && now_us() < deadline) {
+        usleep(10000);
+    }
+    client.disconnect();
+    return recorded();
+}
+
+static std::vector<MarketData> run_feed(MarketDataClient& client, MockVenues& mock, size_t markets) {
+    return run_feed(client, mock, [markets](const std::vector<MarketData>& seen) {
+        return distinct_markets(seen) >= markets;
+    });
+}
+
+static bool load_json(const std::string& path, Json::Value& root) {
+    std::ifstream file(path.c_str());
+    Json::Reader reader;
+    return file && reader.parse(file, root);
+}
+
+// Best prices of a recorded CLOB book, found the slow way
+static void recorded_top(const Json::Value& book, double& best_bid, double& best_ask) {
+    best_bid = 0.0;
+    best_ask = 0.0;
+    for (Json::ArrayIndex i = 0; i < book["bids"].size(); i++) {
+        double price = atof(book["bids"][i]["price"].asCString());
+        best_bid = std::max(best_bid, price);
+    }
+    for (Json::ArrayIndex i = 0; i < book["asks"].size(); i++) {
+        double price = atof(book["asks"][i]["price"].asCString());
+        best_ask = best_ask == 0.0 ? price : std::min(best_ask, price);
+    }
+}
+
+// Every update for a token with a recorded book carries that book's top;
+// a token without one is reported, as invalid
+static void check_polymarket_books(const std::vector<MarketData>& seen, const std::string& fixtures) {
+    size_t matched = 0;
+    size_t mismatched = 0;
+    size_t unbooked = 0;
+    std::map<SymbolId, std::set<SymbolId> > groups;
+    std::map<SymbolId, int> group_sizes;
+    for (size_t i = 0; i < seen.size(); i++) {
+        const MarketData& data = seen[i];
+        if (data.group_id != INVALID_SYMBOL) {
+            groups[data.group_id].insert(data.market_id);
+            group_sizes[data.group_id] = data.group_size;
+        }
+        
+        Json::Value book;
+        if (!load_json(fixtures + "/polymarket/books/" + market_symbols().name(data.market_id) + ".json", book)) {
+            unbooked++;
+            mismatched += data.is_valid;
+            continue;
+        }
+        double best_bid = 0.0;
+        double best_ask = 0.0;
+        recorded_top(book, best_bid, best_ask);
+        if (data.is_valid && same_price(data.best_bid, best_bid) && same_price(data.best_ask, best_ask)) {
+            matched++;
+        } else {
+            mismatched++;
+        }
+    }
+    check(matched > 0 && mismatched == 0, std::to_string(matched) + " quotes match their recorded book, " +
+          std::to_string(mismatched) + " don't");
+    check(unbooked > 0, "a token without a book is reported as invalid");
+    
+    // 13 YES + NO pairs and the nomination's 4 open candidates
+    size_t complete = 0;
+    size_t pairs = 0;
+    size_t nominees = 0;
+    for (std::map<SymbolId, std::set<SymbolId> >::iterator it = groups.begin(); it != groups.end(); ++it) {
+        complete += (int)it->second.size() == group_sizes[it->first];
+        pairs += group_sizes[it->first] == 2;
+        nominees += group_sizes[it->first] == 4;
+    }
+    check(nominees == 1 && pairs == 13 && complete == groups.size(),
+          "outcome sets: " + std::to_string(pairs) + " YES + NO pairs, " +
+          std::to_string(nominees) + " four-way nomination");
+}
+
+static void check_polymarket_polling(MockVenues& mock, const std::string& fixtures) {
+    std::cout << "Polymarket, REST polling" << std::endl;
+    Config config;
+    config.polymarket_gamma_url = mock.url() + "/gamma";
+    config.polymarket_clob_url = mock.url() + "/clob";
+    config.polymarket_ws_url = "";
+    config.http_max_concurrency = 8;
+    config.http_rate_limit = 1000.0;
+    config.http_rate_burst = 1000;
+    config.poll_interval_ms = 60000;
+    
+    // 30 tokens: every market's YES and NO but the nomination's NOs
+    size_t tokens = 30;
+    std::vector<MarketData> seen;
+    {
+        PolymarketClient client(&config);
+        seen = run_feed(client, mock, tokens);
+    }
+    check(seen.size() == tokens, std::to_string(seen.size()) + " of " + std::to_string(tokens) + " tokens reported");
+    check_polymarket_books(seen, fixtures);
+    
+    // Each book takes the mock 50ms to serve
+    std::vector<long long> books = mock.arrivals("/clob/book");
+    long long last_update = 0;
+    for (size_t i = 0; i < seen.size(); i++) {
+        last_update = std::max(last_update, seen[i].timestamp);
+    }
+    double cycle_ms = books.empty() ? 0.0 : (last_update - books[0]) / 1000.0;
+    double serial_ms = 50.0 * tokens;
+    check(!books.empty() && cycle_ms < serial_ms / 2, "cycle took " + std::to_string((int)cycle_ms) +
+          "ms against " + std::to_string((int)serial_ms) + "ms one book at a time");
+    check(mock.max_in_flight() > 1 && mock.max_in_flight() <= config.http_max_concurrency,
+          std::to_string(mock.max_in_flight()) + " requests in flight at most, limit " +
+          std::to_string(config.http_max_concurrency));
+    
+    // The token bucket: never more than burst + rate * t requests by t
+    config.http_rate_limit = 20.0;
+    config.http_rate_burst = 5;
+    {
+        PolymarketClient client(&config);
+        seen = run_feed(client, mock, tokens);
+    }
+    books = mock.arrivals("/clob/book");
+    size_t early = 0;
+    for (size_t i = 0; i < books.size(); i++) {
+        double allowed_at = (double)((int)i + 1 - config.http_rate_burst) / config.http_rate_limit;
+        early += (books[i] - books[0]) / 1e6 < allowed_at - 0.05;
+    }
+    check(books.size() == tokens && early == 0, std::to_string(books.size()) + " books at 20/s after a burst of 5, " +
+          std::to_string(early) + " early");
+}
+
+// The tokens polymarket/stream.txt carries
+static const char* STREAM_BTC_YES = "50266715963017120746783345495885880699221142011617771677192137773708941274575";
+static const char* STREAM_BTC_NO = "84064916601291713654493109645513382228287536867635812642714649059518835064749";
+static const char* STREAM_ETH_YES = "51086285865505056863470997532532129979929642077188143282602006009806337076619";
+
+// Whether the token was ever quoted at bid / ask, or, with `last`, is now
+static bool quoted(const std::vector<MarketData>& seen, const char* token, double bid, double ask, bool last) {
+    SymbolId market_id = market_symbols().find(token);
+    bool found = false;
+    for (size_t i = 0; i < seen.size(); i++) {
+        if (seen[i].market_id != market_id) {
+            continue;
+        }
+        bool match = seen[i].is_valid && same_price(seen[i].best_bid, bid) && same_price(seen[i].best_ask, ask);
+        found = last ? match : found || match;
+    }
+    return found;
+}
+
+static void check_polymarket_streaming(MockVenues& mock) {
+    std::cout << "Polymarket, market channel" << std::endl;
+    Config config;
+    config.polymarket_gamma_url = mock.url() + "/gamma";
+    config.polymarket_ws_url = "ws://127.0.0.1:" + std::to_string(mock.port()) + "/ws/market";
+    
+    // Done once the snapshot sent after the reconnect is in
+    std::vector<MarketData> seen;
+    {
+        PolymarketClient client(&config);
+        seen = run_feed(client, mock, [](const std::vector<MarketData>& so_far) {
+            return quoted(so_far, STREAM_BTC_YES, 0.41, 0.43, true);
+        });
+    }
+    
+    check(quoted(seen, STREAM_BTC_YES, 0.47, 0.49, false) && quoted(seen, STREAM_BTC_NO, 0.50, 0.53, false),
+          "snapshots: BTC YES 0.47 / 0.49, NO 0.50 / 0.53");
+    check(quoted(seen, STREAM_ETH_YES, 0.12, 0.14, false), "snapshot with buys / sells: ETH YES 0.12 / 0.14");
+    check(quoted(seen, STREAM_BTC_YES, 0.48, 0.49, false) && quoted(seen, STREAM_BTC_NO, 0.51, 0.53, false),
+          "price_changes deltas: BTC YES bid 0.48, NO bid 0.51");
+    check(quoted(seen, STREAM_ETH_YES, 0.12, 0.15, true), "fragmented changes delta clears ETH YES's 0.14 ask");
+    check(mock.stream_pongs() >= 2, std::to_string(mock.stream_pongs()) + " pings answered, one between fragments");
+    
+    // Both connections' subscriptions name every tracked token
+    std::vector<std::string> messages = mock.stream_messages();
+    size_t complete = 0;
+    for (size_t i = 0; i < messages.size(); i++) {
+        Json::Value subscribe;
+        Json::Reader reader;
+        if (!reader.parse(messages[i], subscribe) || subscribe["type"].asString() != "market") {
+            continue;
+        }
+        std::set<std::string> ids;
+        for (Json::ArrayIndex j = 0; j < subscribe["assets_ids"].size(); j++) {
+            ids.insert(subscribe["assets_ids"][j].asString());
+        }
+        complete += ids.size() == 30 && ids.count(STREAM_BTC_YES) && ids.count(STREAM_BTC_NO) && ids.count(STREAM_ETH_YES);
+    }
+    check(messages.size() == 2 && complete == 2, std::to_string(complete) + " subscriptions to all 30 tokens, "
+          "one before and one after the drop");
+    check(quoted(seen, STREAM_BTC_YES, 0.41, 0.43, true), "after resubscribing: BTC YES 0.41 / 0.43 from the new snapshot");
+}
+
+// Updates for one market: all of them, or only the invalid ones
+static size_t count_updates(const std::vector<MarketData>& seen, SymbolId market_id, bool invalid_only) {
+    size_t count = 0;
+    for (size_t i = 0; i < seen.size(); i++) {
+        count += seen[i].market_id == market_id && (!invalid_only || !seen[i].is_valid);
+    }
+    return count;
+}
+
+static MarketData last_update(const std::vector<MarketData>& seen, SymbolId market_id) {
+    MarketData last;
+    for (size_t i = 0; i < seen.size(); i++) {
+        if (seen[i].market_id == market_id) {
+            last = seen[i];
+        }
+    }
+    return last;
+}
+
+static bool quoted(const MarketData& data, double bid, double ask, double bid_size, double ask_size) {
+    return data.is_valid && same_price(data.best_bid, bid) && same_price(data.best_ask, ask) &&
+           std::fabs(data.bid_size - bid_size) < 1e-6 && std::fabs(data.ask_size - ask_size) < 1e-6;
+}
+
+static void check_kalshi(MockVenues& mock) {
+    std::cout << "Kalshi" << std::endl;
+    Config config;
+    config.kalshi_url = mock.url() + "/kalshi/trade-api/v2";
+    config.http_rate_limit = 1000.0;
+    config.http_rate_burst = 1000;
+    config.poll_interval_ms = 100;
+    
+    // Done once the Fed book is back after its 429 and 503
+    std::string fed_book = "/kalshi/trade-api/v2/markets/KXFEDDECISION-27MAR-C25/orderbook";
+    std::vector<MarketData> seen;
+    {
+        KalshiClient client(&config);
+        seen = run_feed(client, mock, [](const std::vector<MarketData>& so_far) {
+            return quoted(so_far, "KXFEDDECISION-27MAR-C25", 0.25, 0.27, true);
+        });
+    }
+    
+    check(distinct_markets(seen) == 4, std::to_string(distinct_markets(seen)) + " markets found over two pages");
+    check(quoted(last_update(seen, market_symbols().find("KXBTCMAXY-27-150000")), 0.50, 0.55, 100, 200),
+          "cents: YES bid 50 x 100, NO bid 45 x 200 -> 0.50 x 100 / 0.55 x 200");
+    check(quoted(last_update(seen, market_symbols().find("KXDEMNOM-28-GNEW")), 0.30, 0.35, 5, 7),
+          "dollar strings: YES bid 0.3000 x 5, NO bid 0.6500 x 7 -> 0.30 x 5 / 0.35 x 7");
+    check(count_updates(seen, market_symbols().find("KXRECSSNBER-27"), true) > 0 &&
+          count_updates(seen, market_symbols().find("KXRECSSNBER-27"), false) ==
+          count_updates(seen, market_symbols().find("KXRECSSNBER-27"), true), "empty book reported as invalid");
+    
+    SymbolId fed = market_symbols().find("KXFEDDECISION-27MAR-C25");
+    check(mock.arrivals(fed_book).size() >= 4 && quoted(seen, "KXFEDDECISION-27MAR-C25", 0.22, 0.24, false) &&
+          count_updates(seen, fed, true) == 0, "429 and 503 keep the last quote: no invalid update in " +
+          std::to_string(mock.arrivals(fed_book).size()) + " polls");
+    check(quoted(seen, "KXFEDDECISION-27MAR-C25", 0.25, 0.27, true), "the book after the outage: 0.25 / 0.27");
+}
+
+static SymbolId predictit_contract(const char* id) {
+    return market_symbols().find(EventMatcher::market_key(MARKET_PREDICTIT, id));
+}
+
+static void check_predictit(MockVenues& mock) {
+    std::cout << "PredictIt" << std::endl;
+    Config config;
+    config.predictit_url = mock.url() + "/predictit/api/marketdata/all/";
+    config.predictit_poll_interval_ms = 100;
+    
+    // Done once the last snapshot has been served twice
+    std::string snapshot = "/predictit/api/marketdata/all/";
+    std::vector<MarketData> seen;
+    {
+        PredictItClient client(&config);
+        seen = run_feed(client, mock, [&mock, &snapshot](const std::vector<MarketData>&) {
+            return mock.arrivals(snapshot).size() >= 6;
+        });
+    }
+    
+    SymbolId democratic = predictit_contract("31002");
+    SymbolId republican = predictit_contract("31003");
+    SymbolId libertarian = predictit_contract("31004");
+    SymbolId bitcoin = predictit_contract("34517");
+    check(distinct_markets(seen) == 4, std::to_string(distinct_markets(seen)) + " contracts reported");
+    check(count_updates(seen, democratic, false) == 2 &&
+          quoted(last_update(seen, democratic), 0.53, 0.54, 850.0 / 0.47, 850.0 / 0.54),
+          "Democratic moved to 0.53 / 0.54, sized by the $850 position limit");
+    check(count_updates(seen, libertarian, true) == 1 && !last_update(seen, libertarian).is_valid,
+          "Libertarian, gone from the snapshot, invalidated once");
+    check(count_updates(seen, republican, true) == 1 && !last_update(seen, republican).is_valid,
+          "Republican, closed, invalidated once");
+    check(count_updates(seen, bitcoin, false) == 1, "unchanged Bitcoin contract reported once over " +
+          std::to_string(mock.arrivals(snapshot).size()) + " snapshots");
+    check(seen.size() == 7, std::to_string(seen.size()) + " updates: 4 contracts, a move, 2 invalidations");
+}
+
+int main(int argc, char* argv[]) {
+    std::string fixtures = FIXTURE_DIR;
+    MockVenues mock(fixtures);
+    
+    if (argc > 1 && std::string(argv[1]) == "serve") {
+        if (!mock.start(argc > 2 ? atoi(argv[2]) : 0)) {
+            return 1;
+        }
+        std::cout << "Serving " << fixtures << " at " << mock.url() << std::endl;
+        while (true) {
+            pause();
+        }
+    }
+    
+    if (!mock.start(0)) {
+        return 1;
+    }
+    check_polymarket_polling(mock, fixtures);
+    check_polymarket_streaming(mock);
+    check_kalshi(mock);
+    check_predictit(mock);
+    mock.stop();
+    
+    std::cout << (failures == 0 ? "All checks passed" : std::to_string(failures) + " checks failed") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
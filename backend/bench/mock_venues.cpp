@@ -0,0 +1,619 @@
+#include "mock_venues.h"
+#include "websocket_protocol.h"
+#include "websocket_decoder.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <atomic>
+#include <algorithm>
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <cstring>
+#include <cerrno>
+#include <cctype>
+
+static const int POLL_INTERVAL_MS = 5;
+static const size_t READ_CHUNK = 16384;
+static const size_t MAX_CLIENT_MESSAGE = 1 << 20;
+
+struct Route {
+    std::string prefix;
+    int status;
+    int delay_ms;
+    std::string body_path;  // relative to the fixture directory; empty for none
+    size_t served;          // on a script's first line: requests it has answered
+    
+    Route() {
+        status = 0;
+        delay_ms = 0;
+        served = 0;
+    }
+};
+
+struct MockConnection {
+    int fd;
+    std::string in;
+    std::string out;
+    bool waiting;           // a response is due at ready_us
+    long long ready_us;
+    std::string response;
+    bool close_after;       // the client asked for Connection: close, or the script closed
+    
+    // Once upgraded: the script's steps for this connection, the next one
+    // to run, client messages no await has taken yet and when a pause ends
+    WebSocketDecoder* decoder;
+    std::vector<std::string> steps;
+    size_t step;
+    int unread;
+    long long resume_us;
+    
+    MockConnection() {
+        fd = -1;
+        waiting = false;
+        ready_us = 0;
+        close_after = false;
+        decoder = NULL;
+        step = 0;
+        unread = 0;
+        resume_us = 0;
+    }
+    
+    ~MockConnection() {
+        delete decoder;
+    }
+};
+
+struct MockState {
+    std::string fixture_dir;
+    std::vector<Route> routes;
+    int listen_fd;
+    int port;
+    std::atomic<bool> running;
+    pthread_t thread;
+    std::vector<MockConnection*> connections;
+    
+    // Shared with the accessors
+    pthread_mutex_t lock;
+    std::vector<std::pair<std::string, long long> > requests;
+    int in_flight;
+    int max_in_flight;
+    int stream_connections;
+    std::vector<std::string> stream_messages;
+    int stream_pongs;
+    
+    MockState() {
+        listen_fd = -1;
+        port = 0;
+        running = false;
+        in_flight = 0;
+        max_in_flight = 0;
+        stream_connections = 0;
+        stream_pongs = 0;
+        pthread_mutex_init(&lock, NULL);
+    }
+    
+    ~MockState() {
+        pthread_mutex_destroy(&lock);
+    }
+};
+
+static long long now_us() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+static bool read_file(const std::string& path, std::string& out) {
+    std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    out = contents.str();
+    return true;
+}
+
+static bool load_routes(MockState* ms) {
+    std::ifstream file((ms->fixture_dir + "/routes.txt").c_str());
+    if (!file) {
+        std::cerr << "No routes.txt in " << ms->fixture_dir << std::endl;
+        return false;
+    }
+    
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        Route route;
+        std::string body;
+        if (!(fields >> route.prefix) || route.prefix[0] == '#') {
+            continue;
+        }
+        if (!(fields >> route.status >> route.delay_ms >> body)) {
+            std::cerr << "Bad route: " << line << std::endl;
+            return false;
+        }
+        route.body_path = body == "-" ? "" : body;
+        ms->routes.push_back(route);
+    }
+    return true;
+}
+
+static const char* status_text(int status) {
+    switch (status) {
+        case 101: return "Switching Protocols";
+        case 200: return "OK";
+        case 404: return "Not Found";
+        case 429: return "Too Many Requests";
+        case 500: return "Internal Server Error";
+        case 502: return "Bad Gateway";
+        case 503: return "Service Unavailable";
+        default: return "Unknown";
+    }
+}
+
+static std::string http_response(int status, const std::string& body) {
+    std::string response = "HTTP/1.1 " + std::to_string(status) + " " + status_text(status) + "\r\n";
+    response += "Content-Type: application/json\r\n";
+    response += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    response += body;
+    return response;
+}
+
+// Length of the start of target that pattern matches, a * standing for
+// any run of characters (the shortest that works), or npos
+static size_t match_prefix(const std::string& pattern, size_t p, const std::string& target, size_t t) {
+    for (; p < pattern.size(); p++, t++) {
+        if (pattern[p] == '*') {
+            for (size_t skip = t; skip <= target.size(); skip++) {
+                size_t length = match_prefix(pattern, p + 1, target, skip);
+                if (length != std::string::npos) {
+                    return length;
+                }
+            }
+            return std::string::npos;
+        }
+        if (t >= target.size() || target[t] != pattern[p]) {
+            return std::string::npos;
+        }
+    }
+    return t;
+}
+
+static const Route* find_route(MockState* ms, const std::string& target, size_t& matched) {
+    for (size_t i = 0; i < ms->routes.size(); i++) {
+        matched = match_prefix(ms->routes[i].prefix, 0, target, 0);
+        if (matched != std::string::npos) {
+            return &ms->routes[i];
+        }
+    }
+    return NULL;
+}
+
+// Builds the response to a target from the first matching route, or the
+// line of its script this request has got to
+static std::string respond(MockState* ms, const std::string& target, int& delay_ms) {
+    delay_ms = 0;
+    size_t matched = 0;
+    const Route* found = find_route(ms, target, matched);
+    if (found != NULL) {
+        size_t first = found - &ms->routes[0];
+        size_t last = first;
+        while (last + 1 < ms->routes.size() && ms->routes[last + 1].prefix == found->prefix) {
+            last++;
+        }
+        pthread_mutex_lock(&ms->lock);
+        const Route& route = ms->routes[std::min(first + ms->routes[first].served++, last)];
+        pthread_mutex_unlock(&ms->lock);
+        delay_ms = route.delay_ms;
+        
+        std::string body;
+        if (!route.body_path.empty()) {
+            std::string path = route.body_path;
+            size_t star = path.find('*');
+            if (star != std::string::npos) {
+                path.replace(star, 1, target.substr(matched));
+            }
+            if (!read_file(ms->fixture_dir + "/" + path, body)) {
+                return http_response(404, "");
+            }
+        }
+        return http_response(route.status, body);
+    }
+    return http_response(404, "");
+}
+
+static void send_frame(MockConnection* conn, int opcode, const std::string& payload, bool fin) {
+    unsigned char header[WS_MAX_HEADER];
+    size_t length = websocket_frame_header(header, opcode, payload.size());
+    if (!fin) {
+        header[0] &= 0x7F;
+    }
+    conn->out.append((const char*)header, length);
+    conn->out += payload;
+}
+
+// Completes the handshake and picks this connection's section of the
+// script: the Nth connection gets the Nth, and the last one repeats
+static void upgrade(MockState* ms, MockConnection* conn, const Route& route, const std::string& head, const std::string& lower) {
+    static const char KEY_HEADER[] = "\r\nsec-websocket-key:";
+    size_t key_start = lower.find(KEY_HEADER);
+    std::string key;
+    if (key_start != std::string::npos) {
+        key_start = head.find_first_not_of(' ', key_start + sizeof(KEY_HEADER) - 1);
+        key = head.substr(key_start, head.find("\r\n", key_start) - key_start);
+    }
+    conn->out += "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                 "Sec-WebSocket-Accept: " + websocket_accept_key(key) + "\r\n\r\n";
+    
+    std::vector<std::vector<std::string> > sections;
+    std::ifstream file((ms->fixture_dir + "/" + route.body_path).c_str());
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        if (line == "connection" || sections.empty()) {
+            sections.push_back(std::vector<std::string>());
+        }
+        if (line != "connection") {
+            sections.back().push_back(line);
+        }
+    }
+    
+    pthread_mutex_lock(&ms->lock);
+    size_t section = ms->stream_connections++;
+    pthread_mutex_unlock(&ms->lock);
+    if (!sections.empty()) {
+        conn->steps = sections[std::min(section, sections.size() - 1)];
+    }
+    
+    conn->decoder = new WebSocketDecoder(true, MAX_CLIENT_MESSAGE);
+    conn->decoder->feed(conn->in.data(), conn->in.size());
+    conn->in.clear();
+}
+
+// Runs script steps until one has to wait
+static void run_script(MockConnection* conn) {
+    while (conn->step < conn->steps.size() && !conn->close_after && now_us() >= conn->resume_us) {
+        std::istringstream fields(conn->steps[conn->step]);
+        std::string command;
+        fields >> command;
+        std::string rest;
+        std::getline(fields, rest);
+        rest.erase(0, rest.find_first_not_of(' '));
+        
+        if (command == "await") {
+            if (conn->unread == 0) {
+                return;
+            }
+            conn->unread--;
+        } else if (command == "send") {
+            send_frame(conn, WS_TEXT, rest, true);
+        } else if (command == "fragments") {
+            std::istringstream split(rest);
+            size_t pieces = 1;
+            split >> pieces;
+            std::string message;
+            std::getline(split, message);
+            message.erase(0, message.find_first_not_of(' '));
+            pieces = std::max((size_t)1, std::min(pieces, message.size()));
+            size_t piece = (message.size() + pieces - 1) / pieces;
+            for (size_t offset = 0; offset < message.size(); offset += piece) {
+                bool last = offset + piece >= message.size();
+                send_frame(conn, offset == 0 ? WS_TEXT : WS_CONTINUATION, message.substr(offset, piece), last);
+                if (offset == 0 && !last) {
+                    send_frame(conn, WS_PING, "mid-message", true);
+                }
+            }
+        } else if (command == "ping") {
+            send_frame(conn, WS_PING, "keepalive", true);
+        } else if (command == "pause") {
+            conn->resume_us = now_us() + atoi(rest.c_str()) * 1000LL;
+        } else if (command == "close") {
+            std::string code;
+            code += (char)(WS_CLOSE_GOING_AWAY >> 8);
+            code += (char)(WS_CLOSE_GOING_AWAY & 0xFF);
+            send_frame(conn, WS_CLOSE, code, true);
+            conn->close_after = true;
+        }
+        conn->step++;
+    }
+}
+
+// Returns false once the client is gone or broke the protocol
+static bool handle_client_frames(MockState* ms, MockConnection* conn) {
+    WebSocketMessage message;
+    while (true) {
+        int result = conn->decoder->next(message);
+        if (result == DECODE_MORE) {
+            return true;
+        }
+        if (result == DECODE_ERROR || message.opcode == WS_CLOSE) {
+            return false;
+        }
+        if (message.opcode == WS_PING) {
+            send_frame(conn, WS_PONG, message.payload, true);
+        } else if (message.opcode == WS_PONG) {
+            pthread_mutex_lock(&ms->lock);
+            ms->stream_pongs++;
+            pthread_mutex_unlock(&ms->lock);
+        } else if (message.payload == "PING") {
+            // Polymarket's application-level keep-alive
+            send_frame(conn, WS_TEXT, "PONG", true);
+        } else {
+            pthread_mutex_lock(&ms->lock);
+            ms->stream_messages.push_back(message.payload);
+            pthread_mutex_unlock(&ms->lock);
+            conn->unread++;
+        }
+    }
+}
+
+// Takes the next complete request off the connection's input, if there is
+// one, and schedules its response
+static void next_request(MockState* ms, MockConnection* conn) {
+    if (conn->waiting) {
+        return;
+    }
+    size_t header_end = conn->in.find("\r\n\r\n");
+    if (header_end == std::string::npos) {
+        return;
+    }
+    std::string head = conn->in.substr(0, header_end);
+    conn->in.erase(0, header_end + 4);
+    
+    std::istringstream request_line(head.substr(0, head.find("\r\n")));
+    std::string method;
+    std::string target;
+    request_line >> method >> target;
+    
+    std::string lower = head;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    conn->close_after = lower.find("\r\nconnection: close") != std::string::npos;
+    
+    size_t matched = 0;
+    const Route* route = find_route(ms, target, matched);
+    if (route != NULL && route->status == 101 && lower.find("\r\nupgrade: websocket") != std::string::npos) {
+        upgrade(ms, conn, *route, head, lower);
+        return;
+    }
+    
+    int delay_ms = 0;
+    conn->response = respond(ms, target, delay_ms);
+    conn->waiting = true;
+    conn->ready_us = now_us() + delay_ms * 1000LL;
+    
+    pthread_mutex_lock(&ms->lock);
+    ms->requests.push_back(std::make_pair(target, now_us()));
+    ms->in_flight++;
+    ms->max_in_flight = std::max(ms->max_in_flight, ms->in_flight);
+    pthread_mutex_unlock(&ms->lock);
+}
+
+static void finish_response(MockState* ms, MockConnection* conn) {
+    conn->out += conn->response;
+    conn->response.clear();
+    conn->waiting = false;
+    pthread_mutex_lock(&ms->lock);
+    ms->in_flight--;
+    pthread_mutex_unlock(&ms->lock);
+}
+
+static void close_connection(MockState* ms, size_t i) {
+    MockConnection* conn = ms->connections[i];
+    if (conn->waiting) {
+        pthread_mutex_lock(&ms->lock);
+        ms->in_flight--;
+        pthread_mutex_unlock(&ms->lock);
+    }
+    close(conn->fd);
+    delete conn;
+    ms->connections.erase(ms->connections.begin() + i);
+}
+
+// Returns false once the connection should be closed
+static bool service(MockState* ms, MockConnection* conn, short revents) {
+    if (revents & POLLIN) {
+        char chunk[READ_CHUNK];
+        ssize_t received = recv(conn->fd, chunk, sizeof(chunk), 0);
+        if (received <= 0) {
+            return false;
+        }
+        if (conn->decoder != NULL) {
+            conn->decoder->feed(chunk, received);
+        } else {
+            conn->in.append(chunk, received);
+        }
+    }
+    if (revents & (POLLERR | POLLHUP)) {
+        return false;
+    }
+    
+    if (conn->decoder != NULL) {
+        if (!handle_client_frames(ms, conn)) {
+            return false;
+        }
+        run_script(conn);
+    } else {
+        next_request(ms, conn);
+        if (conn->waiting && now_us() >= conn->ready_us) {
+            finish_response(ms, conn);
+            next_request(ms, conn);
+        }
+    }
+    
+    if (!conn->out.empty()) {
+        ssize_t sent = send(conn->fd, conn->out.data(), conn->out.size(), MSG_NOSIGNAL);
+        if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            return false;
+        }
+        if (sent > 0) {
+            conn->out.erase(0, sent);
+        }
+    }
+    return !(conn->close_after && !conn->waiting && conn->out.empty());
+}
+
+static void* serve(void* arg) {
+    MockState* ms = (MockState*)arg;
+    std::vector<struct pollfd> fds;
+    
+    while (ms->running.load()) {
+        fds.resize(ms->connections.size() + 1);
+        fds[0].fd = ms->listen_fd;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        for (size_t i = 0; i < ms->connections.size(); i++) {
+            fds[i + 1].fd = ms->connections[i]->fd;
+            fds[i + 1].events = POLLIN | (ms->connections[i]->out.empty() ? 0 : POLLOUT);
+            fds[i + 1].revents = 0;
+        }
+        poll(&fds[0], fds.size(), POLL_INTERVAL_MS);
+        
+        // Every connection is serviced each round, ready or not, so
+        // delayed responses go out on time
+        for (size_t i = ms->connections.size(); i > 0; i--) {
+            if (!service(ms, ms->connections[i - 1], fds[i].revents)) {
+                close_connection(ms, i - 1);
+            }
+        }
+        
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(ms->listen_fd, NULL, NULL);
+            if (fd >= 0) {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+                MockConnection* conn = new MockConnection();
+                conn->fd = fd;
+                ms->connections.push_back(conn);
+            }
+        }
+    }
+    
+    while (!ms->connections.empty()) {
+        close_connection(ms, ms->connections.size() - 1);
+    }
+    return NULL;
+}
+
+MockVenues::MockVenues(const std::string& fixture_dir) {
+    MockState* ms = new MockState();
+    ms->fixture_dir = fixture_dir;
+    state = ms;
+}
+
+MockVenues::~MockVenues() {
+    stop();
+    delete (MockState*)state;
+}
+
+bool MockVenues::start(int port) {
+    MockState* ms = (MockState*)state;
+    if (ms->running.load() || !load_routes(ms)) {
+        return false;
+    }
+    
+    ms->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(ms->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons((uint16_t)port);
+    socklen_t length = sizeof(address);
+    if (bind(ms->listen_fd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(ms->listen_fd, 64) < 0 ||
+        getsockname(ms->listen_fd, (struct sockaddr*)&address, &length) < 0) {
+        std::cerr << "Mock venues can't listen on port " << port << ": " << strerror(errno) << std::endl;
+        close(ms->listen_fd);
+        ms->listen_fd = -1;
+        return false;
+    }
+    ms->port = ntohs(address.sin_port);
+    
+    ms->running.store(true);
+    if (pthread_create(&ms->thread, NULL, serve, ms) != 0) {
+        ms->running.store(false);
+        close(ms->listen_fd);
+        ms->listen_fd = -1;
+        return false;
+    }
+    return true;
+}
+
+void MockVenues::stop() {
+    MockState* ms = (MockState*)state;
+    if (!ms->running.load()) {
+        return;
+    }
+    ms->running.store(false);
+    pthread_join(ms->thread, NULL);
+    close(ms->listen_fd);
+    ms->listen_fd = -1;
+}
+
+int MockVenues::port() {
+    return ((MockState*)state)->port;
+}
+
+std::string MockVenues::url() {
+    return "http://127.0.0.1:" + std::to_string(port());
+}
+
+std::vector<long long> MockVenues::arrivals(const std::string& prefix) {
+    MockState* ms = (MockState*)state;
+    std::vector<long long> times;
+    pthread_mutex_lock(&ms->lock);
+    for (size_t i = 0; i < ms->requests.size(); i++) {
+        if (ms->requests[i].first.compare(0, prefix.size(), prefix) == 0) {
+            times.push_back(ms->requests[i].second);
+        }
+    }
+    pthread_mutex_unlock(&ms->lock);
+    return times;
+}
+
+int MockVenues::max_in_flight() {
+    MockState* ms = (MockState*)state;
+    pthread_mutex_lock(&ms->lock);
+    int result = ms->max_in_flight;
+    pthread_mutex_unlock(&ms->lock);
+    return result;
+}
+
+std::vector<std::string> MockVenues::stream_messages() {
+    MockState* ms = (MockState*)state;
+    pthread_mutex_lock(&ms->lock);
+    std::vector<std::string> copy = ms->stream_messages;
+    pthread_mutex_unlock(&ms->lock);
+    return copy;
+}
+
+int MockVenues::stream_pongs() {
+    MockState* ms = (MockState*)state;
+    pthread_mutex_lock(&ms->lock);
+    int result = ms->stream_pongs;
+    pthread_mutex_unlock(&ms->lock);
+    return result;
+}
+
+void MockVenues::reset() {
+    MockState* ms = (MockState*)state;
+    pthread_mutex_lock(&ms->lock);
+    ms->requests.clear();
+    ms->max_in_flight = ms->in_flight;
+    for (size_t i = 0; i < ms->routes.size(); i++) {
+        ms->routes[i].served = 0;
+    }
+    ms->stream_connections = 0;
+    ms->stream_messages.clear();
+    ms->stream_pongs = 0;
+    pthread_mutex_unlock(&ms->lock);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Stand-in for the venues' HTTP and WebSocket APIs on 127.0.0.1, serving
+// recorded payloads from a fixture directory, so the feeds can be run and
+// checked without the network. fixture_dir/routes.txt maps request targets to
+// responses, one per line:
+//
+//   # target prefix          status  delay_ms  body (under fixture_dir, - for none)
+//   /clob/book?token_id=     200     50        polymarket/books/*.json
+//
+// The first line whose prefix starts the request target answers it; a *
+// in a prefix matches any run of characters. A * in the body path stands
+// for the rest of the target after the prefix; a body file that
+// doesn't exist is a 404. Consecutive lines with the same prefix are a
+// script: the Nth request gets the Nth line, and the last line repeats.
+// Responses wait out their delay without holding up other connections, as
+// a slow venue would.
+//
+// A route with status 101 takes WebSocket upgrades and replays its body
+// file, a script of one step per line, to each connection:
+//
+//   connection            starts the next connection's steps; the Nth
+//                         connection gets the Nth section, the last repeats
+//   await                 waits for a text message from the client
+//   send <message>        one text frame
+//   fragments <n> <message>  the message over n frames, a ping after the first
+//   ping                  a ping, which the client must answer
+//   pause <ms>
+//   close                 the close handshake, dropping the client
+//
+// A client's text "PING" is answered "PONG" whenever it comes.
+//
+// One thread serves every connection; the accessors are safe from any
+// other thread.
+class MockVenues {
+public:
+    MockVenues(const std::string& fixture_dir);
+    ~MockVenues();
+    
+    bool start(int port);   // 0 picks a free port
+    void stop();
+    
+    int port();
+    std::string url();      // http://127.0.0.1:<port>
+    
+    // Arrival times (microseconds since epoch) of requests whose target
+    // starts with prefix, in order
+    std::vector<long long> arrivals(const std::string& prefix);
+    
+    // Most requests that were waiting on a response at once
+    int max_in_flight();
+    
+    // Text messages stream clients sent, in order, and pings they answered
+    std::vector<std::string> stream_messages();
+    int stream_pongs();
+    
+    // Forgets the request log and restarts the scripts
+    void reset();
+    
+private:
+    void* state;
+};
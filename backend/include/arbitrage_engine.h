@@ -1,22 +1,46 @@
 #pragma once
 
 #include "types.h"
+#include "quote_store.h"
+#include "order_book.h"
+#include <vector>
 
 class ArbitrageEngine {
 public:
     ArbitrageEngine(Config* config);
     ~ArbitrageEngine();
     
+    // Stores the quote and checks the pairs it is in, on the caller's thread
     void update_market_data(MarketData* data);
+    
+    // The two halves of update_market_data, for when detection runs on a
+    // different thread from the feed: the store copies the book, so
+    // find_opportunities only needs the market's ID. Both also cover the
+    // outcome set the market belongs to (MarketData::group_id), if any.
+    void store_market_data(MarketData* data);
+    void find_opportunities(SymbolId market_id, std::vector<ArbitrageOpportunity>& found);
+    
+    void remove_market_data(SymbolId market_id);
+    void scan_all_markets();
+    void scan_all_markets(std::vector<ArbitrageOpportunity>& found);
     void set_opportunity_function(void (*func)(ArbitrageOpportunity*));
     
+    // NUM_MARKETS schedules, by Market. Checks from then on use the new
+    // fees; quotes that haven't ticked since are only re-priced by a scan.
+    void set_fee_schedules(const FeeSchedule* schedules);
+    
 private:
-    void check_for_opportunities();
-    double compute_profit(MarketData* buy, MarketData* sell);
-    double compute_max_size(MarketData* buy, MarketData* sell);
+    void* store_market_data(MarketData* data, uint32_t& slot);
+    void check_for_opportunities(void* event, uint32_t slot, const Quote& updated, const OrderBook* updated_book, std::vector<ArbitrageOpportunity>& found);
+    void store_group_quote(MarketData* data);
+    void check_outcome_group(SymbolId market_id, std::vector<ArbitrageOpportunity>& found);
+    void check_group(void* outcome_group, std::vector<ArbitrageOpportunity>& found);
+    void check_pair(SymbolId event_id, const Quote& buy, const Quote& sell, const OrderBook* buy_book, const OrderBook* sell_book, const void* fees, std::vector<ArbitrageOpportunity>& found);
+    bool size_from_depth(const OrderBook& buy_book, const OrderBook& sell_book, const void* fees, ArbitrageOpportunity& opp);
+    double compute_profit(const Quote& buy, const Quote& sell, const void* fees);
+    double compute_max_size(const Quote& buy, const Quote& sell);
     
     Config* config;
     void (*opportunity_callback)(ArbitrageOpportunity*);
     void* market_data_map;
 };
-
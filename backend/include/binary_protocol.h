@@ -0,0 +1,126 @@
+#pragma once
+
+#include "types.h"
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+// Compact binary feed for programmatic subscribers, an alternative to the
+// JSON messages the dashboard reads. A client opts in by offering the
+// BINARY_SUBPROTOCOL in Sec-WebSocket-Protocol, or at any time with
+// {"type":"subscribe","format":"binary"}. It then receives one message per
+// binary frame; byte 0 is the BinaryMessageType. Integers and IEEE 754
+// doubles are little-endian and every field sits at a fixed offset.
+//
+// Records refer to markets and events by interned ID. The names come in
+// symbols messages: the whole dictionary right after opting in, entries
+// for new IDs before the first record that uses them, and the whole
+// dictionary again periodically, which repairs a client that lost a delta
+// to its slow-consumer policy.
+//
+// Right after opting in, after a subscribe, on request and whenever the
+// server had to discard messages for it, a client gets a snapshot: the
+// latest record of every market and live opportunity it subscribes to,
+// between a begin and an end marker. Records don't carry the JSON feed's
+// sequence numbers; the markers say which point in that sequence the
+// snapshot is current to.
+//
+// market_data, BINARY_RECORD_SIZE bytes
+//    0  u8   BIN_MARKET_DATA
+//    1  u8   market (Market)
+//    2  u16  reserved
+//    4  u32  market_id
+//    8  u32  event_id
+//   12  u32  reserved
+//   16  i64  timestamp, microseconds since epoch
+//   24  f64  best_bid
+//   32  f64  best_ask
+//   40  f64  bid_size
+//   48  f64  ask_size
+//
+// opportunity, BINARY_RECORD_SIZE bytes
+//    0  u8   BIN_OPPORTUNITY
+//    1  u8   buy_market
+//    2  u8   sell_market
+//    3  u8   legs: outcome set size (capped at 255), 0 for a cross-venue pair
+//    4  u32  event_id
+//    8  f64  buy_price
+//   16  f64  sell_price
+//   24  f64  profit as a fraction (JSON sends a percentage)
+//   32  f64  max_size
+//   40  f64  avg_buy_price
+//   48  f64  avg_sell_price
+//
+// symbols, variable length
+//    0  u8   BIN_SYMBOLS
+//    1  u8   flags (SYMBOLS_FULL: replaces everything the client knows)
+//    2  u16  reserved
+//    4  u32  entry count
+//    8  entries, each: u8 table (SymbolKind), u8 reserved, u16 name
+//       length, u32 id, then the name's UTF-8 bytes
+//
+// snapshot marker, SNAPSHOT_MARKER_SIZE bytes
+//    0  u8   BIN_SNAPSHOT
+//    1  u8   SNAPSHOT_BEGIN or SNAPSHOT_END
+//    2  u8   reason (SnapshotReason)
+//    3  u8   reserved
+//    4  u32  records in the snapshot; 0 in the begin marker
+//    8  u64  sequence number the snapshot is current to
+
+static const char BINARY_SUBPROTOCOL[] = "arb.binary.v1";
+static const char JSON_SUBPROTOCOL[] = "arb.json.v1";
+
+enum BinaryMessageType {
+    BIN_MARKET_DATA = 1,
+    BIN_OPPORTUNITY = 2,
+    BIN_SYMBOLS = 3,
+    BIN_SNAPSHOT = 4
+};
+
+enum SymbolKind {
+    SYMBOL_MARKET = 0,
+    SYMBOL_EVENT = 1
+};
+
+enum SnapshotPhase {
+    SNAPSHOT_BEGIN = 1,
+    SNAPSHOT_END = 2
+};
+
+// Why a snapshot was sent; the JSON markers spell these out
+enum SnapshotReason {
+    SNAPSHOT_CONNECT = 1,    // the connection just opened
+    SNAPSHOT_SUBSCRIBE = 2,  // the subscription or format changed
+    SNAPSHOT_REQUEST = 3,    // the client asked with {"type":"resync"}
+    SNAPSHOT_OVERFLOW = 4    // messages for the client were discarded
+};
+
+static const unsigned char SYMBOLS_FULL = 0x01;
+static const size_t BINARY_RECORD_SIZE = 56;
+static const size_t SNAPSHOT_MARKER_SIZE = 16;
+
+struct SymbolEntry {
+    int kind;
+    SymbolId id;
+    std::string name;
+};
+
+// Write BINARY_RECORD_SIZE bytes into out
+void encode_market_data(const MarketData& data, unsigned char* out);
+void encode_opportunity(const ArbitrageOpportunity& opp, unsigned char* out);
+
+// Writes SNAPSHOT_MARKER_SIZE bytes into out
+void encode_snapshot_marker(int phase, int reason, uint32_t records, uint64_t sequence, unsigned char* out);
+
+// Appends a symbols message naming market IDs [market_begin, market_end)
+// and event IDs [event_begin, event_end) from the process-wide tables
+void encode_symbols(std::string& out, bool full, SymbolId market_begin, SymbolId market_end,
+                    SymbolId event_begin, SymbolId event_end);
+
+// For consumers. False if the message is truncated or of another type.
+bool decode_market_data(const unsigned char* in, size_t length, MarketData& data);
+bool decode_opportunity(const unsigned char* in, size_t length, ArbitrageOpportunity& opp);
+bool decode_symbols(const unsigned char* in, size_t length, bool& full, std::vector<SymbolEntry>& entries);
+bool decode_snapshot_marker(const unsigned char* in, size_t length, int& phase, int& reason, uint32_t& records,
+                            uint64_t& sequence);
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "types.h"
+
+struct ConflatorStats {
+    unsigned long long offered;    // updates handed in
+    unsigned long long emitted;    // updates passed on
+    unsigned long long unchanged;  // dropped: same quote as clients already have
+    unsigned long long coalesced;  // dropped: superseded while waiting for the rate limit
+    size_t pending;                // markets holding an update back right now
+    
+    ConflatorStats() {
+        offered = 0;
+        emitted = 0;
+        unchanged = 0;
+        coalesced = 0;
+        pending = 0;
+    }
+};
+
+// Throttles the market_data stream on its way to subscribers; the engine
+// should be fed before it, since it holds updates back and drops some.
+//
+// Per market, an update whose quote (bid, ask and their sizes) matches the
+// latest one is dropped, and changes are passed on at most once per
+// Config::conflate_interval_ms: the first change after a quiet spell goes
+// out at once, changes inside the interval replace each other and the
+// survivor goes out when the interval is up, from a flusher thread. So
+// clients always end up with every market's latest quote, at a bounded
+// rate however bursty the feed is. An interval of 0 only drops unchanged
+// quotes.
+class Conflator {
+public:
+    Conflator(Config* config);
+    ~Conflator();
+    
+    bool start();
+    void stop();
+    
+    // Safe from any thread. The update is copied; its book isn't kept.
+    void offer(const MarketData* data);
+    
+    void set_emit_function(void (*func)(MarketData*));
+    ConflatorStats stats();
+    
+private:
+    Config* config;
+    void (*emit_callback)(MarketData*);
+    void* state;
+};
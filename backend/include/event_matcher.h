@@ -0,0 +1,81 @@
+#pragma once
+
+#include "symbol_table.h"
+#include <string>
+#include <vector>
+
+struct EventContract {
+    int venue;           // Market
+    SymbolId market_id;
+};
+
+struct EventMatcherStats {
+    size_t contracts;       // venue contracts assigned an event
+    size_t events;          // canonical events
+    size_t shared_events;   // events quoted on more than one venue
+    size_t mapped;          // contracts placed by the mapping file
+    size_t fuzzy;           // contracts joined to another venue's event on similarity
+    
+    EventMatcherStats() {
+        contracts = 0;
+        events = 0;
+        shared_events = 0;
+        mapped = 0;
+        fuzzy = 0;
+    }
+};
+
+// Assigns venue contracts to canonical events. The engine only pairs
+// markets within an event, and each venue words the same question its own
+// way, so feeds ask the matcher for a contract's event ID at discovery
+// instead of interning their own question text.
+//
+// A contract named in the mapping file always gets the event the file
+// gives it. Any other contract's question is normalised (case, punctuation,
+// plurals, month names, thousands separators, filler words) and looked up:
+// an identical normalised question means the same event; otherwise the
+// question is scored against every indexed question that shares a token,
+// through an inverted index, by IDF-weighted token overlap (Dice). The best
+// event above the threshold wins, provided it has no contract from the same
+// venue yet and the two questions don't conflict: neither conflicting
+// numbers (a $100k and a $150k Bitcoin market are different events) nor
+// opposite sides ("above" / "below", "before" / "after", "win" / "not
+// win"), either of which scores 0. Failing that the contract starts a new
+// event named after its question.
+//
+// Answers are cached per contract, so rediscovery is a lookup. Safe from
+// any thread; matching takes a mutex, which is fine at discovery rates.
+class EventMatcher {
+public:
+    EventMatcher();
+    ~EventMatcher();
+    
+    // JSON: {"events": [{"name": "...", "contracts": [{"venue": "kalshi",
+    // "id": "KXFED-26DEC"}, ...]}, ...]}. Venues are polymarket (token ID),
+    // kalshi (ticker) and predictit (contract ID). Load before the feeds
+    // start; logs and returns false if the file can't be read.
+    bool load_mapping(const std::string& path);
+    
+    // Minimum similarity in (0, 1] for a fuzzy match
+    void set_threshold(double threshold);
+    
+    SymbolId match(int venue, SymbolId market_id, const std::string& question);
+    
+    // The event -> contracts table built up by match()
+    std::vector<EventContract> contracts(SymbolId event_id);
+    
+    // Similarity of two questions as match() scores them, with the current
+    // token weights; 0 when their numbers conflict
+    double similarity(const std::string& a, const std::string& b);
+    
+    EventMatcherStats stats();
+    
+    // How feeds intern a contract's market ID, e.g. "predictit-<id>"
+    static std::string market_key(int venue, const std::string& id);
+    
+private:
+    void* state;
+};
+
+// Process-wide matcher shared by the feeds
+EventMatcher& event_matcher();
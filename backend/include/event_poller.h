@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+
+enum PollFlags {
+    POLL_READABLE = 1,
+    POLL_WRITABLE = 2,
+    POLL_CLOSED = 4  // hangup or socket error; reported whether asked for or not
+};
+
+struct PollEvent {
+    int fd;
+    int events;
+};
+
+// Level-triggered readiness for a set of descriptors: epoll on Linux,
+// poll() everywhere else. Each poller belongs to one thread.
+class EventPoller {
+public:
+    EventPoller();
+    ~EventPoller();
+    
+    bool add(int fd, int events);
+    bool modify(int fd, int events);
+    void remove(int fd);
+    
+    // Blocks up to timeout_ms (-1 = forever) and fills ready with the
+    // descriptors that have something to report. Returns the count, or -1.
+    int wait(std::vector<PollEvent>& ready, int timeout_ms);
+    
+    // "epoll" or "poll"
+    static const char* backend();
+    
+private:
+    void* state;
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "types.h"
+#include "pricing_kernel.h"
+#include <string>
+
+// Per-leg fee coefficients for taking liquidity under a schedule. Detection
+// always crosses the spread, so maker fees play no part here.
+//
+// Buying YES at p pays taker_rate * p + taker_curve * p * (1 - p), plus
+// profit_rate on the 1 - p it wins. Selling YES at p is buying NO at 1 - p:
+// the same notional and curve fees, and profit_rate on the p it wins. Each
+// leg is charged its profit and withdrawal fees as if it were the one that
+// pays out; only one does, so this errs on the side of missing an
+// opportunity rather than reporting one that loses money.
+LegFee buy_leg_fee(const FeeSchedule& schedule);
+LegFee sell_leg_fee(const FeeSchedule& schedule);
+
+// Overrides from a JSON file keyed by venue name (MARKET_NAMES), e.g.
+// {"kalshi": {"taker_curve": 0.07}, "polymarket": {"taker_rate": 0.01}}.
+// Venues and fields the file leaves out keep their values in schedules.
+// Logs and returns false, leaving schedules untouched, if the file can't
+// be read or a value isn't a number in [0, 1).
+bool load_fee_schedules(const std::string& path, FeeSchedule* schedules);
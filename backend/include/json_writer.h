@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <stddef.h>
+
+// Longest text format_double() produces, without a terminator
+static const size_t MAX_DOUBLE_CHARS = 32;
+
+// Shortest decimal that parses back to exactly `value`, written to out
+// (at least MAX_DOUBLE_CHARS bytes, not NUL-terminated). Returns the
+// length, or 0 for NaN and infinities, which JSON can't represent. Short
+// decimals, which prices and sizes almost always are, take an exact integer
+// path; everything else goes through Grisu2, which always round-trips and
+// is shortest for all but a tiny fraction of inputs. Layout follows
+// JavaScript: plain notation from 1e-7 to 1e21, scientific outside.
+size_t format_double(double value, char* out);
+
+// Streaming JSON writer appending into a buffer it owns. clear() keeps the
+// buffer's capacity, so a writer that is reused (one per thread, say)
+// stops allocating once it has seen its largest message. Commas are placed
+// automatically; strings are escaped per RFC 8259 and bytes >= 0x80 pass
+// through untouched, so UTF-8 survives as is.
+class JsonWriter {
+public:
+    JsonWriter();
+    
+    void clear();
+    
+    void begin_object();
+    void end_object();
+    void begin_array();
+    void end_array();
+    
+    // Inside an object, every value is preceded by its key
+    void key(const char* name);
+    
+    void string(const char* value, size_t length);
+    void string(const std::string& value);
+    void number(double value);  // null for NaN and infinities
+    void integer(long long value);
+    void boolean(bool value);
+    void null();
+    
+    const std::string& str() const { return buffer; }
+    const char* data() const { return buffer.data(); }
+    size_t size() const { return buffer.size(); }
+    
+private:
+    static const int MAX_DEPTH = 32;
+    
+    void separate();
+    void append_escaped(const char* value, size_t length);
+    
+    std::string buffer;
+    int depth;
+    bool has_member[MAX_DEPTH];
+    bool after_key;
+};
@@ -1,22 +1,83 @@
 #pragma once
 
 #include "types.h"
+#include <atomic>
 
-class PolymarketClient {
+// One venue's feed. connect() starts the feed's own worker thread, which
+// discovers the venue's markets and then streams or polls their books,
+// handing every update to the update function on that thread. Feeds share
+// nothing but the symbol tables, so several run side by side, each on its
+// own HTTP pool and sockets; the update function must be safe from all of
+// them at once (Pipeline::submit is).
+//
+// Updates are normalised whatever the venue's units: prices are the YES
+// outcome's probability in [0, 1], sizes are contracts, `market` is the
+// venue's Market value, and a market whose book went away is reported once
+// with is_valid false.
+class MarketDataClient {
 public:
-    PolymarketClient();
-    ~PolymarketClient();
+    MarketDataClient(Config* config, int market, const char* name);
+    virtual ~MarketDataClient();
     
     bool connect();
     void disconnect();
     bool is_connected();
     void set_update_function(void (*func)(MarketData*));
     
-    bool connected;
+    int market() const { return venue; }
+    const char* name() const { return venue_name; }
+    
+    Config* config;
+    std::atomic<bool> connected;
     void (*update_callback)(MarketData*);
     
+protected:
+    // The feed itself, on the worker thread; returns once `connected` is
+    // cleared. Subclasses must call disconnect() in their destructor, so
+    // the thread is gone before their part of the object is.
+    virtual void run() = 0;
+    
 private:
+    static void* thread_function(void* arg);
+    
+    int venue;
+    const char* venue_name;
     void* worker_thread;
-    static const char* WEBSOCKET_URL;
 };
 
+// Gamma API discovery; books from the CLOB market channel, or polled over
+// REST when Config::polymarket_ws_url is empty
+class PolymarketClient : public MarketDataClient {
+public:
+    PolymarketClient(Config* config);
+    ~PolymarketClient();
+    
+protected:
+    void run();
+};
+
+// Open markets from the trade API, with each book polled over REST every
+// Config::poll_interval_ms. Kalshi books list resting bids for YES and for
+// NO in cents; a NO bid at p is a YES ask at 100 - p.
+class KalshiClient : public MarketDataClient {
+public:
+    KalshiClient(Config* config);
+    ~KalshiClient();
+    
+protected:
+    void run();
+};
+
+// PredictIt's all-markets snapshot, one request per
+// Config::predictit_poll_interval_ms, one market per contract. It carries
+// best prices but no depth, so sizes are what the per-contract position
+// limit buys at that price, and only contracts whose quote changed since
+// the last snapshot are passed on.
+class PredictItClient : public MarketDataClient {
+public:
+    PredictItClient(Config* config);
+    ~PredictItClient();
+    
+protected:
+    void run();
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "orderbook_parser.h"
+#include "pricing_kernel.h"
+#include <vector>
+#include <stddef.h>
+
+enum BookSide {
+    BOOK_BID,
+    BOOK_ASK
+};
+
+// Price-level (L2) book for one market. Each side is a flat array sorted so
+// the best level is LAST: bids ascending, asks descending. That's the order
+// the CLOB sends ladders in, so a snapshot is a straight copy, and most
+// deltas land at or near the top of book, where inserting or erasing only
+// moves a few trailing elements. Levels with size 0 are never stored.
+class OrderBook {
+public:
+    OrderBook();
+    
+    void clear();
+    
+    // Replaces both sides. Input may be in any order; already-sorted input
+    // (the common case) skips the sort.
+    void set_snapshot(const PriceLevel* bids, size_t bid_count, const PriceLevel* asks, size_t ask_count);
+    void set_snapshot(const ParsedBook& book);
+    
+    // Sets the size resting at price on one side; size <= 0 removes the level
+    void apply_delta(int side, double price, double size);
+    
+    // Zeros when the side is empty
+    void top(double& best_bid, double& best_ask, double& bid_size, double& ask_size) const;
+    
+    const PriceLevel* bids() const { return bid_levels.empty() ? NULL : &bid_levels[0]; }
+    const PriceLevel* asks() const { return ask_levels.empty() ? NULL : &ask_levels[0]; }
+    size_t bid_count() const { return bid_levels.size(); }
+    size_t ask_count() const { return ask_levels.size(); }
+    
+private:
+    std::vector<PriceLevel> bid_levels;
+    std::vector<PriceLevel> ask_levels;
+};
+
+// Outcome of crossing one book's asks against another's bids
+struct SweepResult {
+    double size;           // total size where every unit clears the threshold
+    double buy_cost;       // sum of ask price * size taken
+    double sell_proceeds;  // sum of bid price * size hit
+    size_t levels;         // price-level pairs touched
+    
+    SweepResult() {
+        size = 0.0;
+        buy_cost = 0.0;
+        sell_proceeds = 0.0;
+        levels = 0;
+    }
+};
+
+// Walks buy's asks up from the best and sell's bids down from the best,
+// matching size level by level while the marginal pair's net profit (see
+// pair_profit) stays above min_profit. Profit per unit only falls as the
+// walk goes deeper, so the result is the largest size whose every unit is
+// profitable; buy_cost / size and sell_proceeds / size are the VWAPs.
+void sweep_books(const OrderBook& buy, const OrderBook& sell, const LegFee& buy_fee, const LegFee& sell_fee, double min_profit, SweepResult& result);
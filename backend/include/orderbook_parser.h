@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+
+static const size_t MAX_BOOK_LEVELS = 256;
+
+struct PriceLevel {
+    double price;
+    double size;
+};
+
+// Both ladders of a parsed book, in the order the venue sent them. Storage
+// is inline so a caller can keep one ParsedBook around and parse into it
+// repeatedly without touching the heap. A deeper ladder keeps its last
+// MAX_BOOK_LEVELS levels, where the CLOB puts the best prices, and sets
+// `truncated`; parse_orderbook fails instead if a level it dropped was
+// better than every one it kept.
+struct ParsedBook {
+    PriceLevel bids[MAX_BOOK_LEVELS];
+    PriceLevel asks[MAX_BOOK_LEVELS];
+    size_t bid_count;
+    size_t ask_count;
+    bool truncated;
+};
+
+// Single pass over a CLOB book object ({"bids":[{"price":"0.5","size":"10"},
+// ...],"asks":[...], ...}). Accepts "buys"/"sells" as aliases and numbers
+// quoted or bare; every other member is skipped. Returns false if the text
+// is not a well-formed object.
+bool parse_orderbook(const char* data, size_t length, ParsedBook& book);
+
+// Best bid (highest price) and best ask (lowest price) with their sizes;
+// zeros when a side is empty. Venues differ in how they sort ladders, so
+// this doesn't assume an order.
+void top_of_book(const ParsedBook& book, double& best_bid, double& best_ask, double& bid_size, double& ask_size);
+
+// Parses a JSON number at [p, end), advancing p past it. Results are
+// correctly rounded: short decimals (the usual case for prices and sizes)
+// take an exact integer fast path, anything else falls back to strtod.
+bool parse_decimal(const char*& p, const char* end, double& out);
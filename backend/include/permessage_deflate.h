@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+#include <stddef.h>
+
+// permessage-deflate (RFC 7692): each data message's payload is a raw
+// DEFLATE stream flushed with Z_SYNC_FLUSH and stripped of the trailing
+// 00 00 FF FF, sent with RSV1 set on its first frame.
+//
+// With context takeover the compressor keeps its 32K window from message to
+// message, so repeated field names and event names shrink to back-references;
+// without it every message stands alone. A message compressed from a reset
+// window references nothing earlier, so a decoder takes it whatever it has
+// seen before: that is what lets one compressed frame serve many clients.
+
+// Picks the first permessage-deflate offer in a Sec-WebSocket-Extensions
+// value that we can honour and sets the extension response for it. We
+// always ask the client not to take over its own context, so one inflater
+// can serve a whole reactor, and keep ours only if `allow_takeover` and the
+// client didn't forbid it; `takeover` reports which. Offers that limit our
+// window below 15 bits are declined.
+bool negotiate_permessage_deflate(const std::string& offered, bool allow_takeover, std::string& response,
+                                  bool& takeover);
+
+class MessageDeflater {
+public:
+    // A standalone deflater, reset for every message, uses a smaller hash
+    // table: clearing the default one costs more than compressing a
+    // typical market_data message
+    MessageDeflater(int level, bool standalone);
+    ~MessageDeflater();
+    
+    // Appends the compressed payload to out. With `reset`, the window starts
+    // empty, which is how every message is compressed without takeover.
+    bool compress(const char* data, size_t length, std::string& out, bool reset);
+    
+private:
+    MessageDeflater(const MessageDeflater&);
+    MessageDeflater& operator=(const MessageDeflater&);
+    
+    void* stream;
+};
+
+// Decompresses messages whose sender doesn't take over its context
+class MessageInflater {
+public:
+    MessageInflater();
+    ~MessageInflater();
+    
+    // Replaces out with the message; false if it is corrupt or would inflate
+    // past `limit` bytes
+    bool decompress(const char* data, size_t length, std::string& out, size_t limit);
+    
+private:
+    MessageInflater(const MessageInflater&);
+    MessageInflater& operator=(const MessageInflater&);
+    
+    void* stream;
+};
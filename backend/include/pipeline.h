@@ -0,0 +1,102 @@
+#pragma once
+
+#include "types.h"
+#include "arbitrage_engine.h"
+
+struct StageStats {
+    unsigned long long items;    // taken off the stage's input queue
+    unsigned long long stalls;   // pushes that found the queue full and had to wait
+    size_t depth;                // waiting right now
+    size_t peak_depth;           // most ever seen waiting
+    size_t capacity;
+    double wait_p50_us;          // time from push to pop
+    double wait_p99_us;
+    double wait_max_us;
+    
+    StageStats() {
+        items = 0;
+        stalls = 0;
+        depth = 0;
+        peak_depth = 0;
+        capacity = 0;
+        wait_p50_us = 0;
+        wait_p99_us = 0;
+        wait_max_us = 0;
+    }
+};
+
+struct PipelineStats {
+    StageStats engine;      // feed threads -> engine thread
+    StageStats publisher;   // engine thread -> publisher thread
+    unsigned long long opportunities;
+    
+    // From submit() to the opportunity being found, and to its publish
+    // callback returning
+    double detect_p50_us;
+    double detect_p99_us;
+    double detect_max_us;
+    double publish_p50_us;
+    double publish_p99_us;
+    double publish_max_us;
+    
+    PipelineStats() {
+        opportunities = 0;
+        detect_p50_us = 0;
+        detect_p99_us = 0;
+        detect_max_us = 0;
+        publish_p50_us = 0;
+        publish_p99_us = 0;
+        publish_max_us = 0;
+    }
+};
+
+// Moves detection and publishing off the feed threads. A feed thread's
+// submit() only writes the quote and its book into the engine's store and
+// pushes the tick onto a lock-free MPSC ring; the engine thread pops ticks
+// and checks each market's pairs, then pushes the quote and any
+// opportunities onto an SPSC ring for the publisher thread, which runs the
+// quote and opportunity callbacks (conflation, broadcast, logging). A slow
+// client or a burst of log lines then holds up neither the feed's socket
+// nor detection.
+//
+// Full queues push back rather than drop: the pushing thread yields until
+// there is room, and the wait counts as a stall. Idle consumers spin
+// briefly and then sleep until a push wakes them. Either thread can be
+// pinned to a CPU with Config::engine_cpu / publisher_cpu.
+//
+// Before start() and after stop(), submit() runs all three stages inline
+// on the caller's thread.
+class Pipeline {
+public:
+    Pipeline(Config* config, ArbitrageEngine* engine);
+    ~Pipeline();
+    
+    bool start();
+    
+    // Drains both queues before returning; stop the feeds first
+    void stop();
+    
+    // Safe from any number of feed threads. The update is copied and its
+    // book stored, so the caller may reuse both on return.
+    void submit(const MarketData* data);
+    
+    // Queues a check of every pair, for when prices haven't moved but the
+    // engine's view of them has (ArbitrageEngine::set_fee_schedules). Runs
+    // on the engine thread after the ticks already queued; what it finds
+    // is published like any other opportunity.
+    void rescan();
+    
+    // Called on the publisher thread, for every submitted quote in order and
+    // for each opportunity after the quote that produced it
+    void set_quote_function(void (*func)(MarketData*));
+    void set_opportunity_function(void (*func)(ArbitrageOpportunity*));
+    
+    PipelineStats stats();
+    
+private:
+    Config* config;
+    ArbitrageEngine* engine;
+    void (*quote_callback)(MarketData*);
+    void (*opportunity_callback)(ArbitrageOpportunity*);
+    void* state;
+};
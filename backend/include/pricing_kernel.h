@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stddef.h>
+
+// Fee on one leg of a $1 contract at price p: fixed + linear * p +
+// quadratic * p^2. Every venue's schedule reduces to these three numbers
+// per side (see fee_model.h), so nothing downstream branches on venue.
+struct LegFee {
+    double fixed;
+    double linear;
+    double quadratic;
+};
+
+inline double leg_fee(double price, const LegFee& fee) {
+    return fee.fixed + price * (fee.linear + price * fee.quadratic);
+}
+
+// Net profit ratio for buying at buy_price and selling at sell_price, with
+// each leg's fee per contract already worked out by leg_fee. Every
+// evaluator (the engine's per-tick path, both batch kernels and the depth
+// sweep) goes through this exact sequence of operations so results agree
+// bit for bit; everything is built with -ffp-contract=off so the compiler
+// can't fuse it differently per path.
+inline double pair_profit(double buy_price, double sell_price, double buy_fee, double sell_fee) {
+    if (buy_price >= sell_price) {
+        return 0.0;
+    }
+    
+    double net_profit = sell_price - buy_price - buy_fee - sell_fee;
+    
+    if (net_profit <= 0.0) {
+        return 0.0;
+    }
+    
+    return net_profit / buy_price;
+}
+
+inline double pair_max_size(double ask_size, double bid_size) {
+    return ask_size < bid_size ? ask_size : bid_size;
+}
+
+// Packed (buy leg, sell leg) inputs for many pairs at once; element i of
+// every array describes pair i.
+struct PairBatch {
+    const double* buy_ask;
+    const double* sell_bid;
+    const double* ask_size;
+    const double* bid_size;
+    const double* buy_fee;    // per contract, leg_fee of buy_ask
+    const double* sell_fee;   // per contract, leg_fee of sell_bid
+    size_t count;
+};
+
+// Writes profit[i] and max_size[i] for every pair, using AVX2 when the CPU
+// supports it and the scalar loop otherwise.
+void evaluate_pairs(const PairBatch& batch, double* profit, double* max_size);
+void evaluate_pairs_scalar(const PairBatch& batch, double* profit, double* max_size);
+
+// "avx2" or "scalar", whichever evaluate_pairs dispatches to
+const char* pricing_kernel_name();
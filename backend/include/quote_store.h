@@ -0,0 +1,65 @@
+#pragma once
+
+#include "types.h"
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+
+static const uint32_t INVALID_SLOT = 0xFFFFFFFF;
+
+// Consistent top-of-book read for one slot, taken without holding any lock
+struct Quote {
+    SymbolId market_id;
+    int market;
+    double best_bid;
+    double best_ask;
+    double bid_size;
+    double ask_size;
+    long long timestamp;
+};
+
+// Flat structure-of-arrays quote store. Each field lives in its own
+// contiguous, cache-line-aligned array indexed by slot, and slots are handed
+// out in per-event blocks so walking an event's markets touches adjacent
+// memory. Capacity is fixed at construction: arrays never move, which is
+// what lets readers index them without a lock.
+//
+// Every slot is guarded by a seqlock. write() may be called concurrently
+// for the same slot from several threads; read() retries until it sees an
+// untorn quote. allocate()/release() change slot ownership and must be
+// serialised by the caller.
+class QuoteStore {
+public:
+    QuoteStore(size_t capacity);
+    ~QuoteStore();
+    
+    uint32_t allocate(SymbolId event_id);
+    void release(SymbolId event_id, uint32_t slot);
+    
+    void write(uint32_t slot, const MarketData* data);
+    void read(uint32_t slot, Quote& out) const;
+    
+    size_t capacity() const;
+    size_t size() const;
+    
+private:
+    struct EventBlocks {
+        uint32_t next;
+        uint32_t end;
+        uint32_t block_size;
+        std::vector<uint32_t> free_slots;
+    };
+    
+    size_t slot_capacity;
+    size_t used;
+    std::vector<EventBlocks> blocks;
+    
+    std::atomic<uint32_t>* seq;
+    std::atomic<SymbolId>* market_id;
+    std::atomic<int>* market;
+    std::atomic<double>* best_bid;
+    std::atomic<double>* best_ask;
+    std::atomic<double>* bid_size;
+    std::atomic<double>* ask_size;
+    std::atomic<long long>* timestamp;
+};
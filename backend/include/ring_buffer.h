@@ -0,0 +1,185 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bounded lock-free queues for handing items between pipeline threads.
+// Both are fixed arrays of slots allocated once, with capacity rounded up
+// to a power of two; push and pop copy items in and out and never block,
+// returning false when the queue is full or empty so the caller picks the
+// waiting strategy. The producer and consumer positions are padded onto
+// their own cache lines so the two sides don't bounce one line between
+// cores (padding rather than alignas: plain new doesn't honour over-aligned
+// members before C++17).
+
+static const size_t RING_CACHE_LINE = 64;
+
+static inline size_t ring_capacity(size_t requested) {
+    size_t capacity = 2;
+    while (capacity < requested) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+// One producer thread, one consumer thread. Each side keeps a private copy
+// of the other's position and only reloads it when the copy says the queue
+// is full (or empty), so in steady state a push or pop touches no shared
+// line but the slot itself.
+template <typename T>
+class SpscRing {
+public:
+    SpscRing(size_t capacity) {
+        mask = ring_capacity(capacity) - 1;
+        slots = new T[mask + 1];
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+        cached_head = 0;
+        cached_tail = 0;
+    }
+    
+    ~SpscRing() {
+        delete[] slots;
+    }
+    
+    // Producer thread only
+    bool push(const T& item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - cached_head > mask) {
+            cached_head = head.load(std::memory_order_acquire);
+            if (t - cached_head > mask) {
+                return false;
+            }
+        }
+        slots[t & mask] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+    
+    // Consumer thread only
+    bool pop(T& item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == cached_tail) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (h == cached_tail) {
+                return false;
+            }
+        }
+        item = slots[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+    
+    // Exact from either end's own thread, a snapshot from anywhere else
+    size_t size() const {
+        size_t h = head.load(std::memory_order_acquire);
+        size_t t = tail.load(std::memory_order_acquire);
+        return t >= h ? t - h : 0;
+    }
+    
+    size_t capacity() const { return mask + 1; }
+    
+private:
+    SpscRing(const SpscRing&);
+    SpscRing& operator=(const SpscRing&);
+    
+    T* slots;
+    size_t mask;
+    char pad0[RING_CACHE_LINE];
+    
+    std::atomic<size_t> head;  // consumer
+    size_t cached_tail;
+    char pad1[RING_CACHE_LINE - sizeof(size_t) * 2];
+    
+    std::atomic<size_t> tail;  // producer
+    size_t cached_head;
+    char pad2[RING_CACHE_LINE - sizeof(size_t) * 2];
+};
+
+// Any number of producer threads, one consumer. Each slot carries a
+// sequence number saying whose turn it is (Vyukov's bounded queue):
+// producers claim a position with one CAS on the tail and publish by
+// bumping the slot's sequence, so a producer stalled mid-copy holds up only
+// the consumer reaching that slot, never the other producers.
+template <typename T>
+class MpscRing {
+public:
+    MpscRing(size_t capacity) {
+        mask = ring_capacity(capacity) - 1;
+        slots = new Slot[mask + 1];
+        for (size_t i = 0; i <= mask; i++) {
+            slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+    }
+    
+    ~MpscRing() {
+        delete[] slots;
+    }
+    
+    // Any thread
+    bool push(const T& item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &slots[t & mask];
+            size_t seq = slot->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)t;
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(t, t + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;  // the consumer hasn't freed this slot from the last lap
+            } else {
+                t = tail.load(std::memory_order_relaxed);
+            }
+        }
+        slot->item = item;
+        slot->seq.store(t + 1, std::memory_order_release);
+        return true;
+    }
+    
+    // Consumer thread only
+    bool pop(T& item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        Slot* slot = &slots[h & mask];
+        if (slot->seq.load(std::memory_order_acquire) != h + 1) {
+            return false;  // empty, or the next producer is still copying
+        }
+        item = slot->item;
+        slot->seq.store(h + mask + 1, std::memory_order_release);
+        head.store(h + 1, std::memory_order_relaxed);
+        return true;
+    }
+    
+    // A snapshot; counts claimed positions, including pushes still copying
+    size_t size() const {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t t = tail.load(std::memory_order_relaxed);
+        return t >= h ? t - h : 0;
+    }
+    
+    size_t capacity() const { return mask + 1; }
+    
+private:
+    MpscRing(const MpscRing&);
+    MpscRing& operator=(const MpscRing&);
+    
+    struct Slot {
+        std::atomic<size_t> seq;
+        T item;
+    };
+    
+    Slot* slots;
+    size_t mask;
+    char pad0[RING_CACHE_LINE];
+    
+    std::atomic<size_t> head;  // consumer
+    char pad1[RING_CACHE_LINE - sizeof(size_t)];
+    
+    std::atomic<size_t> tail;  // producers
+    char pad2[RING_CACHE_LINE - sizeof(size_t)];
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <stdint.h>
+#include <stddef.h>
+
+enum PushResult {
+    PUSH_QUEUED,
+    PUSH_COALESCED,  // replaced an unsent message with the same key
+    PUSH_DROPPED,    // queue was full; the oldest unsent message was discarded
+    PUSH_OVERFLOW    // queue was full and the policy is to disconnect
+};
+
+// A framed message, built once per broadcast and shared by every queue it
+// is pushed onto
+typedef std::shared_ptr<const std::string> SharedFrame;
+
+// Bounded FIFO of frames waiting for one client's socket, kept in a fixed
+// ring of slots. Pushing a frame only takes a reference.
+//
+// What happens when a message arrives for a client that isn't keeping up
+// depends on the policy (see SlowConsumerPolicy in types.h). Under
+// SLOW_COALESCE a message with a non-zero key replaces any queued message
+// with the same key, so a lagging client gets the latest value per market
+// instead of a backlog of stale ones. The old entry is left as a tombstone
+// and the new one goes to the back, so frames still leave in the order
+// they were pushed and a client's seq never goes backwards. Messages leave
+// the queue whole; once popped they belong to the caller.
+class SendQueue {
+public:
+    SendQueue(size_t capacity, int policy);
+    
+    int push(const SharedFrame& frame, uint64_t key);
+    
+    // Hands over the oldest frame; false when empty
+    bool pop(SharedFrame& frame);
+    void clear();
+    
+    size_t size() const { return live; }
+    bool empty() const { return live == 0; }
+    size_t peak() const { return peak_size; }
+    
+private:
+    struct Entry {
+        SharedFrame frame;  // null for a tombstone
+        uint64_t key;
+    };
+    
+    void forget_front();
+    void skip_tombstones();
+    void compact();
+    
+    // Twice the capacity, so that when the ring fills at least half of it
+    // is tombstones and compacting stays amortised O(1) per push
+    std::vector<Entry> entries;
+    size_t capacity;
+    size_t live;  // queued frames, not counting tombstones
+    size_t head;  // sequence number of the oldest entry
+    size_t tail;  // sequence number the next push gets
+    int policy;
+    size_t peak_size;
+    std::unordered_map<uint64_t, size_t> latest;  // key -> sequence, SLOW_COALESCE only
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <stdint.h>
+
+typedef uint32_t SymbolId;
+
+static const SymbolId INVALID_SYMBOL = 0xFFFFFFFF;
+
+// Interns strings (token IDs, event questions) into dense 32-bit IDs so the
+// hot path hashes and copies integers. IDs are assigned in first-seen
+// order and never reused; interning takes a mutex, but resolving an ID back
+// to its string is lock-free and the returned reference stays valid for the
+// lifetime of the table.
+class SymbolTable {
+public:
+    SymbolTable();
+    ~SymbolTable();
+    
+    SymbolId intern(const std::string& name);
+    SymbolId find(const std::string& name);
+    const std::string& name(SymbolId id);
+    size_t size();
+    
+private:
+    void* table;
+};
+
+// Process-wide tables, populated at market discovery
+SymbolTable& market_symbols();
+SymbolTable& event_symbols();
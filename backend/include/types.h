@@ -1,6 +1,9 @@
 #pragma once
 
 #include <string>
+#include "symbol_table.h"
+
+class OrderBook;
 
 enum Market {
     MARKET_POLYMARKET,
@@ -8,45 +11,110 @@ enum Market {
     MARKET_PREDICTIT
 };
 
+static const int NUM_MARKETS = MARKET_PREDICTIT + 1;
+
+// Venue names as config files spell them, indexed by Market
+static const char* const MARKET_NAMES[NUM_MARKETS] = {"polymarket", "kalshi", "predictit"};
+
+// What the WebSocket server does when a client's send queue is full. A
+// client that loses messages isn't left with stale quotes: its backlog is
+// replaced by a fresh snapshot (see websocket_server.h).
+enum SlowConsumerPolicy {
+    SLOW_DROP_OLDEST,  // discard the backlog and resync
+    SLOW_COALESCE,     // keep only the latest unsent update per market, then resync
+    SLOW_DISCONNECT    // close the connection
+};
+
+// market_id and event_id are interned (see symbol_table.h); resolve them
+// with market_symbols()/event_symbols() only when a string is needed.
 struct MarketData {
-    std::string market_id;
+    SymbolId market_id;
     int market;
-    std::string event_name;
+    SymbolId event_id;
     double best_bid;
     double best_ask;
     double bid_size;
     double ask_size;
+    long long timestamp;  // microseconds since epoch when the book was read
     bool is_valid;
     
+    // Exhaustive set of mutually exclusive outcomes on this venue that the
+    // market belongs to (interned in event_symbols(), like event_id), and
+    // how many outcomes it has: buying one contract of each pays exactly
+    // $1. INVALID_SYMBOL when the feed doesn't know of one.
+    SymbolId group_id;
+    int group_size;
+    
+    // Full depth behind the top-of-book fields, when the feed keeps it.
+    // Borrowed: only valid for the duration of the update callback.
+    const OrderBook* book;
+    
     MarketData() {
-        market_id = "";
+        market_id = INVALID_SYMBOL;
         market = MARKET_POLYMARKET;
-        event_name = "";
+        event_id = INVALID_SYMBOL;
         best_bid = 0.0;
         best_ask = 0.0;
         bid_size = 0.0;
         ask_size = 0.0;
+        timestamp = 0;
         is_valid = false;
+        group_id = INVALID_SYMBOL;
+        group_size = 0;
+        book = NULL;
     }
 };
 
+// A cross-venue pair buys on buy_market and sells on sell_market. An
+// outcome set (legs > 0) buys one contract of each of legs outcomes on one
+// venue: event_id is the set's group_id, both markets are the venue,
+// buy_price is the sum of the asks and sell_price the $1 payout.
 struct ArbitrageOpportunity {
-    std::string event_id;
+    SymbolId event_id;
     int buy_market;
     int sell_market;
     double buy_price;
     double sell_price;
     double profit_percentage;
     double max_size;
+    double avg_buy_price;   // VWAP over max_size; equals buy_price without depth
+    double avg_sell_price;
+    int legs;               // outcome set size; 0 for a cross-venue pair
     
     ArbitrageOpportunity() {
-        event_id = "";
+        event_id = INVALID_SYMBOL;
         buy_market = MARKET_POLYMARKET;
         sell_market = MARKET_POLYMARKET;
         buy_price = 0.0;
         sell_price = 0.0;
         profit_percentage = 0.0;
         max_size = 0.0;
+        avg_buy_price = 0.0;
+        avg_sell_price = 0.0;
+        legs = 0;
+    }
+};
+
+// What a venue charges on a $1 contract bought or sold at price p, as
+// fractions of a dollar: rate * p on the notional, curve * p * (1 - p)
+// for fees that peak at even odds (Kalshi's), profit_rate on the winnings
+// and withdrawal_rate on the payout taken off the venue. See fee_model.h
+// for how these become per-leg costs.
+struct FeeSchedule {
+    double taker_rate;
+    double maker_rate;
+    double taker_curve;
+    double maker_curve;
+    double profit_rate;
+    double withdrawal_rate;
+    
+    FeeSchedule() {
+        taker_rate = 0.0;
+        maker_rate = 0.0;
+        taker_curve = 0.0;
+        maker_curve = 0.0;
+        profit_rate = 0.0;
+        withdrawal_rate = 0.0;
     }
 };
 
@@ -54,12 +122,80 @@ struct Config {
     double min_profit_threshold;
     int update_interval_ms;
     std::string websocket_port;
+    int server_io_threads;  // WebSocket reactor threads
+    size_t server_queue_limit;  // messages buffered per client
+    int server_slow_policy;     // SlowConsumerPolicy
+    int server_dictionary_interval_s;  // full symbol dictionary resent to binary clients
+    int conflate_interval_ms;   // market_data sent to clients at most this often per market
+    bool server_deflate;        // permessage-deflate for clients that offer it
+    bool server_deflate_context_takeover;  // keep the compression window across messages
+    int server_deflate_level;   // zlib level, 1 (fastest) to 9
+    size_t server_deflate_min_size;  // shorter messages go uncompressed
+    int server_opportunity_ttl_s;    // opportunities seen this recently go in snapshots
     bool enable_execution;
+    size_t max_markets;  // quote store capacity, preallocated at startup
+    bool depth_sizing;   // size opportunities by sweeping full books, not top of book
+    size_t pipeline_queue_size;  // ticks (and published items) buffered between pipeline threads
+    int engine_cpu;      // CPU to pin the detection thread to; -1 leaves it to the scheduler
+    int publisher_cpu;   // likewise for the publisher thread
+    FeeSchedule fees[NUM_MARKETS];  // by Market
+    std::string fee_schedule_path;  // JSON overrides for fees, reloaded on SIGHUP; empty = defaults
+    
+    // Venue endpoints; point these at a local mock server for testing
+    std::string polymarket_gamma_url;
+    std::string polymarket_clob_url;
+    std::string polymarket_ws_url;  // market channel; empty = poll REST books
+    std::string kalshi_url;      // trade API base; empty = no Kalshi feed
+    size_t kalshi_max_markets;   // open markets tracked, in the API's order
+    std::string predictit_url;   // all-markets snapshot; empty = no PredictIt feed
+    int predictit_poll_interval_ms;  // the snapshot itself only refreshes about once a minute
+    std::string event_mapping_path;  // curated cross-venue event mapping (JSON); empty = none
+    double event_match_threshold;    // similarity for joining another venue's event, in (0, 1]
+    
+    int http_max_concurrency;  // requests in flight per feed
+    double http_rate_limit;    // requests per second per feed
+    int http_rate_burst;
+    int poll_interval_ms;      // target time between book refresh cycles
     
     Config() {
         min_profit_threshold = 0.01;
         update_interval_ms = 100;
         websocket_port = "8080";
+        server_io_threads = 1;
+        server_queue_limit = 1024;
+        server_slow_policy = SLOW_COALESCE;
+        server_dictionary_interval_s = 30;
+        conflate_interval_ms = 250;
+        server_deflate = true;
+        server_deflate_context_takeover = false;
+        server_deflate_level = 1;
+        server_deflate_min_size = 64;
+        server_opportunity_ttl_s = 60;
         enable_execution = false;
+        max_markets = 65536;
+        depth_sizing = true;
+        pipeline_queue_size = 65536;
+        engine_cpu = -1;
+        publisher_cpu = -1;
+        // Polymarket charges no trading fees on most markets; Kalshi takes
+        // 7% of p * (1 - p) from takers; PredictIt 10% of profits and 5%
+        // of withdrawals
+        fees[MARKET_KALSHI].taker_curve = 0.07;
+        fees[MARKET_PREDICTIT].profit_rate = 0.10;
+        fees[MARKET_PREDICTIT].withdrawal_rate = 0.05;
+        fee_schedule_path = "";
+        polymarket_gamma_url = "https://gamma-api.polymarket.com";
+        polymarket_clob_url = "https://clob.polymarket.com";
+        polymarket_ws_url = "wss://ws-subscriptions-clob.polymarket.com/ws/market";
+        kalshi_url = "https://api.elections.kalshi.com/trade-api/v2";
+        kalshi_max_markets = 200;
+        predictit_url = "https://www.predictit.org/api/marketdata/all/";
+        predictit_poll_interval_ms = 60000;
+        event_mapping_path = "";
+        event_match_threshold = 0.6;
+        http_max_concurrency = 8;
+        http_rate_limit = 20.0;
+        http_rate_burst = 20;
+        poll_interval_ms = 2000;
     }
 };
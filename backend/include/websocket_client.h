@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+
+// Minimal blocking RFC 6455 client for venue streaming APIs. Handles ws://
+// and wss:// (OpenSSL), answers pings, reassembles fragmented messages and
+// reports the close handshake as a disconnect. One thread per client.
+class WebSocketClient {
+public:
+    WebSocketClient();
+    ~WebSocketClient();
+    
+    bool connect(const std::string& url);
+    void close();
+    bool is_open();
+    
+    bool send_text(const std::string& message);
+    
+    // Waits up to timeout_ms for the next complete text or binary message.
+    // Returns 1 when `message` holds one, 0 on timeout and -1 once the
+    // connection is gone.
+    int receive(std::string& message, int timeout_ms);
+    
+private:
+    void* state;
+};
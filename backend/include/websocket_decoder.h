@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+enum DecodeResult {
+    DECODE_MORE,     // no complete message buffered; feed more bytes
+    DECODE_MESSAGE,  // one message or control frame taken off the buffer
+    DECODE_ERROR     // protocol violation; close with error_code()
+};
+
+struct WebSocketMessage {
+    int opcode;       // WS_TEXT or WS_BINARY for a whole message, else the control opcode
+    bool compressed;  // RSV1 was set on its first frame (permessage-deflate)
+    std::string payload;
+    
+    WebSocketMessage() {
+        opcode = 0;
+        compressed = false;
+    }
+};
+
+// Incremental RFC 6455 frame decoder for one connection. Bytes go in as
+// they arrive, in chunks of any size; complete messages come out, with
+// fragments reassembled and control frames (which may arrive between
+// fragments) handed back as soon as they are whole. Payloads are unmasked
+// in place in the buffer, a register at a time.
+//
+// Validation follows the RFC: frames from a client must be masked and from
+// a server must not; reserved bits are errors unless compression allows
+// RSV1 on a first frame; control frames must be unfragmented and at most
+// 125 bytes; continuation frames must continue something and data frames
+// mustn't interrupt a fragmented message. A message over `max_message`
+// bytes fails as soon as its length is known, without buffering it.
+class WebSocketDecoder {
+public:
+    // masked: this side is the server, decoding client frames
+    WebSocketDecoder(bool masked, size_t max_message);
+    
+    void feed(const char* data, size_t length);
+    int next(WebSocketMessage& message);
+    
+    // Set once permessage-deflate has been agreed
+    void allow_compression(bool allow) { compression = allow; }
+    
+    // Close code for the last DECODE_ERROR
+    int error_code() const { return error; }
+    size_t buffered() const { return buffer.size() - head; }
+    void reset();
+    
+private:
+    int fail(int code);
+    
+    std::string buffer;
+    size_t head;              // start of the first unconsumed frame
+    std::string fragments;    // a fragmented message so far
+    int fragment_opcode;      // 0 when no fragmented message is open
+    bool fragment_compressed;
+    bool masked;
+    bool compression;
+    size_t max_message;
+    int error;
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+// RFC 6455 pieces shared by the server and the market-data client
+
+std::string base64_encode(const unsigned char* data, size_t length);
+void sha1(const unsigned char* data, size_t length, unsigned char* hash);
+
+// Sec-WebSocket-Accept value for a client's Sec-WebSocket-Key
+std::string websocket_accept_key(const std::string& key);
+
+enum WebSocketOpcode {
+    WS_CONTINUATION = 0x0,
+    WS_TEXT = 0x1,
+    WS_BINARY = 0x2,
+    WS_CLOSE = 0x8,
+    WS_PING = 0x9,
+    WS_PONG = 0xA
+};
+
+// Status codes a close frame carries (RFC 6455 7.4.1)
+enum WebSocketCloseCode {
+    WS_CLOSE_NORMAL = 1000,
+    WS_CLOSE_GOING_AWAY = 1001,
+    WS_CLOSE_PROTOCOL_ERROR = 1002,
+    WS_CLOSE_UNSUPPORTED = 1003,
+    WS_CLOSE_NO_STATUS = 1005,   // never sent: the peer's close had no code
+    WS_CLOSE_INVALID_DATA = 1007,
+    WS_CLOSE_TOO_BIG = 1009
+};
+
+// First-byte flag marking a permessage-deflate message (RFC 7692)
+static const int WS_RSV1 = 0x40;
+
+static const size_t WS_MAX_HEADER = 14;
+
+// Writes an unmasked (server-to-client) frame header with FIN set into out,
+// which must hold WS_MAX_HEADER bytes; opcode may carry WS_RSV1. Returns the
+// header length.
+size_t websocket_frame_header(unsigned char* out, int opcode, uint64_t payload_length);
+
+// XORs the 4-byte masking key over data in place, starting at key byte 0;
+// masking and unmasking are the same operation. Works a vector register or
+// a 64-bit word at a time.
+void websocket_apply_mask(char* data, size_t length, const unsigned char* mask);
+
+// True for a code a peer may put in a close frame
+bool websocket_valid_close_code(int code);
@@ -1,13 +1,92 @@
 #pragma once
 
 #include "types.h"
+#include "json_writer.h"
 #include <string>
 #include <functional>
 #include <cstddef>
+#include <stdint.h>
 
+struct ServerStats {
+    size_t clients;
+    size_t binary_clients;      // of those, on the binary protocol
+    size_t deflate_clients;     // of those, with permessage-deflate
+    size_t queued;              // messages waiting across all clients
+    size_t max_queue_depth;     // deepest client queue right now
+    size_t peak_queue_depth;    // deepest any current client's queue has been
+    unsigned long long messages_queued;     // per client, so one broadcast counts once per client
+    unsigned long long messages_coalesced;  // replaced by a newer update before being sent
+    unsigned long long messages_dropped;    // discarded from a full queue
+    unsigned long long slow_disconnects;    // clients closed for a full queue
+    unsigned long long resyncs;             // backlogs replaced by a snapshot for a full queue
+    unsigned long long snapshots_sent;      // for any reason, resyncs included
+    unsigned long long messages_filtered;   // not sent to a client that didn't subscribe
+    unsigned long long write_calls;         // sendmsg() calls that wrote something
+    unsigned long long bytes_sent;
+    unsigned long long messages_compressed;  // deflate runs; each frame may go to many clients
+    unsigned long long compress_bytes_in;
+    unsigned long long compress_bytes_out;
+    
+    ServerStats() {
+        clients = 0;
+        binary_clients = 0;
+        deflate_clients = 0;
+        queued = 0;
+        max_queue_depth = 0;
+        peak_queue_depth = 0;
+        messages_queued = 0;
+        messages_coalesced = 0;
+        messages_dropped = 0;
+        slow_disconnects = 0;
+        resyncs = 0;
+        snapshots_sent = 0;
+        messages_filtered = 0;
+        write_calls = 0;
+        bytes_sent = 0;
+        messages_compressed = 0;
+        compress_bytes_in = 0;
+        compress_bytes_out = 0;
+    }
+};
+
+// Event-driven WebSocket server. A fixed set of I/O threads ("shards"), one
+// by default, each run a non-blocking reactor over their own connections, so
+// the thread count doesn't grow with the number of subscribers. With more
+// than one shard every shard binds the port with SO_REUSEPORT and the kernel
+// spreads new connections between them.
+//
+// broadcast_* may be called from any thread. They frame the message once
+// per wire format in use, push it onto every open connection's bounded send
+// queue and wake the reactors; nothing blocks on a client socket. A client
+// whose queue fills up is handled per Config::server_slow_policy. Clients
+// get JSON unless they negotiate the binary records of binary_protocol.h,
+// and every market_data and opportunity message unless they subscribe to
+// particular events, markets or channels; a per-shard topic index means a
+// broadcast only visits the connections that asked for it.
+//
+// The server keeps the latest market_data of every market and the
+// opportunities seen within Config::server_opportunity_ttl_s. A client is
+// sent them as a snapshot as soon as it connects, between
+// {"type":"snapshot_begin","seq":S,"reason":...} and
+// {"type":"snapshot_end","seq":S,"markets":N,"opportunities":M}, as
+// ordinary market_data and opportunity messages (binary clients get
+// records; see binary_protocol.h). Every market_data and opportunity
+// message carries "seq", numbered across the whole server: the snapshot
+// holds everything up to S and the live messages after it start above S.
+// A client sees only part of the sequence (subscriptions, coalescing), so
+// a skipped number isn't a loss; when the server does have to discard a
+// message for a client, it drops that client's whole backlog and sends a
+// new snapshot instead. {"type":"resync"} asks for one at any time, and a
+// subscribe gets one for the new subscription.
+//
+// Clients offering permessage-deflate get compressed messages. Without
+// context takeover (the default) each message is compressed once and the
+// frame shared by every such client. With context takeover configured,
+// unfiltered JSON clients on a shard instead share one running compression
+// context, which compresses far better; see join_open and deliver.
 class WebSocketServer {
 public:
-    WebSocketServer(int port);
+    WebSocketServer(int port, Config* config);
     ~WebSocketServer();
     
     bool start();
@@ -16,24 +95,25 @@ public:
     
     void broadcast_opportunity(ArbitrageOpportunity* opp);
     void broadcast_market_data(MarketData* data);
+    void broadcast_text(const std::string& message);
     
+    size_t client_count();
+    ServerStats stats();
+    
+    // Called on the owning I/O thread, after the upgrade and after close
     void set_on_connect(std::function<void(int)> callback);
     void set_on_disconnect(std::function<void(int)> callback);
     
-    void server_loop();
-    
 private:
-    void handle_client(int client_fd);
-    bool handle_websocket_upgrade(int client_fd, const std::string& request);
-    void send_message(int client_fd, const std::string& message);
-    std::string create_opportunity_json(ArbitrageOpportunity* opp);
-    std::string create_market_data_json(MarketData* data);
-    
     int port;
-    int server_fd;
+    Config* config;
     bool running;
-    void* server_thread;
+    void* state;
     std::function<void(int)> on_connect;
     std::function<void(int)> on_disconnect;
 };
 
+// The server's JSON messages, appended to out, numbered `seq`. Exposed for
+// benchmarks and other producers of the same wire format.
+void write_opportunity_json(JsonWriter& out, const ArbitrageOpportunity* opp, uint64_t seq);
+void write_market_data_json(JsonWriter& out, const MarketData* data, uint64_t seq);
@@ -1,27 +1,318 @@
 #include "arbitrage_engine.h"
 #include "types.h"
-#include <map>
-#include <string>
+#include "quote_store.h"
+#include "pricing_kernel.h"
+#include "fee_model.h"
+#include "order_book.h"
+#include <iostream>
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <math.h>
 #include <pthread.h>
 
+static const double NANODOLLARS = 1e9;
+
+static int64_t to_nanodollars(double amount) {
+    return (int64_t)llround(amount * NANODOLLARS);
+}
+
+// Immutable membership list for one event, as quote store slots kept in
+// ascending order so a walk follows the store's memory layout. A membership
+// change builds a new snapshot and publishes it atomically; detection keeps
+// whatever snapshot it loaded alive through the shared_ptr, so it never
+// needs the registry lock.
+struct EventSnapshot {
+    SymbolId event_id;
+    std::vector<uint32_t> slots;
+};
+
+// Never freed while the engine lives, so a raw pointer taken under the
+// registry lock stays usable after the lock is released.
+struct EventEntry {
+    std::shared_ptr<const EventSnapshot> snapshot;
+};
+
+// Copy of a market's L2 book, kept per quote store slot for depth-aware
+// sizing. Books are variable length, so unlike quotes they sit behind a
+// mutex; nothing ever holds two of these locks at once.
+struct DepthBook {
+    pthread_mutex_t lock;
+    OrderBook book;
+    bool has_depth;
+    
+    DepthBook() {
+        has_depth = false;
+        pthread_mutex_init(&lock, NULL);
+    }
+    
+    ~DepthBook() {
+        pthread_mutex_destroy(&lock);
+    }
+};
+
+// Taker fees for every (buy venue, sell venue) pair, worked out from the
+// schedules once so detection does one indexed load per pair instead of
+// consulting the schedules
+struct PairFees {
+    LegFee buy;
+    LegFee sell;
+};
+
+struct FeeTable {
+    PairFees pairs[NUM_MARKETS][NUM_MARKETS];
+};
+
+// One venue's exhaustive set of mutually exclusive outcomes (see
+// MarketData::group_id). A tick moves one member's ask, so the set's cost
+// is kept as running sums adjusted by the difference, O(1) however many
+// outcomes there are. The sums are integer nanodollars so that millions of
+// adjustments add up to exactly what summing the current asks would.
+struct OutcomeGroup {
+    pthread_mutex_t lock;
+    SymbolId group_id;
+    int market;
+    int size;                      // outcomes the feed says the set has
+    std::vector<SymbolId> members;
+    std::vector<double> ask;       // 0 while the member has no ask
+    std::vector<double> ask_size;
+    std::vector<int64_t> cost;     // ask plus its buy fee, nanodollars
+    int64_t total_ask;
+    int64_t total_cost;
+    int quoted;                    // members with an ask
+    
+    OutcomeGroup(SymbolId group_id, int market) {
+        this->group_id = group_id;
+        this->market = market;
+        size = 0;
+        total_ask = 0;
+        total_cost = 0;
+        quoted = 0;
+        pthread_mutex_init(&lock, NULL);
+    }
+    
+    ~OutcomeGroup() {
+        pthread_mutex_destroy(&lock);
+    }
+    
+    // Caller must hold lock. An ask outside (0, 1) leaves the member
+    // unquoted, so the set can't complete without it.
+    void set_ask(uint32_t index, double new_ask, double new_size, const LegFee& fee) {
+        if (ask[index] > 0.0) {
+            total_ask -= to_nanodollars(ask[index]);
+            total_cost -= cost[index];
+            quoted--;
+        }
+        ask[index] = 0.0;
+        ask_size[index] = 0.0;
+        cost[index] = 0;
+        
+        if (new_ask > 0.0 && new_ask < 1.0) {
+            ask[index] = new_ask;
+            ask_size[index] = new_size;
+            cost[index] = to_nanodollars(new_ask + leg_fee(new_ask, fee));
+            total_ask += to_nanodollars(new_ask);
+            total_cost += cost[index];
+            quoted++;
+        }
+    }
+    
+    // Caller must hold lock. Sums every member again, for when the fees
+    // themselves changed.
+    void reprice(const LegFee& fee) {
+        for (size_t i = 0; i < members.size(); i++) {
+            set_ask((uint32_t)i, ask[i], ask_size[i], fee);
+        }
+    }
+};
+
 struct MarketDataMap {
-    std::map<std::string, MarketData> data;
-    pthread_mutex_t mutex;
+    // Prices live in the quote store; the registry only maps interned IDs
+    // to slots and events. Readers take the lock shared; only membership
+    // changes (new market, re-label, removal) take it exclusively, since
+    // they may grow the vectors. Quote updates never take it exclusively.
+    QuoteStore store;
+    std::vector<uint32_t> market_slots;
+    std::vector<SymbolId> market_events;
+    std::vector<EventEntry*> events;
+    bool store_full;
+    pthread_rwlock_t lock;
     
-    MarketDataMap() {
-        pthread_mutex_init(&mutex, NULL);
+    // Indexed by slot and sized once, like the store; an entry is created
+    // (under the exclusive lock) the first time its slot is handed out and
+    // reused by whichever market gets the slot next. Empty when depth
+    // sizing is off.
+    std::vector<DepthBook*> depth;
+    
+    // Replaced whole on a fee change. Old tables are kept, like event
+    // entries, so detection can load the pointer once and use it without
+    // a lock; fee changes are rare enough that they never add up.
+    std::atomic<const FeeTable*> fees;
+    std::vector<FeeTable*> fee_tables;
+    
+    // Outcome sets by group ID, and each market's set and place in it by
+    // market ID. Never freed while the engine lives, like event entries;
+    // joining a set takes the lock exclusively, the sums take the set's
+    // own mutex, and nothing holds two set mutexes at once.
+    std::vector<OutcomeGroup*> groups;
+    std::vector<OutcomeGroup*> market_groups;
+    std::vector<uint32_t> market_group_index;
+    
+    MarketDataMap(size_t capacity, bool depth_sizing) : store(capacity), fees(NULL) {
+        store_full = false;
+        pthread_rwlock_init(&lock, NULL);
+        if (depth_sizing) {
+            depth.resize(capacity, NULL);
+        }
     }
     
     ~MarketDataMap() {
-        pthread_mutex_destroy(&mutex);
+        for (size_t i = 0; i < events.size(); i++) {
+            delete events[i];
+        }
+        for (size_t i = 0; i < depth.size(); i++) {
+            delete depth[i];
+        }
+        for (size_t i = 0; i < fee_tables.size(); i++) {
+            delete fee_tables[i];
+        }
+        for (size_t i = 0; i < groups.size(); i++) {
+            delete groups[i];
+        }
+        pthread_rwlock_destroy(&lock);
+    }
+    
+    // Caller must hold the lock shared or exclusively, and exclusively if
+    // the slot may be new
+    void write_depth(uint32_t slot, const OrderBook* book) {
+        if (depth.empty()) {
+            return;
+        }
+        if (depth[slot] == NULL) {
+            depth[slot] = new DepthBook();
+        }
+        
+        DepthBook* entry = depth[slot];
+        pthread_mutex_lock(&entry->lock);
+        if (book != NULL) {
+            entry->book = *book;
+            entry->has_depth = true;
+        } else {
+            entry->book.clear();
+            entry->has_depth = false;
+        }
+        pthread_mutex_unlock(&entry->lock);
+    }
+    
+    // Caller must hold the lock shared or exclusively
+    uint32_t find_slot(SymbolId market_id) {
+        return market_id < market_slots.size() ? market_slots[market_id] : INVALID_SLOT;
+    }
+    
+    // Caller must hold the lock shared or exclusively
+    OutcomeGroup* find_group(SymbolId market_id, uint32_t& index) {
+        if (market_id >= market_groups.size() || market_groups[market_id] == NULL) {
+            return NULL;
+        }
+        index = market_group_index[market_id];
+        return market_groups[market_id];
+    }
+    
+    // Caller must hold the lock exclusively. A market that moves to
+    // another set (its event was regrouped at discovery) leaves the old
+    // one.
+    OutcomeGroup* join_group(SymbolId market_id, int market, SymbolId group_id, uint32_t& index) {
+        OutcomeGroup* current = find_group(market_id, index);
+        if (current != NULL && current->group_id == group_id) {
+            return current;
+        }
+        if (current != NULL) {
+            pthread_mutex_lock(&current->lock);
+            current->set_ask(index, 0.0, 0.0, LegFee());
+            current->members.erase(current->members.begin() + index);
+            current->ask.erase(current->ask.begin() + index);
+            current->ask_size.erase(current->ask_size.begin() + index);
+            current->cost.erase(current->cost.begin() + index);
+            for (size_t i = index; i < current->members.size(); i++) {
+                market_group_index[current->members[i]] = (uint32_t)i;
+            }
+            pthread_mutex_unlock(&current->lock);
+        }
+        
+        if (group_id >= groups.size()) {
+            groups.resize(group_id + 1, NULL);
+        }
+        if (groups[group_id] == NULL) {
+            groups[group_id] = new OutcomeGroup(group_id, market);
+        }
+        if (market_id >= market_groups.size()) {
+            market_groups.resize(market_id + 1, NULL);
+            market_group_index.resize(market_id + 1, 0);
+        }
+        
+        OutcomeGroup* group = groups[group_id];
+        pthread_mutex_lock(&group->lock);
+        index = (uint32_t)group->members.size();
+        group->members.push_back(market_id);
+        group->ask.push_back(0.0);
+        group->ask_size.push_back(0.0);
+        group->cost.push_back(0);
+        pthread_mutex_unlock(&group->lock);
+        market_groups[market_id] = group;
+        market_group_index[market_id] = index;
+        return group;
+    }
+    
+    // Caller must hold the lock exclusively
+    EventEntry* event_entry(SymbolId event_id) {
+        if (event_id >= events.size()) {
+            events.resize(event_id + 1, NULL);
+        }
+        if (events[event_id] == NULL) {
+            events[event_id] = new EventEntry();
+        }
+        return events[event_id];
+    }
+    
+    // Caller must hold the lock exclusively
+    void publish(EventEntry* entry, SymbolId event_id, uint32_t added, uint32_t removed) {
+        std::shared_ptr<const EventSnapshot> current = std::atomic_load(&entry->snapshot);
+        std::shared_ptr<EventSnapshot> next(new EventSnapshot());
+        next->event_id = event_id;
+        if (current) {
+            next->slots = current->slots;
+        }
+        if (removed != INVALID_SLOT) {
+            next->slots.erase(std::remove(next->slots.begin(), next->slots.end(), removed), next->slots.end());
+        }
+        if (added != INVALID_SLOT) {
+            next->slots.insert(std::upper_bound(next->slots.begin(), next->slots.end(), added), added);
+        }
+        std::atomic_store(&entry->snapshot, std::shared_ptr<const EventSnapshot>(next));
+    }
+    
+    // Caller must hold the lock exclusively
+    void unindex_market(SymbolId market_id) {
+        uint32_t slot = find_slot(market_id);
+        if (slot == INVALID_SLOT) {
+            return;
+        }
+        
+        SymbolId event_id = market_events[market_id];
+        publish(events[event_id], event_id, INVALID_SLOT, slot);
+        store.release(event_id, slot);
+        market_slots[market_id] = INVALID_SLOT;
+        market_events[market_id] = INVALID_SYMBOL;
     }
 };
 
 ArbitrageEngine::ArbitrageEngine(Config* config) {
     this->config = config;
     this->opportunity_callback = NULL;
-    this->market_data_map = new MarketDataMap();
+    this->market_data_map = new MarketDataMap(config->max_markets, config->depth_sizing);
+    set_fee_schedules(config->fees);
 }
 
 ArbitrageEngine::~ArbitrageEngine() {
@@ -29,121 +320,515 @@ ArbitrageEngine::~ArbitrageEngine() {
 }
 
 void ArbitrageEngine::update_market_data(MarketData* data) {
-    if (data == NULL || !data->is_valid) {
+    uint32_t slot = INVALID_SLOT;
+    EventEntry* entry = (EventEntry*)store_market_data(data, slot);
+    if (entry == NULL || opportunity_callback == NULL) {
         return;
     }
     
+    Quote updated;
+    updated.market_id = data->market_id;
+    updated.market = data->market;
+    updated.best_bid = data->best_bid;
+    updated.best_ask = data->best_ask;
+    updated.bid_size = data->bid_size;
+    updated.ask_size = data->ask_size;
+    updated.timestamp = data->timestamp;
+    
+    std::vector<ArbitrageOpportunity> found;
+    check_for_opportunities(entry, slot, updated, data->book, found);
+    check_outcome_group(data->market_id, found);
+    
+    for (size_t i = 0; i < found.size(); i++) {
+        opportunity_callback(&found[i]);
+    }
+}
+
+void ArbitrageEngine::store_market_data(MarketData* data) {
+    uint32_t slot = INVALID_SLOT;
+    store_market_data(data, slot);
+}
+
+// Detection for a market from what the store holds now rather than from a
+// tick in hand, so it can run on another thread after the tick's book is
+// gone. A later tick for the same market may already have landed; that
+// only means this check sees fresher prices.
+void ArbitrageEngine::find_opportunities(SymbolId market_id, std::vector<ArbitrageOpportunity>& found) {
     MarketDataMap* mdm = (MarketDataMap*)market_data_map;
-    pthread_mutex_lock(&mdm->mutex);
-    mdm->data[data->market_id] = *data;
-    pthread_mutex_unlock(&mdm->mutex);
     
-    check_for_opportunities();
+    EventEntry* entry = NULL;
+    pthread_rwlock_rdlock(&mdm->lock);
+    uint32_t slot = mdm->find_slot(market_id);
+    if (slot != INVALID_SLOT) {
+        entry = mdm->events[mdm->market_events[market_id]];
+    }
+    pthread_rwlock_unlock(&mdm->lock);
+    if (entry == NULL) {
+        return;
+    }
+    
+    Quote updated;
+    mdm->store.read(slot, updated);
+    if (updated.market_id != market_id) {
+        return;  // removed, and the slot handed to another market, since the lookup
+    }
+    
+    // Copied out like the buy side in scan_all_markets, so the counterparty
+    // locks in check_for_opportunities are still never held with another
+    const OrderBook* updated_book = NULL;
+    static thread_local OrderBook book;
+    if (!mdm->depth.empty() && mdm->depth[slot] != NULL) {
+        DepthBook* depth = mdm->depth[slot];
+        pthread_mutex_lock(&depth->lock);
+        if (depth->has_depth) {
+            book = depth->book;
+            updated_book = &book;
+        }
+        pthread_mutex_unlock(&depth->lock);
+    }
+    
+    check_for_opportunities(entry, slot, updated, updated_book, found);
+    check_outcome_group(market_id, found);
 }
 
-void ArbitrageEngine::set_opportunity_function(void (*func)(ArbitrageOpportunity*)) {
-    opportunity_callback = func;
+// Writes the quote and its depth and returns the market's event entry, or
+// NULL when there is nothing to check (bad IDs, removal, store full).
+void* ArbitrageEngine::store_market_data(MarketData* data, uint32_t& slot) {
+    if (data == NULL || data->market_id == INVALID_SYMBOL || data->event_id == INVALID_SYMBOL ||
+        data->market < 0 || data->market >= NUM_MARKETS) {
+        return NULL;
+    }
+    
+    // An invalid quote means the book went away; drop the market so a
+    // stale price can't keep producing opportunities.
+    if (!data->is_valid) {
+        remove_market_data(data->market_id);
+        return NULL;
+    }
+    
+    MarketDataMap* mdm = (MarketDataMap*)market_data_map;
+    
+    // Fast path: known market on the same event. The write happens under
+    // the shared lock so the slot can't be recycled mid-write, but feed
+    // threads never exclude each other here.
+    slot = INVALID_SLOT;
+    EventEntry* entry = NULL;
+    pthread_rwlock_rdlock(&mdm->lock);
+    uint32_t existing = mdm->find_slot(data->market_id);
+    if (existing != INVALID_SLOT && mdm->market_events[data->market_id] == data->event_id) {
+        slot = existing;
+        entry = mdm->events[data->event_id];
+        mdm->store.write(slot, data);
+        mdm->write_depth(slot, data->book);
+    }
+    pthread_rwlock_unlock(&mdm->lock);
+    
+    if (slot == INVALID_SLOT) {
+        pthread_rwlock_wrlock(&mdm->lock);
+        if (data->market_id >= mdm->market_slots.size()) {
+            mdm->market_slots.resize(data->market_id + 1, INVALID_SLOT);
+            mdm->market_events.resize(data->market_id + 1, INVALID_SYMBOL);
+        }
+        
+        // Another thread may have registered it while we waited
+        slot = mdm->find_slot(data->market_id);
+        if (slot != INVALID_SLOT && mdm->market_events[data->market_id] != data->event_id) {
+            mdm->unindex_market(data->market_id);
+            slot = INVALID_SLOT;
+        }
+        
+        entry = mdm->event_entry(data->event_id);
+        if (slot == INVALID_SLOT) {
+            slot = mdm->store.allocate(data->event_id);
+            if (slot == INVALID_SLOT) {
+                if (!mdm->store_full) {
+                    std::cerr << "Quote store full (" << mdm->store.capacity()
+                              << " slots), ignoring new markets" << std::endl;
+                    mdm->store_full = true;
+                }
+                pthread_rwlock_unlock(&mdm->lock);
+                return NULL;
+            }
+            
+            // Publish the quote before the slot becomes visible to readers
+            mdm->store.write(slot, data);
+            mdm->write_depth(slot, data->book);
+            mdm->market_slots[data->market_id] = slot;
+            mdm->market_events[data->market_id] = data->event_id;
+            mdm->publish(entry, data->event_id, slot, INVALID_SLOT);
+        } else {
+            mdm->store.write(slot, data);
+            mdm->write_depth(slot, data->book);
+        }
+        pthread_rwlock_unlock(&mdm->lock);
+    }
+    
+    if (data->group_id != INVALID_SYMBOL) {
+        store_group_quote(data);
+    }
+    return entry;
 }
 
-void ArbitrageEngine::check_for_opportunities() {
+// Moves the market's ask in its outcome set's running sums
+void ArbitrageEngine::store_group_quote(MarketData* data) {
+    MarketDataMap* mdm = (MarketDataMap*)market_data_map;
+    
+    uint32_t index = 0;
+    pthread_rwlock_rdlock(&mdm->lock);
+    OutcomeGroup* group = mdm->find_group(data->market_id, index);
+    if (group == NULL || group->group_id != data->group_id) {
+        pthread_rwlock_unlock(&mdm->lock);
+        pthread_rwlock_wrlock(&mdm->lock);
+        group = mdm->join_group(data->market_id, data->market, data->group_id, index);
+    }
+    
+    // The map lock is held until the set's own is, and join_group renumbers
+    // members under both, so the index read here stays this market's until
+    // the set is unlocked
+    const FeeTable* fees = mdm->fees.load(std::memory_order_acquire);
+    pthread_mutex_lock(&group->lock);
+    index = mdm->market_group_index[data->market_id];
+    pthread_rwlock_unlock(&mdm->lock);
+    group->size = data->group_size;
+    group->set_ask(index, data->best_ask, data->ask_size, fees->pairs[group->market][group->market].buy);
+    pthread_mutex_unlock(&group->lock);
+}
+
+void ArbitrageEngine::remove_market_data(SymbolId market_id) {
+    MarketDataMap* mdm = (MarketDataMap*)market_data_map;
+    pthread_rwlock_wrlock(&mdm->lock);
+    mdm->unindex_market(market_id);
+    
+    // Still a member, so the set completes again when the book comes back
+    uint32_t index = 0;
+    OutcomeGroup* group = mdm->find_group(market_id, index);
+    if (group != NULL) {
+        pthread_mutex_lock(&group->lock);
+        group->set_ask(index, 0.0, 0.0, LegFee());
+        pthread_mutex_unlock(&group->lock);
+    }
+    pthread_rwlock_unlock(&mdm->lock);
+}
+
+// Full sweep over every cross-venue pair of every event, for when all
+// quotes may be stale at once (startup, reconnect, fee changes). Pairs are
+// packed into flat arrays and priced by the batch kernel rather than one
+// compute_profit call at a time. Outcome sets are re-summed from their
+// members' asks under the current fees.
+void ArbitrageEngine::scan_all_markets() {
     if (opportunity_callback == NULL) {
         return;
     }
     
+    std::vector<ArbitrageOpportunity> found;
+    scan_all_markets(found);
+    for (size_t i = 0; i < found.size(); i++) {
+        opportunity_callback(&found[i]);
+    }
+}
+
+void ArbitrageEngine::scan_all_markets(std::vector<ArbitrageOpportunity>& found) {
     MarketDataMap* mdm = (MarketDataMap*)market_data_map;
-    pthread_mutex_lock(&mdm->mutex);
+    const FeeTable* fees = mdm->fees.load(std::memory_order_acquire);
     
-    // O(n): Group markets by event_name first
-    // This reduces complexity from O(n²) to O(n + k²×e)
-    // where k = markets per event (typically 2-3), e = unique events
-    std::map<std::string, std::vector<MarketData*>> events_map;
-    for (std::map<std::string, MarketData>::iterator it = mdm->data.begin(); 
-         it != mdm->data.end(); ++it) {
-        events_map[it->second.event_name].push_back(&it->second);
+    std::vector<std::shared_ptr<const EventSnapshot> > snapshots;
+    pthread_rwlock_rdlock(&mdm->lock);
+    for (size_t i = 0; i < mdm->events.size(); i++) {
+        if (mdm->events[i] != NULL) {
+            std::shared_ptr<const EventSnapshot> snapshot = std::atomic_load(&mdm->events[i]->snapshot);
+            if (snapshot && snapshot->slots.size() >= 2) {
+                snapshots.push_back(snapshot);
+            }
+        }
     }
+    pthread_rwlock_unlock(&mdm->lock);
     
-    pthread_mutex_unlock(&mdm->mutex);
+    std::vector<SymbolId> pair_event;
+    std::vector<uint32_t> buy_slot;
+    std::vector<uint32_t> sell_slot;
+    std::vector<int> buy_market;
+    std::vector<int> sell_market;
+    std::vector<double> buy_ask;
+    std::vector<double> sell_bid;
+    std::vector<double> ask_size;
+    std::vector<double> bid_size;
+    std::vector<double> buy_fee;
+    std::vector<double> sell_fee;
     
-    // O(k²×e): Only compare markets within the same event
-    // For each event, compare pairs of markets (typically 2-3 markets per event)
-    for (std::map<std::string, std::vector<MarketData*>>::iterator event_it = events_map.begin();
-         event_it != events_map.end(); ++event_it) {
-        
-        std::vector<MarketData*>& markets = event_it->second;
-        
-        // Skip if less than 2 markets for this event
-        if (markets.size() < 2) {
-            continue;
+    std::vector<Quote> quotes;
+    for (size_t e = 0; e < snapshots.size(); e++) {
+        const std::vector<uint32_t>& slots = snapshots[e]->slots;
+        quotes.resize(slots.size());
+        for (size_t i = 0; i < slots.size(); i++) {
+            mdm->store.read(slots[i], quotes[i]);
         }
         
-        // Compare all pairs of markets for this event
-        for (size_t i = 0; i < markets.size(); i++) {
-            for (size_t j = i + 1; j < markets.size(); j++) {
-                MarketData* data1 = markets[i];
-                MarketData* data2 = markets[j];
-                
-                // Skip if same market (shouldn't happen, but safety check)
-                if (data1->market == data2->market) {
+        for (size_t i = 0; i < quotes.size(); i++) {
+            for (size_t j = 0; j < quotes.size(); j++) {
+                if (quotes[i].market == quotes[j].market) {
                     continue;
                 }
+                pair_event.push_back(snapshots[e]->event_id);
+                buy_slot.push_back(slots[i]);
+                sell_slot.push_back(slots[j]);
+                buy_market.push_back(quotes[i].market);
+                sell_market.push_back(quotes[j].market);
+                buy_ask.push_back(quotes[i].best_ask);
+                sell_bid.push_back(quotes[j].best_bid);
+                ask_size.push_back(quotes[i].ask_size);
+                bid_size.push_back(quotes[j].bid_size);
                 
-                double profit = compute_profit(data1, data2);
+                const PairFees& pair = fees->pairs[quotes[i].market][quotes[j].market];
+                buy_fee.push_back(leg_fee(quotes[i].best_ask, pair.buy));
+                sell_fee.push_back(leg_fee(quotes[j].best_bid, pair.sell));
+            }
+        }
+    }
+    
+    std::vector<OutcomeGroup*> groups;
+    pthread_rwlock_rdlock(&mdm->lock);
+    for (size_t i = 0; i < mdm->groups.size(); i++) {
+        if (mdm->groups[i] != NULL) {
+            groups.push_back(mdm->groups[i]);
+        }
+    }
+    pthread_rwlock_unlock(&mdm->lock);
+    
+    for (size_t i = 0; i < groups.size(); i++) {
+        pthread_mutex_lock(&groups[i]->lock);
+        groups[i]->reprice(fees->pairs[groups[i]->market][groups[i]->market].buy);
+        check_group(groups[i], found);
+        pthread_mutex_unlock(&groups[i]->lock);
+    }
+    
+    size_t count = pair_event.size();
+    if (count == 0) {
+        return;
+    }
+    
+    std::vector<double> profit(count);
+    std::vector<double> max_size(count);
+    
+    PairBatch batch;
+    batch.buy_ask = &buy_ask[0];
+    batch.sell_bid = &sell_bid[0];
+    batch.ask_size = &ask_size[0];
+    batch.bid_size = &bid_size[0];
+    batch.buy_fee = &buy_fee[0];
+    batch.sell_fee = &sell_fee[0];
+    batch.count = count;
+    evaluate_pairs(batch, &profit[0], &max_size[0]);
+    
+    OrderBook buy_book;
+    for (size_t i = 0; i < count; i++) {
+        if (profit[i] > config->min_profit_threshold) {
+            ArbitrageOpportunity opp;
+            opp.event_id = pair_event[i];
+            opp.buy_market = buy_market[i];
+            opp.sell_market = sell_market[i];
+            opp.buy_price = buy_ask[i];
+            opp.sell_price = sell_bid[i];
+            opp.profit_percentage = profit[i];
+            opp.max_size = max_size[i];
+            opp.avg_buy_price = opp.buy_price;
+            opp.avg_sell_price = opp.sell_price;
+            
+            // Only the few profitable pairs pay for a sweep. The buy side is
+            // copied out so no two book locks are ever held together.
+            if (!mdm->depth.empty()) {
+                DepthBook* buy_depth = mdm->depth[buy_slot[i]];
+                DepthBook* sell_depth = mdm->depth[sell_slot[i]];
+                pthread_mutex_lock(&buy_depth->lock);
+                bool have_buy = buy_depth->has_depth;
+                if (have_buy) {
+                    buy_book = buy_depth->book;
+                }
+                pthread_mutex_unlock(&buy_depth->lock);
                 
-                if (profit > config->min_profit_threshold) {
-                    ArbitrageOpportunity opp;
-                    opp.event_id = data1->event_name;
-                    opp.buy_market = data1->market;
-                    opp.sell_market = data2->market;
-                    opp.buy_price = data1->best_ask;
-                    opp.sell_price = data2->best_bid;
-                    opp.profit_percentage = profit;
-                    opp.max_size = compute_max_size(data1, data2);
-                    
-                    if (opportunity_callback != NULL) {
-                        opportunity_callback(&opp);
-                    }
+                bool keep = true;
+                pthread_mutex_lock(&sell_depth->lock);
+                if (have_buy && sell_depth->has_depth) {
+                    keep = size_from_depth(buy_book, sell_depth->book, fees, opp);
+                }
+                pthread_mutex_unlock(&sell_depth->lock);
+                if (!keep) {
+                    continue;
                 }
             }
+            found.push_back(opp);
         }
     }
 }
 
-double ArbitrageEngine::compute_profit(MarketData* buy, MarketData* sell) {
-    if (buy == NULL || sell == NULL) {
-        return 0.0;
-    }
+void ArbitrageEngine::set_opportunity_function(void (*func)(ArbitrageOpportunity*)) {
+    opportunity_callback = func;
+}
+
+void ArbitrageEngine::set_fee_schedules(const FeeSchedule* schedules) {
+    MarketDataMap* mdm = (MarketDataMap*)market_data_map;
     
-    if (buy->best_ask >= sell->best_bid) {
-        return 0.0;
+    FeeTable* table = new FeeTable();
+    for (int buy = 0; buy < NUM_MARKETS; buy++) {
+        for (int sell = 0; sell < NUM_MARKETS; sell++) {
+            table->pairs[buy][sell].buy = buy_leg_fee(schedules[buy]);
+            table->pairs[buy][sell].sell = sell_leg_fee(schedules[sell]);
+        }
     }
     
-    double buy_price = buy->best_ask;
-    double sell_price = sell->best_bid;
+    pthread_rwlock_wrlock(&mdm->lock);
+    mdm->fee_tables.push_back(table);
+    mdm->fees.store(table, std::memory_order_release);
+    pthread_rwlock_unlock(&mdm->lock);
+}
+
+// Only pairs involving the updated market can have changed, so a tick costs
+// O(k) where k = markets quoting the same event. Runs without any engine
+// lock: membership comes from an immutable snapshot and each counterparty
+// quote is read through its seqlock.
+void ArbitrageEngine::check_for_opportunities(void* event, uint32_t slot, const Quote& updated, const OrderBook* updated_book, std::vector<ArbitrageOpportunity>& found) {
+    EventEntry* entry = (EventEntry*)event;
+    MarketDataMap* mdm = (MarketDataMap*)market_data_map;
     
-    double buy_fee = buy_price * 0.02;
-    double sell_fee = sell_price * 0.02;
+    std::shared_ptr<const EventSnapshot> snapshot = std::atomic_load(&entry->snapshot);
+    if (!snapshot || snapshot->slots.size() < 2) {
+        return;
+    }
     
-    double net_profit = sell_price - buy_price - buy_fee - sell_fee;
+    const FeeTable* fees = mdm->fees.load(std::memory_order_acquire);
+    const std::vector<uint32_t>& slots = snapshot->slots;
+    for (size_t i = 0; i < slots.size(); i++) {
+        if (slots[i] == slot) {
+            continue;
+        }
+        
+        Quote quote;
+        mdm->store.read(slots[i], quote);
+        
+        // Skip if same venue. The market_id check covers a snapshot taken
+        // just before this market was re-labelled into a recycled slot.
+        if (quote.market == updated.market || quote.market_id == updated.market_id) {
+            continue;
+        }
+        
+        // The counterparty's book stays locked only for its two sweeps;
+        // the updated market's book is the caller's own copy
+        DepthBook* other = NULL;
+        if (updated_book != NULL && !mdm->depth.empty()) {
+            other = mdm->depth[slots[i]];
+            pthread_mutex_lock(&other->lock);
+        }
+        const OrderBook* other_book = other != NULL && other->has_depth ? &other->book : NULL;
+        
+        check_pair(snapshot->event_id, updated, quote, updated_book, other_book, fees, found);
+        check_pair(snapshot->event_id, quote, updated, other_book, updated_book, fees, found);
+        
+        if (other != NULL) {
+            pthread_mutex_unlock(&other->lock);
+        }
+    }
+}
+
+void ArbitrageEngine::check_outcome_group(SymbolId market_id, std::vector<ArbitrageOpportunity>& found) {
+    MarketDataMap* mdm = (MarketDataMap*)market_data_map;
     
-    if (net_profit <= 0.0) {
-        return 0.0;
+    uint32_t index = 0;
+    pthread_rwlock_rdlock(&mdm->lock);
+    OutcomeGroup* group = mdm->find_group(market_id, index);
+    pthread_rwlock_unlock(&mdm->lock);
+    if (group == NULL) {
+        return;
     }
     
-    double profit_ratio = net_profit / buy_price;
-    return profit_ratio;
+    pthread_mutex_lock(&group->lock);
+    check_group(group, found);
+    pthread_mutex_unlock(&group->lock);
 }
 
-double ArbitrageEngine::compute_max_size(MarketData* buy, MarketData* sell) {
-    if (buy == NULL || sell == NULL) {
-        return 0.0;
+// Buying every outcome of a complete set pays $1 whichever one wins, so
+// the profit is what that leaves over the asks and their fees. The set is
+// complete when as many members have an ask as the feed says it has
+// outcomes; members that dropped out were sent an invalid quote, which
+// cleared theirs. The verdict comes straight from the running sums; only a
+// profitable set walks its members, for the size. Caller must hold the
+// set's mutex.
+void ArbitrageEngine::check_group(void* outcome_group, std::vector<ArbitrageOpportunity>& found) {
+    OutcomeGroup* group = (OutcomeGroup*)outcome_group;
+    if (group->size < 2 || group->quoted != group->size) {
+        return;
+    }
+    
+    int64_t payout = to_nanodollars(1.0);
+    if (group->total_cost >= payout) {
+        return;
+    }
+    double profit = (double)(payout - group->total_cost) / (double)group->total_ask;
+    if (profit <= config->min_profit_threshold) {
+        return;
     }
     
-    double buy_max = buy->ask_size;
-    double sell_max = sell->bid_size;
+    ArbitrageOpportunity opp;
+    opp.event_id = group->group_id;
+    opp.buy_market = group->market;
+    opp.sell_market = group->market;
+    opp.buy_price = group->total_ask / NANODOLLARS;
+    opp.sell_price = 1.0;
+    opp.profit_percentage = profit;
+    opp.max_size = -1.0;
+    for (size_t i = 0; i < group->members.size(); i++) {
+        if (group->ask[i] > 0.0 && (opp.max_size < 0.0 || group->ask_size[i] < opp.max_size)) {
+            opp.max_size = group->ask_size[i];
+        }
+    }
+    opp.avg_buy_price = opp.buy_price;
+    opp.avg_sell_price = opp.sell_price;
+    opp.legs = group->size;
+    found.push_back(opp);
+}
+
+void ArbitrageEngine::check_pair(SymbolId event_id, const Quote& buy, const Quote& sell, const OrderBook* buy_book, const OrderBook* sell_book, const void* fees, std::vector<ArbitrageOpportunity>& found) {
+    double profit = compute_profit(buy, sell, fees);
     
-    if (buy_max < sell_max) {
-        return buy_max;
-    } else {
-        return sell_max;
+    if (profit > config->min_profit_threshold) {
+        ArbitrageOpportunity opp;
+        opp.event_id = event_id;
+        opp.buy_market = buy.market;
+        opp.sell_market = sell.market;
+        opp.buy_price = buy.best_ask;
+        opp.sell_price = sell.best_bid;
+        opp.profit_percentage = profit;
+        opp.max_size = compute_max_size(buy, sell);
+        opp.avg_buy_price = opp.buy_price;
+        opp.avg_sell_price = opp.sell_price;
+        
+        if (buy_book != NULL && sell_book != NULL && !size_from_depth(*buy_book, *sell_book, fees, opp)) {
+            return;
+        }
+        found.push_back(opp);
+    }
+}
+
+// Replaces the top-of-book size with what can be done across levels while
+// every unit stays above the threshold. Returns false when nothing clears,
+// which happens when the book has moved since the quote was read.
+bool ArbitrageEngine::size_from_depth(const OrderBook& buy_book, const OrderBook& sell_book, const void* fees, ArbitrageOpportunity& opp) {
+    const PairFees& pair = ((const FeeTable*)fees)->pairs[opp.buy_market][opp.sell_market];
+    SweepResult sweep;
+    sweep_books(buy_book, sell_book, pair.buy, pair.sell, config->min_profit_threshold, sweep);
+    if (sweep.size <= 0.0) {
+        return false;
     }
+    
+    opp.max_size = sweep.size;
+    opp.avg_buy_price = sweep.buy_cost / sweep.size;
+    opp.avg_sell_price = sweep.sell_proceeds / sweep.size;
+    return true;
+}
+
+double ArbitrageEngine::compute_profit(const Quote& buy, const Quote& sell, const void* fees) {
+    const PairFees& pair = ((const FeeTable*)fees)->pairs[buy.market][sell.market];
+    return pair_profit(buy.best_ask, sell.best_bid, leg_fee(buy.best_ask, pair.buy), leg_fee(sell.best_bid, pair.sell));
+}
+
+double ArbitrageEngine::compute_max_size(const Quote& buy, const Quote& sell) {
+    return pair_max_size(buy.ask_size, sell.bid_size);
 }
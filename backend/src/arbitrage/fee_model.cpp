@@ -0,0 +1,97 @@
+#include "fee_model.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <json/json.h>
+
+struct FeeField {
+    const char* name;
+    double FeeSchedule::*value;
+};
+
+static const FeeField FEE_FIELDS[] = {
+    {"taker_rate", &FeeSchedule::taker_rate},
+    {"maker_rate", &FeeSchedule::maker_rate},
+    {"taker_curve", &FeeSchedule::taker_curve},
+    {"maker_curve", &FeeSchedule::maker_curve},
+    {"profit_rate", &FeeSchedule::profit_rate},
+    {"withdrawal_rate", &FeeSchedule::withdrawal_rate}
+};
+
+// rate * p + curve * (p - p^2) + profit_rate * (1 - p) + withdrawal_rate
+LegFee buy_leg_fee(const FeeSchedule& schedule) {
+    LegFee fee;
+    fee.fixed = schedule.profit_rate + schedule.withdrawal_rate;
+    fee.linear = schedule.taker_rate + schedule.taker_curve - schedule.profit_rate;
+    fee.quadratic = -schedule.taker_curve;
+    return fee;
+}
+
+// rate * p + curve * (p - p^2) + profit_rate * p + withdrawal_rate
+LegFee sell_leg_fee(const FeeSchedule& schedule) {
+    LegFee fee;
+    fee.fixed = schedule.withdrawal_rate;
+    fee.linear = schedule.taker_rate + schedule.taker_curve + schedule.profit_rate;
+    fee.quadratic = -schedule.taker_curve;
+    return fee;
+}
+
+bool load_fee_schedules(const std::string& path, FeeSchedule* schedules) {
+    std::ifstream file(path.c_str());
+    if (!file) {
+        std::cerr << "Cannot open fee schedule " << path << std::endl;
+        return false;
+    }
+    std::stringstream text;
+    text << file.rdbuf();
+    
+    Json::Value root;
+    Json::Reader reader;
+    if (!reader.parse(text.str(), root) || !root.isObject()) {
+        std::cerr << "Fee schedule " << path << " is not a JSON object" << std::endl;
+        return false;
+    }
+    
+    // Validate everything before touching schedules, so a bad edit leaves
+    // the fees in force as they were
+    FeeSchedule loaded[NUM_MARKETS];
+    for (int m = 0; m < NUM_MARKETS; m++) {
+        loaded[m] = schedules[m];
+    }
+    
+    Json::Value::Members venues = root.getMemberNames();
+    for (size_t v = 0; v < venues.size(); v++) {
+        int market = -1;
+        for (int m = 0; m < NUM_MARKETS; m++) {
+            if (venues[v] == MARKET_NAMES[m]) {
+                market = m;
+            }
+        }
+        const Json::Value& entry = root[venues[v]];
+        if (market < 0 || !entry.isObject()) {
+            std::cerr << "Fee schedule " << path << ": unknown venue \"" << venues[v] << "\"" << std::endl;
+            return false;
+        }
+        
+        Json::Value::Members fields = entry.getMemberNames();
+        for (size_t f = 0; f < fields.size(); f++) {
+            const FeeField* field = NULL;
+            for (size_t k = 0; k < sizeof(FEE_FIELDS) / sizeof(FEE_FIELDS[0]); k++) {
+                if (fields[f] == FEE_FIELDS[k].name) {
+                    field = &FEE_FIELDS[k];
+                }
+            }
+            const Json::Value& value = entry[fields[f]];
+            if (field == NULL || !value.isNumeric() || value.asDouble() < 0.0 || value.asDouble() >= 1.0) {
+                std::cerr << "Fee schedule " << path << ": bad " << venues[v] << " field \"" << fields[f] << "\"" << std::endl;
+                return false;
+            }
+            loaded[market].*(field->value) = value.asDouble();
+        }
+    }
+    
+    for (int m = 0; m < NUM_MARKETS; m++) {
+        schedules[m] = loaded[m];
+    }
+    return true;
+}
@@ -0,0 +1,525 @@
+#include "pipeline.h"
+#include "ring_buffer.h"
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+// Empty polls before an idle consumer goes to sleep; a few hundred
+// microseconds of spinning, so a steady feed never pays for a wakeup. On a
+// single CPU a spinning consumer only delays the thread it waits for, so
+// there it sleeps straight away.
+static const int SPIN_POLLS = 4000;
+static const long SLEEP_NS = 10000000;  // bounds a missed wakeup
+
+// Latency buckets: four per power of two, so percentiles are within 25%
+static const int LATENCY_SUB_BUCKETS = 4;
+static const int LATENCY_BUCKETS = 4 * 46;  // up to ~2^46 ns, about 19 hours
+
+enum PublishKind {
+    PUBLISH_QUOTE,
+    PUBLISH_OPPORTUNITY
+};
+
+struct Tick {
+    MarketData data;          // book is NULL; the store has the copy
+    bool rescan;              // no quote: scan every pair instead
+    long long submitted_ns;
+};
+
+struct PublishItem {
+    int kind;
+    MarketData quote;
+    ArbitrageOpportunity opportunity;
+    long long submitted_ns;   // of the tick behind it
+    long long queued_ns;
+};
+
+// Written by one thread, read by stats() from any other
+class LatencyHistogram {
+public:
+    LatencyHistogram() {
+        for (int i = 0; i < LATENCY_BUCKETS; i++) {
+            counts[i].store(0, std::memory_order_relaxed);
+        }
+        max_ns.store(0, std::memory_order_relaxed);
+    }
+    
+    void record(long long ns) {
+        if (ns < 0) {
+            ns = 0;
+        }
+        std::atomic<unsigned long long>& count = counts[bucket(ns)];
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (ns > max_ns.load(std::memory_order_relaxed)) {
+            max_ns.store(ns, std::memory_order_relaxed);
+        }
+    }
+    
+    double percentile_us(double q) const {
+        unsigned long long total = 0;
+        unsigned long long snapshot[LATENCY_BUCKETS];
+        for (int i = 0; i < LATENCY_BUCKETS; i++) {
+            snapshot[i] = counts[i].load(std::memory_order_relaxed);
+            total += snapshot[i];
+        }
+        if (total == 0) {
+            return 0;
+        }
+        
+        unsigned long long rank = (unsigned long long)(q * (double)(total - 1)) + 1;
+        unsigned long long seen = 0;
+        for (int i = 0; i < LATENCY_BUCKETS; i++) {
+            seen += snapshot[i];
+            if (seen >= rank) {
+                return (double)upper_bound(i) / 1000.0;
+            }
+        }
+        return max_us();
+    }
+    
+    double max_us() const {
+        return (double)max_ns.load(std::memory_order_relaxed) / 1000.0;
+    }
+    
+private:
+    static int bucket(long long ns) {
+        if (ns < LATENCY_SUB_BUCKETS) {
+            return (int)ns;
+        }
+        int octave = 63 - __builtin_clzll((unsigned long long)ns);
+        int sub = (int)((ns >> (octave - 2)) & (LATENCY_SUB_BUCKETS - 1));
+        int index = LATENCY_SUB_BUCKETS * (octave - 1) + sub;
+        return index < LATENCY_BUCKETS ? index : LATENCY_BUCKETS - 1;
+    }
+    
+    static long long upper_bound(int index) {
+        if (index < LATENCY_SUB_BUCKETS) {
+            return index;
+        }
+        int octave = index / LATENCY_SUB_BUCKETS + 1;
+        long long sub = index % LATENCY_SUB_BUCKETS;
+        return ((LATENCY_SUB_BUCKETS + sub + 1) << (octave - 2)) - 1;
+    }
+    
+    std::atomic<unsigned long long> counts[LATENCY_BUCKETS];
+    std::atomic<long long> max_ns;
+};
+
+// One consumer's sleep and wakeup. The consumer marks itself sleeping and
+// re-checks its queue under the lock; producers look at the mark after
+// pushing, with a full fence on both sides, so either the consumer sees the
+// item or the producer sees the mark and signals.
+struct Wakeup {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    std::atomic<bool> sleeping;
+    
+    Wakeup() {
+        sleeping.store(false);
+        pthread_mutex_init(&lock, NULL);
+        pthread_cond_init(&cond, NULL);
+    }
+    
+    ~Wakeup() {
+        pthread_cond_destroy(&cond);
+        pthread_mutex_destroy(&lock);
+    }
+    
+    void notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping.load(std::memory_order_relaxed)) {
+            pthread_mutex_lock(&lock);
+            pthread_cond_signal(&cond);
+            pthread_mutex_unlock(&lock);
+        }
+    }
+};
+
+// Per queue. The consumer writes everything but stalls, which the
+// producers add to
+struct StageCounters {
+    std::atomic<unsigned long long> items;
+    std::atomic<unsigned long long> stalls;
+    std::atomic<size_t> peak_depth;
+    LatencyHistogram wait;
+    
+    StageCounters() {
+        items.store(0);
+        stalls.store(0);
+        peak_depth.store(0);
+    }
+};
+
+struct PipelineState {
+    MpscRing<Tick> ticks;
+    SpscRing<PublishItem> published;
+    Wakeup engine_wakeup;
+    Wakeup publisher_wakeup;
+    StageCounters engine_stage;
+    StageCounters publisher_stage;
+    LatencyHistogram detect;
+    LatencyHistogram publish;
+    std::atomic<unsigned long long> opportunities;
+    
+    ArbitrageEngine* engine;
+    void (*quote)(MarketData*);
+    void (*opportunity)(ArbitrageOpportunity*);
+    int engine_cpu;
+    int publisher_cpu;
+    int spin_polls;
+    
+    pthread_t engine_thread;
+    pthread_t publisher_thread;
+    std::atomic<bool> running;
+    std::atomic<bool> stop_engine;
+    std::atomic<bool> stop_publisher;
+    
+    PipelineState(size_t queue_size) : ticks(queue_size), published(queue_size) {
+        engine = NULL;
+        quote = NULL;
+        opportunity = NULL;
+        engine_cpu = -1;
+        publisher_cpu = -1;
+        spin_polls = SPIN_POLLS;
+        opportunities.store(0);
+        running.store(false);
+        stop_engine.store(false);
+        stop_publisher.store(false);
+    }
+};
+
+static long long now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static void pin_thread(pthread_t thread, int cpu, const char* name) {
+    if (cpu < 0) {
+        return;
+    }
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int rc = pthread_setaffinity_np(thread, sizeof(set), &set);
+    if (rc != 0) {
+        std::cerr << "Could not pin the " << name << " thread to CPU " << cpu << std::endl;
+    }
+#else
+    std::cerr << "CPU pinning is not supported here; " << name << " thread left unpinned" << std::endl;
+#endif
+}
+
+// Sleeps until a push notifies, or SLEEP_NS at most; not at all if
+// something arrived since the consumer last looked
+template <typename Ring>
+static void sleep_until_pushed(Wakeup& wakeup, Ring& ring, std::atomic<bool>& stop) {
+    pthread_mutex_lock(&wakeup.lock);
+    wakeup.sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ring.size() == 0 && !stop.load()) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += SLEEP_NS;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&wakeup.cond, &wakeup.lock, &deadline);
+    }
+    wakeup.sleeping.store(false, std::memory_order_relaxed);
+    pthread_mutex_unlock(&wakeup.lock);
+}
+
+static void note_depth(StageCounters& stage, size_t depth) {
+    if (depth > stage.peak_depth.load(std::memory_order_relaxed)) {
+        stage.peak_depth.store(depth, std::memory_order_relaxed);
+    }
+}
+
+// Engine thread only
+static void publish(PipelineState* ps, const PublishItem& item) {
+    if (!ps->published.push(item)) {
+        ps->publisher_stage.stalls.fetch_add(1, std::memory_order_relaxed);
+        do {
+            ps->publisher_wakeup.notify();
+            sched_yield();
+        } while (!ps->published.push(item));
+    }
+    ps->publisher_wakeup.notify();
+}
+
+static void detect(PipelineState* ps, const Tick& tick, std::vector<ArbitrageOpportunity>& found, PublishItem& item) {
+    found.clear();
+    if (tick.rescan) {
+        ps->engine->scan_all_markets(found);
+    } else if (tick.data.is_valid) {
+        ps->engine->find_opportunities(tick.data.market_id, found);
+    }
+    long long detected = now_ns();
+    
+    item.submitted_ns = tick.submitted_ns;
+    item.queued_ns = detected;
+    if (!tick.rescan) {
+        item.kind = PUBLISH_QUOTE;
+        item.quote = tick.data;
+        publish(ps, item);
+    }
+    
+    item.kind = PUBLISH_OPPORTUNITY;
+    for (size_t i = 0; i < found.size(); i++) {
+        ps->detect.record(detected - tick.submitted_ns);
+        item.opportunity = found[i];
+        publish(ps, item);
+    }
+    if (!found.empty()) {
+        ps->opportunities.fetch_add(found.size(), std::memory_order_relaxed);
+    }
+}
+
+static void deliver(PipelineState* ps, PublishItem& item) {
+    if (item.kind == PUBLISH_QUOTE) {
+        if (ps->quote != NULL) {
+            ps->quote(&item.quote);
+        }
+        return;
+    }
+    if (ps->opportunity != NULL) {
+        ps->opportunity(&item.opportunity);
+    }
+    ps->publish.record(now_ns() - item.submitted_ns);
+}
+
+static void* engine_thread_func(void* arg) {
+    PipelineState* ps = (PipelineState*)arg;
+    std::vector<ArbitrageOpportunity> found;
+    PublishItem item;
+    Tick tick;
+    int idle = 0;
+    
+    while (true) {
+        size_t depth = ps->ticks.size();
+        if (!ps->ticks.pop(tick)) {
+            if (ps->stop_engine.load() && ps->ticks.size() == 0) {
+                break;
+            }
+            if (++idle < ps->spin_polls) {
+                cpu_relax();
+            } else {
+                sleep_until_pushed(ps->engine_wakeup, ps->ticks, ps->stop_engine);
+                idle = 0;
+            }
+            continue;
+        }
+        idle = 0;
+        
+        note_depth(ps->engine_stage, depth);
+        ps->engine_stage.items.fetch_add(1, std::memory_order_relaxed);
+        ps->engine_stage.wait.record(now_ns() - tick.submitted_ns);
+        detect(ps, tick, found, item);
+    }
+    return NULL;
+}
+
+static void* publisher_thread_func(void* arg) {
+    PipelineState* ps = (PipelineState*)arg;
+    PublishItem item;
+    int idle = 0;
+    
+    while (true) {
+        size_t depth = ps->published.size();
+        if (!ps->published.pop(item)) {
+            if (ps->stop_publisher.load() && ps->published.size() == 0) {
+                break;
+            }
+            if (++idle < ps->spin_polls) {
+                cpu_relax();
+            } else {
+                sleep_until_pushed(ps->publisher_wakeup, ps->published, ps->stop_publisher);
+                idle = 0;
+            }
+            continue;
+        }
+        idle = 0;
+        
+        note_depth(ps->publisher_stage, depth);
+        ps->publisher_stage.items.fetch_add(1, std::memory_order_relaxed);
+        ps->publisher_stage.wait.record(now_ns() - item.queued_ns);
+        deliver(ps, item);
+    }
+    return NULL;
+}
+
+Pipeline::Pipeline(Config* config, ArbitrageEngine* engine) {
+    this->config = config;
+    this->engine = engine;
+    this->quote_callback = NULL;
+    this->opportunity_callback = NULL;
+    
+    PipelineState* ps = new PipelineState(config->pipeline_queue_size);
+    ps->engine = engine;
+    ps->engine_cpu = config->engine_cpu;
+    ps->publisher_cpu = config->publisher_cpu;
+    if (sysconf(_SC_NPROCESSORS_ONLN) <= 1) {
+        ps->spin_polls = 0;
+    }
+    state = ps;
+}
+
+Pipeline::~Pipeline() {
+    stop();
+    delete (PipelineState*)state;
+}
+
+void Pipeline::set_quote_function(void (*func)(MarketData*)) {
+    quote_callback = func;
+    ((PipelineState*)state)->quote = func;
+}
+
+void Pipeline::set_opportunity_function(void (*func)(ArbitrageOpportunity*)) {
+    opportunity_callback = func;
+    ((PipelineState*)state)->opportunity = func;
+}
+
+bool Pipeline::start() {
+    PipelineState* ps = (PipelineState*)state;
+    if (ps->running.load()) {
+        return true;
+    }
+    ps->stop_engine.store(false);
+    ps->stop_publisher.store(false);
+    
+    if (pthread_create(&ps->publisher_thread, NULL, publisher_thread_func, ps) != 0) {
+        std::cerr << "Failed to start pipeline publisher thread" << std::endl;
+        return false;
+    }
+    if (pthread_create(&ps->engine_thread, NULL, engine_thread_func, ps) != 0) {
+        std::cerr << "Failed to start pipeline engine thread" << std::endl;
+        ps->stop_publisher.store(true);
+        ps->publisher_wakeup.notify();
+        pthread_join(ps->publisher_thread, NULL);
+        return false;
+    }
+    pin_thread(ps->engine_thread, ps->engine_cpu, "engine");
+    pin_thread(ps->publisher_thread, ps->publisher_cpu, "publisher");
+    ps->running.store(true);
+    return true;
+}
+
+void Pipeline::stop() {
+    PipelineState* ps = (PipelineState*)state;
+    if (!ps->running.load()) {
+        return;
+    }
+    ps->running.store(false);
+    
+    // Upstream first, so everything the engine publishes while draining
+    // still reaches the publisher
+    ps->stop_engine.store(true);
+    ps->engine_wakeup.notify();
+    pthread_join(ps->engine_thread, NULL);
+    
+    ps->stop_publisher.store(true);
+    ps->publisher_wakeup.notify();
+    pthread_join(ps->publisher_thread, NULL);
+}
+
+static void push_tick(PipelineState* ps, const Tick& tick) {
+    if (!ps->ticks.push(tick)) {
+        ps->engine_stage.stalls.fetch_add(1, std::memory_order_relaxed);
+        do {
+            ps->engine_wakeup.notify();
+            sched_yield();
+        } while (!ps->ticks.push(tick));
+    }
+    ps->engine_wakeup.notify();
+}
+
+void Pipeline::submit(const MarketData* data) {
+    PipelineState* ps = (PipelineState*)state;
+    if (data == NULL) {
+        return;
+    }
+    
+    if (!ps->running.load(std::memory_order_relaxed)) {
+        engine->store_market_data((MarketData*)data);
+        if (quote_callback != NULL) {
+            quote_callback((MarketData*)data);
+        }
+        if (opportunity_callback != NULL && data->is_valid) {
+            std::vector<ArbitrageOpportunity> found;
+            engine->find_opportunities(data->market_id, found);
+            for (size_t i = 0; i < found.size(); i++) {
+                opportunity_callback(&found[i]);
+            }
+        }
+        return;
+    }
+    
+    engine->store_market_data((MarketData*)data);
+    
+    Tick tick;
+    tick.data = *data;
+    tick.data.book = NULL;
+    tick.rescan = false;
+    tick.submitted_ns = now_ns();
+    push_tick(ps, tick);
+}
+
+void Pipeline::rescan() {
+    PipelineState* ps = (PipelineState*)state;
+    if (!ps->running.load(std::memory_order_relaxed)) {
+        if (opportunity_callback != NULL) {
+            std::vector<ArbitrageOpportunity> found;
+            engine->scan_all_markets(found);
+            for (size_t i = 0; i < found.size(); i++) {
+                opportunity_callback(&found[i]);
+            }
+        }
+        return;
+    }
+    
+    Tick tick;
+    tick.rescan = true;
+    tick.submitted_ns = now_ns();
+    push_tick(ps, tick);
+}
+
+static StageStats stage_stats(const StageCounters& stage, size_t depth, size_t capacity) {
+    StageStats s;
+    s.items = stage.items.load(std::memory_order_relaxed);
+    s.stalls = stage.stalls.load(std::memory_order_relaxed);
+    s.depth = depth;
+    s.peak_depth = stage.peak_depth.load(std::memory_order_relaxed);
+    s.capacity = capacity;
+    s.wait_p50_us = stage.wait.percentile_us(0.50);
+    s.wait_p99_us = stage.wait.percentile_us(0.99);
+    s.wait_max_us = stage.wait.max_us();
+    return s;
+}
+
+PipelineStats Pipeline::stats() {
+    PipelineState* ps = (PipelineState*)state;
+    PipelineStats s;
+    s.engine = stage_stats(ps->engine_stage, ps->ticks.size(), ps->ticks.capacity());
+    s.publisher = stage_stats(ps->publisher_stage, ps->published.size(), ps->published.capacity());
+    s.opportunities = ps->opportunities.load(std::memory_order_relaxed);
+    s.detect_p50_us = ps->detect.percentile_us(0.50);
+    s.detect_p99_us = ps->detect.percentile_us(0.99);
+    s.detect_max_us = ps->detect.max_us();
+    s.publish_p50_us = ps->publish.percentile_us(0.50);
+    s.publish_p99_us = ps->publish.percentile_us(0.99);
+    s.publish_max_us = ps->publish.max_us();
+    return s;
+}
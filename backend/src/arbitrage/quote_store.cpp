@@ -0,0 +1,150 @@
+#include "quote_store.h"
+#include <stdlib.h>
+#include <new>
+#include <sched.h>
+
+static const size_t CACHE_LINE = 64;
+
+// Most events are quoted by 2-3 venues, so start with a small block and
+// double it each time an event outgrows the previous one.
+static const uint32_t FIRST_BLOCK_SIZE = 4;
+
+template <typename T>
+static std::atomic<T>* alloc_array(size_t count, T initial) {
+    void* mem = NULL;
+    size_t bytes = ((count * sizeof(std::atomic<T>) + CACHE_LINE - 1) / CACHE_LINE) * CACHE_LINE;
+    if (posix_memalign(&mem, CACHE_LINE, bytes) != 0) {
+        throw std::bad_alloc();
+    }
+    std::atomic<T>* array = (std::atomic<T>*)mem;
+    for (size_t i = 0; i < count; i++) {
+        new (&array[i]) std::atomic<T>(initial);
+    }
+    return array;
+}
+
+template <typename T>
+static void free_array(std::atomic<T>* array, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        array[i].~atomic<T>();
+    }
+    free(array);
+}
+
+QuoteStore::QuoteStore(size_t capacity) {
+    slot_capacity = capacity;
+    used = 0;
+    seq = alloc_array<uint32_t>(capacity, 0);
+    market_id = alloc_array<SymbolId>(capacity, INVALID_SYMBOL);
+    market = alloc_array<int>(capacity, MARKET_POLYMARKET);
+    best_bid = alloc_array<double>(capacity, 0.0);
+    best_ask = alloc_array<double>(capacity, 0.0);
+    bid_size = alloc_array<double>(capacity, 0.0);
+    ask_size = alloc_array<double>(capacity, 0.0);
+    timestamp = alloc_array<long long>(capacity, 0);
+}
+
+QuoteStore::~QuoteStore() {
+    free_array(seq, slot_capacity);
+    free_array(market_id, slot_capacity);
+    free_array(market, slot_capacity);
+    free_array(best_bid, slot_capacity);
+    free_array(best_ask, slot_capacity);
+    free_array(bid_size, slot_capacity);
+    free_array(ask_size, slot_capacity);
+    free_array(timestamp, slot_capacity);
+}
+
+uint32_t QuoteStore::allocate(SymbolId event_id) {
+    if (event_id >= blocks.size()) {
+        EventBlocks empty;
+        empty.next = 0;
+        empty.end = 0;
+        empty.block_size = 0;
+        blocks.resize(event_id + 1, empty);
+    }
+    
+    EventBlocks& eb = blocks[event_id];
+    
+    // Reuse a slot this event gave back before carving a new block
+    if (!eb.free_slots.empty()) {
+        uint32_t slot = eb.free_slots.back();
+        eb.free_slots.pop_back();
+        return slot;
+    }
+    
+    if (eb.next == eb.end) {
+        uint32_t size = eb.block_size == 0 ? FIRST_BLOCK_SIZE : eb.block_size * 2;
+        if (used + size > slot_capacity) {
+            // Fall back to whatever is left rather than failing outright
+            size = (uint32_t)(slot_capacity - used);
+            if (size == 0) {
+                return INVALID_SLOT;
+            }
+        }
+        eb.next = (uint32_t)used;
+        eb.end = (uint32_t)(used + size);
+        eb.block_size = size;
+        used += size;
+    }
+    
+    return eb.next++;
+}
+
+void QuoteStore::release(SymbolId event_id, uint32_t slot) {
+    if (event_id < blocks.size() && slot < slot_capacity) {
+        blocks[event_id].free_slots.push_back(slot);
+    }
+}
+
+void QuoteStore::write(uint32_t slot, const MarketData* data) {
+    std::atomic<uint32_t>& s = seq[slot];
+    
+    // Several feed threads may write the same market, so claim the slot by
+    // moving seq from even to odd before touching the fields.
+    uint32_t v = s.load(std::memory_order_relaxed);
+    while ((v & 1) != 0 || !s.compare_exchange_weak(v, v + 1, std::memory_order_acquire)) {
+        sched_yield();
+        v = s.load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    
+    market_id[slot].store(data->market_id, std::memory_order_relaxed);
+    market[slot].store(data->market, std::memory_order_relaxed);
+    best_bid[slot].store(data->best_bid, std::memory_order_relaxed);
+    best_ask[slot].store(data->best_ask, std::memory_order_relaxed);
+    bid_size[slot].store(data->bid_size, std::memory_order_relaxed);
+    ask_size[slot].store(data->ask_size, std::memory_order_relaxed);
+    timestamp[slot].store(data->timestamp, std::memory_order_relaxed);
+    
+    s.store(v + 2, std::memory_order_release);
+}
+
+void QuoteStore::read(uint32_t slot, Quote& out) const {
+    const std::atomic<uint32_t>& s = seq[slot];
+    uint32_t s1, s2;
+    do {
+        s1 = s.load(std::memory_order_acquire);
+        if ((s1 & 1) != 0) {
+            sched_yield();
+            continue;
+        }
+        out.market_id = market_id[slot].load(std::memory_order_relaxed);
+        out.market = market[slot].load(std::memory_order_relaxed);
+        out.best_bid = best_bid[slot].load(std::memory_order_relaxed);
+        out.best_ask = best_ask[slot].load(std::memory_order_relaxed);
+        out.bid_size = bid_size[slot].load(std::memory_order_relaxed);
+        out.ask_size = ask_size[slot].load(std::memory_order_relaxed);
+        out.timestamp = timestamp[slot].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        s2 = s.load(std::memory_order_relaxed);
+    } while ((s1 & 1) != 0 || s1 != s2);
+}
+
+size_t QuoteStore::capacity() const {
+    return slot_capacity;
+}
+
+size_t QuoteStore::size() const {
+    return used;
+}
@@ -0,0 +1,201 @@
+#include "binary_protocol.h"
+#include "symbol_table.h"
+#include <cstring>
+
+// Byte-at-a-time so the layout is little-endian whatever the host is; the
+// compiler turns these into plain stores on x86
+static void put_u16(unsigned char* out, uint16_t value) {
+    out[0] = (unsigned char)value;
+    out[1] = (unsigned char)(value >> 8);
+}
+
+static void put_u32(unsigned char* out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static void put_u64(unsigned char* out, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        out[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static void put_f64(unsigned char* out, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put_u64(out, bits);
+}
+
+static uint16_t get_u16(const unsigned char* in) {
+    return (uint16_t)(in[0] | (in[1] << 8));
+}
+
+static uint32_t get_u32(const unsigned char* in) {
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+static uint64_t get_u64(const unsigned char* in) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+static double get_f64(const unsigned char* in) {
+    uint64_t bits = get_u64(in);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+void encode_market_data(const MarketData& data, unsigned char* out) {
+    memset(out, 0, BINARY_RECORD_SIZE);
+    out[0] = BIN_MARKET_DATA;
+    out[1] = (unsigned char)data.market;
+    put_u32(out + 4, data.market_id);
+    put_u32(out + 8, data.event_id);
+    put_u64(out + 16, (uint64_t)data.timestamp);
+    put_f64(out + 24, data.best_bid);
+    put_f64(out + 32, data.best_ask);
+    put_f64(out + 40, data.bid_size);
+    put_f64(out + 48, data.ask_size);
+}
+
+void encode_opportunity(const ArbitrageOpportunity& opp, unsigned char* out) {
+    memset(out, 0, BINARY_RECORD_SIZE);
+    out[0] = BIN_OPPORTUNITY;
+    out[1] = (unsigned char)opp.buy_market;
+    out[2] = (unsigned char)opp.sell_market;
+    out[3] = (unsigned char)(opp.legs > 255 ? 255 : opp.legs);
+    put_u32(out + 4, opp.event_id);
+    put_f64(out + 8, opp.buy_price);
+    put_f64(out + 16, opp.sell_price);
+    put_f64(out + 24, opp.profit_percentage);
+    put_f64(out + 32, opp.max_size);
+    put_f64(out + 40, opp.avg_buy_price);
+    put_f64(out + 48, opp.avg_sell_price);
+}
+
+void encode_snapshot_marker(int phase, int reason, uint32_t records, uint64_t sequence, unsigned char* out) {
+    memset(out, 0, SNAPSHOT_MARKER_SIZE);
+    out[0] = BIN_SNAPSHOT;
+    out[1] = (unsigned char)phase;
+    out[2] = (unsigned char)reason;
+    put_u32(out + 4, records);
+    put_u64(out + 8, sequence);
+}
+
+static void append_entries(std::string& out, SymbolTable& table, int kind, SymbolId begin, SymbolId end) {
+    for (SymbolId id = begin; id < end; id++) {
+        const std::string& name = table.name(id);
+        size_t length = name.size() > 0xFFFF ? 0xFFFF : name.size();
+        
+        unsigned char entry[8];
+        entry[0] = (unsigned char)kind;
+        entry[1] = 0;
+        put_u16(entry + 2, (uint16_t)length);
+        put_u32(entry + 4, id);
+        out.append((const char*)entry, sizeof(entry));
+        out.append(name.data(), length);
+    }
+}
+
+void encode_symbols(std::string& out, bool full, SymbolId market_begin, SymbolId market_end,
+                    SymbolId event_begin, SymbolId event_end) {
+    uint32_t count = 0;
+    if (market_end > market_begin) {
+        count += market_end - market_begin;
+    }
+    if (event_end > event_begin) {
+        count += event_end - event_begin;
+    }
+    
+    unsigned char header[8];
+    header[0] = BIN_SYMBOLS;
+    header[1] = full ? SYMBOLS_FULL : 0;
+    put_u16(header + 2, 0);
+    put_u32(header + 4, count);
+    out.append((const char*)header, sizeof(header));
+    
+    append_entries(out, market_symbols(), SYMBOL_MARKET, market_begin, market_end);
+    append_entries(out, event_symbols(), SYMBOL_EVENT, event_begin, event_end);
+}
+
+bool decode_market_data(const unsigned char* in, size_t length, MarketData& data) {
+    if (length < BINARY_RECORD_SIZE || in[0] != BIN_MARKET_DATA) {
+        return false;
+    }
+    data.market = in[1];
+    data.market_id = get_u32(in + 4);
+    data.event_id = get_u32(in + 8);
+    data.timestamp = (long long)get_u64(in + 16);
+    data.best_bid = get_f64(in + 24);
+    data.best_ask = get_f64(in + 32);
+    data.bid_size = get_f64(in + 40);
+    data.ask_size = get_f64(in + 48);
+    data.is_valid = true;
+    return true;
+}
+
+bool decode_opportunity(const unsigned char* in, size_t length, ArbitrageOpportunity& opp) {
+    if (length < BINARY_RECORD_SIZE || in[0] != BIN_OPPORTUNITY) {
+        return false;
+    }
+    opp.buy_market = in[1];
+    opp.sell_market = in[2];
+    opp.legs = in[3];
+    opp.event_id = get_u32(in + 4);
+    opp.buy_price = get_f64(in + 8);
+    opp.sell_price = get_f64(in + 16);
+    opp.profit_percentage = get_f64(in + 24);
+    opp.max_size = get_f64(in + 32);
+    opp.avg_buy_price = get_f64(in + 40);
+    opp.avg_sell_price = get_f64(in + 48);
+    return true;
+}
+
+bool decode_symbols(const unsigned char* in, size_t length, bool& full, std::vector<SymbolEntry>& entries) {
+    if (length < 8 || in[0] != BIN_SYMBOLS) {
+        return false;
+    }
+    full = (in[1] & SYMBOLS_FULL) != 0;
+    uint32_t count = get_u32(in + 4);
+    
+    size_t pos = 8;
+    entries.clear();
+    for (uint32_t i = 0; i < count; i++) {
+        if (length - pos < 8) {
+            return false;
+        }
+        size_t name_length = get_u16(in + pos + 2);
+        if (length - pos - 8 < name_length) {
+            return false;
+        }
+        
+        SymbolEntry entry;
+        entry.kind = in[pos];
+        entry.id = get_u32(in + pos + 4);
+        entry.name.assign((const char*)in + pos + 8, name_length);
+        entries.push_back(entry);
+        pos += 8 + name_length;
+    }
+    return true;
+}
+
+bool decode_snapshot_marker(const unsigned char* in, size_t length, int& phase, int& reason, uint32_t& records,
+                            uint64_t& sequence) {
+    if (length < SNAPSHOT_MARKER_SIZE || in[0] != BIN_SNAPSHOT) {
+        return false;
+    }
+    phase = in[1];
+    reason = in[2];
+    records = get_u32(in + 4);
+    sequence = get_u64(in + 8);
+    return true;
+}
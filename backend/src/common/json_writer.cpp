@@ -0,0 +1,422 @@
+#include "json_writer.h"
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+// Powers of ten that are exactly representable as doubles
+static const double EXACT_POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9
+};
+
+static const int MAX_FAST_DECIMALS = 9;
+static const double MAX_EXACT_INTEGER = 9007199254740992.0;  // 2^53
+
+static const uint64_t POW10[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+    10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+// 10^k for k = -348, -340, ..., 340 as normalized 64-bit significands and
+// binary exponents, rounded to nearest
+static const uint64_t CACHED_POW10_F[] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+    0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+    0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+    0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+    0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+    0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+    0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+    0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+    0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+    0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+    0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+    0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+    0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+    0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+    0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+    0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+    0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+    0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+    0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+    0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+    0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+    0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL
+};
+
+static const int16_t CACHED_POW10_E[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+    -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+    -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+    -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+    -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+    109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+    641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+    907, 933, 960, 986, 1013, 1039, 1066
+};
+
+// A double as f * 2^e with a full 64-bit significand
+struct DiyFp {
+    uint64_t f;
+    int e;
+    
+    DiyFp(uint64_t f, int e) {
+        this->f = f;
+        this->e = e;
+    }
+};
+
+static DiyFp multiply(const DiyFp& a, const DiyFp& b) {
+    unsigned __int128 product = (unsigned __int128)a.f * b.f;
+    uint64_t high = (uint64_t)(product >> 64);
+    if ((uint64_t)product & (1ULL << 63)) {
+        high++;  // round to nearest
+    }
+    return DiyFp(high, a.e + b.e + 64);
+}
+
+static DiyFp normalize(DiyFp x) {
+    int shift = __builtin_clzll(x.f);
+    return DiyFp(x.f << shift, x.e - shift);
+}
+
+// Cached power c = 10^-k such that x * c lands with a binary exponent in
+// [-60, -32], which the digit loop relies on
+static DiyFp cached_power(int e, int* k) {
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int rounded = (int)dk;
+    if (dk - rounded > 0.0) {
+        rounded++;
+    }
+    unsigned index = (unsigned)((rounded >> 3) + 1);
+    *k = -(-348 + (int)(index << 3));
+    return DiyFp(CACHED_POW10_F[index], CACHED_POW10_E[index]);
+}
+
+// Nudges the last digit towards the exact value while it stays inside the
+// rounding interval
+static void round_digits(char* digits, int length, uint64_t delta, uint64_t rest,
+                         uint64_t ten_kappa, uint64_t distance) {
+    while (rest < distance && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < distance || distance - rest > rest + ten_kappa - distance)) {
+        digits[length - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+// Grisu2 (Loitsch, "Printing Floating-Point Numbers Quickly and Accurately
+// with Integers"): the digits of a positive finite value such that
+// value == digits * 10^exponent after parsing. Always round-trips and is
+// the shortest such string for all but a tiny fraction of inputs.
+static int grisu2(double value, char* digits, int* exponent) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const uint64_t hidden = 1ULL << 52;
+    int biased = (int)((bits >> 52) & 0x7FF);
+    uint64_t significand = bits & (hidden - 1);
+    DiyFp v = biased != 0 ? DiyFp(significand + hidden, biased - 1075) : DiyFp(significand, -1074);
+    
+    // The halfway points to the neighbouring doubles bound what parses back
+    DiyFp plus = normalize(DiyFp((v.f << 1) + 1, v.e - 1));
+    DiyFp minus = v.f == hidden ? DiyFp((v.f << 2) - 1, v.e - 2) : DiyFp((v.f << 1) - 1, v.e - 1);
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+    
+    int k;
+    DiyFp c = cached_power(plus.e, &k);
+    DiyFp w = multiply(normalize(v), c);
+    DiyFp high = multiply(plus, c);
+    DiyFp low = multiply(minus, c);
+    high.f--;
+    low.f++;
+    uint64_t delta = high.f - low.f;
+    
+    // Integral and fractional parts of the scaled upper bound
+    DiyFp one(1ULL << -high.e, high.e);
+    uint64_t distance = high.f - w.f;
+    uint32_t integral = (uint32_t)(high.f >> -one.e);
+    uint64_t fraction = high.f & (one.f - 1);
+    int kappa = 1;
+    while (kappa < 10 && integral >= POW10[kappa]) {
+        kappa++;
+    }
+    
+    int length = 0;
+    while (kappa > 0) {
+        uint32_t digit = (uint32_t)(integral / POW10[kappa - 1]);
+        integral %= (uint32_t)POW10[kappa - 1];
+        if (digit != 0 || length != 0) {
+            digits[length++] = (char)('0' + digit);
+        }
+        kappa--;
+        uint64_t rest = ((uint64_t)integral << -one.e) + fraction;
+        if (rest <= delta) {
+            *exponent = k + kappa;
+            round_digits(digits, length, delta, rest, POW10[kappa] << -one.e, distance);
+            return length;
+        }
+    }
+    while (true) {
+        fraction *= 10;
+        delta *= 10;
+        char digit = (char)(fraction >> -one.e);
+        if (digit != 0 || length != 0) {
+            digits[length++] = (char)('0' + digit);
+        }
+        fraction &= one.f - 1;
+        kappa--;
+        if (fraction < delta) {
+            *exponent = k + kappa;
+            int index = -kappa;
+            round_digits(digits, length, delta, fraction, one.f, index < 20 ? distance * POW10[index] : 0);
+            return length;
+        }
+    }
+}
+
+static size_t format_integer(uint64_t value, char* out) {
+    char digits[20];
+    size_t count = 0;
+    do {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    
+    for (size_t i = 0; i < count; i++) {
+        out[i] = digits[count - 1 - i];
+    }
+    return count;
+}
+
+// Lays out digits * 10^exponent the way JavaScript prints numbers: plain
+// notation from 1e-7 up to 1e21, scientific outside that
+static size_t place_decimal_point(const char* digits, int count, int exponent, char* out) {
+    int point = count + exponent;  // digits before the decimal point
+    size_t length = 0;
+    if (exponent >= 0 && point <= 21) {
+        memcpy(out, digits, count);
+        length = count;
+        for (int i = 0; i < exponent; i++) {
+            out[length++] = '0';
+        }
+    } else if (point > 0 && point <= 21) {
+        memcpy(out, digits, point);
+        out[point] = '.';
+        memcpy(out + point + 1, digits + point, count - point);
+        length = count + 1;
+    } else if (point > -6 && point <= 0) {
+        out[length++] = '0';
+        out[length++] = '.';
+        for (int i = point; i < 0; i++) {
+            out[length++] = '0';
+        }
+        memcpy(out + length, digits, count);
+        length += count;
+    } else {
+        out[length++] = digits[0];
+        if (count > 1) {
+            out[length++] = '.';
+            memcpy(out + length, digits + 1, count - 1);
+            length += count - 1;
+        }
+        out[length++] = 'e';
+        int scientific = point - 1;
+        if (scientific < 0) {
+            out[length++] = '-';
+            scientific = -scientific;
+        }
+        length += format_integer((uint64_t)scientific, out + length);
+    }
+    return length;
+}
+
+size_t format_double(double value, char* out) {
+    if (!isfinite(value)) {
+        return 0;
+    }
+    
+    size_t length = 0;
+    if (signbit(value)) {
+        out[length++] = '-';
+        value = -value;
+    }
+    if (value == 0.0) {
+        out[length++] = '0';
+        return length;
+    }
+    
+    // Short decimals first: find the fewest decimals k for which
+    // mantissa / 10^k is exactly value. Both operands are exact doubles, so
+    // the division is correctly rounded - just as parsing the text is - and
+    // the digits are guaranteed to read back as the same double.
+    if (value < MAX_EXACT_INTEGER) {
+        for (int k = 0; k <= MAX_FAST_DECIMALS; k++) {
+            double scaled = value * EXACT_POW10[k];
+            if (scaled >= MAX_EXACT_INTEGER) {
+                break;
+            }
+            double mantissa = floor(scaled + 0.5);
+            if (mantissa / EXACT_POW10[k] == value) {
+                char digits[20];
+                size_t count = format_integer((uint64_t)mantissa, digits);
+                return length + place_decimal_point(digits, (int)count, -k, out + length);
+            }
+        }
+    }
+    
+    char digits[20];
+    int exponent;
+    int count = grisu2(value, digits, &exponent);
+    return length + place_decimal_point(digits, count, exponent, out + length);
+}
+
+JsonWriter::JsonWriter() {
+    clear();
+}
+
+void JsonWriter::clear() {
+    buffer.clear();
+    depth = 0;
+    has_member[0] = false;
+    after_key = false;
+}
+
+// Comma before every member or element after the first; nothing between a
+// key and its value
+void JsonWriter::separate() {
+    if (after_key) {
+        after_key = false;
+        return;
+    }
+    if (has_member[depth]) {
+        buffer += ',';
+    }
+    has_member[depth] = true;
+}
+
+void JsonWriter::begin_object() {
+    separate();
+    buffer += '{';
+    if (depth + 1 < MAX_DEPTH) {
+        depth++;
+    }
+    has_member[depth] = false;
+}
+
+void JsonWriter::end_object() {
+    buffer += '}';
+    if (depth > 0) {
+        depth--;
+    }
+}
+
+void JsonWriter::begin_array() {
+    separate();
+    buffer += '[';
+    if (depth + 1 < MAX_DEPTH) {
+        depth++;
+    }
+    has_member[depth] = false;
+}
+
+void JsonWriter::end_array() {
+    buffer += ']';
+    if (depth > 0) {
+        depth--;
+    }
+}
+
+void JsonWriter::key(const char* name) {
+    separate();
+    append_escaped(name, strlen(name));
+    buffer += ':';
+    after_key = true;
+}
+
+void JsonWriter::string(const char* value, size_t length) {
+    separate();
+    append_escaped(value, length);
+}
+
+void JsonWriter::string(const std::string& value) {
+    string(value.data(), value.size());
+}
+
+void JsonWriter::number(double value) {
+    separate();
+    char text[MAX_DOUBLE_CHARS];
+    size_t length = format_double(value, text);
+    if (length == 0) {
+        buffer.append("null", 4);
+    } else {
+        buffer.append(text, length);
+    }
+}
+
+void JsonWriter::integer(long long value) {
+    separate();
+    char text[24];
+    size_t length = 0;
+    uint64_t magnitude = (uint64_t)value;
+    if (value < 0) {
+        text[length++] = '-';
+        magnitude = 0 - magnitude;
+    }
+    length += format_integer(magnitude, text + length);
+    buffer.append(text, length);
+}
+
+void JsonWriter::boolean(bool value) {
+    separate();
+    if (value) {
+        buffer.append("true", 4);
+    } else {
+        buffer.append("false", 5);
+    }
+}
+
+void JsonWriter::null() {
+    separate();
+    buffer.append("null", 4);
+}
+
+// Copies runs of plain bytes in one append and escapes the rest
+void JsonWriter::append_escaped(const char* value, size_t length) {
+    static const char hex[] = "0123456789abcdef";
+    
+    buffer += '"';
+    size_t run = 0;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)value[i];
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        
+        buffer.append(value + run, i - run);
+        run = i + 1;
+        switch (c) {
+            case '"': buffer.append("\\\"", 2); break;
+            case '\\': buffer.append("\\\\", 2); break;
+            case '\n': buffer.append("\\n", 2); break;
+            case '\r': buffer.append("\\r", 2); break;
+            case '\t': buffer.append("\\t", 2); break;
+            case '\b': buffer.append("\\b", 2); break;
+            case '\f': buffer.append("\\f", 2); break;
+            default: {
+                char escape[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+                buffer.append(escape, 6);
+            }
+        }
+    }
+    buffer.append(value + run, length - run);
+    buffer += '"';
+}
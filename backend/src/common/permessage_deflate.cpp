@@ -0,0 +1,211 @@
+#include "permessage_deflate.h"
+#include <zlib.h>
+#include <cstring>
+#include <cstdlib>
+#include <set>
+#include <vector>
+
+static const int WINDOW_BITS = 15;
+static const int MEM_LEVEL = 8;
+static const int STANDALONE_MEM_LEVEL = 4;
+static const unsigned char SYNC_TRAILER[4] = {0x00, 0x00, 0xFF, 0xFF};
+
+static std::string trim(const std::string& s, size_t start, size_t end) {
+    while (start < end && (s[start] == ' ' || s[start] == '\t')) {
+        start++;
+    }
+    while (end > start && (s[end - 1] == ' ' || s[end - 1] == '\t')) {
+        end--;
+    }
+    return s.substr(start, end - start);
+}
+
+static void split(const std::string& s, char separator, std::vector<std::string>& parts) {
+    parts.clear();
+    size_t start = 0;
+    while (start <= s.size()) {
+        size_t end = s.find(separator, start);
+        if (end == std::string::npos) {
+            end = s.size();
+        }
+        parts.push_back(trim(s, start, end));
+        start = end + 1;
+    }
+}
+
+// Window bits parameter value, quoted or not; -1 if malformed
+static int window_bits(const std::string& value) {
+    std::string digits = value;
+    if (digits.size() >= 2 && digits[0] == '"' && digits[digits.size() - 1] == '"') {
+        digits = digits.substr(1, digits.size() - 2);
+    }
+    if (digits.empty() || digits.size() > 2 || digits.find_first_not_of("0123456789") != std::string::npos) {
+        return -1;
+    }
+    int bits = atoi(digits.c_str());
+    return bits >= 8 && bits <= 15 ? bits : -1;
+}
+
+bool negotiate_permessage_deflate(const std::string& offered, bool allow_takeover, std::string& response,
+                                  bool& takeover) {
+    std::vector<std::string> offers;
+    std::vector<std::string> params;
+    split(offered, ',', offers);
+    
+    for (size_t i = 0; i < offers.size(); i++) {
+        split(offers[i], ';', params);
+        if (params[0] != "permessage-deflate") {
+            continue;
+        }
+        
+        bool acceptable = true;
+        bool server_no_takeover = false;
+        std::set<std::string> seen;
+        for (size_t p = 1; p < params.size() && acceptable; p++) {
+            size_t equals = params[p].find('=');
+            std::string name = trim(params[p], 0, equals == std::string::npos ? params[p].size() : equals);
+            std::string value = equals == std::string::npos ? "" : trim(params[p], equals + 1, params[p].size());
+            if (!seen.insert(name).second) {
+                acceptable = false;  // a repeated parameter invalidates the offer
+            } else if (name == "server_no_context_takeover" || name == "client_no_context_takeover") {
+                acceptable = equals == std::string::npos;
+                server_no_takeover = server_no_takeover || name == "server_no_context_takeover";
+            } else if (name == "server_max_window_bits") {
+                acceptable = window_bits(value) == WINDOW_BITS;
+            } else if (name == "client_max_window_bits") {
+                // A 15-bit inflater reads streams from any smaller window
+                acceptable = equals == std::string::npos || window_bits(value) > 0;
+            } else {
+                acceptable = false;
+            }
+        }
+        if (!acceptable) {
+            continue;
+        }
+        
+        takeover = allow_takeover && !server_no_takeover;
+        response = "permessage-deflate; client_no_context_takeover";
+        if (!takeover) {
+            response += "; server_no_context_takeover";
+        }
+        return true;
+    }
+    return false;
+}
+
+MessageDeflater::MessageDeflater(int level, bool standalone) {
+    z_stream* zs = new z_stream();
+    memset(zs, 0, sizeof(*zs));
+    if (level < 1 || level > 9) {
+        level = Z_DEFAULT_COMPRESSION;
+    }
+    // Negative window bits: raw DEFLATE, no zlib header or checksum
+    int mem_level = standalone ? STANDALONE_MEM_LEVEL : MEM_LEVEL;
+    if (deflateInit2(zs, level, Z_DEFLATED, -WINDOW_BITS, mem_level, Z_DEFAULT_STRATEGY) != Z_OK) {
+        delete zs;
+        zs = NULL;
+    }
+    stream = zs;
+}
+
+MessageDeflater::~MessageDeflater() {
+    z_stream* zs = (z_stream*)stream;
+    if (zs != NULL) {
+        deflateEnd(zs);
+        delete zs;
+    }
+}
+
+bool MessageDeflater::compress(const char* data, size_t length, std::string& out, bool reset) {
+    z_stream* zs = (z_stream*)stream;
+    if (zs == NULL || (reset && deflateReset(zs) != Z_OK)) {
+        return false;
+    }
+    
+    size_t start = out.size();
+    size_t written = start;
+    zs->next_in = (Bytef*)data;
+    zs->avail_in = (uInt)length;
+    
+    // The sync flush ends in an empty stored block; the room deflateBound
+    // leaves is nearly always enough in one pass
+    size_t room = deflateBound(zs, (uLong)length) + 16;
+    while (true) {
+        out.resize(written + room);
+        zs->next_out = (Bytef*)&out[written];
+        zs->avail_out = (uInt)room;
+        int rc = deflate(zs, Z_SYNC_FLUSH);
+        written += room - zs->avail_out;
+        if (rc != Z_OK && rc != Z_BUF_ERROR) {
+            out.resize(start);
+            return false;
+        }
+        if (zs->avail_out != 0) {
+            break;
+        }
+        room = room < 4096 ? 4096 : room * 2;
+    }
+    
+    if (written - start < sizeof(SYNC_TRAILER) ||
+        memcmp(&out[written - sizeof(SYNC_TRAILER)], SYNC_TRAILER, sizeof(SYNC_TRAILER)) != 0) {
+        out.resize(start);
+        return false;
+    }
+    out.resize(written - sizeof(SYNC_TRAILER));
+    return true;
+}
+
+MessageInflater::MessageInflater() {
+    z_stream* zs = new z_stream();
+    memset(zs, 0, sizeof(*zs));
+    if (inflateInit2(zs, -WINDOW_BITS) != Z_OK) {
+        delete zs;
+        zs = NULL;
+    }
+    stream = zs;
+}
+
+MessageInflater::~MessageInflater() {
+    z_stream* zs = (z_stream*)stream;
+    if (zs != NULL) {
+        inflateEnd(zs);
+        delete zs;
+    }
+}
+
+bool MessageInflater::decompress(const char* data, size_t length, std::string& out, size_t limit) {
+    z_stream* zs = (z_stream*)stream;
+    out.clear();
+    if (zs == NULL || inflateReset(zs) != Z_OK) {
+        return false;
+    }
+    
+    // The sender stripped the flush trailer; it goes back on as a second input
+    const unsigned char* inputs[2] = {(const unsigned char*)data, SYNC_TRAILER};
+    size_t lengths[2] = {length, sizeof(SYNC_TRAILER)};
+    char buffer[16384];
+    for (int i = 0; i < 2; i++) {
+        zs->next_in = (Bytef*)inputs[i];
+        zs->avail_in = (uInt)lengths[i];
+        do {
+            zs->next_out = (Bytef*)buffer;
+            zs->avail_out = sizeof(buffer);
+            int rc = inflate(zs, Z_SYNC_FLUSH);
+            size_t produced = sizeof(buffer) - zs->avail_out;
+            if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR) {
+                return false;
+            }
+            out.append(buffer, produced);
+            if (out.size() > limit) {
+                return false;
+            }
+            if (rc == Z_STREAM_END) {
+                return true;  // a final block; anything after it is ignored
+            }
+            if (rc == Z_BUF_ERROR && produced == 0) {
+                break;  // no progress possible with what's left
+            }
+        } while (zs->avail_in > 0 || zs->avail_out == 0);
+    }
+    return true;
+}
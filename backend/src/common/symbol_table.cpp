@@ -0,0 +1,106 @@
+#include "symbol_table.h"
+#include <unordered_map>
+#include <atomic>
+#include <pthread.h>
+
+// Names live in fixed-size chunks that are never moved, so an ID resolves
+// with two loads and no lock even while other threads are interning.
+static const size_t CHUNK_BITS = 10;
+static const size_t CHUNK_SIZE = 1 << CHUNK_BITS;
+static const size_t MAX_CHUNKS = 4096;
+
+struct SymbolStorage {
+    std::unordered_map<std::string, SymbolId> ids;
+    std::atomic<std::string*> chunks[MAX_CHUNKS];
+    std::atomic<uint32_t> count;
+    pthread_mutex_t mutex;
+    
+    SymbolStorage() : count(0) {
+        for (size_t i = 0; i < MAX_CHUNKS; i++) {
+            chunks[i].store(NULL, std::memory_order_relaxed);
+        }
+        pthread_mutex_init(&mutex, NULL);
+    }
+    
+    ~SymbolStorage() {
+        for (size_t i = 0; i < MAX_CHUNKS; i++) {
+            delete[] chunks[i].load(std::memory_order_relaxed);
+        }
+        pthread_mutex_destroy(&mutex);
+    }
+};
+
+static const std::string EMPTY_SYMBOL;
+
+SymbolTable::SymbolTable() {
+    table = new SymbolStorage();
+}
+
+SymbolTable::~SymbolTable() {
+    delete (SymbolStorage*)table;
+}
+
+SymbolId SymbolTable::intern(const std::string& name) {
+    SymbolStorage* st = (SymbolStorage*)table;
+    pthread_mutex_lock(&st->mutex);
+    
+    std::unordered_map<std::string, SymbolId>::iterator it = st->ids.find(name);
+    if (it != st->ids.end()) {
+        SymbolId id = it->second;
+        pthread_mutex_unlock(&st->mutex);
+        return id;
+    }
+    
+    uint32_t id = st->count.load(std::memory_order_relaxed);
+    size_t chunk = id >> CHUNK_BITS;
+    if (chunk >= MAX_CHUNKS) {
+        pthread_mutex_unlock(&st->mutex);
+        return INVALID_SYMBOL;
+    }
+    
+    std::string* names = st->chunks[chunk].load(std::memory_order_relaxed);
+    if (names == NULL) {
+        names = new std::string[CHUNK_SIZE];
+        st->chunks[chunk].store(names, std::memory_order_release);
+    }
+    names[id & (CHUNK_SIZE - 1)] = name;
+    st->ids[name] = id;
+    st->count.store(id + 1, std::memory_order_release);
+    
+    pthread_mutex_unlock(&st->mutex);
+    return id;
+}
+
+SymbolId SymbolTable::find(const std::string& name) {
+    SymbolStorage* st = (SymbolStorage*)table;
+    pthread_mutex_lock(&st->mutex);
+    std::unordered_map<std::string, SymbolId>::iterator it = st->ids.find(name);
+    SymbolId id = (it != st->ids.end()) ? it->second : INVALID_SYMBOL;
+    pthread_mutex_unlock(&st->mutex);
+    return id;
+}
+
+const std::string& SymbolTable::name(SymbolId id) {
+    SymbolStorage* st = (SymbolStorage*)table;
+    if (id >= st->count.load(std::memory_order_acquire)) {
+        return EMPTY_SYMBOL;
+    }
+    
+    std::string* names = st->chunks[id >> CHUNK_BITS].load(std::memory_order_acquire);
+    return names[id & (CHUNK_SIZE - 1)];
+}
+
+size_t SymbolTable::size() {
+    SymbolStorage* st = (SymbolStorage*)table;
+    return st->count.load(std::memory_order_acquire);
+}
+
+SymbolTable& market_symbols() {
+    static SymbolTable table;
+    return table;
+}
+
+SymbolTable& event_symbols() {
+    static SymbolTable table;
+    return table;
+}
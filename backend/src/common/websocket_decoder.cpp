@@ -0,0 +1,159 @@
+#include "websocket_decoder.h"
+#include "websocket_protocol.h"
+
+static const size_t MAX_CONTROL_PAYLOAD = 125;
+static const size_t COMPACT_THRESHOLD = 65536;  // consumed bytes kept before the buffer is shifted
+
+WebSocketDecoder::WebSocketDecoder(bool masked, size_t max_message) {
+    this->masked = masked;
+    this->max_message = max_message;
+    head = 0;
+    fragment_opcode = 0;
+    fragment_compressed = false;
+    compression = false;
+    error = 0;
+}
+
+void WebSocketDecoder::reset() {
+    buffer.clear();
+    head = 0;
+    fragments.clear();
+    fragment_opcode = 0;
+    fragment_compressed = false;
+    error = 0;
+}
+
+void WebSocketDecoder::feed(const char* data, size_t length) {
+    // Consumed frames are dropped lazily: all at once when the buffer
+    // empties, otherwise only once enough has piled up to be worth a move
+    if (head == buffer.size()) {
+        buffer.clear();
+        head = 0;
+    } else if (head >= COMPACT_THRESHOLD && head >= buffer.size() / 2) {
+        buffer.erase(0, head);
+        head = 0;
+    }
+    buffer.append(data, length);
+}
+
+int WebSocketDecoder::fail(int code) {
+    error = code;
+    return DECODE_ERROR;
+}
+
+static bool is_control(int opcode) {
+    return (opcode & 0x08) != 0;
+}
+
+int WebSocketDecoder::next(WebSocketMessage& message) {
+    if (error != 0) {
+        return DECODE_ERROR;
+    }
+    
+    while (true) {
+        const unsigned char* p = (const unsigned char*)buffer.data() + head;
+        size_t avail = buffer.size() - head;
+        if (avail < 2) {
+            return DECODE_MORE;
+        }
+        
+        bool fin = (p[0] & 0x80) != 0;
+        int reserved = p[0] & 0x70;
+        int opcode = p[0] & 0x0F;
+        bool frame_masked = (p[1] & 0x80) != 0;
+        uint64_t length = p[1] & 0x7F;
+        size_t header = 2;
+        
+        // Everything that can be judged from the first two bytes fails
+        // before we wait for the rest of the frame
+        if (frame_masked != masked) {
+            return fail(WS_CLOSE_PROTOCOL_ERROR);
+        }
+        bool first = opcode == WS_TEXT || opcode == WS_BINARY;
+        if (reserved != 0 && !(reserved == WS_RSV1 && compression && first)) {
+            return fail(WS_CLOSE_PROTOCOL_ERROR);
+        }
+        if (is_control(opcode)) {
+            if (opcode > WS_PONG || !fin || length > MAX_CONTROL_PAYLOAD) {
+                return fail(WS_CLOSE_PROTOCOL_ERROR);
+            }
+        } else if (opcode == WS_CONTINUATION) {
+            if (fragment_opcode == 0) {
+                return fail(WS_CLOSE_PROTOCOL_ERROR);
+            }
+        } else if (!first || fragment_opcode != 0) {
+            return fail(WS_CLOSE_PROTOCOL_ERROR);  // reserved opcode, or interrupts a fragmented message
+        }
+        
+        if (length == 126) {
+            if (avail < 4) {
+                return DECODE_MORE;
+            }
+            length = ((uint64_t)p[2] << 8) | p[3];
+            header = 4;
+        } else if (length == 127) {
+            if (avail < 10) {
+                return DECODE_MORE;
+            }
+            length = 0;
+            for (int i = 0; i < 8; i++) {
+                length = (length << 8) | p[2 + i];
+            }
+            if (length >> 63) {
+                return fail(WS_CLOSE_PROTOCOL_ERROR);  // the top bit must be zero
+            }
+            header = 10;
+        }
+        
+        size_t so_far = opcode == WS_CONTINUATION ? fragments.size() : 0;
+        if (length > max_message - so_far) {
+            return fail(WS_CLOSE_TOO_BIG);
+        }
+        
+        const unsigned char* mask = p + header;
+        if (masked) {
+            header += 4;
+        }
+        if (avail < header || avail - header < length) {
+            return DECODE_MORE;
+        }
+        
+        char* payload = &buffer[head + header];
+        if (masked) {
+            websocket_apply_mask(payload, (size_t)length, mask);
+        }
+        head += header + (size_t)length;
+        
+        if (is_control(opcode)) {
+            message.opcode = opcode;
+            message.compressed = false;
+            message.payload.assign(payload, (size_t)length);
+            return DECODE_MESSAGE;
+        }
+        if (opcode != WS_CONTINUATION && fin) {
+            // Unfragmented: the common case, one copy out of the buffer
+            message.opcode = opcode;
+            message.compressed = reserved != 0;
+            message.payload.assign(payload, (size_t)length);
+            return DECODE_MESSAGE;
+        }
+        if (opcode != WS_CONTINUATION) {
+            fragment_opcode = opcode;
+            fragment_compressed = reserved != 0;
+            fragments.assign(payload, (size_t)length);
+            continue;
+        }
+        
+        fragments.append(payload, (size_t)length);
+        if (!fin) {
+            continue;
+        }
+        message.opcode = fragment_opcode;
+        message.compressed = fragment_compressed;
+        message.payload.swap(fragments);
+        fragments.clear();
+        fragment_opcode = 0;
+        fragment_compressed = false;
+        return DECODE_MESSAGE;
+    }
+}
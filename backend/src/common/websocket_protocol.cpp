@@ -0,0 +1,196 @@
+#include "websocket_protocol.h"
+#include <cstring>
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const char base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+std::string base64_encode(const unsigned char* data, size_t length) {
+    std::string result;
+    int i = 0;
+    int j = 0;
+    unsigned char char_array_3[3];
+    unsigned char char_array_4[4];
+    
+    while (length--) {
+        char_array_3[i++] = *(data++);
+        if (i == 3) {
+            char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
+            char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
+            char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
+            char_array_4[3] = char_array_3[2] & 0x3f;
+            
+            for (i = 0; i < 4; i++) {
+                result += base64_chars[char_array_4[i]];
+            }
+            i = 0;
+        }
+    }
+    
+    if (i) {
+        for (j = i; j < 3; j++) {
+            char_array_3[j] = '\0';
+        }
+        
+        char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
+        char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
+        char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
+        char_array_4[3] = char_array_3[2] & 0x3f;
+        
+        for (j = 0; j < i + 1; j++) {
+            result += base64_chars[char_array_4[j]];
+        }
+        
+        while (i++ < 3) {
+            result += '=';
+        }
+    }
+    
+    return result;
+}
+
+void sha1(const unsigned char* data, size_t length, unsigned char* hash) {
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    
+    size_t orig_len = length;
+    size_t new_len = ((length + 9) / 64) * 64 + 64;
+    unsigned char* msg = new unsigned char[new_len];
+    memcpy(msg, data, length);
+    msg[length] = 0x80;
+    memset(msg + length + 1, 0, new_len - length - 1);
+    
+    uint64_t bit_len = orig_len * 8;
+    for (int i = 0; i < 8; i++) {
+        msg[new_len - 8 + i] = (bit_len >> (56 - i * 8)) & 0xFF;
+    }
+    
+    for (size_t chunk = 0; chunk < new_len; chunk += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++) {
+            w[i] = (msg[chunk + i * 4] << 24) | (msg[chunk + i * 4 + 1] << 16) |
+                   (msg[chunk + i * 4 + 2] << 8) | msg[chunk + i * 4 + 3];
+        }
+        for (int i = 16; i < 80; i++) {
+            w[i] = ((w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16]) << 1) |
+                   ((w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16]) >> 31);
+        }
+        
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | ((~b) & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            
+            uint32_t temp = ((a << 5) | (a >> 27)) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = ((b << 30) | (b >> 2));
+            b = a;
+            a = temp;
+        }
+        
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+    
+    for (int i = 0; i < 5; i++) {
+        hash[i * 4] = (h[i] >> 24) & 0xFF;
+        hash[i * 4 + 1] = (h[i] >> 16) & 0xFF;
+        hash[i * 4 + 2] = (h[i] >> 8) & 0xFF;
+        hash[i * 4 + 3] = h[i] & 0xFF;
+    }
+    
+    delete[] msg;
+}
+
+std::string websocket_accept_key(const std::string& key) {
+    const std::string magic = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    std::string accept_key = key + magic;
+    
+    unsigned char hash[20];
+    sha1((const unsigned char*)accept_key.c_str(), accept_key.length(), hash);
+    
+    return base64_encode(hash, 20);
+}
+
+size_t websocket_frame_header(unsigned char* out, int opcode, uint64_t payload_length) {
+    out[0] = (unsigned char)(0x80 | opcode);
+    
+    if (payload_length < 126) {
+        out[1] = (unsigned char)payload_length;
+        return 2;
+    }
+    if (payload_length < 65536) {
+        out[1] = 126;
+        out[2] = (unsigned char)((payload_length >> 8) & 0xFF);
+        out[3] = (unsigned char)(payload_length & 0xFF);
+        return 4;
+    }
+    out[1] = 127;
+    for (int i = 0; i < 8; i++) {
+        out[2 + i] = (unsigned char)((payload_length >> (56 - i * 8)) & 0xFF);
+    }
+    return 10;
+}
+
+void websocket_apply_mask(char* data, size_t length, const unsigned char* mask) {
+    // The key repeated across a register. Every step below is a multiple of
+    // four bytes, so each one starts on key byte 0 again; XOR is bytewise,
+    // so host byte order doesn't matter.
+    unsigned char pattern[16];
+    for (int i = 0; i < 16; i++) {
+        pattern[i] = mask[i & 3];
+    }
+    
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128i key = _mm_loadu_si128((const __m128i*)pattern);
+    for (; i + 64 <= length; i += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(data + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(data + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(data + i + 32));
+        __m128i d = _mm_loadu_si128((const __m128i*)(data + i + 48));
+        _mm_storeu_si128((__m128i*)(data + i), _mm_xor_si128(a, key));
+        _mm_storeu_si128((__m128i*)(data + i + 16), _mm_xor_si128(b, key));
+        _mm_storeu_si128((__m128i*)(data + i + 32), _mm_xor_si128(c, key));
+        _mm_storeu_si128((__m128i*)(data + i + 48), _mm_xor_si128(d, key));
+    }
+    for (; i + 16 <= length; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(data + i));
+        _mm_storeu_si128((__m128i*)(data + i), _mm_xor_si128(a, key));
+    }
+#endif
+    uint64_t word;
+    memcpy(&word, pattern, sizeof(word));
+    for (; i + 8 <= length; i += 8) {
+        uint64_t value;
+        memcpy(&value, data + i, sizeof(value));
+        value ^= word;
+        memcpy(data + i, &value, sizeof(value));
+    }
+    for (; i < length; i++) {
+        data[i] ^= mask[i & 3];
+    }
+}
+
+bool websocket_valid_close_code(int code) {
+    return (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1014) || (code >= 3000 && code <= 4999);
+}
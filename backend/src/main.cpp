@@ -1,37 +1,68 @@
 #include "types.h"
+#include "symbol_table.h"
+#include "event_matcher.h"
 #include "market_data_client.h"
 #include "arbitrage_engine.h"
 #include "websocket_server.h"
+#include "conflator.h"
+#include "pipeline.h"
+#include "fee_model.h"
 #include <iostream>
+#include <vector>
 #include <signal.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <time.h>
+
+static const time_t SERVER_STATS_INTERVAL = 60;
 
 bool should_run = true;
-ArbitrageEngine* global_engine = NULL;
+volatile sig_atomic_t reload_fees = 0;
+Pipeline* global_pipeline = NULL;
 WebSocketServer* global_server = NULL;
+Conflator* global_conflator = NULL;
 
 void handle_signal(int sig) {
     std::cout << "\nShutting down..." << std::endl;
     should_run = false;
 }
 
+void handle_reload(int) {
+    reload_fees = 1;
+}
+
 void on_opportunity(ArbitrageOpportunity* opp) {
     double profit_pct = opp->profit_percentage * 100.0;
-    std::cout << "Opportunity: " << opp->event_id << " - " << profit_pct 
-              << "% profit, buy at " << opp->buy_price << " sell at " 
-              << opp->sell_price << std::endl;
+    if (opp->legs > 0) {
+        std::cout << "Opportunity: " << event_symbols().name(opp->event_id) << " - " << profit_pct
+                  << "% profit, buy all " << opp->legs << " outcomes for " << opp->buy_price << std::endl;
+    } else {
+        std::cout << "Opportunity: " << event_symbols().name(opp->event_id) << " - " << profit_pct 
+                  << "% profit, buy at " << opp->buy_price << " sell at " 
+                  << opp->sell_price << std::endl;
+    }
     
     if (global_server != NULL) {
         global_server->broadcast_opportunity(opp);
     }
 }
 
+// Feed threads only hand ticks to the pipeline; detection and everything
+// below run on its engine and publisher threads
 void on_market_update(MarketData* data) {
-    if (global_engine != NULL) {
-        global_engine->update_market_data(data);
+    if (global_pipeline != NULL) {
+        global_pipeline->submit(data);
     }
-    
+}
+
+// The engine sees every tick; clients get the conflated stream
+void on_published_quote(MarketData* data) {
+    if (global_conflator != NULL) {
+        global_conflator->offer(data);
+    }
+}
+
+void on_conflated_update(MarketData* data) {
     if (global_server != NULL) {
         global_server->broadcast_market_data(data);
     }
@@ -40,45 +71,187 @@ void on_market_update(MarketData* data) {
 int main(int argc, char* argv[]) {
     signal(SIGINT, handle_signal);
     signal(SIGTERM, handle_signal);
+    signal(SIGHUP, handle_reload);
     
     std::cout << "Cross-Market Arbitrage Platform" << std::endl;
     std::cout << "Starting..." << std::endl;
     
     Config config;
     
+    // Endpoint overrides, e.g. to run against a local mock server
+    if (getenv("POLYMARKET_GAMMA_URL") != NULL) {
+        config.polymarket_gamma_url = getenv("POLYMARKET_GAMMA_URL");
+    }
+    if (getenv("POLYMARKET_CLOB_URL") != NULL) {
+        config.polymarket_clob_url = getenv("POLYMARKET_CLOB_URL");
+    }
+    if (getenv("POLYMARKET_WS_URL") != NULL) {
+        // Set to an empty string to fall back to REST polling
+        config.polymarket_ws_url = getenv("POLYMARKET_WS_URL");
+    }
+    
+    // Set to an empty string to leave a venue out
+    if (getenv("KALSHI_URL") != NULL) {
+        config.kalshi_url = getenv("KALSHI_URL");
+    }
+    if (getenv("PREDICTIT_URL") != NULL) {
+        config.predictit_url = getenv("PREDICTIT_URL");
+    }
+    
+    // Per-venue fee overrides, see fee_model.h; SIGHUP reloads the file
+    if (getenv("FEE_SCHEDULE") != NULL) {
+        config.fee_schedule_path = getenv("FEE_SCHEDULE");
+    }
+    if (!config.fee_schedule_path.empty() && !load_fee_schedules(config.fee_schedule_path, config.fees)) {
+        return 1;
+    }
+    
+    // Curated cross-venue event mapping, see EventMatcher::load_mapping
+    if (getenv("EVENT_MAPPING") != NULL) {
+        config.event_mapping_path = getenv("EVENT_MAPPING");
+    }
+    
+    // Feeds ask the matcher for event IDs at discovery, so it is ready
+    // before they start
+    event_matcher().set_threshold(config.event_match_threshold);
+    if (!config.event_mapping_path.empty() && !event_matcher().load_mapping(config.event_mapping_path)) {
+        return 1;
+    }
+    
     ArbitrageEngine engine(&config);
-    engine.set_opportunity_function(on_opportunity);
-    global_engine = &engine;
     
     int ws_port = 8080;
     if (argc > 1) {
         ws_port = atoi(argv[1]);
     }
     
-    WebSocketServer ws_server(ws_port);
+    WebSocketServer ws_server(ws_port, &config);
     if (!ws_server.start()) {
         std::cout << "Failed to start WebSocket server" << std::endl;
         return 1;
     }
     global_server = &ws_server;
     
-    PolymarketClient polymarket;
-    polymarket.set_update_function(on_market_update);
+    Conflator conflator(&config);
+    conflator.set_emit_function(on_conflated_update);
+    if (!conflator.start()) {
+        ws_server.stop();
+        return 1;
+    }
+    global_conflator = &conflator;
     
-    std::cout << "Connecting to Polymarket..." << std::endl;
-    if (!polymarket.connect()) {
+    Pipeline pipeline(&config, &engine);
+    pipeline.set_quote_function(on_published_quote);
+    pipeline.set_opportunity_function(on_opportunity);
+    if (!pipeline.start()) {
+        conflator.stop();
+        ws_server.stop();
+        return 1;
+    }
+    global_pipeline = &pipeline;
+    
+    // Each venue runs on its own thread and submits to the pipeline
+    // concurrently
+    PolymarketClient polymarket(&config);
+    KalshiClient kalshi(&config);
+    PredictItClient predictit(&config);
+    std::vector<MarketDataClient*> feeds;
+    feeds.push_back(&polymarket);
+    if (!config.kalshi_url.empty()) {
+        feeds.push_back(&kalshi);
+    }
+    if (!config.predictit_url.empty()) {
+        feeds.push_back(&predictit);
+    }
+    
+    size_t connected = 0;
+    for (size_t i = 0; i < feeds.size(); i++) {
+        feeds[i]->set_update_function(on_market_update);
+        if (feeds[i]->connect()) {
+            connected++;
+        }
+    }
+    if (connected == 0) {
         std::cout << "Failed to connect" << std::endl;
+        pipeline.stop();
+        conflator.stop();
         ws_server.stop();
         return 1;
     }
     
     std::cout << "Running. WebSocket server on port " << ws_port << ". Press Ctrl+C to stop." << std::endl;
     
+    time_t last_stats = time(NULL);
     while (should_run) {
         usleep(100000);
+        
+        // SIGHUP: re-read the fee file, then re-price every standing pair,
+        // since quotes that don't tick would otherwise keep the old verdict
+        if (reload_fees) {
+            reload_fees = 0;
+            if (config.fee_schedule_path.empty()) {
+                std::cout << "No fee schedule file to reload (FEE_SCHEDULE)" << std::endl;
+            } else if (load_fee_schedules(config.fee_schedule_path, config.fees)) {
+                engine.set_fee_schedules(config.fees);
+                pipeline.rescan();
+                std::cout << "Fee schedule reloaded from " << config.fee_schedule_path << std::endl;
+            }
+        }
+        
+        if (time(NULL) - last_stats >= SERVER_STATS_INTERVAL) {
+            last_stats = time(NULL);
+            ServerStats stats = ws_server.stats();
+            if (stats.clients > 0 || stats.slow_disconnects > 0 || stats.resyncs > 0) {
+                std::cout << "WebSocket: " << stats.clients << " clients, "
+                          << stats.queued << " queued (deepest " << stats.max_queue_depth
+                          << ", peak " << stats.peak_queue_depth << "), "
+                          << stats.messages_coalesced << " coalesced, "
+                          << stats.messages_dropped << " dropped, "
+                          << stats.messages_filtered << " filtered, "
+                          << stats.resyncs << " resyncs, "
+                          << stats.snapshots_sent << " snapshots, "
+                          << stats.slow_disconnects << " slow clients closed" << std::endl;
+                if (stats.compress_bytes_in > 0) {
+                    std::cout << "Compression: " << stats.deflate_clients << " clients, "
+                              << stats.messages_compressed << " messages, "
+                              << stats.compress_bytes_in << " -> " << stats.compress_bytes_out << " bytes" << std::endl;
+                }
+                
+                ConflatorStats conflation = conflator.stats();
+                std::cout << "Conflation: " << conflation.offered << " updates in, "
+                          << conflation.emitted << " sent, " << conflation.unchanged << " unchanged, "
+                          << conflation.coalesced << " coalesced, " << conflation.pending << " pending" << std::endl;
+            }
+            
+            EventMatcherStats matching = event_matcher().stats();
+            if (matching.contracts > 0) {
+                std::cout << "Events: " << matching.contracts << " contracts in " << matching.events << " events, "
+                          << matching.shared_events << " across venues (" << matching.mapped << " mapped, "
+                          << matching.fuzzy << " fuzzy matches)" << std::endl;
+            }
+            
+            PipelineStats flow = pipeline.stats();
+            if (flow.engine.items > 0) {
+                std::cout << "Pipeline: engine " << flow.engine.items << " ticks, "
+                          << flow.engine.depth << " queued (peak " << flow.engine.peak_depth << "/" << flow.engine.capacity << "), "
+                          << flow.engine.stalls << " stalls, wait p50 " << flow.engine.wait_p50_us
+                          << "us p99 " << flow.engine.wait_p99_us << "us; publisher " << flow.publisher.items << " items, "
+                          << flow.publisher.depth << " queued (peak " << flow.publisher.peak_depth << "), "
+                          << flow.publisher.stalls << " stalls, wait p99 " << flow.publisher.wait_p99_us << "us" << std::endl;
+                if (flow.opportunities > 0) {
+                    std::cout << "Tick to opportunity: " << flow.opportunities << " found, detect p50 "
+                              << flow.detect_p50_us << "us p99 " << flow.detect_p99_us << "us, published p50 "
+                              << flow.publish_p50_us << "us p99 " << flow.publish_p99_us << "us" << std::endl;
+                }
+            }
+        }
     }
     
-    polymarket.disconnect();
+    for (size_t i = 0; i < feeds.size(); i++) {
+        feeds[i]->disconnect();
+    }
+    pipeline.stop();
+    conflator.stop();
     ws_server.stop();
     std::cout << "Stopped." << std::endl;
     
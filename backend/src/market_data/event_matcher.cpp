@@ -0,0 +1,658 @@
+#include "event_matcher.h"
+#include "types.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <unordered_map>
+#include <cmath>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <json/json.h>
+
+static const double DEFAULT_THRESHOLD = 0.6;
+
+// Tokens in more than this share of indexed questions ("win", "price",
+// the year) don't start candidates; they only add to candidates found
+// through rarer tokens
+static const double COMMON_TOKEN_SHARE = 0.01;
+static const size_t COMMON_TOKEN_MIN_DOCS = 64;
+
+// Words that say nothing about which event a question is about. Never
+// add a POLARITY_WORDS entry here: those decide which side of an event a
+// question is on.
+static const char* STOPWORDS[] = {
+    "a", "an", "the", "will", "be", "is", "are", "was", "were", "of", "in", "on", "at",
+    "to", "for", "and", "or", "by", "it", "its", "this", "that", "does", "do", "there", "any"
+};
+
+static const char* MONTHS[][2] = {
+    {"january", "jan"}, {"february", "feb"}, {"march", "mar"}, {"april", "apr"},
+    {"june", "jun"}, {"july", "jul"}, {"august", "aug"}, {"september", "sep"},
+    {"sept", "sep"}, {"october", "oct"}, {"november", "nov"}, {"december", "dec"}
+};
+
+// Which side of a threshold, date or outcome a question asks about. Two
+// questions that only differ in these ("above" / "below", "win" / "not
+// win") share almost every token but are opposite events.
+enum Polarity {
+    POLARITY_UP = 1,
+    POLARITY_DOWN = 2,
+    POLARITY_BEFORE = 4,
+    POLARITY_AFTER = 8,
+    POLARITY_NEGATED = 16   // an odd number of negations
+};
+
+struct PolarityWord {
+    const char* word;   // as stem() leaves it
+    unsigned flag;
+};
+
+static const PolarityWord POLARITY_WORDS[] = {
+    {"above", POLARITY_UP}, {"over", POLARITY_UP}, {"exceed", POLARITY_UP}, {"more", POLARITY_UP},
+    {"higher", POLARITY_UP}, {"greater", POLARITY_UP}, {"reach", POLARITY_UP}, {"hit", POLARITY_UP},
+    {"rise", POLARITY_UP}, {"increase", POLARITY_UP}, {"hike", POLARITY_UP}, {"raise", POLARITY_UP},
+    {"below", POLARITY_DOWN}, {"under", POLARITY_DOWN}, {"less", POLARITY_DOWN}, {"fewer", POLARITY_DOWN},
+    {"lower", POLARITY_DOWN}, {"fall", POLARITY_DOWN}, {"drop", POLARITY_DOWN}, {"dip", POLARITY_DOWN},
+    {"decrease", POLARITY_DOWN}, {"cut", POLARITY_DOWN},
+    {"before", POLARITY_BEFORE}, {"after", POLARITY_AFTER},
+    {"not", POLARITY_NEGATED}, {"no", POLARITY_NEGATED}, {"never", POLARITY_NEGATED},
+    {"without", POLARITY_NEGATED}, {"lose", POLARITY_NEGATED}, {"fail", POLARITY_NEGATED}
+};
+
+// A question as the matcher sees it: distinct token IDs, sorted, the
+// numbers it mentions in canonical form, sorted, and its Polarity flags
+struct Question {
+    std::vector<uint32_t> tokens;
+    std::vector<std::string> numbers;
+    unsigned polarity;
+    
+    Question() {
+        polarity = 0;
+    }
+};
+
+struct Doc {
+    SymbolId event;
+    Question question;
+};
+
+struct EventInfo {
+    unsigned venues;   // bit per Market
+    std::vector<EventContract> contracts;
+    
+    EventInfo() {
+        venues = 0;
+    }
+};
+
+struct Assignment {
+    SymbolId event;
+    bool pinned;       // from the mapping file
+    bool registered;   // in the event table and the index
+    
+    Assignment() {
+        event = INVALID_SYMBOL;
+        pinned = false;
+        registered = false;
+    }
+};
+
+struct MatcherState {
+    pthread_mutex_t lock;
+    double threshold;
+    
+    std::unordered_map<std::string, uint32_t> token_ids;
+    std::vector<uint32_t> df;                        // docs containing each token
+    std::vector<std::vector<uint32_t> > postings;    // token -> docs
+    std::vector<Doc> docs;
+    std::unordered_map<std::string, SymbolId> exact; // normalised question -> event
+    
+    std::unordered_map<SymbolId, EventInfo> events;
+    std::vector<Assignment> assigned;                // by market ID
+    EventMatcherStats counters;
+    
+    // Scratch for candidate scoring
+    std::vector<double> acc;
+    std::vector<uint32_t> touched;
+    
+    MatcherState() {
+        threshold = DEFAULT_THRESHOLD;
+        pthread_mutex_init(&lock, NULL);
+    }
+    
+    ~MatcherState() {
+        pthread_mutex_destroy(&lock);
+    }
+};
+
+static bool is_stopword(const std::string& word) {
+    for (size_t i = 0; i < sizeof(STOPWORDS) / sizeof(STOPWORDS[0]); i++) {
+        if (word == STOPWORDS[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Plural and possessive endings, then month names to their abbreviation
+static std::string stem(const std::string& word) {
+    std::string w = word;
+    size_t n = w.size();
+    if (n > 4 && w.compare(n - 3, 3, "ies") == 0) {
+        w = w.substr(0, n - 3) + "y";
+    } else if (n > 3 && w[n - 1] == 's' && w[n - 2] != 's' && w[n - 2] != 'u') {
+        w.erase(n - 1);
+    }
+    for (size_t i = 0; i < sizeof(MONTHS) / sizeof(MONTHS[0]); i++) {
+        if (w == MONTHS[i][0]) {
+            return MONTHS[i][1];
+        }
+    }
+    return w;
+}
+
+// "150k", "$150,000" and "150000.00" are all 150000; ordinals and decades
+// ("31st", "1990s") lose their suffix
+static std::string canonical_number(const std::string& word) {
+    size_t end = 0;
+    while (end < word.size() && (isdigit((unsigned char)word[end]) || word[end] == '.')) {
+        end++;
+    }
+    double value = atof(word.substr(0, end).c_str());
+    std::string suffix = word.substr(end);
+    if (suffix == "k") {
+        value *= 1e3;
+    } else if (suffix == "m" || suffix == "mm") {
+        value *= 1e6;
+    } else if (suffix == "b" || suffix == "bn") {
+        value *= 1e9;
+    }
+    
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.10g", value);
+    return buffer;
+}
+
+// Lowercases and splits on anything but letters and digits, keeping the
+// decimal point and dropping thousands separators inside numbers
+static void split_words(const std::string& text, std::vector<std::string>& words) {
+    std::string word;
+    for (size_t i = 0; i < text.size(); i++) {
+        char c = text[i];
+        bool between_digits = i > 0 && i + 1 < text.size() &&
+                              isdigit((unsigned char)text[i - 1]) && isdigit((unsigned char)text[i + 1]);
+        if (isalnum((unsigned char)c)) {
+            word += (char)tolower((unsigned char)c);
+        } else if (c == ',' && between_digits) {
+            continue;
+        } else if (c == '.' && between_digits) {
+            word += c;
+        } else if (!word.empty()) {
+            words.push_back(word);
+            word.clear();
+        }
+    }
+    if (!word.empty()) {
+        words.push_back(word);
+    }
+}
+
+static unsigned polarity_flag(const std::string& stemmed) {
+    for (size_t i = 0; i < sizeof(POLARITY_WORDS) / sizeof(POLARITY_WORDS[0]); i++) {
+        if (stemmed == POLARITY_WORDS[i].word) {
+            return POLARITY_WORDS[i].flag;
+        }
+    }
+    return 0;
+}
+
+// Token strings for a question, distinct and sorted, numbers included, and
+// its Polarity. A contraction splits into "won" + "t", so a lone "t" after
+// a word ending in n is a negation too.
+static void normalise(const std::string& text, std::vector<std::string>& tokens, std::vector<std::string>& numbers,
+                      unsigned& polarity) {
+    std::vector<std::string> words;
+    split_words(text, words);
+    
+    polarity = 0;
+    for (size_t i = 0; i < words.size(); i++) {
+        const std::string& word = words[i];
+        if (isdigit((unsigned char)word[0])) {
+            std::string number = canonical_number(word);
+            numbers.push_back(number);
+            tokens.push_back("#" + number);
+        } else if (word == "t" && i > 0 && words[i - 1][words[i - 1].size() - 1] == 'n') {
+            polarity ^= POLARITY_NEGATED;
+        } else if (word.size() > 1 && !is_stopword(word)) {
+            std::string stemmed = stem(word);
+            unsigned flag = polarity_flag(stemmed);
+            polarity = flag == POLARITY_NEGATED ? polarity ^ flag : polarity | flag;
+            tokens.push_back(stemmed);
+        }
+    }
+    
+    std::sort(tokens.begin(), tokens.end());
+    tokens.erase(std::unique(tokens.begin(), tokens.end()), tokens.end());
+    std::sort(numbers.begin(), numbers.end());
+    numbers.erase(std::unique(numbers.begin(), numbers.end()), numbers.end());
+}
+
+// Token IDs for a question. With `add` unknown tokens get IDs; without,
+// they get INVALID_SYMBOL and only count towards the question's weight.
+static void resolve(MatcherState* ms, const std::vector<std::string>& strings, bool add, std::vector<uint32_t>& ids) {
+    ids.clear();
+    for (size_t i = 0; i < strings.size(); i++) {
+        std::unordered_map<std::string, uint32_t>::iterator it = ms->token_ids.find(strings[i]);
+        if (it != ms->token_ids.end()) {
+            ids.push_back(it->second);
+        } else if (add) {
+            uint32_t id = (uint32_t)ms->df.size();
+            ms->token_ids[strings[i]] = id;
+            ms->df.push_back(0);
+            ms->postings.push_back(std::vector<uint32_t>());
+            ids.push_back(id);
+        } else {
+            ids.push_back(INVALID_SYMBOL);
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+}
+
+// Rarer tokens say more: log(1 + N / df), with unseen tokens as rare as
+// can be
+static double weight(MatcherState* ms, uint32_t token) {
+    double n = (double)ms->docs.size() + 1.0;
+    double df = token == INVALID_SYMBOL ? 0.0 : (double)ms->df[token];
+    return log(1.0 + n / (df + 1.0));
+}
+
+static double total_weight(MatcherState* ms, const std::vector<uint32_t>& tokens) {
+    double sum = 0.0;
+    for (size_t i = 0; i < tokens.size(); i++) {
+        sum += weight(ms, tokens[i]);
+    }
+    return sum;
+}
+
+// Both mention numbers and neither set contains the other
+static bool numbers_conflict(const std::vector<std::string>& a, const std::vector<std::string>& b) {
+    if (a.empty() || b.empty()) {
+        return false;
+    }
+    return !std::includes(a.begin(), a.end(), b.begin(), b.end()) &&
+           !std::includes(b.begin(), b.end(), a.begin(), a.end());
+}
+
+// One side of a pair of opposites, or none when a question names both
+static unsigned side(unsigned polarity, unsigned pair) {
+    unsigned s = polarity & pair;
+    return s == pair ? 0 : s;
+}
+
+// Opposite directions, opposite sides of a date, or one negated and the
+// other not
+static bool polarity_conflict(unsigned a, unsigned b) {
+    unsigned direction = POLARITY_UP | POLARITY_DOWN;
+    unsigned timing = POLARITY_BEFORE | POLARITY_AFTER;
+    if (side(a, direction) != 0 && side(b, direction) != 0 && side(a, direction) != side(b, direction)) {
+        return true;
+    }
+    if (side(a, timing) != 0 && side(b, timing) != 0 && side(a, timing) != side(b, timing)) {
+        return true;
+    }
+    return (a & POLARITY_NEGATED) != (b & POLARITY_NEGATED);
+}
+
+static bool questions_conflict(const Question& a, const Question& b) {
+    return numbers_conflict(a.numbers, b.numbers) || polarity_conflict(a.polarity, b.polarity);
+}
+
+static double dice(MatcherState* ms, const Question& a, const Question& b) {
+    if (questions_conflict(a, b)) {
+        return 0.0;
+    }
+    double common = 0.0;
+    size_t i = 0;
+    size_t j = 0;
+    while (i < a.tokens.size() && j < b.tokens.size()) {
+        if (a.tokens[i] == b.tokens[j]) {
+            if (a.tokens[i] != INVALID_SYMBOL) {
+                common += weight(ms, a.tokens[i]);
+            }
+            i++;
+            j++;
+        } else if (a.tokens[i] < b.tokens[j]) {
+            i++;
+        } else {
+            j++;
+        }
+    }
+    double total = total_weight(ms, a.tokens) + total_weight(ms, b.tokens);
+    return total > 0.0 ? 2.0 * common / total : 0.0;
+}
+
+struct WeightedToken {
+    uint32_t token;
+    double weight;
+};
+
+static bool heavier(const WeightedToken& a, const WeightedToken& b) {
+    return a.weight > b.weight;
+}
+
+// Best event for a question among those without a contract from `venue`.
+// A candidate needs shared weight c with 2c / (wq + c) >= threshold, so
+// only the heaviest query tokens, down to where the lighter rest couldn't
+// reach that on their own, walk their posting lists; the lighter ones just
+// top up docs already found. Common tokens are treated as light too, once
+// the rarest token has walked its list: a match resting on them alone
+// would be a weak one, and their lists are what makes a walk slow.
+static SymbolId best_match(MatcherState* ms, const Question& query, int venue, double& best_score) {
+    std::vector<WeightedToken> ordered;
+    double wq = 0.0;
+    for (size_t i = 0; i < query.tokens.size(); i++) {
+        WeightedToken wt;
+        wt.token = query.tokens[i];
+        wt.weight = weight(ms, wt.token);
+        wq += wt.weight;
+        if (wt.token != INVALID_SYMBOL) {
+            ordered.push_back(wt);
+        }
+    }
+    std::sort(ordered.begin(), ordered.end(), heavier);
+    
+    double needed = ms->threshold * wq / (2.0 - ms->threshold);
+    std::vector<double> suffix(ordered.size() + 1, 0.0);
+    for (size_t i = ordered.size(); i > 0; i--) {
+        suffix[i - 1] = suffix[i] + ordered[i - 1].weight;
+    }
+    
+    size_t common_df = std::max(COMMON_TOKEN_MIN_DOCS, (size_t)(ms->docs.size() * COMMON_TOKEN_SHARE));
+    
+    ms->acc.resize(ms->docs.size(), 0.0);
+    ms->touched.clear();
+    for (size_t i = 0; i < ordered.size(); i++) {
+        uint32_t token = ordered[i].token;
+        if (suffix[i] >= needed && (i == 0 || ms->df[token] <= common_df)) {
+            const std::vector<uint32_t>& list = ms->postings[token];
+            for (size_t p = 0; p < list.size(); p++) {
+                if (ms->acc[list[p]] == 0.0) {
+                    ms->touched.push_back(list[p]);
+                }
+                ms->acc[list[p]] += ordered[i].weight;
+            }
+        } else {
+            for (size_t t = 0; t < ms->touched.size(); t++) {
+                const std::vector<uint32_t>& doc_tokens = ms->docs[ms->touched[t]].question.tokens;
+                if (std::binary_search(doc_tokens.begin(), doc_tokens.end(), token)) {
+                    ms->acc[ms->touched[t]] += ordered[i].weight;
+                }
+            }
+        }
+    }
+    
+    SymbolId best = INVALID_SYMBOL;
+    best_score = 0.0;
+    unsigned venue_bit = 1u << venue;
+    for (size_t t = 0; t < ms->touched.size(); t++) {
+        uint32_t d = ms->touched[t];
+        double common = ms->acc[d];
+        ms->acc[d] = 0.0;
+        if (common < needed) {
+            continue;
+        }
+        
+        const Doc& doc = ms->docs[d];
+        if ((ms->events[doc.event].venues & venue_bit) != 0 || questions_conflict(query, doc.question)) {
+            continue;
+        }
+        double score = 2.0 * common / (wq + total_weight(ms, doc.question.tokens));
+        if (score >= ms->threshold && score > best_score) {
+            best_score = score;
+            best = doc.event;
+        }
+    }
+    return best;
+}
+
+// Indexes a question under an event, unless that wording is already known
+static void index_question(MatcherState* ms, const std::string& key, const std::vector<std::string>& strings,
+                           const Question& question, SymbolId event) {
+    if (strings.empty() || ms->exact.count(key) != 0) {
+        return;
+    }
+    ms->exact[key] = event;
+    
+    Doc doc;
+    doc.event = event;
+    resolve(ms, strings, true, doc.question.tokens);
+    doc.question.numbers = question.numbers;
+    doc.question.polarity = question.polarity;
+    uint32_t d = (uint32_t)ms->docs.size();
+    for (size_t i = 0; i < doc.question.tokens.size(); i++) {
+        ms->df[doc.question.tokens[i]]++;
+        ms->postings[doc.question.tokens[i]].push_back(d);
+    }
+    ms->docs.push_back(doc);
+}
+
+static Assignment& assignment(MatcherState* ms, SymbolId market_id) {
+    if (market_id >= ms->assigned.size()) {
+        ms->assigned.resize(market_id + 1);
+    }
+    return ms->assigned[market_id];
+}
+
+EventMatcher::EventMatcher() {
+    state = new MatcherState();
+}
+
+EventMatcher::~EventMatcher() {
+    delete (MatcherState*)state;
+}
+
+std::string EventMatcher::market_key(int venue, const std::string& id) {
+    return venue == MARKET_PREDICTIT ? "predictit-" + id : id;
+}
+
+bool EventMatcher::load_mapping(const std::string& path) {
+    MatcherState* ms = (MatcherState*)state;
+    
+    std::ifstream file(path.c_str());
+    if (!file) {
+        std::cerr << "Cannot open event mapping " << path << std::endl;
+        return false;
+    }
+    std::stringstream text;
+    text << file.rdbuf();
+    
+    Json::Value root;
+    Json::Reader reader;
+    if (!reader.parse(text.str(), root) || !root.isObject() || !root["events"].isArray()) {
+        std::cerr << "Event mapping " << path << " is not a {\"events\": [...]} object" << std::endl;
+        return false;
+    }
+    
+    size_t pinned = 0;
+    pthread_mutex_lock(&ms->lock);
+    const Json::Value& events = root["events"];
+    for (Json::ArrayIndex i = 0; i < events.size(); i++) {
+        std::string name = events[i]["name"].asString();
+        const Json::Value& contracts = events[i]["contracts"];
+        if (name.empty() || !contracts.isArray()) {
+            std::cerr << "Event mapping entry " << i << " needs a name and contracts" << std::endl;
+            continue;
+        }
+        
+        SymbolId event = event_symbols().intern(name);
+        for (Json::ArrayIndex j = 0; j < contracts.size(); j++) {
+            std::string venue_name = contracts[j]["venue"].asString();
+            std::string id = contracts[j]["id"].asString();
+            int venue = -1;
+            for (int v = 0; v < NUM_MARKETS; v++) {
+                if (venue_name == MARKET_NAMES[v]) {
+                    venue = v;
+                }
+            }
+            if (venue < 0 || id.empty()) {
+                std::cerr << "Event mapping: skipping contract " << j << " of \"" << name
+                          << "\" (unknown venue \"" << venue_name << "\" or no id)" << std::endl;
+                continue;
+            }
+            
+            Assignment& a = assignment(ms, market_symbols().intern(market_key(venue, id)));
+            a.event = event;
+            a.pinned = true;
+            pinned++;
+        }
+    }
+    pthread_mutex_unlock(&ms->lock);
+    
+    std::cout << "Event mapping: " << pinned << " contracts pinned to " << events.size() << " events" << std::endl;
+    return true;
+}
+
+void EventMatcher::set_threshold(double threshold) {
+    MatcherState* ms = (MatcherState*)state;
+    pthread_mutex_lock(&ms->lock);
+    ms->threshold = threshold;
+    pthread_mutex_unlock(&ms->lock);
+}
+
+SymbolId EventMatcher::match(int venue, SymbolId market_id, const std::string& question) {
+    MatcherState* ms = (MatcherState*)state;
+    pthread_mutex_lock(&ms->lock);
+    
+    Assignment& a = assignment(ms, market_id);
+    if (a.registered) {
+        SymbolId event = a.event;
+        pthread_mutex_unlock(&ms->lock);
+        return event;
+    }
+    
+    std::vector<std::string> strings;
+    Question query;
+    normalise(question, strings, query.numbers, query.polarity);
+    
+    // Polarity goes in the key as well: a contraction's negation leaves
+    // no token behind ("won't win" and "won win" share every token)
+    std::string key;
+    for (size_t i = 0; i < strings.size(); i++) {
+        key += strings[i];
+        key += ' ';
+    }
+    if (query.polarity != 0) {
+        key += "~" + std::to_string(query.polarity);
+    }
+    
+    SymbolId event = INVALID_SYMBOL;
+    if (a.pinned) {
+        event = a.event;
+        ms->counters.mapped++;
+    } else {
+        std::unordered_map<std::string, SymbolId>::iterator exact = ms->exact.find(key);
+        if (exact != ms->exact.end()) {
+            event = exact->second;
+        } else if (!strings.empty()) {
+            double score = 0.0;
+            resolve(ms, strings, false, query.tokens);
+            event = best_match(ms, query, venue, score);
+            if (event != INVALID_SYMBOL) {
+                ms->counters.fuzzy++;
+            }
+        }
+        if (event == INVALID_SYMBOL) {
+            event = event_symbols().intern(question);
+        }
+    }
+    
+    // Pinned questions are indexed too, so other venues' unmapped
+    // wordings can still find the curated event
+    index_question(ms, key, strings, query, event);
+    EventInfo& info = ms->events[event];
+    EventContract contract;
+    contract.venue = venue;
+    contract.market_id = market_id;
+    info.contracts.push_back(contract);
+    info.venues |= 1u << venue;
+    a.event = event;
+    a.registered = true;
+    ms->counters.contracts++;
+    
+    pthread_mutex_unlock(&ms->lock);
+    return event;
+}
+
+std::vector<EventContract> EventMatcher::contracts(SymbolId event_id) {
+    MatcherState* ms = (MatcherState*)state;
+    std::vector<EventContract> result;
+    pthread_mutex_lock(&ms->lock);
+    std::unordered_map<SymbolId, EventInfo>::iterator it = ms->events.find(event_id);
+    if (it != ms->events.end()) {
+        result = it->second.contracts;
+    }
+    pthread_mutex_unlock(&ms->lock);
+    return result;
+}
+
+double EventMatcher::similarity(const std::string& a, const std::string& b) {
+    MatcherState* ms = (MatcherState*)state;
+    std::vector<std::string> strings_a;
+    std::vector<std::string> strings_b;
+    Question qa;
+    Question qb;
+    normalise(a, strings_a, qa.numbers, qa.polarity);
+    normalise(b, strings_b, qb.numbers, qb.polarity);
+    
+    pthread_mutex_lock(&ms->lock);
+    resolve(ms, strings_a, false, qa.tokens);
+    resolve(ms, strings_b, false, qb.tokens);
+    
+    // Tokens neither side has indexed are all INVALID_SYMBOL here, so
+    // compare those by text
+    double score;
+    if (std::find(qa.tokens.begin(), qa.tokens.end(), INVALID_SYMBOL) == qa.tokens.end() &&
+        std::find(qb.tokens.begin(), qb.tokens.end(), INVALID_SYMBOL) == qb.tokens.end()) {
+        score = dice(ms, qa, qb);
+    } else {
+        double unseen = weight(ms, INVALID_SYMBOL);
+        double common = 0.0;
+        double total = 0.0;
+        for (size_t i = 0; i < strings_a.size(); i++) {
+            std::unordered_map<std::string, uint32_t>::iterator it = ms->token_ids.find(strings_a[i]);
+            double w = it == ms->token_ids.end() ? unseen : weight(ms, it->second);
+            total += w;
+            if (std::binary_search(strings_b.begin(), strings_b.end(), strings_a[i])) {
+                common += w;
+            }
+        }
+        for (size_t i = 0; i < strings_b.size(); i++) {
+            std::unordered_map<std::string, uint32_t>::iterator it = ms->token_ids.find(strings_b[i]);
+            total += it == ms->token_ids.end() ? unseen : weight(ms, it->second);
+        }
+        score = questions_conflict(qa, qb) || total == 0.0 ? 0.0 : 2.0 * common / total;
+    }
+    pthread_mutex_unlock(&ms->lock);
+    return score;
+}
+
+EventMatcherStats EventMatcher::stats() {
+    MatcherState* ms = (MatcherState*)state;
+    pthread_mutex_lock(&ms->lock);
+    EventMatcherStats s = ms->counters;
+    s.events = ms->events.size();
+    for (std::unordered_map<SymbolId, EventInfo>::iterator it = ms->events.begin(); it != ms->events.end(); ++it) {
+        if ((it->second.venues & (it->second.venues - 1)) != 0) {
+            s.shared_events++;
+        }
+    }
+    pthread_mutex_unlock(&ms->lock);
+    return s;
+}
+
+EventMatcher& event_matcher() {
+    static EventMatcher matcher;
+    return matcher;
+}
@@ -0,0 +1,240 @@
+#include "http_client.h"
+#include <curl/curl.h>
+#include <sys/time.h>
+
+static const long REQUEST_TIMEOUT_SECONDS = 5;
+static const int MAX_POLL_WAIT_MS = 100;
+
+struct TokenBucket {
+    double rate;
+    double capacity;
+    double tokens;
+    double last_refill;
+};
+
+// A pooled easy handle. Options that never change are set once when the
+// handle is created; each request only swaps the URL and clears the body,
+// which keeps its capacity from earlier responses.
+struct Transfer {
+    CURL* curl;
+    size_t index;
+    double start;
+    HttpResponse response;
+};
+
+struct FetcherState {
+    CURLM* multi;
+    CURLSH* share;
+    int max_concurrency;
+    TokenBucket bucket;
+    std::vector<Transfer*> idle;
+    std::vector<Transfer*> all;
+    HttpStats stats;
+};
+
+static double now_seconds() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
+    size_t total_size = size * nmemb;
+    std::string* body = (std::string*)userp;
+    body->append((char*)contents, total_size);
+    return total_size;
+}
+
+static void refill(TokenBucket& bucket) {
+    double now = now_seconds();
+    bucket.tokens += (now - bucket.last_refill) * bucket.rate;
+    if (bucket.tokens > bucket.capacity) {
+        bucket.tokens = bucket.capacity;
+    }
+    bucket.last_refill = now;
+}
+
+// Milliseconds until the bucket holds a whole token again
+static int ms_until_token(const TokenBucket& bucket) {
+    if (bucket.tokens >= 1.0 || bucket.rate <= 0.0) {
+        return 0;
+    }
+    return (int)((1.0 - bucket.tokens) / bucket.rate * 1000.0) + 1;
+}
+
+static Transfer* acquire_transfer(FetcherState* fs) {
+    if (!fs->idle.empty()) {
+        Transfer* transfer = fs->idle.back();
+        fs->idle.pop_back();
+        return transfer;
+    }
+    
+    CURL* curl = curl_easy_init();
+    if (!curl) {
+        return NULL;
+    }
+    
+    Transfer* transfer = new Transfer();
+    transfer->curl = curl;
+    
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &transfer->response.body);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, transfer);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, REQUEST_TIMEOUT_SECONDS);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_SHARE, fs->share);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+    
+    fs->all.push_back(transfer);
+    return transfer;
+}
+
+static void record(HttpStats& stats, CURL* curl, const HttpResponse& response) {
+    stats.requests++;
+    if (!response.ok) {
+        stats.failures++;
+    }
+    
+    long new_connections = 0;
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &new_connections);
+    if (new_connections > 0) {
+        stats.connections_opened += new_connections;
+    } else if (response.ok) {
+        stats.connections_reused++;
+    }
+    
+    stats.total_latency_ms += response.latency_ms;
+    if (response.latency_ms > stats.max_latency_ms) {
+        stats.max_latency_ms = response.latency_ms;
+    }
+}
+
+HttpFetcher::HttpFetcher(int max_concurrency, double requests_per_second, int burst) {
+    FetcherState* fs = new FetcherState();
+    fs->multi = curl_multi_init();
+    curl_multi_setopt(fs->multi, CURLMOPT_PIPELINING, (long)CURLPIPE_MULTIPLEX);
+    
+    fs->share = curl_share_init();
+    curl_share_setopt(fs->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(fs->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(fs->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    
+    fs->max_concurrency = max_concurrency > 0 ? max_concurrency : 1;
+    fs->bucket.rate = requests_per_second;
+    fs->bucket.capacity = burst > 0 ? burst : 1;
+    fs->bucket.tokens = fs->bucket.capacity;
+    fs->bucket.last_refill = now_seconds();
+    state = fs;
+}
+
+HttpFetcher::~HttpFetcher() {
+    FetcherState* fs = (FetcherState*)state;
+    for (size_t i = 0; i < fs->all.size(); i++) {
+        curl_easy_cleanup(fs->all[i]->curl);
+        delete fs->all[i];
+    }
+    curl_multi_cleanup(fs->multi);
+    curl_share_cleanup(fs->share);
+    delete fs;
+}
+
+void HttpFetcher::fetch_all(const std::vector<std::string>& urls, HttpResponseFunction on_response, void* context) {
+    FetcherState* fs = (FetcherState*)state;
+    size_t next = 0;
+    int in_flight = 0;
+    
+    while (next < urls.size() || in_flight > 0) {
+        // Admit as many new requests as the concurrency cap and bucket allow
+        refill(fs->bucket);
+        while (next < urls.size() && in_flight < fs->max_concurrency &&
+               (fs->bucket.rate <= 0.0 || fs->bucket.tokens >= 1.0)) {
+            Transfer* transfer = acquire_transfer(fs);
+            if (transfer == NULL) {
+                HttpResponse failed;
+                on_response(next, failed, context);
+                next++;
+                continue;
+            }
+            
+            transfer->index = next;
+            transfer->start = now_seconds();
+            transfer->response.body.clear();
+            curl_easy_setopt(transfer->curl, CURLOPT_URL, urls[next].c_str());
+            // Over TLS, wait for a multiplexed HTTP/2 stream rather than
+            // opening a new connection. Plain HTTP can't be HTTP/2 here, and
+            // waiting would serialise the first batch behind one request.
+            curl_easy_setopt(transfer->curl, CURLOPT_PIPEWAIT, urls[next].compare(0, 8, "https://") == 0 ? 1L : 0L);
+            next++;
+            
+            curl_multi_add_handle(fs->multi, transfer->curl);
+            fs->bucket.tokens -= 1.0;
+            in_flight++;
+        }
+        
+        int running = 0;
+        curl_multi_perform(fs->multi, &running);
+        
+        CURLMsg* msg;
+        int queued = 0;
+        while ((msg = curl_multi_info_read(fs->multi, &queued)) != NULL) {
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+            
+            CURL* curl = msg->easy_handle;
+            Transfer* transfer = NULL;
+            curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char**)&transfer);
+            
+            HttpResponse& response = transfer->response;
+            response.ok = (msg->data.result == CURLE_OK);
+            response.status = 0;
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response.status);
+            response.latency_ms = (now_seconds() - transfer->start) * 1000.0;
+            if (!response.ok) {
+                response.body.clear();
+            }
+            record(fs->stats, curl, response);
+            
+            curl_multi_remove_handle(fs->multi, curl);
+            in_flight--;
+            
+            on_response(transfer->index, response, context);
+            fs->idle.push_back(transfer);
+        }
+        
+        if (in_flight == 0 && next >= urls.size()) {
+            break;
+        }
+        
+        // Sleep until there is socket activity or the next token is due
+        int wait_ms = MAX_POLL_WAIT_MS;
+        if (next < urls.size() && in_flight < fs->max_concurrency) {
+            int token_ms = ms_until_token(fs->bucket);
+            if (token_ms < wait_ms) {
+                wait_ms = token_ms;
+            }
+        }
+        curl_multi_poll(fs->multi, NULL, 0, wait_ms, NULL);
+    }
+}
+
+struct SingleResult {
+    HttpResponse response;
+};
+
+static void store_single(size_t /*index*/, const HttpResponse& response, void* context) {
+    ((SingleResult*)context)->response = response;
+}
+
+HttpResponse HttpFetcher::get(const std::string& url) {
+    std::vector<std::string> urls(1, url);
+    SingleResult result;
+    fetch_all(urls, store_single, &result);
+    return result.response;
+}
+
+HttpStats HttpFetcher::stats() {
+    FetcherState* fs = (FetcherState*)state;
+    return fs->stats;
+}
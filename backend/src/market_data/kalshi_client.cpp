@@ -0,0 +1,232 @@
+#include "market_data_client.h"
+#include "types.h"
+#include "symbol_table.h"
+#include "event_matcher.h"
+#include "http_client.h"
+#include "orderbook_parser.h"
+#include "order_book.h"
+#include <iostream>
+#include <unistd.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/time.h>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <json/json.h>
+
+static const time_t DISCOVERY_INTERVAL = 60;
+static const int DISCOVERY_PAGE_SIZE = 200;  // the API's per-page maximum is 1000
+
+struct KalshiMarket {
+    std::string ticker;
+    SymbolId market_id;
+    SymbolId event_id;
+};
+
+static long long now_us() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+// Sleeps in small steps so disconnect() is never held up for long
+static void sleep_while_connected(MarketDataClient* client, long long until_us) {
+    while (client->is_connected() && now_us() < until_us) {
+        usleep(50000);
+    }
+}
+
+// Dollar prices come as strings ("0.4500"), counts as numbers or strings
+static double json_number(const Json::Value& value) {
+    return value.isString() ? atof(value.asCString()) : value.asDouble();
+}
+
+// 1 - p in floating point leaves noise like 0.5499999999; prices are
+// quoted to well under a micro-dollar, so round that away
+static double round_price(double price) {
+    return std::floor(price * 1e6 + 0.5) / 1e6;
+}
+
+// Outcomes of one Kalshi event share a title ("Who will win the 2028
+// Democratic nomination?") and differ in yes_sub_title, so that goes into
+// the event name too
+static std::string event_name(const Json::Value& market) {
+    std::string title = market["title"].asString();
+    std::string outcome = market["yes_sub_title"].asString();
+    if (outcome.empty() || title.find(outcome) != std::string::npos) {
+        return title;
+    }
+    return title + " - " + outcome;
+}
+
+// Pages through open markets until max_markets are found or the cursor
+// runs out. Multivariate combos (parlay-style packages) are left out; they
+// have no counterpart on other venues.
+static std::vector<KalshiMarket> discover_markets(HttpFetcher& fetcher, const std::string& base_url, size_t max_markets) {
+    std::vector<KalshiMarket> markets;
+    std::string cursor;
+    
+    while (markets.size() < max_markets) {
+        size_t limit = std::min((size_t)DISCOVERY_PAGE_SIZE, max_markets - markets.size());
+        std::string url = base_url + "/markets?status=open&mve_filter=exclude&limit=" + std::to_string(limit);
+        if (!cursor.empty()) {
+            url += "&cursor=" + cursor;
+        }
+        
+        HttpResponse response = fetcher.get(url);
+        if (!response.ok || response.status != 200) {
+            std::cout << "Kalshi markets request failed (HTTP " << response.status << ")" << std::endl;
+            break;
+        }
+        
+        Json::Value root;
+        Json::Reader reader;
+        if (!reader.parse(response.body, root) || !root.isObject() || !root["markets"].isArray()) {
+            std::cout << "Failed to parse Kalshi markets response" << std::endl;
+            break;
+        }
+        
+        const Json::Value& page = root["markets"];
+        for (Json::ArrayIndex i = 0; i < page.size() && markets.size() < max_markets; i++) {
+            const Json::Value& market = page[i];
+            if (!market.isObject()) {
+                continue;
+            }
+            std::string ticker = market["ticker"].asString();
+            std::string name = event_name(market);
+            if (ticker.empty() || name.empty()) {
+                continue;
+            }
+            
+            KalshiMarket info;
+            info.ticker = ticker;
+            info.market_id = market_symbols().intern(ticker);
+            info.event_id = event_matcher().match(MARKET_KALSHI, info.market_id, name);
+            markets.push_back(info);
+        }
+        
+        cursor = root["cursor"].asString();
+        if (cursor.empty() || page.size() == 0) {
+            break;
+        }
+    }
+    
+    return markets;
+}
+
+// Each entry is [price, count]: cents in "yes"/"no", dollar strings in
+// "yes_dollars"/"no_dollars". A side with no orders may be null or missing.
+static void load_side(const Json::Value& book, const char* name, bool invert, std::vector<PriceLevel>& side) {
+    std::string dollars_name = std::string(name) + "_dollars";
+    bool dollars = book[dollars_name].isArray();
+    const Json::Value& levels = dollars ? book[dollars_name] : book[name];
+    if (!levels.isArray()) {
+        return;
+    }
+    
+    for (Json::ArrayIndex i = 0; i < levels.size(); i++) {
+        const Json::Value& entry = levels[i];
+        if (!entry.isArray() || entry.size() < 2) {
+            continue;
+        }
+        PriceLevel level;
+        level.price = dollars ? json_number(entry[0]) : json_number(entry[0]) / 100.0;
+        level.size = json_number(entry[1]);
+        if (invert) {
+            level.price = round_price(1.0 - level.price);
+        }
+        side.push_back(level);
+    }
+}
+
+struct PollContext {
+    KalshiClient* client;
+    const std::vector<KalshiMarket>* markets;
+    OrderBook* depth;
+    std::vector<PriceLevel> bids;
+    std::vector<PriceLevel> asks;
+};
+
+static void on_book_response(size_t index, const HttpResponse& http, void* context) {
+    PollContext* ctx = (PollContext*)context;
+    const KalshiMarket& market = (*ctx->markets)[index];
+    
+    // Rate limiting and server trouble say nothing about the book; keep
+    // the last quote rather than invalidating it
+    if (!http.ok || http.status == 429 || http.status >= 500) {
+        return;
+    }
+    
+    MarketData data;
+    data.market = MARKET_KALSHI;
+    data.market_id = market.market_id;
+    data.event_id = market.event_id;
+    data.timestamp = now_us();
+    data.is_valid = false;
+    
+    Json::Value root;
+    Json::Reader reader;
+    if (http.status == 200 && reader.parse(http.body, root) && root.isObject() && root["orderbook"].isObject()) {
+        // YES bids are bids; NO bids at p are YES asks at 1 - p
+        const Json::Value& book = root["orderbook"];
+        ctx->bids.clear();
+        ctx->asks.clear();
+        load_side(book, "yes", false, ctx->bids);
+        load_side(book, "no", true, ctx->asks);
+        ctx->depth->set_snapshot(ctx->bids.empty() ? NULL : &ctx->bids[0], ctx->bids.size(),
+                                 ctx->asks.empty() ? NULL : &ctx->asks[0], ctx->asks.size());
+        ctx->depth->top(data.best_bid, data.best_ask, data.bid_size, data.ask_size);
+        
+        if (data.best_bid > 0.0 || data.best_ask > 0.0) {
+            data.is_valid = true;
+            data.book = ctx->depth;
+        }
+    }
+    
+    if (ctx->client->update_callback != NULL) {
+        ctx->client->update_callback(&data);
+    }
+}
+
+void KalshiClient::run() {
+    HttpFetcher fetcher(config->http_max_concurrency, config->http_rate_limit, config->http_rate_burst);
+    std::vector<KalshiMarket> tracked_markets;
+    std::vector<std::string> book_urls;
+    OrderBook depth;
+    time_t last_discovery = 0;
+    
+    while (is_connected()) {
+        long long cycle_start = now_us();
+        
+        if (time(NULL) - last_discovery >= DISCOVERY_INTERVAL) {
+            std::vector<KalshiMarket> found = discover_markets(fetcher, config->kalshi_url, config->kalshi_max_markets);
+            if (!found.empty()) {
+                tracked_markets = found;
+                std::cout << "Tracking " << tracked_markets.size() << " Kalshi markets." << std::endl;
+            }
+            last_discovery = time(NULL);
+        }
+        
+        book_urls.resize(tracked_markets.size());
+        for (size_t i = 0; i < tracked_markets.size(); i++) {
+            book_urls[i] = config->kalshi_url + "/markets/" + tracked_markets[i].ticker + "/orderbook";
+        }
+        
+        PollContext ctx;
+        ctx.client = this;
+        ctx.markets = &tracked_markets;
+        ctx.depth = &depth;
+        fetcher.fetch_all(book_urls, on_book_response, &ctx);
+        
+        sleep_while_connected(this, cycle_start + (long long)config->poll_interval_ms * 1000LL);
+    }
+}
+
+KalshiClient::KalshiClient(Config* config) : MarketDataClient(config, MARKET_KALSHI, "Kalshi") {
+}
+
+KalshiClient::~KalshiClient() {
+    disconnect();
+}
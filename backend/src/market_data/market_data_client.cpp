@@ -0,0 +1,74 @@
+#include "market_data_client.h"
+#include <iostream>
+#include <pthread.h>
+#include <curl/curl.h>
+
+// curl_global_init isn't thread-safe, and with several feeds there is no
+// single thread that owns curl, so it runs once for the process and is
+// never undone
+static pthread_once_t curl_once = PTHREAD_ONCE_INIT;
+
+static void init_curl() {
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+}
+
+MarketDataClient::MarketDataClient(Config* config, int market, const char* name) {
+    this->config = config;
+    connected = false;
+    update_callback = NULL;
+    venue = market;
+    venue_name = name;
+    worker_thread = NULL;
+}
+
+MarketDataClient::~MarketDataClient() {
+}
+
+void* MarketDataClient::thread_function(void* arg) {
+    MarketDataClient* client = (MarketDataClient*)arg;
+    client->run();
+    return NULL;
+}
+
+bool MarketDataClient::connect() {
+    if (connected) {
+        return true;
+    }
+    
+    std::cout << "Connecting to " << venue_name << "..." << std::endl;
+    pthread_once(&curl_once, init_curl);
+    connected = true;
+    
+    pthread_t* thread = new pthread_t;
+    if (pthread_create(thread, NULL, thread_function, this) != 0) {
+        std::cout << "Failed to start " << venue_name << " thread" << std::endl;
+        connected = false;
+        delete thread;
+        return false;
+    }
+    
+    worker_thread = thread;
+    return true;
+}
+
+void MarketDataClient::disconnect() {
+    if (!connected) {
+        return;
+    }
+    
+    connected = false;
+    
+    if (worker_thread != NULL) {
+        pthread_join(*(pthread_t*)worker_thread, NULL);
+        delete (pthread_t*)worker_thread;
+        worker_thread = NULL;
+    }
+}
+
+bool MarketDataClient::is_connected() {
+    return connected;
+}
+
+void MarketDataClient::set_update_function(void (*func)(MarketData*)) {
+    update_callback = func;
+}
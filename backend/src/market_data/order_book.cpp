@@ -0,0 +1,131 @@
+#include "order_book.h"
+#include "pricing_kernel.h"
+#include <algorithm>
+
+static bool bid_before(const PriceLevel& a, const PriceLevel& b) {
+    return a.price < b.price;
+}
+
+static bool ask_before(const PriceLevel& a, const PriceLevel& b) {
+    return a.price > b.price;
+}
+
+// Copies the non-empty levels of one side and puts them in best-last order
+static void load_side(std::vector<PriceLevel>& side, const PriceLevel* levels, size_t count, bool (*before)(const PriceLevel&, const PriceLevel&)) {
+    side.clear();
+    bool sorted = true;
+    for (size_t i = 0; i < count; i++) {
+        if (levels[i].size <= 0.0) {
+            continue;
+        }
+        if (!side.empty() && !before(side.back(), levels[i])) {
+            sorted = false;
+        }
+        side.push_back(levels[i]);
+    }
+    if (!sorted) {
+        std::sort(side.begin(), side.end(), before);
+    }
+}
+
+OrderBook::OrderBook() {
+}
+
+void OrderBook::clear() {
+    bid_levels.clear();
+    ask_levels.clear();
+}
+
+void OrderBook::set_snapshot(const PriceLevel* bids, size_t bid_count, const PriceLevel* asks, size_t ask_count) {
+    load_side(bid_levels, bids, bid_count, bid_before);
+    load_side(ask_levels, asks, ask_count, ask_before);
+}
+
+void OrderBook::set_snapshot(const ParsedBook& book) {
+    set_snapshot(book.bids, book.bid_count, book.asks, book.ask_count);
+}
+
+void OrderBook::apply_delta(int side, double price, double size) {
+    std::vector<PriceLevel>& levels = side == BOOK_BID ? bid_levels : ask_levels;
+    bool (*before)(const PriceLevel&, const PriceLevel&) = side == BOOK_BID ? bid_before : ask_before;
+    
+    PriceLevel level;
+    level.price = price;
+    level.size = size;
+    std::vector<PriceLevel>::iterator it = std::lower_bound(levels.begin(), levels.end(), level, before);
+    
+    if (it != levels.end() && it->price == price) {
+        if (size > 0.0) {
+            it->size = size;
+        } else {
+            levels.erase(it);
+        }
+    } else if (size > 0.0) {
+        levels.insert(it, level);
+    }
+}
+
+void OrderBook::top(double& best_bid, double& best_ask, double& bid_size, double& ask_size) const {
+    best_bid = 0.0;
+    best_ask = 0.0;
+    bid_size = 0.0;
+    ask_size = 0.0;
+    if (!bid_levels.empty()) {
+        best_bid = bid_levels.back().price;
+        bid_size = bid_levels.back().size;
+    }
+    if (!ask_levels.empty()) {
+        best_ask = ask_levels.back().price;
+        ask_size = ask_levels.back().size;
+    }
+}
+
+void sweep_books(const OrderBook& buy, const OrderBook& sell, const LegFee& buy_fee, const LegFee& sell_fee, double min_profit, SweepResult& result) {
+    result = SweepResult();
+    
+    const PriceLevel* asks = buy.asks();
+    const PriceLevel* bids = sell.bids();
+    size_t a = buy.ask_count();
+    size_t b = sell.bid_count();
+    if (a == 0 || b == 0) {
+        return;
+    }
+    
+    // Walk both ladders from the top, carrying whatever is left of the
+    // level that wasn't used up by the previous match
+    a--;
+    b--;
+    double ask_left = asks[a].size;
+    double bid_left = bids[b].size;
+    
+    while (true) {
+        double ask = asks[a].price;
+        double bid = bids[b].price;
+        if (pair_profit(ask, bid, leg_fee(ask, buy_fee), leg_fee(bid, sell_fee)) <= min_profit) {
+            break;
+        }
+        
+        double size = ask_left < bid_left ? ask_left : bid_left;
+        result.size += size;
+        result.buy_cost += size * ask;
+        result.sell_proceeds += size * bid;
+        result.levels++;
+        
+        ask_left -= size;
+        bid_left -= size;
+        if (ask_left <= 0.0) {
+            if (a == 0) {
+                break;
+            }
+            a--;
+            ask_left = asks[a].size;
+        }
+        if (bid_left <= 0.0) {
+            if (b == 0) {
+                break;
+            }
+            b--;
+            bid_left = bids[b].size;
+        }
+    }
+}
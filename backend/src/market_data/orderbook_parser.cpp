@@ -0,0 +1,421 @@
+#include "orderbook_parser.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
+// Powers of ten that are exactly representable as doubles
+static const double EXACT_POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8,
+    1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15
+};
+
+static const size_t MAX_FAST_DIGITS = 15;
+static const int MAX_NESTING = 32;
+
+static inline bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline void skip_ws(const char*& p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) {
+        p++;
+    }
+}
+
+bool parse_decimal(const char*& p, const char* end, double& out) {
+    const char* start = p;
+    bool negative = false;
+    if (p < end && *p == '-') {
+        negative = true;
+        p++;
+    }
+    
+    const char* int_begin = p;
+    while (p < end && is_digit(*p)) {
+        p++;
+    }
+    const char* int_end = p;
+    
+    const char* frac_begin = p;
+    const char* frac_end = p;
+    if (p < end && *p == '.') {
+        p++;
+        frac_begin = p;
+        while (p < end && is_digit(*p)) {
+            p++;
+        }
+        frac_end = p;
+    }
+    
+    if (int_begin == int_end && frac_begin == frac_end) {
+        p = start;
+        return false;
+    }
+    
+    bool has_exponent = false;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        has_exponent = true;
+        p++;
+        if (p < end && (*p == '+' || *p == '-')) {
+            p++;
+        }
+        while (p < end && is_digit(*p)) {
+            p++;
+        }
+    }
+    
+    // Clinger's fast path: up to 15 digits always fit below 2^53, so the
+    // mantissa is an exact integer and scaling it by an exact power of ten
+    // is a single correctly rounded division
+    size_t int_digits = int_end - int_begin;
+    size_t frac_digits = frac_end - frac_begin;
+    if (!has_exponent && int_digits + frac_digits <= MAX_FAST_DIGITS) {
+        uint64_t mantissa = 0;
+        for (const char* q = int_begin; q < int_end; q++) {
+            mantissa = mantissa * 10 + (*q - '0');
+        }
+        for (const char* q = frac_begin; q < frac_end; q++) {
+            mantissa = mantissa * 10 + (*q - '0');
+        }
+        double value = (double)mantissa;
+        if (frac_digits > 0) {
+            value /= EXACT_POW10[frac_digits];
+        }
+        out = negative ? -value : value;
+        return true;
+    }
+    
+    // Rare: long mantissas or explicit exponents. Copy to a bounded stack
+    // buffer so strtod sees a terminated string.
+    char buffer[64];
+    size_t length = p - start;
+    if (length >= sizeof(buffer)) {
+        return false;
+    }
+    memcpy(buffer, start, length);
+    buffer[length] = '\0';
+    out = strtod(buffer, NULL);
+    return true;
+}
+
+// Skips a string starting at the opening quote. Strings in book payloads
+// are short keys and IDs, where a plain loop beats memchr's call overhead.
+static inline bool skip_string(const char*& p, const char* end) {
+    p++;
+    while (p < end) {
+        char c = *p++;
+        if (c == '"') {
+            return true;
+        }
+        if (c == '\\') {
+            p++;
+        }
+    }
+    return false;
+}
+
+static bool skip_value(const char*& p, const char* end, int depth);
+
+static bool skip_container(const char*& p, const char* end, char close, int depth) {
+    if (depth > MAX_NESTING) {
+        return false;
+    }
+    p++;
+    skip_ws(p, end);
+    if (p < end && *p == close) {
+        p++;
+        return true;
+    }
+    
+    while (p < end) {
+        skip_ws(p, end);
+        if (close == '}') {
+            if (p >= end || *p != '"' || !skip_string(p, end)) {
+                return false;
+            }
+            skip_ws(p, end);
+            if (p >= end || *p != ':') {
+                return false;
+            }
+            p++;
+            skip_ws(p, end);
+        }
+        if (!skip_value(p, end, depth + 1)) {
+            return false;
+        }
+        skip_ws(p, end);
+        if (p < end && *p == ',') {
+            p++;
+            continue;
+        }
+        if (p < end && *p == close) {
+            p++;
+            return true;
+        }
+        return false;
+    }
+    return false;
+}
+
+static bool skip_value(const char*& p, const char* end, int depth) {
+    if (p >= end) {
+        return false;
+    }
+    switch (*p) {
+        case '"':
+            return skip_string(p, end);
+        case '{':
+            return skip_container(p, end, '}', depth);
+        case '[':
+            return skip_container(p, end, ']', depth);
+        default: {
+            double ignored;
+            if (parse_decimal(p, end, ignored)) {
+                return true;
+            }
+            static const char* LITERALS[] = {"true", "false", "null"};
+            for (size_t i = 0; i < sizeof(LITERALS) / sizeof(LITERALS[0]); i++) {
+                size_t length = strlen(LITERALS[i]);
+                if ((size_t)(end - p) >= length && memcmp(p, LITERALS[i], length) == 0) {
+                    p += length;
+                    return true;
+                }
+            }
+            return false;
+        }
+    }
+}
+
+// Key at p (opening quote) compared in place, no copy
+static bool read_key(const char*& p, const char* end, const char*& key, size_t& key_length) {
+    if (p >= end || *p != '"') {
+        return false;
+    }
+    key = p + 1;
+    if (!skip_string(p, end)) {
+        return false;
+    }
+    key_length = (p - 1) - key;
+    return true;
+}
+
+static inline bool key_is(const char* key, size_t length, const char* name, size_t name_length) {
+    return length == name_length && memcmp(key, name, length) == 0;
+}
+
+// "0.5" or 0.5
+static bool read_number(const char*& p, const char* end, double& out) {
+    if (p < end && *p == '"') {
+        p++;
+        if (!parse_decimal(p, end, out) || p >= end || *p != '"') {
+            return false;
+        }
+        p++;
+        return true;
+    }
+    return parse_decimal(p, end, out);
+}
+
+// {"price":"0.5","size":"10"}; other members are skipped
+static bool parse_level(const char*& p, const char* end, PriceLevel& level) {
+    if (p >= end || *p != '{') {
+        return false;
+    }
+    p++;
+    level.price = 0.0;
+    level.size = 0.0;
+    
+    skip_ws(p, end);
+    if (p < end && *p == '}') {
+        p++;
+        return true;
+    }
+    
+    while (p < end) {
+        skip_ws(p, end);
+        const char* key;
+        size_t key_length;
+        if (!read_key(p, end, key, key_length)) {
+            return false;
+        }
+        skip_ws(p, end);
+        if (p >= end || *p != ':') {
+            return false;
+        }
+        p++;
+        skip_ws(p, end);
+        
+        bool ok;
+        if (key_is(key, key_length, "price", 5)) {
+            ok = read_number(p, end, level.price);
+        } else if (key_is(key, key_length, "size", 4)) {
+            ok = read_number(p, end, level.size);
+        } else {
+            ok = skip_value(p, end, 2);
+        }
+        if (!ok) {
+            return false;
+        }
+        
+        skip_ws(p, end);
+        if (p < end && *p == ',') {
+            p++;
+            continue;
+        }
+        if (p < end && *p == '}') {
+            p++;
+            return true;
+        }
+        return false;
+    }
+    return false;
+}
+
+static inline bool better_price(bool bids, double a, double b) {
+    return bids ? a > b : a < b;
+}
+
+// The CLOB sends each ladder best level last, so a ladder deeper than
+// MAX_BOOK_LEVELS is kept as a ring over its last MAX_BOOK_LEVELS entries
+// and rotated back into the order it was sent. Evicted levels are watched:
+// if one of them beat every level kept (a venue sorting best first), the
+// parse fails, so the quote is reported invalid rather than wrong.
+static bool finish_ladder(bool bids, PriceLevel* levels, size_t seen, size_t& count, bool& truncated,
+                          bool dropped, double dropped_best) {
+    if (seen <= MAX_BOOK_LEVELS) {
+        count = seen;
+        return true;
+    }
+    count = MAX_BOOK_LEVELS;
+    truncated = true;
+    std::rotate(levels, levels + seen % MAX_BOOK_LEVELS, levels + MAX_BOOK_LEVELS);
+    if (!dropped) {
+        return true;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (levels[i].size > 0.0 && !better_price(bids, dropped_best, levels[i].price)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_ladder(const char*& p, const char* end, bool bids, PriceLevel* levels, size_t& count, bool& truncated) {
+    count = 0;
+    if (p >= end || *p != '[') {
+        return skip_value(p, end, 1);
+    }
+    p++;
+    skip_ws(p, end);
+    if (p < end && *p == ']') {
+        p++;
+        return true;
+    }
+    
+    size_t seen = 0;
+    bool dropped = false;      // an evicted level had size
+    double dropped_best = 0.0;
+    while (p < end) {
+        skip_ws(p, end);
+        PriceLevel level;
+        if (!parse_level(p, end, level)) {
+            return false;
+        }
+        PriceLevel& slot = levels[seen % MAX_BOOK_LEVELS];
+        if (seen >= MAX_BOOK_LEVELS && slot.size > 0.0 && (!dropped || better_price(bids, slot.price, dropped_best))) {
+            dropped_best = slot.price;
+            dropped = true;
+        }
+        slot = level;
+        seen++;
+        
+        skip_ws(p, end);
+        if (p < end && *p == ',') {
+            p++;
+            continue;
+        }
+        if (p < end && *p == ']') {
+            p++;
+            return finish_ladder(bids, levels, seen, count, truncated, dropped, dropped_best);
+        }
+        return false;
+    }
+    return false;
+}
+
+bool parse_orderbook(const char* data, size_t length, ParsedBook& book) {
+    book.bid_count = 0;
+    book.ask_count = 0;
+    book.truncated = false;
+    
+    const char* p = data;
+    const char* end = data + length;
+    skip_ws(p, end);
+    if (p >= end || *p != '{') {
+        return false;
+    }
+    p++;
+    
+    skip_ws(p, end);
+    if (p < end && *p == '}') {
+        return true;
+    }
+    
+    while (p < end) {
+        skip_ws(p, end);
+        const char* key;
+        size_t key_length;
+        if (!read_key(p, end, key, key_length)) {
+            return false;
+        }
+        skip_ws(p, end);
+        if (p >= end || *p != ':') {
+            return false;
+        }
+        p++;
+        skip_ws(p, end);
+        
+        bool ok;
+        if (key_is(key, key_length, "bids", 4) || key_is(key, key_length, "buys", 4)) {
+            ok = parse_ladder(p, end, true, book.bids, book.bid_count, book.truncated);
+        } else if (key_is(key, key_length, "asks", 4) || key_is(key, key_length, "sells", 5)) {
+            ok = parse_ladder(p, end, false, book.asks, book.ask_count, book.truncated);
+        } else {
+            ok = skip_value(p, end, 1);
+        }
+        if (!ok) {
+            return false;
+        }
+        
+        skip_ws(p, end);
+        if (p < end && *p == ',') {
+            p++;
+            continue;
+        }
+        return p < end && *p == '}';
+    }
+    return false;
+}
+
+void top_of_book(const ParsedBook& book, double& best_bid, double& best_ask, double& bid_size, double& ask_size) {
+    best_bid = 0.0;
+    best_ask = 0.0;
+    bid_size = 0.0;
+    ask_size = 0.0;
+    
+    for (size_t i = 0; i < book.bid_count; i++) {
+        const PriceLevel& level = book.bids[i];
+        if (level.size > 0.0 && level.price > best_bid) {
+            best_bid = level.price;
+            bid_size = level.size;
+        }
+    }
+    for (size_t i = 0; i < book.ask_count; i++) {
+        const PriceLevel& level = book.asks[i];
+        if (level.size > 0.0 && (best_ask == 0.0 || level.price < best_ask)) {
+            best_ask = level.price;
+            ask_size = level.size;
+        }
+    }
+}
@@ -1,206 +1,54 @@
 #include "market_data_client.h"
 #include "types.h"
+#include "symbol_table.h"
+#include "event_matcher.h"
+#include "http_client.h"
+#include "websocket_client.h"
+#include "orderbook_parser.h"
+#include "order_book.h"
 #include <iostream>
 #include <pthread.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <time.h>
-#include <curl/curl.h>
+#include <sys/time.h>
 #include <string>
 #include <sstream>
 #include <cstring>
 #include <vector>
+#include <unordered_map>
+#include <algorithm>
 #include <json/json.h>
 
-const char* PolymarketClient::WEBSOCKET_URL = "wss://clob.polymarket.com";
-
-struct ThreadData {
-    PolymarketClient* client;
-};
-
 struct MarketInfo {
     std::string token_id;
     std::string event_name;
-};
-
-struct CurlWriteData {
-    std::string response;
-};
-
-static size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
-    size_t total_size = size * nmemb;
-    CurlWriteData* data = (CurlWriteData*)userp;
-    data->response.append((char*)contents, total_size);
-    return total_size;
-}
-
-static std::string http_get(const std::string& url) {
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-        return "";
-    }
-    
-    CurlWriteData write_data;
+    SymbolId market_id;
+    SymbolId event_id;
+    SymbolId group_id;  // see MarketData::group_id
+    int group_size;
     
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &write_data);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 5L);
-    
-    CURLcode res = curl_easy_perform(curl);
-    curl_easy_cleanup(curl);
-    
-    if (res != CURLE_OK) {
-        return "";
+    MarketInfo() {
+        market_id = INVALID_SYMBOL;
+        event_id = INVALID_SYMBOL;
+        group_id = INVALID_SYMBOL;
+        group_size = 0;
     }
-    
-    return write_data.response;
-}
+};
 
-static bool parse_orderbook(const std::string& json, double& best_bid, double& best_ask, double& bid_size, double& ask_size) {
-    best_bid = 0.0;
-    best_ask = 0.0;
-    bid_size = 0.0;
-    ask_size = 0.0;
-    
-    // Parse bids array - get first bid
-    size_t bids_pos = json.find("\"bids\"");
-    if (bids_pos != std::string::npos) {
-        size_t array_start = json.find("[", bids_pos);
-        if (array_start != std::string::npos && json[array_start + 1] != ']') {
-            // Has bids - try quoted string first, then numeric
-            size_t price_pos = json.find("\"price\":\"", array_start);
-            if (price_pos != std::string::npos) {
-                // Quoted string format: "price":"0.5"
-                price_pos += 9; // Skip "price":"
-                size_t price_end = json.find("\"", price_pos);
-                std::string bid_price_str = json.substr(price_pos, price_end - price_pos);
-                best_bid = atof(bid_price_str.c_str());
-            } else {
-                // Numeric format: "price":0.5
-                price_pos = json.find("\"price\":", array_start);
-                if (price_pos != std::string::npos) {
-                    price_pos += 8; // Skip "price":
-                    // Find end of number (comma, }, or whitespace)
-                    size_t price_end = price_pos;
-                    while (price_end < json.length() && 
-                           json[price_end] != ',' && 
-                           json[price_end] != '}' && 
-                           json[price_end] != ' ' &&
-                           json[price_end] != '\n' &&
-                           json[price_end] != '\r') {
-                        price_end++;
-                    }
-                    std::string bid_price_str = json.substr(price_pos, price_end - price_pos);
-                    best_bid = atof(bid_price_str.c_str());
-                }
-            }
-            
-            if (best_bid > 0.0) {
-                // Parse size - try quoted string first, then numeric
-                size_t size_pos = json.find("\"size\":\"", array_start);
-                if (size_pos != std::string::npos && size_pos > array_start) {
-                    // Quoted string format
-                    size_pos += 8; // Skip "size":"
-                    size_t size_end = json.find("\"", size_pos);
-                    std::string bid_size_str = json.substr(size_pos, size_end - size_pos);
-                    bid_size = atof(bid_size_str.c_str());
-                } else {
-                    // Numeric format: "size":100.0
-                    size_pos = json.find("\"size\":", array_start);
-                    if (size_pos != std::string::npos && size_pos > array_start) {
-                        size_pos += 7; // Skip "size":
-                        size_t size_end = size_pos;
-                        while (size_end < json.length() && 
-                               json[size_end] != ',' && 
-                               json[size_end] != '}' && 
-                               json[size_end] != ' ' &&
-                               json[size_end] != '\n' &&
-                               json[size_end] != '\r') {
-                            size_end++;
-                        }
-                        std::string bid_size_str = json.substr(size_pos, size_end - size_pos);
-                        bid_size = atof(bid_size_str.c_str());
-                    }
-                }
-            }
-        }
-    }
-    
-    // Parse asks array - get first ask
-    size_t asks_pos = json.find("\"asks\"");
-    if (asks_pos != std::string::npos) {
-        size_t array_start = json.find("[", asks_pos);
-        if (array_start != std::string::npos && json[array_start + 1] != ']') {
-            // Has asks - try quoted string first, then numeric
-            size_t price_pos = json.find("\"price\":\"", array_start);
-            if (price_pos != std::string::npos) {
-                // Quoted string format: "price":"0.5"
-                price_pos += 9; // Skip "price":"
-                size_t price_end = json.find("\"", price_pos);
-                std::string ask_price_str = json.substr(price_pos, price_end - price_pos);
-                best_ask = atof(ask_price_str.c_str());
-            } else {
-                // Numeric format: "price":0.5
-                price_pos = json.find("\"price\":", array_start);
-                if (price_pos != std::string::npos) {
-                    price_pos += 8; // Skip "price":
-                    // Find end of number (comma, }, or whitespace)
-                    size_t price_end = price_pos;
-                    while (price_end < json.length() && 
-                           json[price_end] != ',' && 
-                           json[price_end] != '}' && 
-                           json[price_end] != ' ' &&
-                           json[price_end] != '\n' &&
-                           json[price_end] != '\r') {
-                        price_end++;
-                    }
-                    std::string ask_price_str = json.substr(price_pos, price_end - price_pos);
-                    best_ask = atof(ask_price_str.c_str());
-                }
-            }
-            
-            if (best_ask > 0.0) {
-                // Parse size - try quoted string first, then numeric
-                size_t size_pos = json.find("\"size\":\"", array_start);
-                if (size_pos != std::string::npos && size_pos > array_start) {
-                    // Quoted string format
-                    size_pos += 8; // Skip "size":"
-                    size_t size_end = json.find("\"", size_pos);
-                    std::string ask_size_str = json.substr(size_pos, size_end - size_pos);
-                    ask_size = atof(ask_size_str.c_str());
-                } else {
-                    // Numeric format: "size":100.0
-                    size_pos = json.find("\"size\":", array_start);
-                    if (size_pos != std::string::npos && size_pos > array_start) {
-                        size_pos += 7; // Skip "size":
-                        size_t size_end = size_pos;
-                        while (size_end < json.length() && 
-                               json[size_end] != ',' && 
-                               json[size_end] != '}' && 
-                               json[size_end] != ' ' &&
-                               json[size_end] != '\n' &&
-                               json[size_end] != '\r') {
-                            size_end++;
-                        }
-                        std::string ask_size_str = json.substr(size_pos, size_end - size_pos);
-                        ask_size = atof(ask_size_str.c_str());
-                    }
-                }
-            }
-        }
-    }
-    
-    return (best_bid > 0.0 || best_ask > 0.0);
+static long long now_us() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000000LL + tv.tv_usec;
 }
 
 // Parse Gamma API response and extract market information using jsoncpp
-static std::vector<MarketInfo> discover_markets() {
+static std::vector<MarketInfo> discover_markets(HttpFetcher& fetcher, const std::string& gamma_url) {
     std::vector<MarketInfo> markets;
     
     // Query Gamma API for active markets (limit to 20 to avoid rate limits)
-    std::string url = "https://gamma-api.polymarket.com/events?active=true&closed=false&limit=20";
-    std::string response = http_get(url);
+    std::string url = gamma_url + "/events?active=true&closed=false&limit=20";
+    std::string response = fetcher.get(url).body;
     
     if (response.empty()) {
         std::cout << "Gamma API returned empty response" << std::endl;
@@ -233,18 +81,25 @@ static std::vector<MarketInfo> discover_markets() {
             continue;
         }
         
-        // Iterate through markets in this event
+        // Iterate through markets in this event. Every open market's YES
+        // token is tracked, and its NO token for the complement set.
+        std::vector<MarketInfo> yes_tokens;
+        std::vector<MarketInfo> no_tokens;
+        size_t open_markets = 0;
         for (Json::ArrayIndex j = 0; j < eventMarkets.size(); j++) {
             const Json::Value& market = eventMarkets[j];
             if (!market.isObject()) {
                 continue;
             }
             
-            // Check if market is active and has orderbook enabled
-            if (!market.isMember("active") || !market["active"].asBool()) {
+            // Resolved markets drop out of the event's outcomes
+            if (market.isMember("closed") && market["closed"].asBool()) {
                 continue;
             }
-            if (market.isMember("closed") && market["closed"].asBool()) {
+            open_markets++;
+            
+            // Check if market is active and has orderbook enabled
+            if (!market.isMember("active") || !market["active"].asBool()) {
                 continue;
             }
             if (!market.isMember("enableOrderBook") || !market["enableOrderBook"].asBool()) {
@@ -259,197 +114,463 @@ static std::vector<MarketInfo> discover_markets() {
             std::string question = market["question"].asString();
             std::string clobTokenIdsStr = market["clobTokenIds"].asString();
             
-            // Parse clobTokenIds JSON string array
+            // Parse clobTokenIds JSON string array: ["<Yes>", "<No>"]
             Json::Value tokenIdsArray;
             Json::Reader tokenReader;
             if (!tokenReader.parse(clobTokenIdsStr, tokenIdsArray) || !tokenIdsArray.isArray() || tokenIdsArray.size() == 0) {
                 continue;
             }
             
-            // Use first token ID (typically the "Yes" outcome)
             std::string tokenId = tokenIdsArray[0].asString();
+            if (tokenId.empty() || question.empty()) {
+                continue;
+            }
+            
+            MarketInfo info;
+            info.token_id = tokenId;
+            info.event_name = question;
+            info.market_id = market_symbols().intern(tokenId);
+            info.event_id = event_matcher().match(MARKET_POLYMARKET, info.market_id, question);
+            yes_tokens.push_back(info);
             
-            if (!tokenId.empty() && !question.empty()) {
-                MarketInfo info;
-                info.token_id = tokenId;
-                info.event_name = question;
-                markets.push_back(info);
+            // The NO token is only ever priced against its own YES, so it
+            // gets an event of its own rather than going to the matcher
+            std::string noTokenId = tokenIdsArray.size() > 1 ? tokenIdsArray[1].asString() : "";
+            MarketInfo no;
+            if (!noTokenId.empty()) {
+                no.token_id = noTokenId;
+                no.event_name = question + " (No)";
+                no.market_id = market_symbols().intern(noTokenId);
+                no.event_id = event_symbols().intern(no.event_name);
+            }
+            no_tokens.push_back(no);
+        }
+        
+        // In a negative-risk event exactly one market resolves YES, so the
+        // YES tokens together are one outcome set, provided none is
+        // missing: not an augmented event (placeholder outcomes can still
+        // be added) and every open market tracked. Otherwise each market
+        // is its own YES + NO set.
+        bool neg_risk = event["negRisk"].isBool() && event["negRisk"].asBool() &&
+                        !(event["negRiskAugmented"].isBool() && event["negRiskAugmented"].asBool());
+        if (neg_risk && yes_tokens.size() == open_markets && yes_tokens.size() >= 2 && event["title"].isString()) {
+            SymbolId group = event_symbols().intern(event["title"].asString() + " (Polymarket, all outcomes)");
+            for (size_t j = 0; j < yes_tokens.size(); j++) {
+                yes_tokens[j].group_id = group;
+                yes_tokens[j].group_size = (int)yes_tokens.size();
+                markets.push_back(yes_tokens[j]);
+            }
+            continue;
+        }
+        for (size_t j = 0; j < yes_tokens.size(); j++) {
+            markets.push_back(yes_tokens[j]);
+            if (no_tokens[j].token_id.empty()) {
+                continue;
             }
+            SymbolId group = event_symbols().intern(yes_tokens[j].event_name + " (Polymarket, Yes + No)");
+            markets.back().group_id = group;
+            markets.back().group_size = 2;
+            no_tokens[j].group_id = group;
+            no_tokens[j].group_size = 2;
+            markets.push_back(no_tokens[j]);
         }
     }
     
     return markets;
 }
 
-void* thread_function(void* arg) {
-    ThreadData* td = (ThreadData*)arg;
-    PolymarketClient* client = td->client;
+struct PollContext {
+    PolymarketClient* client;
+    const std::vector<MarketInfo>* markets;
+    ParsedBook* book;
+    OrderBook* depth;
+};
+
+static void on_book_response(size_t index, const HttpResponse& http, void* context) {
+    PollContext* ctx = (PollContext*)context;
+    const MarketInfo& market = (*ctx->markets)[index];
+    const std::string& response = http.body;
     
-    // Initialize curl (thread-safe)
-    curl_global_init(CURL_GLOBAL_DEFAULT);
+    MarketData data;
+    data.market = MARKET_POLYMARKET;
+    data.market_id = market.market_id;
+    data.event_id = market.event_id;
+    data.group_id = market.group_id;
+    data.group_size = market.group_size;
+    data.best_bid = 0.0;
+    data.best_ask = 0.0;
+    data.bid_size = 0.0;
+    data.ask_size = 0.0;
+    data.timestamp = now_us();
+    data.is_valid = false;
     
-    std::vector<MarketInfo> tracked_markets;
-    time_t last_discovery = 0;
-    const time_t DISCOVERY_INTERVAL = 60; // Discover markets every 60 seconds
+    // An {"error": ...} body means the market has no orderbook - this is
+    // normal for some markets; it parses to empty ladders and is reported
+    // as an invalid quote
+    if (!response.empty() && parse_orderbook(response.data(), response.size(), *ctx->book)) {
+        double best_bid = 0.0;
+        double best_ask = 0.0;
+        double bid_size = 0.0;
+        double ask_size = 0.0;
+        ctx->depth->set_snapshot(*ctx->book);
+        ctx->depth->top(best_bid, best_ask, bid_size, ask_size);
+        
+        if (best_bid > 0.0 || best_ask > 0.0) {
+            data.best_bid = best_bid;
+            data.best_ask = best_ask;
+            data.bid_size = bid_size;
+            data.ask_size = ask_size;
+            data.is_valid = true;
+            data.book = ctx->depth;
+            std::cout << "Market: " << market.event_name.substr(0, 40) 
+                      << " | Bid: " << best_bid 
+                      << " | Ask: " << best_ask 
+                      << " | Prob: " << ((best_bid + best_ask) / 2.0 * 100.0) << "%" << std::endl;
+        }
+    }
     
-    std::cout << "Discovering markets from Gamma API..." << std::endl;
-    tracked_markets = discover_markets();
-    if (tracked_markets.empty()) {
-        std::cout << "Warning: No markets discovered. Using fallback market." << std::endl;
-        // Fallback to test market
-        MarketInfo fallback;
-        fallback.token_id = "93233117327291618289066315828674286787516183725243918731390800170422815079307";
-        fallback.event_name = "The Fantastic Four: First Steps";
-        tracked_markets.push_back(fallback);
-    } else {
-        std::cout << "Discovered " << tracked_markets.size() << " markets to track." << std::endl;
+    // Send market data even if orderbook is empty (so all markets show up)
+    if (ctx->client->update_callback != NULL) {
+        ctx->client->update_callback(&data);
+    }
+}
+
+static const time_t DISCOVERY_INTERVAL = 60; // Discover markets every 60 seconds
+static const long long STREAM_PING_INTERVAL_US = 10000000LL;
+static const int STREAM_MAX_BACKOFF_MS = 30000;
+
+// Sleeps in small steps so disconnect() is never held up for long
+static void sleep_while_connected(PolymarketClient* client, long long until_us) {
+    while (client->is_connected() && now_us() < until_us) {
+        usleep(50000);
+    }
+}
+
+// Re-runs discovery once DISCOVERY_INTERVAL has passed. Returns true when
+// the set of tracked tokens changed; when it didn't, what discovery says
+// about each market (event, outcome set) is refreshed in place, keeping
+// the positions the stream's books are indexed by. Markets that dropped
+// out (closed, or gone from the listing) get an invalid quote so their
+// last price doesn't stay in the engine, still counting towards a pair or
+// an outcome set.
+static bool maybe_rediscover(PolymarketClient* client, HttpFetcher& fetcher, Config* config, std::vector<MarketInfo>& tracked_markets, time_t& last_discovery) {
+    time_t now = time(NULL);
+    if (now - last_discovery < DISCOVERY_INTERVAL) {
+        return false;
     }
-    last_discovery = time(NULL);
     
-    while (client->is_connected()) {
-        time_t now = time(NULL);
-        
-        // Re-discover markets periodically
-        if (now - last_discovery >= DISCOVERY_INTERVAL) {
-            std::cout << "Re-discovering markets..." << std::endl;
-            std::vector<MarketInfo> new_markets = discover_markets();
-            if (!new_markets.empty()) {
-                tracked_markets = new_markets;
-                std::cout << "Now tracking " << tracked_markets.size() << " markets." << std::endl;
-            }
-            last_discovery = now;
+    bool changed = false;
+    std::cout << "Re-discovering markets..." << std::endl;
+    std::vector<MarketInfo> new_markets = discover_markets(fetcher, config->polymarket_gamma_url);
+    if (!new_markets.empty()) {
+        std::unordered_map<SymbolId, size_t> still_tracked;
+        for (size_t i = 0; i < new_markets.size(); i++) {
+            still_tracked[new_markets[i].market_id] = i;
         }
-        
-        // Poll all tracked markets
-        if (client->update_callback != NULL) {
-            for (size_t i = 0; i < tracked_markets.size(); i++) {
-                const MarketInfo& market = tracked_markets[i];
-                
-                // Fetch orderbook from Polymarket CLOB API
-                std::string url = "https://clob.polymarket.com/book?token_id=" + market.token_id;
-                std::string response = http_get(url);
-                
+        changed = still_tracked.size() != tracked_markets.size();
+        for (size_t i = 0; i < tracked_markets.size(); i++) {
+            if (still_tracked.count(tracked_markets[i].market_id) != 0) {
+                continue;
+            }
+            changed = true;
+            if (client->update_callback != NULL) {
                 MarketData data;
                 data.market = MARKET_POLYMARKET;
-                data.market_id = market.token_id;
-                data.event_name = market.event_name;
-                data.best_bid = 0.0;
-                data.best_ask = 0.0;
-                data.bid_size = 0.0;
-                data.ask_size = 0.0;
-                data.is_valid = false;
-                
-                if (!response.empty()) {
-                    // Check for error response
-                    if (response.find("\"error\"") != std::string::npos) {
-                        // Market has no orderbook - this is normal for some markets
-                        data.best_bid = 0.0;
-                        data.best_ask = 0.0;
-                        data.bid_size = 0.0;
-                        data.ask_size = 0.0;
-                        data.is_valid = false;
-                    } else {
-                        double best_bid = 0.0;
-                        double best_ask = 0.0;
-                        double bid_size = 0.0;
-                        double ask_size = 0.0;
-                        
-                        if (parse_orderbook(response, best_bid, best_ask, bid_size, ask_size)) {
-                            data.best_bid = best_bid;
-                            data.best_ask = best_ask;
-                            data.bid_size = bid_size;
-                            data.ask_size = ask_size;
-                            data.is_valid = true;
-                            std::cout << "Market: " << market.event_name.substr(0, 40) 
-                                      << " | Bid: " << best_bid 
-                                      << " | Ask: " << best_ask 
-                                      << " | Prob: " << ((best_bid + best_ask) / 2.0 * 100.0) << "%" << std::endl;
-                        } else {
-                            // No valid orderbook data found
-                            data.best_bid = 0.0;
-                            data.best_ask = 0.0;
-                            data.bid_size = 0.0;
-                            data.ask_size = 0.0;
-                            data.is_valid = false;
-                        }
-                    }
-                } else {
-                    data.best_bid = 0.0;
-                    data.best_ask = 0.0;
-                    data.bid_size = 0.0;
-                    data.ask_size = 0.0;
-                    data.is_valid = false;
-                }
-                
-                // Send market data even if orderbook is empty (so all markets show up)
+                data.market_id = tracked_markets[i].market_id;
+                data.event_id = tracked_markets[i].event_id;
+                data.timestamp = now_us();
                 client->update_callback(&data);
-                
-                // Small delay between markets to avoid rate limiting
-                usleep(50000); // 50ms between markets (reduced from 100ms)
             }
         }
         
-        // Wait 2 seconds before next poll cycle
-        usleep(2000000);
+        if (changed) {
+            tracked_markets = new_markets;
+            std::cout << "Now tracking " << tracked_markets.size() << " markets." << std::endl;
+        } else {
+            for (size_t i = 0; i < tracked_markets.size(); i++) {
+                tracked_markets[i] = new_markets[still_tracked[tracked_markets[i].market_id]];
+            }
+        }
     }
+    last_discovery = now;
     
-    curl_global_cleanup();
-    delete td;
-    return NULL;
+    HttpStats stats = fetcher.stats();
+    if (stats.requests > 0) {
+        std::cout << "HTTP: " << stats.requests << " requests, "
+                  << stats.connections_reused << " reused connections, "
+                  << stats.connections_opened << " opened, "
+                  << stats.failures << " failed, avg "
+                  << (stats.total_latency_ms / stats.requests) << "ms, max "
+                  << stats.max_latency_ms << "ms" << std::endl;
+    }
+    return changed;
 }
 
-PolymarketClient::PolymarketClient() {
-    connected = false;
-    update_callback = NULL;
-    worker_thread = NULL;
+static void run_polling(PolymarketClient* client, HttpFetcher& fetcher, std::vector<MarketInfo>& tracked_markets, time_t& last_discovery) {
+    Config* config = client->config;
+    std::vector<std::string> book_urls;
+    ParsedBook* book = new ParsedBook();
+    OrderBook depth;
+    
+    while (client->is_connected()) {
+        long long cycle_start = now_us();
+        maybe_rediscover(client, fetcher, config, tracked_markets, last_discovery);
+        
+        // Refresh every tracked book in parallel from the CLOB API
+        book_urls.resize(tracked_markets.size());
+        for (size_t i = 0; i < tracked_markets.size(); i++) {
+            book_urls[i] = config->polymarket_clob_url + "/book?token_id=" + tracked_markets[i].token_id;
+        }
+        
+        PollContext ctx;
+        ctx.client = client;
+        ctx.markets = &tracked_markets;
+        ctx.book = book;
+        ctx.depth = &depth;
+        fetcher.fetch_all(book_urls, on_book_response, &ctx);
+        
+        // Wait out the rest of the cycle, waking early on disconnect
+        sleep_while_connected(client, cycle_start + (long long)config->poll_interval_ms * 1000LL);
+    }
+    
+    delete book;
 }
 
-PolymarketClient::~PolymarketClient() {
-    disconnect();
-}
+// Each token's book is rebuilt from "book" snapshots and kept current by
+// "price_change" deltas
+struct StreamContext {
+    PolymarketClient* client;
+    const std::vector<MarketInfo>* markets;
+    std::unordered_map<std::string, size_t> index;
+    std::vector<OrderBook> books;
+    std::vector<PriceLevel> bid_scratch;
+    std::vector<PriceLevel> ask_scratch;
+};
 
-bool PolymarketClient::connect() {
-    if (connected) {
-        return true;
-    }
+static void emit_top_of_book(StreamContext& ctx, size_t i) {
+    const MarketInfo& market = (*ctx.markets)[i];
+    const OrderBook& book = ctx.books[i];
     
-    std::cout << "Connecting to Polymarket..." << std::endl;
-    connected = true;
+    MarketData data;
+    data.market = MARKET_POLYMARKET;
+    data.market_id = market.market_id;
+    data.event_id = market.event_id;
+    data.group_id = market.group_id;
+    data.group_size = market.group_size;
+    data.timestamp = now_us();
+    book.top(data.best_bid, data.best_ask, data.bid_size, data.ask_size);
+    data.is_valid = (data.best_bid > 0.0 || data.best_ask > 0.0);
+    data.book = &book;
     
-    ThreadData* td = new ThreadData;
-    td->client = this;
-    
-    pthread_t* thread = new pthread_t;
-    if (pthread_create(thread, NULL, thread_function, td) != 0) {
-        std::cout << "Failed to start thread" << std::endl;
-        connected = false;
-        delete td;
-        delete thread;
+    if (ctx.client->update_callback != NULL) {
+        ctx.client->update_callback(&data);
+    }
+}
+
+// Levels arrive as {"price":"0.48","size":"120.5"} with string numbers
+static double json_number(const Json::Value& value) {
+    return value.isString() ? atof(value.asCString()) : value.asDouble();
+}
+
+static void load_levels(std::vector<PriceLevel>& side, const Json::Value& levels) {
+    side.clear();
+    if (!levels.isArray()) {
+        return;
+    }
+    for (Json::ArrayIndex i = 0; i < levels.size(); i++) {
+        PriceLevel level;
+        level.price = json_number(levels[i]["price"]);
+        level.size = json_number(levels[i]["size"]);
+        side.push_back(level);
+    }
+}
+
+static bool apply_change(StreamContext& ctx, const std::string& asset_id, const Json::Value& change, size_t& touched) {
+    std::unordered_map<std::string, size_t>::iterator it = ctx.index.find(asset_id);
+    if (it == ctx.index.end()) {
         return false;
     }
     
-    worker_thread = thread;
+    int side = change["side"].asString() == "BUY" ? BOOK_BID : BOOK_ASK;
+    ctx.books[it->second].apply_delta(side, json_number(change["price"]), json_number(change["size"]));
+    touched = it->second;
     return true;
 }
 
-void PolymarketClient::disconnect() {
-    if (!connected) {
+static void handle_stream_event(StreamContext& ctx, const Json::Value& event) {
+    if (!event.isObject()) {
         return;
     }
+    std::string type = event["event_type"].asString();
     
-    connected = false;
+    if (type == "book") {
+        std::unordered_map<std::string, size_t>::iterator it = ctx.index.find(event["asset_id"].asString());
+        if (it == ctx.index.end()) {
+            return;
+        }
+        OrderBook& book = ctx.books[it->second];
+        load_levels(ctx.bid_scratch, event.isMember("bids") ? event["bids"] : event["buys"]);
+        load_levels(ctx.ask_scratch, event.isMember("asks") ? event["asks"] : event["sells"]);
+        book.set_snapshot(ctx.bid_scratch.empty() ? NULL : &ctx.bid_scratch[0], ctx.bid_scratch.size(),
+                          ctx.ask_scratch.empty() ? NULL : &ctx.ask_scratch[0], ctx.ask_scratch.size());
+        
+        const MarketInfo& market = (*ctx.markets)[it->second];
+        std::cout << "Book: " << market.event_name.substr(0, 40)
+                  << " | " << book.bid_count() << " bids, " << book.ask_count() << " asks" << std::endl;
+        emit_top_of_book(ctx, it->second);
+    } else if (type == "price_change") {
+        // Current format carries asset_id per change; older messages had
+        // one asset_id and a "changes" array
+        std::vector<size_t> touched;
+        size_t index = 0;
+        if (event.isMember("price_changes")) {
+            const Json::Value& changes = event["price_changes"];
+            for (Json::ArrayIndex i = 0; i < changes.size(); i++) {
+                if (apply_change(ctx, changes[i]["asset_id"].asString(), changes[i], index)) {
+                    touched.push_back(index);
+                }
+            }
+        } else {
+            const Json::Value& changes = event["changes"];
+            std::string asset_id = event["asset_id"].asString();
+            for (Json::ArrayIndex i = 0; i < changes.size(); i++) {
+                if (apply_change(ctx, asset_id, changes[i], index)) {
+                    touched.push_back(index);
+                }
+            }
+        }
+        
+        std::sort(touched.begin(), touched.end());
+        touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+        for (size_t i = 0; i < touched.size(); i++) {
+            emit_top_of_book(ctx, touched[i]);
+        }
+    }
+}
+
+static void handle_stream_message(StreamContext& ctx, const std::string& message) {
+    // Keep-alive replies are bare text
+    if (message.empty() || (message[0] != '{' && message[0] != '[')) {
+        return;
+    }
     
-    if (worker_thread != NULL) {
-        pthread_join(*(pthread_t*)worker_thread, NULL);
-        delete (pthread_t*)worker_thread;
-        worker_thread = NULL;
+    Json::Value root;
+    Json::Reader reader;
+    if (!reader.parse(message, root)) {
+        return;
+    }
+    
+    if (root.isArray()) {
+        for (Json::ArrayIndex i = 0; i < root.size(); i++) {
+            handle_stream_event(ctx, root[i]);
+        }
+    } else {
+        handle_stream_event(ctx, root);
     }
 }
 
-bool PolymarketClient::is_connected() {
-    return connected;
+static void reset_stream_books(StreamContext& ctx) {
+    ctx.index.clear();
+    for (size_t i = 0; i < ctx.markets->size(); i++) {
+        ctx.index[(*ctx.markets)[i].token_id] = i;
+    }
+    ctx.books.assign(ctx.markets->size(), OrderBook());
 }
 
-void PolymarketClient::set_update_function(void (*func)(MarketData*)) {
-    update_callback = func;
+static std::string subscribe_message(const std::vector<MarketInfo>& markets) {
+    Json::Value msg;
+    msg["type"] = "market";
+    Json::Value& ids = msg["assets_ids"];
+    ids = Json::Value(Json::arrayValue);
+    for (size_t i = 0; i < markets.size(); i++) {
+        ids.append(markets[i].token_id);
+    }
+    Json::FastWriter writer;
+    return writer.write(msg);
+}
+
+// Streams book snapshots and deltas over the market channel. Any
+// disconnect, and any change in the tracked set, goes through a fresh
+// connect + subscribe, which makes the venue resend full snapshots.
+static void run_streaming(PolymarketClient* client, HttpFetcher& fetcher, std::vector<MarketInfo>& tracked_markets, time_t& last_discovery) {
+    Config* config = client->config;
+    WebSocketClient ws;
+    StreamContext ctx;
+    ctx.client = client;
+    ctx.markets = &tracked_markets;
+    
+    int backoff_ms = 1000;
+    long long last_ping = 0;
+    std::string message;
+    
+    while (client->is_connected()) {
+        if (maybe_rediscover(client, fetcher, config, tracked_markets, last_discovery) && ws.is_open()) {
+            ws.close();
+        }
+        
+        if (!ws.is_open()) {
+            if (!ws.connect(config->polymarket_ws_url) || !ws.send_text(subscribe_message(tracked_markets))) {
+                std::cout << "Polymarket stream unavailable, retrying in " << backoff_ms << "ms" << std::endl;
+                sleep_while_connected(client, now_us() + backoff_ms * 1000LL);
+                backoff_ms = std::min(backoff_ms * 2, STREAM_MAX_BACKOFF_MS);
+                continue;
+            }
+            std::cout << "Subscribed to " << tracked_markets.size() << " markets on Polymarket stream" << std::endl;
+            reset_stream_books(ctx);
+            backoff_ms = 1000;
+            last_ping = now_us();
+        }
+        
+        int result = ws.receive(message, 250);
+        if (result < 0) {
+            std::cout << "Polymarket stream disconnected, resubscribing" << std::endl;
+            continue;
+        }
+        if (result > 0) {
+            handle_stream_message(ctx, message);
+        }
+        
+        if (now_us() - last_ping >= STREAM_PING_INTERVAL_US) {
+            ws.send_text("PING");
+            last_ping = now_us();
+        }
+    }
+    
+    ws.close();
+}
+
+void PolymarketClient::run() {
+    HttpFetcher fetcher(config->http_max_concurrency, config->http_rate_limit, config->http_rate_burst);
+    
+    std::vector<MarketInfo> tracked_markets;
+    time_t last_discovery = 0;
+    
+    std::cout << "Discovering markets from Gamma API..." << std::endl;
+    tracked_markets = discover_markets(fetcher, config->polymarket_gamma_url);
+    if (tracked_markets.empty()) {
+        std::cout << "Warning: No markets discovered. Using fallback market." << std::endl;
+        // Fallback to test market
+        MarketInfo fallback;
+        fallback.token_id = "93233117327291618289066315828674286787516183725243918731390800170422815079307";
+        fallback.event_name = "The Fantastic Four: First Steps";
+        fallback.market_id = market_symbols().intern(fallback.token_id);
+        fallback.event_id = event_matcher().match(MARKET_POLYMARKET, fallback.market_id, fallback.event_name);
+        tracked_markets.push_back(fallback);
+    } else {
+        std::cout << "Discovered " << tracked_markets.size() << " markets to track." << std::endl;
+    }
+    last_discovery = time(NULL);
+    
+    if (!config->polymarket_ws_url.empty()) {
+        run_streaming(this, fetcher, tracked_markets, last_discovery);
+    } else {
+        run_polling(this, fetcher, tracked_markets, last_discovery);
+    }
+}
+
+PolymarketClient::PolymarketClient(Config* config) : MarketDataClient(config, MARKET_POLYMARKET, "Polymarket") {
+}
+
+PolymarketClient::~PolymarketClient() {
+    disconnect();
 }
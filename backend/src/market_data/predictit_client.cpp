@@ -0,0 +1,163 @@
+#include "market_data_client.h"
+#include "types.h"
+#include "symbol_table.h"
+#include "event_matcher.h"
+#include "http_client.h"
+#include <iostream>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <json/json.h>
+
+// Most a trader may hold in one contract, in dollars
+static const double POSITION_LIMIT = 850.0;
+
+struct ContractQuote {
+    SymbolId event_id;
+    double best_bid;
+    double best_ask;
+    bool is_valid;
+    bool seen;   // in the current snapshot
+};
+
+static long long now_us() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+// Sleeps in small steps so disconnect() is never held up for long
+static void sleep_while_connected(MarketDataClient* client, long long until_us) {
+    while (client->is_connected() && now_us() < until_us) {
+        usleep(50000);
+    }
+}
+
+// Prices are dollars, or null when nobody is offering
+static double json_price(const Json::Value& value) {
+    if (value.isString()) {
+        return atof(value.asCString());
+    }
+    return value.isNumeric() ? value.asDouble() : 0.0;
+}
+
+static void emit(PredictItClient* client, SymbolId market_id, const ContractQuote& quote, long long timestamp) {
+    MarketData data;
+    data.market = MARKET_PREDICTIT;
+    data.market_id = market_id;
+    data.event_id = quote.event_id;
+    data.timestamp = timestamp;
+    data.is_valid = quote.is_valid;
+    if (quote.is_valid) {
+        data.best_bid = quote.best_bid;
+        data.best_ask = quote.best_ask;
+        // Buying YES is capped by the position limit at the ask; selling
+        // YES at the bid is buying NO at 1 - bid, capped the same way
+        data.ask_size = quote.best_ask > 0.0 ? POSITION_LIMIT / quote.best_ask : 0.0;
+        data.bid_size = quote.best_bid > 0.0 && quote.best_bid < 1.0 ? POSITION_LIMIT / (1.0 - quote.best_bid) : 0.0;
+    }
+    
+    if (client->update_callback != NULL) {
+        client->update_callback(&data);
+    }
+}
+
+// One snapshot: {"markets":[{"id":..,"name":"..","contracts":[{"id":..,
+// "name":"..","status":"Open","bestBuyYesCost":0.55,"bestSellYesCost":0.54,
+// ...}]}]}. Contracts that changed are emitted; ones that dropped out of
+// the snapshot or closed are emitted once as invalid.
+static void handle_snapshot(PredictItClient* client, const Json::Value& root, std::unordered_map<SymbolId, ContractQuote>& last) {
+    long long timestamp = now_us();
+    for (std::unordered_map<SymbolId, ContractQuote>::iterator it = last.begin(); it != last.end(); ++it) {
+        it->second.seen = false;
+    }
+    
+    const Json::Value& markets = root["markets"];
+    for (Json::ArrayIndex i = 0; i < markets.size(); i++) {
+        const Json::Value& market = markets[i];
+        const Json::Value& contracts = market["contracts"];
+        if (!market.isObject() || !contracts.isArray()) {
+            continue;
+        }
+        std::string market_name = market["name"].asString();
+        
+        for (Json::ArrayIndex j = 0; j < contracts.size(); j++) {
+            const Json::Value& contract = contracts[j];
+            if (!contract.isObject() || !contract.isMember("id")) {
+                continue;
+            }
+            
+            // Each contract of a multi-outcome market is its own binary
+            // question, named like the other venues' outcomes
+            std::string contract_name = contract["name"].asString();
+            std::string name = market_name;
+            if (contracts.size() > 1 && !contract_name.empty()) {
+                name += " - " + contract_name;
+            }
+            
+            SymbolId market_id = market_symbols().intern(EventMatcher::market_key(MARKET_PREDICTIT, contract["id"].asString()));
+            ContractQuote quote;
+            quote.event_id = event_matcher().match(MARKET_PREDICTIT, market_id, name);
+            quote.best_bid = json_price(contract["bestSellYesCost"]);
+            quote.best_ask = json_price(contract["bestBuyYesCost"]);
+            quote.is_valid = contract["status"].asString() == "Open" && (quote.best_bid > 0.0 || quote.best_ask > 0.0);
+            quote.seen = true;
+            
+            std::unordered_map<SymbolId, ContractQuote>::iterator it = last.find(market_id);
+            bool changed = it == last.end() || it->second.is_valid != quote.is_valid ||
+                           it->second.event_id != quote.event_id ||
+                           (quote.is_valid && (it->second.best_bid != quote.best_bid || it->second.best_ask != quote.best_ask));
+            last[market_id] = quote;
+            if (changed) {
+                emit(client, market_id, quote, timestamp);
+            }
+        }
+    }
+    
+    for (std::unordered_map<SymbolId, ContractQuote>::iterator it = last.begin(); it != last.end();) {
+        if (it->second.seen) {
+            ++it;
+            continue;
+        }
+        if (it->second.is_valid) {
+            it->second.is_valid = false;
+            emit(client, it->first, it->second, timestamp);
+        }
+        it = last.erase(it);
+    }
+}
+
+void PredictItClient::run() {
+    HttpFetcher fetcher(1, config->http_rate_limit, config->http_rate_burst);
+    std::unordered_map<SymbolId, ContractQuote> last;
+    bool reported = false;
+    
+    while (is_connected()) {
+        long long cycle_start = now_us();
+        
+        HttpResponse response = fetcher.get(config->predictit_url);
+        Json::Value root;
+        Json::Reader reader;
+        if (response.ok && response.status == 200 && reader.parse(response.body, root) && root.isObject() && root["markets"].isArray()) {
+            handle_snapshot(this, root, last);
+            if (!reported) {
+                std::cout << "Tracking " << last.size() << " PredictIt contracts." << std::endl;
+                reported = true;
+            }
+        } else {
+            std::cout << "PredictIt snapshot unavailable (HTTP " << response.status << ")" << std::endl;
+        }
+        
+        sleep_while_connected(this, cycle_start + (long long)config->predictit_poll_interval_ms * 1000LL);
+    }
+}
+
+PredictItClient::PredictItClient(Config* config) : MarketDataClient(config, MARKET_PREDICTIT, "PredictIt") {
+}
+
+PredictItClient::~PredictItClient() {
+    disconnect();
+}
@@ -0,0 +1,370 @@
+#include "websocket_client.h"
+#include "websocket_protocol.h"
+#include "websocket_decoder.h"
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <cstring>
+#include <stdint.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/rand.h>
+
+static const size_t READ_CHUNK = 16384;
+static const int HANDSHAKE_TIMEOUT_MS = 10000;
+static const size_t MAX_MESSAGE_SIZE = 16 << 20;  // full book snapshots can be large
+
+struct ClientState {
+    int fd;
+    SSL_CTX* ssl_ctx;
+    SSL* ssl;
+    bool open;
+    std::string buffer;         // handshake response received so far
+    WebSocketDecoder decoder;   // frames, once open
+    WebSocketMessage message;
+    
+    ClientState() : decoder(false, MAX_MESSAGE_SIZE) {
+        fd = -1;
+        ssl_ctx = NULL;
+        ssl = NULL;
+        open = false;
+    }
+};
+
+struct ParsedUrl {
+    bool secure;
+    std::string host;
+    std::string port;
+    std::string path;
+};
+
+static bool parse_url(const std::string& url, ParsedUrl& out) {
+    size_t scheme_end = url.find("://");
+    if (scheme_end == std::string::npos) {
+        return false;
+    }
+    
+    std::string scheme = url.substr(0, scheme_end);
+    if (scheme == "wss") {
+        out.secure = true;
+        out.port = "443";
+    } else if (scheme == "ws") {
+        out.secure = false;
+        out.port = "80";
+    } else {
+        return false;
+    }
+    
+    size_t host_start = scheme_end + 3;
+    size_t path_start = url.find('/', host_start);
+    std::string authority = url.substr(host_start, path_start == std::string::npos ? std::string::npos : path_start - host_start);
+    out.path = path_start == std::string::npos ? "/" : url.substr(path_start);
+    
+    size_t colon = authority.rfind(':');
+    if (colon != std::string::npos) {
+        out.host = authority.substr(0, colon);
+        out.port = authority.substr(colon + 1);
+    } else {
+        out.host = authority;
+    }
+    return !out.host.empty();
+}
+
+static int tcp_connect(const std::string& host, const std::string& port) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    
+    struct addrinfo* results = NULL;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &results) != 0) {
+        return -1;
+    }
+    
+    int fd = -1;
+    for (struct addrinfo* ai = results; ai != NULL; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        ::close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(results);
+    
+    if (fd >= 0) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+static bool write_all(ClientState* cs, const char* data, size_t length) {
+    while (length > 0) {
+        int written;
+        if (cs->ssl != NULL) {
+            written = SSL_write(cs->ssl, data, (int)length);
+        } else {
+            written = (int)send(cs->fd, data, length, MSG_NOSIGNAL);
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+// Hands whatever arrives within timeout_ms to the frame decoder, or to
+// cs->buffer during the handshake. Returns bytes read, 0 on timeout, -1 on
+// error or EOF.
+static int read_some(ClientState* cs, int timeout_ms) {
+    bool pending = cs->ssl != NULL && SSL_pending(cs->ssl) > 0;
+    if (!pending) {
+        struct pollfd pfd;
+        pfd.fd = cs->fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        int ready = poll(&pfd, 1, timeout_ms);
+        if (ready == 0) {
+            return 0;
+        }
+        if (ready < 0) {
+            return -1;
+        }
+    }
+    
+    char chunk[READ_CHUNK];
+    int received;
+    if (cs->ssl != NULL) {
+        received = SSL_read(cs->ssl, chunk, sizeof(chunk));
+        if (received <= 0) {
+            int err = SSL_get_error(cs->ssl, received);
+            // Renegotiation/session tickets: no application data yet
+            return (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) ? 0 : -1;
+        }
+    } else {
+        received = (int)recv(cs->fd, chunk, sizeof(chunk), 0);
+        if (received <= 0) {
+            return -1;
+        }
+    }
+    
+    if (cs->open) {
+        cs->decoder.feed(chunk, received);
+    } else {
+        cs->buffer.append(chunk, received);
+    }
+    return received;
+}
+
+// Client frames must be masked (RFC 6455 5.3)
+static bool send_frame(ClientState* cs, unsigned char opcode, const char* payload, size_t length) {
+    std::string frame;
+    frame.reserve(length + 14);
+    frame += (char)(0x80 | opcode);
+    
+    if (length < 126) {
+        frame += (char)(0x80 | length);
+    } else if (length < 65536) {
+        frame += (char)(0x80 | 126);
+        frame += (char)((length >> 8) & 0xFF);
+        frame += (char)(length & 0xFF);
+    } else {
+        frame += (char)(0x80 | 127);
+        for (int i = 0; i < 8; i++) {
+            frame += (char)(((uint64_t)length >> (56 - i * 8)) & 0xFF);
+        }
+    }
+    
+    unsigned char mask[4];
+    RAND_bytes(mask, sizeof(mask));
+    frame.append((const char*)mask, 4);
+    
+    size_t offset = frame.size();
+    frame.append(payload, length);
+    websocket_apply_mask(&frame[offset], length, mask);
+    
+    return write_all(cs, frame.data(), frame.size());
+}
+
+static void teardown(ClientState* cs) {
+    if (cs->ssl != NULL) {
+        SSL_shutdown(cs->ssl);
+        SSL_free(cs->ssl);
+        cs->ssl = NULL;
+    }
+    if (cs->fd >= 0) {
+        ::close(cs->fd);
+        cs->fd = -1;
+    }
+    cs->open = false;
+    cs->buffer.clear();
+    cs->decoder.reset();
+}
+
+WebSocketClient::WebSocketClient() {
+    state = new ClientState();
+}
+
+WebSocketClient::~WebSocketClient() {
+    ClientState* cs = (ClientState*)state;
+    teardown(cs);
+    if (cs->ssl_ctx != NULL) {
+        SSL_CTX_free(cs->ssl_ctx);
+    }
+    delete cs;
+}
+
+bool WebSocketClient::connect(const std::string& url) {
+    ClientState* cs = (ClientState*)state;
+    teardown(cs);
+    
+    ParsedUrl parsed;
+    if (!parse_url(url, parsed)) {
+        std::cerr << "Invalid WebSocket URL: " << url << std::endl;
+        return false;
+    }
+    
+    cs->fd = tcp_connect(parsed.host, parsed.port);
+    if (cs->fd < 0) {
+        return false;
+    }
+    
+    if (parsed.secure) {
+        if (cs->ssl_ctx == NULL) {
+            cs->ssl_ctx = SSL_CTX_new(TLS_client_method());
+            SSL_CTX_set_default_verify_paths(cs->ssl_ctx);
+            SSL_CTX_set_verify(cs->ssl_ctx, SSL_VERIFY_PEER, NULL);
+        }
+        cs->ssl = SSL_new(cs->ssl_ctx);
+        SSL_set_fd(cs->ssl, cs->fd);
+        SSL_set_tlsext_host_name(cs->ssl, parsed.host.c_str());
+        SSL_set1_host(cs->ssl, parsed.host.c_str());
+        if (SSL_connect(cs->ssl) != 1) {
+            std::cerr << "TLS handshake with " << parsed.host << " failed" << std::endl;
+            teardown(cs);
+            return false;
+        }
+    }
+    
+    unsigned char nonce[16];
+    RAND_bytes(nonce, sizeof(nonce));
+    std::string key = base64_encode(nonce, sizeof(nonce));
+    
+    std::string request = "GET " + parsed.path + " HTTP/1.1\r\n"
+                          "Host: " + parsed.host + "\r\n"
+                          "Upgrade: websocket\r\n"
+                          "Connection: Upgrade\r\n"
+                          "Sec-WebSocket-Key: " + key + "\r\n"
+                          "Sec-WebSocket-Version: 13\r\n"
+                          "\r\n";
+    if (!write_all(cs, request.data(), request.size())) {
+        teardown(cs);
+        return false;
+    }
+    
+    size_t header_end;
+    while ((header_end = cs->buffer.find("\r\n\r\n")) == std::string::npos) {
+        if (read_some(cs, HANDSHAKE_TIMEOUT_MS) <= 0) {
+            teardown(cs);
+            return false;
+        }
+    }
+    
+    std::string headers = cs->buffer.substr(0, header_end);
+    cs->buffer.erase(0, header_end + 4);
+    
+    std::string expected = "Sec-WebSocket-Accept: " + websocket_accept_key(key);
+    std::string expected_lower = "sec-websocket-accept: " + websocket_accept_key(key);
+    if (headers.compare(0, 12, "HTTP/1.1 101") != 0 ||
+        (headers.find(expected) == std::string::npos && headers.find(expected_lower) == std::string::npos)) {
+        std::cerr << "WebSocket upgrade rejected: " << headers.substr(0, headers.find("\r\n")) << std::endl;
+        teardown(cs);
+        return false;
+    }
+    
+    // Frames the server sent right behind its response
+    cs->decoder.feed(cs->buffer.data(), cs->buffer.size());
+    cs->buffer.clear();
+    cs->open = true;
+    return true;
+}
+
+void WebSocketClient::close() {
+    ClientState* cs = (ClientState*)state;
+    if (cs->open) {
+        send_frame(cs, 0x8, "", 0);
+    }
+    teardown(cs);
+}
+
+bool WebSocketClient::is_open() {
+    ClientState* cs = (ClientState*)state;
+    return cs->open;
+}
+
+bool WebSocketClient::send_text(const std::string& message) {
+    ClientState* cs = (ClientState*)state;
+    if (!cs->open) {
+        return false;
+    }
+    if (!send_frame(cs, 0x1, message.data(), message.size())) {
+        teardown(cs);
+        return false;
+    }
+    return true;
+}
+
+int WebSocketClient::receive(std::string& message, int timeout_ms) {
+    ClientState* cs = (ClientState*)state;
+    
+    while (cs->open) {
+        int result = cs->decoder.next(cs->message);
+        if (result == DECODE_ERROR) {
+            int code = cs->decoder.error_code();
+            unsigned char payload[2] = {(unsigned char)(code >> 8), (unsigned char)(code & 0xFF)};
+            send_frame(cs, WS_CLOSE, (const char*)payload, sizeof(payload));
+            teardown(cs);
+            return -1;
+        }
+        if (result == DECODE_MESSAGE) {
+            const std::string& payload = cs->message.payload;
+            if (cs->message.opcode == WS_PING) {
+                send_frame(cs, WS_PONG, payload.data(), payload.size());
+                continue;
+            }
+            if (cs->message.opcode == WS_PONG) {
+                continue;
+            }
+            if (cs->message.opcode == WS_CLOSE) {
+                send_frame(cs, WS_CLOSE, payload.data(), payload.size() >= 2 ? 2 : 0);
+                teardown(cs);
+                return -1;
+            }
+            message.swap(cs->message.payload);
+            return 1;
+        }
+        
+        int received = read_some(cs, timeout_ms);
+        if (received < 0) {
+            teardown(cs);
+            return -1;
+        }
+        if (received == 0) {
+            return 0;
+        }
+    }
+    
+    return -1;
+}
@@ -0,0 +1,230 @@
+#include "conflator.h"
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <pthread.h>
+#include <unistd.h>
+
+static const long long MAX_FLUSH_TICK_MS = 50;
+
+struct MarketSlot {
+    MarketData sent;       // last quote passed on
+    MarketData latest;     // newer quote waiting for the interval to end
+    bool seen;             // `sent` is set
+    bool pending;          // `latest` is set
+    long long last_emit_ms;
+    
+    MarketSlot() {
+        seen = false;
+        pending = false;
+        last_emit_ms = 0;
+    }
+};
+
+struct ConflatorState {
+    pthread_mutex_t lock;
+    std::vector<MarketSlot> slots;   // indexed by market SymbolId, grown on demand
+    std::vector<SymbolId> dirty;     // markets that had an update held back
+    ConflatorStats counters;         // offered = emitted + unchanged + coalesced + pending
+    size_t max_markets;
+    long long interval_ms;
+    
+    pthread_t thread;
+    std::atomic<bool> running;
+    
+    ConflatorState() {
+        max_markets = 0;
+        interval_ms = 0;
+        running.store(false);
+        pthread_mutex_init(&lock, NULL);
+    }
+    
+    ~ConflatorState() {
+        pthread_mutex_destroy(&lock);
+    }
+};
+
+static long long now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool same_quote(const MarketData& a, const MarketData& b) {
+    return a.best_bid == b.best_bid && a.best_ask == b.best_ask &&
+           a.bid_size == b.bid_size && a.ask_size == b.ask_size && a.is_valid == b.is_valid;
+}
+
+Conflator::Conflator(Config* config) {
+    this->config = config;
+    this->emit_callback = NULL;
+    
+    ConflatorState* cs = new ConflatorState();
+    cs->max_markets = config->max_markets;
+    cs->interval_ms = config->conflate_interval_ms > 0 ? config->conflate_interval_ms : 0;
+    state = cs;
+}
+
+Conflator::~Conflator() {
+    stop();
+    delete (ConflatorState*)state;
+}
+
+void Conflator::set_emit_function(void (*func)(MarketData*)) {
+    emit_callback = func;
+}
+
+void Conflator::offer(const MarketData* data) {
+    ConflatorState* cs = (ConflatorState*)state;
+    if (data->market_id >= cs->max_markets) {
+        // Beyond the markets we track: nothing to conflate against
+        if (emit_callback != NULL) {
+            emit_callback((MarketData*)data);
+        }
+        return;
+    }
+    
+    long long now = now_ms();
+    pthread_mutex_lock(&cs->lock);
+    cs->counters.offered++;
+    if (data->market_id >= cs->slots.size()) {
+        cs->slots.resize(data->market_id + 1);
+    }
+    MarketSlot& slot = cs->slots[data->market_id];
+    
+    if (slot.pending) {
+        cs->counters.coalesced++;
+        if (same_quote(slot.sent, *data)) {
+            // Back to what clients already have: nothing left to send
+            slot.pending = false;
+            cs->counters.pending--;
+            cs->counters.unchanged++;
+        } else {
+            slot.latest = *data;
+            slot.latest.book = NULL;
+        }
+        pthread_mutex_unlock(&cs->lock);
+        return;
+    }
+    if (slot.seen && same_quote(slot.sent, *data)) {
+        cs->counters.unchanged++;
+        pthread_mutex_unlock(&cs->lock);
+        return;
+    }
+    if (slot.seen && now - slot.last_emit_ms < cs->interval_ms) {
+        slot.latest = *data;
+        slot.latest.book = NULL;
+        slot.pending = true;
+        cs->counters.pending++;
+        cs->dirty.push_back(data->market_id);
+        pthread_mutex_unlock(&cs->lock);
+        return;
+    }
+    
+    slot.sent = *data;
+    slot.sent.book = NULL;
+    slot.seen = true;
+    slot.last_emit_ms = now;
+    cs->counters.emitted++;
+    pthread_mutex_unlock(&cs->lock);
+    
+    // Straight through: the caller's copy, book and all
+    if (emit_callback != NULL) {
+        emit_callback((MarketData*)data);
+    }
+}
+
+// Emits the held-back updates whose interval is up
+static void flush_due(ConflatorState* cs, void (*emit)(MarketData*), std::vector<MarketData>& due) {
+    long long now = now_ms();
+    due.clear();
+    
+    pthread_mutex_lock(&cs->lock);
+    size_t kept = 0;
+    for (size_t i = 0; i < cs->dirty.size(); i++) {
+        MarketSlot& slot = cs->slots[cs->dirty[i]];
+        if (!slot.pending) {
+            continue;  // cancelled, or already flushed through an earlier entry
+        }
+        if (now - slot.last_emit_ms < cs->interval_ms) {
+            cs->dirty[kept++] = cs->dirty[i];
+            continue;
+        }
+        slot.sent = slot.latest;
+        slot.pending = false;
+        slot.last_emit_ms = now;
+        due.push_back(slot.latest);
+    }
+    cs->dirty.resize(kept);
+    cs->counters.emitted += due.size();
+    cs->counters.pending -= due.size();
+    pthread_mutex_unlock(&cs->lock);
+    
+    for (size_t i = 0; i < due.size() && emit != NULL; i++) {
+        emit(&due[i]);
+    }
+}
+
+struct FlusherArgs {
+    ConflatorState* cs;
+    void (*emit)(MarketData*);
+};
+
+static void* flusher_thread_func(void* arg) {
+    FlusherArgs* args = (FlusherArgs*)arg;
+    ConflatorState* cs = args->cs;
+    void (*emit)(MarketData*) = args->emit;
+    delete args;
+    
+    // A quarter interval keeps the trailing update at most 25% late
+    long long tick_ms = cs->interval_ms / 4;
+    if (tick_ms < 1) {
+        tick_ms = 1;
+    }
+    if (tick_ms > MAX_FLUSH_TICK_MS) {
+        tick_ms = MAX_FLUSH_TICK_MS;
+    }
+    
+    std::vector<MarketData> due;
+    while (cs->running.load()) {
+        usleep(tick_ms * 1000);
+        flush_due(cs, emit, due);
+    }
+    return NULL;
+}
+
+bool Conflator::start() {
+    ConflatorState* cs = (ConflatorState*)state;
+    if (cs->running.load() || cs->interval_ms == 0) {
+        return true;  // without an interval nothing is ever held back
+    }
+    
+    FlusherArgs* args = new FlusherArgs();
+    args->cs = cs;
+    args->emit = emit_callback;
+    cs->running.store(true);
+    if (pthread_create(&cs->thread, NULL, flusher_thread_func, args) != 0) {
+        std::cerr << "Failed to start conflation thread" << std::endl;
+        cs->running.store(false);
+        delete args;
+        return false;
+    }
+    return true;
+}
+
+void Conflator::stop() {
+    ConflatorState* cs = (ConflatorState*)state;
+    if (!cs->running.load()) {
+        return;
+    }
+    cs->running.store(false);
+    pthread_join(cs->thread, NULL);
+}
+
+ConflatorStats Conflator::stats() {
+    ConflatorState* cs = (ConflatorState*)state;
+    pthread_mutex_lock(&cs->lock);
+    ConflatorStats result = cs->counters;
+    pthread_mutex_unlock(&cs->lock);
+    return result;
+}
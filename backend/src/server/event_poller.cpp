@@ -0,0 +1,196 @@
+#include "event_poller.h"
+#include <unistd.h>
+#include <errno.h>
+#include <map>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+
+static const int MAX_EVENTS = 256;
+
+struct PollerState {
+    int epoll_fd;
+    struct epoll_event events[MAX_EVENTS];
+};
+
+static unsigned int to_epoll(int events) {
+    unsigned int mask = 0;
+    if (events & POLL_READABLE) {
+        mask |= EPOLLIN | EPOLLRDHUP;
+    }
+    if (events & POLL_WRITABLE) {
+        mask |= EPOLLOUT;
+    }
+    return mask;
+}
+
+EventPoller::EventPoller() {
+    PollerState* s = new PollerState();
+    s->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    state = s;
+}
+
+EventPoller::~EventPoller() {
+    PollerState* s = (PollerState*)state;
+    if (s->epoll_fd >= 0) {
+        close(s->epoll_fd);
+    }
+    delete s;
+}
+
+bool EventPoller::add(int fd, int events) {
+    struct epoll_event ev;
+    ev.events = to_epoll(events);
+    ev.data.fd = fd;
+    return epoll_ctl(((PollerState*)state)->epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+bool EventPoller::modify(int fd, int events) {
+    struct epoll_event ev;
+    ev.events = to_epoll(events);
+    ev.data.fd = fd;
+    return epoll_ctl(((PollerState*)state)->epoll_fd, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+void EventPoller::remove(int fd) {
+    struct epoll_event ev;
+    epoll_ctl(((PollerState*)state)->epoll_fd, EPOLL_CTL_DEL, fd, &ev);
+}
+
+int EventPoller::wait(std::vector<PollEvent>& ready, int timeout_ms) {
+    PollerState* s = (PollerState*)state;
+    ready.clear();
+    
+    int count = epoll_wait(s->epoll_fd, s->events, MAX_EVENTS, timeout_ms);
+    if (count < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        PollEvent ev;
+        ev.fd = s->events[i].data.fd;
+        ev.events = 0;
+        if (s->events[i].events & EPOLLIN) {
+            ev.events |= POLL_READABLE;
+        }
+        if (s->events[i].events & EPOLLOUT) {
+            ev.events |= POLL_WRITABLE;
+        }
+        if (s->events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+            ev.events |= POLL_CLOSED;
+        }
+        ready.push_back(ev);
+    }
+    return count;
+}
+
+const char* EventPoller::backend() {
+    return "epoll";
+}
+
+#else
+#include <poll.h>
+
+// poll() needs the whole interest set on every call, so keep it as the
+// pollfd array itself plus an index for O(1) modify/remove
+struct PollerState {
+    std::vector<struct pollfd> fds;
+    std::map<int, size_t> index;
+};
+
+static short to_poll(int events) {
+    short mask = 0;
+    if (events & POLL_READABLE) {
+        mask |= POLLIN;
+    }
+    if (events & POLL_WRITABLE) {
+        mask |= POLLOUT;
+    }
+    return mask;
+}
+
+EventPoller::EventPoller() {
+    state = new PollerState();
+}
+
+EventPoller::~EventPoller() {
+    delete (PollerState*)state;
+}
+
+bool EventPoller::add(int fd, int events) {
+    PollerState* s = (PollerState*)state;
+    if (s->index.count(fd) != 0) {
+        return false;
+    }
+    struct pollfd entry;
+    entry.fd = fd;
+    entry.events = to_poll(events);
+    entry.revents = 0;
+    s->index[fd] = s->fds.size();
+    s->fds.push_back(entry);
+    return true;
+}
+
+bool EventPoller::modify(int fd, int events) {
+    PollerState* s = (PollerState*)state;
+    std::map<int, size_t>::iterator it = s->index.find(fd);
+    if (it == s->index.end()) {
+        return false;
+    }
+    s->fds[it->second].events = to_poll(events);
+    return true;
+}
+
+void EventPoller::remove(int fd) {
+    PollerState* s = (PollerState*)state;
+    std::map<int, size_t>::iterator it = s->index.find(fd);
+    if (it == s->index.end()) {
+        return;
+    }
+    
+    // Swap the last entry into the hole
+    size_t slot = it->second;
+    s->index.erase(it);
+    if (slot != s->fds.size() - 1) {
+        s->fds[slot] = s->fds.back();
+        s->index[s->fds[slot].fd] = slot;
+    }
+    s->fds.pop_back();
+}
+
+int EventPoller::wait(std::vector<PollEvent>& ready, int timeout_ms) {
+    PollerState* s = (PollerState*)state;
+    ready.clear();
+    
+    int count = poll(s->fds.empty() ? NULL : &s->fds[0], s->fds.size(), timeout_ms);
+    if (count < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    
+    for (size_t i = 0; i < s->fds.size() && (int)ready.size() < count; i++) {
+        short revents = s->fds[i].revents;
+        if (revents == 0) {
+            continue;
+        }
+        PollEvent ev;
+        ev.fd = s->fds[i].fd;
+        ev.events = 0;
+        if (revents & POLLIN) {
+            ev.events |= POLL_READABLE;
+        }
+        if (revents & POLLOUT) {
+            ev.events |= POLL_WRITABLE;
+        }
+        if (revents & (POLLERR | POLLHUP | POLLNVAL)) {
+            ev.events |= POLL_CLOSED;
+        }
+        ready.push_back(ev);
+    }
+    return (int)ready.size();
+}
+
+const char* EventPoller::backend() {
+    return "poll";
+}
+
+#endif
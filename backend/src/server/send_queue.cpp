@@ -0,0 +1,113 @@
+#include "send_queue.h"
+#include "types.h"
+
+SendQueue::SendQueue(size_t capacity, int policy) {
+    this->capacity = capacity < 1 ? 1 : capacity;
+    entries.resize(this->capacity * 2);
+    live = 0;
+    head = 0;
+    tail = 0;
+    this->policy = policy;
+    peak_size = 0;
+}
+
+int SendQueue::push(const SharedFrame& frame, uint64_t key) {
+    int result = PUSH_QUEUED;
+    if (key != 0 && policy == SLOW_COALESCE) {
+        std::unordered_map<uint64_t, size_t>::iterator it = latest.find(key);
+        if (it != latest.end()) {
+            Entry& old = entries[it->second % entries.size()];
+            old.frame.reset();
+            old.key = 0;
+            live--;
+            result = PUSH_COALESCED;
+        }
+    }
+    
+    if (live == capacity) {
+        if (policy == SLOW_DISCONNECT) {
+            return PUSH_OVERFLOW;
+        }
+        skip_tombstones();
+        forget_front();
+        result = PUSH_DROPPED;
+    }
+    if (tail - head == entries.size()) {
+        compact();
+    }
+    
+    Entry& entry = entries[tail % entries.size()];
+    entry.frame = frame;
+    entry.key = key;
+    if (key != 0 && policy == SLOW_COALESCE) {
+        latest[key] = tail;
+    }
+    tail++;
+    live++;
+    
+    if (live > peak_size) {
+        peak_size = live;
+    }
+    return result;
+}
+
+bool SendQueue::pop(SharedFrame& frame) {
+    skip_tombstones();
+    if (empty()) {
+        return false;
+    }
+    frame = entries[head % entries.size()].frame;
+    forget_front();
+    return true;
+}
+
+void SendQueue::clear() {
+    while (head != tail) {
+        forget_front();
+    }
+}
+
+// Drops the oldest entry, frame or tombstone
+void SendQueue::forget_front() {
+    Entry& entry = entries[head % entries.size()];
+    if (entry.key != 0 && policy == SLOW_COALESCE) {
+        std::unordered_map<uint64_t, size_t>::iterator it = latest.find(entry.key);
+        if (it != latest.end() && it->second == head) {
+            latest.erase(it);
+        }
+    }
+    if (entry.frame) {
+        live--;
+    }
+    entry.frame.reset();
+    entry.key = 0;
+    head++;
+}
+
+void SendQueue::skip_tombstones() {
+    while (head != tail && !entries[head % entries.size()].frame) {
+        head++;
+    }
+}
+
+// Slides every frame down over the tombstones before it, keeping order
+void SendQueue::compact() {
+    size_t write = head;
+    for (size_t read = head; read != tail; read++) {
+        Entry& from = entries[read % entries.size()];
+        if (!from.frame) {
+            continue;
+        }
+        if (write != read) {
+            Entry& to = entries[write % entries.size()];
+            to.frame.swap(from.frame);
+            to.key = from.key;
+            from.key = 0;
+            if (to.key != 0 && policy == SLOW_COALESCE) {
+                latest[to.key] = write;
+            }
+        }
+        write++;
+    }
+    tail = write;
+}
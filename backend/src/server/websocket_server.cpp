@@ -1,152 +1,1262 @@
 #include "websocket_server.h"
+#include "symbol_table.h"
+#include "websocket_protocol.h"
+#include "websocket_decoder.h"
+#include "event_poller.h"
+#include "send_queue.h"
+#include "json_writer.h"
+#include "binary_protocol.h"
+#include "permessage_deflate.h"
+#include <json/json.h>
 #include <iostream>
-#include <sstream>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <pthread.h>
 #include <cstring>
+#include <cctype>
 #include <algorithm>
 #include <vector>
 #include <map>
+#include <set>
+#include <unordered_map>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 
-static const char base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-
-static std::string base64_encode(const unsigned char* data, size_t length) {
-    std::string result;
-    int i = 0;
-    int j = 0;
-    unsigned char char_array_3[3];
-    unsigned char char_array_4[4];
-    
-    while (length--) {
-        char_array_3[i++] = *(data++);
-        if (i == 3) {
-            char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-            char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-            char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-            char_array_4[3] = char_array_3[2] & 0x3f;
-            
-            for (i = 0; i < 4; i++) {
-                result += base64_chars[char_array_4[i]];
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#ifndef MSG_MORE
+#define MSG_MORE 0
+#endif
+
+static const size_t READ_CHUNK = 16384;
+static const size_t MAX_REQUEST_SIZE = 8192;
+static const size_t MAX_MESSAGE_SIZE = 1 << 20;  // client messages, reassembled and inflated
+static const int POLL_TIMEOUT_MS = 1000;
+static const size_t WRITE_BATCH = 65536;  // bytes gathered into one sendmsg() at most
+static const size_t MAX_IOV = 64;         // frames gathered into one sendmsg() at most
+
+// Send queue keys: market_data coalesces per market, everything else is
+// unkeyed and never coalesced
+static const uint64_t KEY_MARKET_DATA = 1ULL << 32;
+
+// open_as reasons beyond SnapshotReason (binary_protocol.h)
+static const int NO_SNAPSHOT = 0;
+static const char* const SNAPSHOT_REASON_NAMES[] = {"", "connect", "subscribe", "request", "overflow"};
+
+enum ConnectionState {
+    CONN_HTTP,     // waiting for the request head
+    CONN_OPEN,     // upgraded; frames flow both ways
+    CONN_CLOSING   // flushing a last response or close frame, then closing
+};
+
+// What an open connection receives broadcasts as; see binary_protocol.h
+enum WireFormat {
+    WIRE_JSON,
+    WIRE_BINARY,
+    WIRE_FORMATS
+};
+
+// Broadcast message types a client can subscribe to
+enum Channel {
+    CHANNEL_MARKET_DATA,
+    CHANNEL_OPPORTUNITY,
+    CHANNELS
+};
+
+// A subscription topic is a kind and an interned ID: market_data for one
+// market or one event, or opportunities for one event
+enum TopicKind {
+    TOPIC_MARKET = 1,
+    TOPIC_EVENT_DATA = 2,
+    TOPIC_EVENT_OPPORTUNITY = 3
+};
+
+static uint64_t topic_key(int kind, SymbolId id) {
+    return ((uint64_t)kind << 32) | id;
+}
+
+static int topic_channel(uint64_t topic) {
+    return (topic >> 32) == TOPIC_EVENT_OPPORTUNITY ? CHANNEL_OPPORTUNITY : CHANNEL_MARKET_DATA;
+}
+
+// What a client has asked for. A new connection gets everything, which is
+// what the dashboard relies on; subscribe/unsubscribe messages narrow it.
+struct Subscription {
+    bool everything[CHANNELS];  // channel unfiltered
+    std::set<uint64_t> topics;  // topic keys, for filtered channels
+    double min_profit;          // opportunities below this fraction are skipped
+    
+    Subscription() {
+        for (int i = 0; i < CHANNELS; i++) {
+            everything[i] = true;
+        }
+        min_profit = 0.0;
+    }
+};
+
+struct Connection {
+    int fd;
+    int state;
+    bool upgraded;
+    bool want_write;   // POLL_WRITABLE is registered
+    std::string in;    // request head; reactor thread only
+    WebSocketDecoder decoder;  // frames once upgraded; likewise
+    
+    // Guarded by the shard lock. Broadcasts go through the bounded queue;
+    // handshake responses and control frames go in `control`, which is
+    // never dropped and jumps ahead of queued broadcasts at the next batch
+    // boundary. `inflight` is the batch currently being written, straight
+    // from the shared frames.
+    SendQueue queue;
+    std::string control;
+    std::vector<SharedFrame> inflight;
+    size_t inflight_head;    // first frame not completely written
+    size_t inflight_offset;  // bytes of that frame already written
+    bool queued;       // on the shard's flush list
+    bool evict;        // queue overflowed under SLOW_DISCONNECT
+    bool resync;       // lost a message; skipped until the reactor sends a snapshot
+    std::string snapshot;  // framed snapshot, sent after `control` and before the queue
+    int format;        // WireFormat; set by the reactor under the shard lock
+    Subscription subscription;  // likewise
+    uint64_t stamp;    // last broadcast delivered, to skip duplicate topic matches
+    bool deflate;      // permessage-deflate agreed in the handshake
+    bool takeover;     // ...and we may keep our compression context
+    bool in_group;     // takes the shard's shared-context frames; see join_open
+    
+    Connection(int fd, size_t queue_limit, int policy)
+        : decoder(true, MAX_MESSAGE_SIZE), queue(queue_limit, policy) {
+        this->fd = fd;
+        state = CONN_HTTP;
+        upgraded = false;
+        want_write = false;
+        inflight_head = 0;
+        inflight_offset = 0;
+        queued = false;
+        evict = false;
+        resync = false;
+        format = WIRE_JSON;
+        stamp = 0;
+        deflate = false;
+        takeover = false;
+        in_group = false;
+    }
+};
+
+struct ServerState;
+
+// One reactor thread and the connections it owns. Only the reactor reads,
+// parses, registers interest or closes; other threads touch a connection
+// only through its send queue and control buffer, under the lock, and then
+// poke the wake pipe.
+struct Shard {
+    ServerState* owner;
+    int listen_fd;
+    int wake_fds[2];
+    EventPoller poller;
+    pthread_t thread;
+    bool thread_started;
+    std::map<int, Connection*> connections;
+    WebSocketMessage message;  // reactor scratch, reused message to message
+    MessageInflater inflater;  // client messages; they never take over context
+    std::string inflated;
+    
+    pthread_mutex_t lock;
+    std::vector<Connection*> open;        // upgraded, receiving broadcasts
+    
+    // Subscriber index over `open`: who takes a channel unfiltered, and who
+    // asked for each topic. A broadcast visits only these lists.
+    std::vector<Connection*> everything[CHANNELS];
+    std::unordered_map<uint64_t, std::vector<Connection*> > topics;
+    uint64_t stamp;
+    std::vector<Connection*> flush_list;  // have output queued since the last wake
+    bool wake_pending;
+    ServerStats counters;                 // the cumulative fields only
+    
+    // Compression, when enabled. `deflater` makes standalone messages any
+    // deflate client can take; `group_deflater` keeps one context across
+    // messages for the connections flagged in_group, and starts over from an
+    // empty window whenever one joins.
+    MessageDeflater* deflater;
+    MessageDeflater* group_deflater;
+    size_t group_members;
+    bool group_reset;
+    std::string compressed;
+    
+    Shard(ServerState* owner) {
+        this->owner = owner;
+        listen_fd = -1;
+        wake_fds[0] = -1;
+        wake_fds[1] = -1;
+        thread_started = false;
+        wake_pending = false;
+        stamp = 0;
+        deflater = NULL;
+        group_deflater = NULL;
+        group_members = 0;
+        group_reset = true;
+        pthread_mutex_init(&lock, NULL);
+    }
+    
+    ~Shard() {
+        delete deflater;
+        delete group_deflater;
+        pthread_mutex_destroy(&lock);
+    }
+};
+
+// The latest market_data of a market, as broadcast
+struct CachedQuote {
+    MarketData data;  // without its book
+    uint64_t seq;     // 0: nothing cached
+    
+    CachedQuote() {
+        seq = 0;
+    }
+};
+
+struct CachedOpportunity {
+    ArbitrageOpportunity opp;
+    uint64_t seq;
+    long long time_ms;  // when it was last broadcast
+};
+
+struct ServerState {
+    WebSocketServer* server;
+    size_t queue_limit;
+    int slow_policy;
+    std::vector<Shard*> shards;
+    std::function<void(int)> on_connect;
+    std::function<void(int)> on_disconnect;
+    
+    // Binary clients, and what the symbol dictionary has told them so far.
+    // dictionary_lock orders announcements against clients joining; take
+    // it before any shard lock, never while holding one.
+    std::atomic<int> binary_clients;
+    pthread_mutex_t dictionary_lock;
+    std::atomic<uint32_t> markets_announced;
+    std::atomic<uint32_t> events_announced;
+    std::atomic<long long> last_full_dictionary_ms;
+    long long dictionary_interval_ms;
+    
+    bool deflate;             // offer permessage-deflate
+    bool deflate_takeover;    // ...with server context takeover
+    size_t deflate_min_size;
+    
+    // What snapshots are built from. sequence_lock covers numbering a
+    // broadcast, caching it and queueing it, so queues are in sequence
+    // order and a snapshot taken under the lock is exactly the stream up
+    // to `sequence`. Take it after dictionary_lock and before any shard
+    // lock.
+    pthread_mutex_t sequence_lock;
+    uint64_t sequence;                   // last number handed out
+    std::vector<CachedQuote> quotes;     // by market ID, grown on demand
+    std::vector<SymbolId> quoted;        // IDs with a cached quote, first seen first
+    std::map<uint64_t, CachedOpportunity> opportunities;  // by event and venue pair
+    size_t max_markets;
+    long long opportunity_ttl_ms;
+    
+    ServerState() : binary_clients(0), markets_announced(0), events_announced(0), last_full_dictionary_ms(0) {
+        server = NULL;
+        queue_limit = 0;
+        slow_policy = SLOW_COALESCE;
+        dictionary_interval_ms = 0;
+        deflate = false;
+        deflate_takeover = false;
+        deflate_min_size = 0;
+        sequence = 0;
+        max_markets = 0;
+        opportunity_ttl_ms = 0;
+        pthread_mutex_init(&dictionary_lock, NULL);
+        pthread_mutex_init(&sequence_lock, NULL);
+    }
+    
+    ~ServerState() {
+        pthread_mutex_destroy(&dictionary_lock);
+        pthread_mutex_destroy(&sequence_lock);
+    }
+};
+
+static long long monotonic_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static int open_listener(int port, bool reuse_port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        std::cerr << "Failed to create socket" << std::endl;
+        return -1;
+    }
+    
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+#ifdef SO_REUSEPORT
+    if (reuse_port) {
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+    }
+#endif
+    
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(port);
+    
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        std::cerr << "Failed to bind to port " << port << std::endl;
+        close(fd);
+        return -1;
+    }
+    
+    if (listen(fd, SOMAXCONN) < 0 || !set_nonblocking(fd)) {
+        std::cerr << "Failed to listen" << std::endl;
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool equals_ignore_case(const std::string& a, const char* b) {
+    size_t n = strlen(b);
+    if (a.size() != n) {
+        return false;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Value of a request header, matched case-insensitively, with surrounding
+// whitespace trimmed; empty if absent
+static std::string header_value(const std::string& request, const char* name) {
+    size_t name_len = strlen(name);
+    size_t line = request.find("\r\n");
+    while (line != std::string::npos && line + 2 < request.size()) {
+        size_t start = line + 2;
+        size_t end = request.find("\r\n", start);
+        if (end == std::string::npos) {
+            end = request.size();
+        }
+        
+        size_t colon = request.find(':', start);
+        if (colon != std::string::npos && colon < end && colon - start == name_len &&
+            equals_ignore_case(request.substr(start, name_len), name)) {
+            size_t value_start = colon + 1;
+            while (value_start < end && (request[value_start] == ' ' || request[value_start] == '\t')) {
+                value_start++;
             }
-            i = 0;
+            size_t value_end = end;
+            while (value_end > value_start && (request[value_end - 1] == ' ' || request[value_end - 1] == '\t')) {
+                value_end--;
+            }
+            return request.substr(value_start, value_end - value_start);
+        }
+        line = end;
+    }
+    return "";
+}
+
+static void append_frame(std::string& out, int opcode, const char* payload, size_t length) {
+    unsigned char header[WS_MAX_HEADER];
+    size_t header_len = websocket_frame_header(header, opcode, length);
+    out.append((const char*)header, header_len);
+    out.append(payload, length);
+}
+
+// A broadcast frame, built once and shared by every queue it goes on
+static SharedFrame make_frame(int opcode, const char* payload, size_t length) {
+    std::shared_ptr<std::string> framed = std::make_shared<std::string>();
+    framed->reserve(length + WS_MAX_HEADER);
+    append_frame(*framed, opcode, payload, length);
+    return framed;
+}
+
+// Moves control bytes, a snapshot and then queued frames into the
+// in-flight batch
+static void refill_batch(Connection* conn) {
+    conn->inflight.clear();
+    conn->inflight_head = 0;
+    conn->inflight_offset = 0;
+    
+    size_t bytes = 0;
+    std::string* unqueued[2] = {&conn->control, &conn->snapshot};
+    for (int i = 0; i < 2; i++) {
+        if (!unqueued[i]->empty()) {
+            std::shared_ptr<std::string> data = std::make_shared<std::string>();
+            data->swap(*unqueued[i]);
+            bytes += data->size();
+            conn->inflight.push_back(data);
         }
     }
     
-    if (i) {
-        for (j = i; j < 3; j++) {
-            char_array_3[j] = '\0';
+    SharedFrame frame;
+    while (conn->inflight.size() < MAX_IOV && bytes < WRITE_BATCH && conn->queue.pop(frame)) {
+        bytes += frame->size();
+        conn->inflight.push_back(SharedFrame());
+        conn->inflight.back().swap(frame);
+    }
+}
+
+// Advances the in-flight batch past `sent` written bytes
+static void consume_batch(Connection* conn, size_t sent) {
+    while (sent > 0) {
+        size_t left = conn->inflight[conn->inflight_head]->size() - conn->inflight_offset;
+        if (sent < left) {
+            conn->inflight_offset += sent;
+            return;
+        }
+        sent -= left;
+        conn->inflight[conn->inflight_head].reset();
+        conn->inflight_head++;
+        conn->inflight_offset = 0;
+    }
+}
+
+// Writes as much queued output as the socket takes, gathering up to
+// MAX_IOV frames per sendmsg() without copying them. MSG_MORE is set while
+// the queue still holds more behind the batch so a backlog leaves in full
+// segments; the last batch goes without it and is pushed out at once.
+// Caller holds the shard lock and is the reactor thread. Returns false once
+// the connection should be closed: a send error, or a closing connection
+// fully flushed.
+static bool flush_locked(Shard* shard, Connection* conn) {
+    struct iovec iov[MAX_IOV];
+    
+    while (true) {
+        if (conn->inflight_head == conn->inflight.size()) {
+            refill_batch(conn);
+            if (conn->inflight.empty()) {
+                break;
+            }
         }
         
-        char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-        char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-        char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-        char_array_4[3] = char_array_3[2] & 0x3f;
+        size_t count = 0;
+        for (size_t i = conn->inflight_head; i < conn->inflight.size(); i++) {
+            size_t skip = i == conn->inflight_head ? conn->inflight_offset : 0;
+            iov[count].iov_base = (void*)(conn->inflight[i]->data() + skip);
+            iov[count].iov_len = conn->inflight[i]->size() - skip;
+            count++;
+        }
         
-        for (j = 0; j < i + 1; j++) {
-            result += base64_chars[char_array_4[j]];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        int flags = MSG_NOSIGNAL;
+        if (!conn->queue.empty() || !conn->control.empty() || !conn->snapshot.empty()) {
+            flags |= MSG_MORE;
         }
         
-        while (i++ < 3) {
-            result += '=';
+        ssize_t sent = sendmsg(conn->fd, &msg, flags);
+        if (sent > 0) {
+            shard->counters.write_calls++;
+            shard->counters.bytes_sent += sent;
+            consume_batch(conn, sent);
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) {
+            continue;
         }
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!conn->want_write) {
+                shard->poller.modify(conn->fd, POLL_READABLE | POLL_WRITABLE);
+                conn->want_write = true;
+            }
+            return true;
+        }
+        return false;
     }
     
-    return result;
+    if (conn->want_write) {
+        shard->poller.modify(conn->fd, POLL_READABLE);
+        conn->want_write = false;
+    }
+    return conn->state != CONN_CLOSING;
+}
+
+// Queues data ahead of any pending broadcasts and tries to send it now
+static bool send_now(Shard* shard, Connection* conn, const std::string& data) {
+    pthread_mutex_lock(&shard->lock);
+    conn->control.append(data);
+    bool alive = flush_locked(shard, conn);
+    pthread_mutex_unlock(&shard->lock);
+    return alive;
+}
+
+static void remove_from(std::vector<Connection*>& list, Connection* conn) {
+    list.erase(std::remove(list.begin(), list.end(), conn), list.end());
+}
+
+// A connection can share the shard's compression context only if it takes
+// every JSON message the shard compresses: both channels unfiltered, no
+// profit floor. Anyone else gets standalone frames.
+static bool group_eligible(const Connection* conn) {
+    return conn->deflate && conn->takeover && conn->format == WIRE_JSON &&
+           conn->subscription.everything[CHANNEL_MARKET_DATA] &&
+           conn->subscription.everything[CHANNEL_OPPORTUNITY] && conn->subscription.min_profit == 0.0;
 }
 
-static void sha1(const unsigned char* data, size_t length, unsigned char* hash) {
-    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+// Adds an upgraded connection to the broadcast list and the subscriber
+// index. A connection joining the shared compression context restarts it,
+// since it has none of the history. Caller holds the shard lock.
+static void join_open(Shard* shard, Connection* conn) {
+    shard->open.push_back(conn);
+    for (int channel = 0; channel < CHANNELS; channel++) {
+        if (conn->subscription.everything[channel]) {
+            shard->everything[channel].push_back(conn);
+        }
+    }
+    std::set<uint64_t>::const_iterator it;
+    for (it = conn->subscription.topics.begin(); it != conn->subscription.topics.end(); ++it) {
+        shard->topics[*it].push_back(conn);
+    }
+    if (conn->format == WIRE_BINARY) {
+        shard->owner->binary_clients++;
+    }
+    if (shard->group_deflater != NULL && group_eligible(conn)) {
+        conn->in_group = true;
+        shard->group_members++;
+        shard->group_reset = true;
+    }
+}
+
+// Caller holds the shard lock; no-op if the connection isn't open
+static void leave_open(Shard* shard, Connection* conn) {
+    std::vector<Connection*>::iterator found = std::find(shard->open.begin(), shard->open.end(), conn);
+    if (found == shard->open.end()) {
+        return;
+    }
+    shard->open.erase(found);
+    for (int channel = 0; channel < CHANNELS; channel++) {
+        if (conn->subscription.everything[channel]) {
+            remove_from(shard->everything[channel], conn);
+        }
+    }
+    std::set<uint64_t>::const_iterator it;
+    for (it = conn->subscription.topics.begin(); it != conn->subscription.topics.end(); ++it) {
+        std::unordered_map<uint64_t, std::vector<Connection*> >::iterator topic = shard->topics.find(*it);
+        if (topic != shard->topics.end()) {
+            remove_from(topic->second, conn);
+            if (topic->second.empty()) {
+                shard->topics.erase(topic);
+            }
+        }
+    }
+    if (conn->format == WIRE_BINARY) {
+        shard->owner->binary_clients--;
+    }
+    if (conn->in_group) {
+        conn->in_group = false;
+        shard->group_members--;
+    }
+}
+
+// Sends a close frame, drops pending broadcasts and closes the connection
+// once the frame is out
+static bool start_close(Shard* shard, Connection* conn, int code) {
+    unsigned char payload[2];
+    payload[0] = (unsigned char)((code >> 8) & 0xFF);
+    payload[1] = (unsigned char)(code & 0xFF);
+    std::string frame;
+    append_frame(frame, WS_CLOSE, (const char*)payload, 2);
+    
+    pthread_mutex_lock(&shard->lock);
+    leave_open(shard, conn);
+    conn->state = CONN_CLOSING;
+    conn->queue.clear();
+    conn->snapshot.clear();
+    conn->control.append(frame);
+    bool alive = flush_locked(shard, conn);
+    pthread_mutex_unlock(&shard->lock);
+    return alive;
+}
+
+static void close_connection(Shard* shard, Connection* conn) {
+    pthread_mutex_lock(&shard->lock);
+    leave_open(shard, conn);
+    if (conn->queued) {
+        remove_from(shard->flush_list, conn);
+    }
+    pthread_mutex_unlock(&shard->lock);
+    
+    shard->poller.remove(conn->fd);
+    shard->connections.erase(conn->fd);
+    if (conn->upgraded && shard->owner->on_disconnect) {
+        shard->owner->on_disconnect(conn->fd);
+    }
+    close(conn->fd);
+    delete conn;
+}
+
+static bool wants_market(const Subscription& subscription, const MarketData& data) {
+    return subscription.everything[CHANNEL_MARKET_DATA] ||
+           subscription.topics.count(topic_key(TOPIC_MARKET, data.market_id)) > 0 ||
+           subscription.topics.count(topic_key(TOPIC_EVENT_DATA, data.event_id)) > 0;
+}
+
+static bool wants_opportunity(const Subscription& subscription, const ArbitrageOpportunity& opp) {
+    if (opp.profit_percentage < subscription.min_profit) {
+        return false;
+    }
+    return subscription.everything[CHANNEL_OPPORTUNITY] ||
+           subscription.topics.count(topic_key(TOPIC_EVENT_OPPORTUNITY, opp.event_id)) > 0;
+}
+
+static void append_marker(std::string& out, int format, int phase, int reason, size_t markets,
+                          size_t opportunities, uint64_t seq) {
+    if (format == WIRE_BINARY) {
+        unsigned char marker[SNAPSHOT_MARKER_SIZE];
+        encode_snapshot_marker(phase, reason, (uint32_t)(markets + opportunities), seq, marker);
+        append_frame(out, WS_BINARY, (const char*)marker, sizeof(marker));
+        return;
+    }
     
-    size_t orig_len = length;
-    size_t new_len = ((length + 9) / 64) * 64 + 64;
-    unsigned char* msg = new unsigned char[new_len];
-    memcpy(msg, data, length);
-    msg[length] = 0x80;
-    memset(msg + length + 1, 0, new_len - length - 1);
+    JsonWriter json;
+    json.begin_object();
+    json.key("type");
+    json.string(phase == SNAPSHOT_BEGIN ? "snapshot_begin" : "snapshot_end");
+    json.key("seq");
+    json.integer((long long)seq);
+    if (phase == SNAPSHOT_BEGIN) {
+        json.key("reason");
+        json.string(SNAPSHOT_REASON_NAMES[reason]);
+    } else {
+        json.key("markets");
+        json.integer((long long)markets);
+        json.key("opportunities");
+        json.integer((long long)opportunities);
+    }
+    json.end_object();
+    append_frame(out, WS_TEXT, json.data(), json.size());
+}
+
+// Appends the framed snapshot for a client taking this format and
+// subscription: every cached message it would have been sent, each with
+// its own sequence number, between the markers. Opportunities past their
+// time to live are dropped from the cache on the way. Caller holds the
+// sequence lock.
+static void build_snapshot(ServerState* ss, int format, const Subscription& subscription, int reason,
+                           std::string& out) {
+    append_marker(out, format, SNAPSHOT_BEGIN, reason, 0, 0, ss->sequence);
     
-    uint64_t bit_len = orig_len * 8;
-    for (int i = 0; i < 8; i++) {
-        msg[new_len - 8 + i] = (bit_len >> (56 - i * 8)) & 0xFF;
+    JsonWriter json;
+    unsigned char record[BINARY_RECORD_SIZE];
+    size_t markets = 0;
+    for (size_t i = 0; i < ss->quoted.size(); i++) {
+        const CachedQuote& quote = ss->quotes[ss->quoted[i]];
+        if (!wants_market(subscription, quote.data)) {
+            continue;
+        }
+        if (format == WIRE_BINARY) {
+            encode_market_data(quote.data, record);
+            append_frame(out, WS_BINARY, (const char*)record, sizeof(record));
+        } else {
+            json.clear();
+            write_market_data_json(json, &quote.data, quote.seq);
+            append_frame(out, WS_TEXT, json.data(), json.size());
+        }
+        markets++;
     }
     
-    for (size_t chunk = 0; chunk < new_len; chunk += 64) {
-        uint32_t w[80];
-        for (int i = 0; i < 16; i++) {
-            w[i] = (msg[chunk + i * 4] << 24) | (msg[chunk + i * 4 + 1] << 16) |
-                   (msg[chunk + i * 4 + 2] << 8) | msg[chunk + i * 4 + 3];
+    long long expired = monotonic_ms() - ss->opportunity_ttl_ms;
+    size_t opportunities = 0;
+    std::map<uint64_t, CachedOpportunity>::iterator it = ss->opportunities.begin();
+    while (it != ss->opportunities.end()) {
+        const CachedOpportunity& cached = it->second;
+        if (cached.time_ms < expired) {
+            ss->opportunities.erase(it++);
+            continue;
         }
-        for (int i = 16; i < 80; i++) {
-            w[i] = ((w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16]) << 1) |
-                   ((w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16]) >> 31);
+        if (wants_opportunity(subscription, cached.opp)) {
+            if (format == WIRE_BINARY) {
+                encode_opportunity(cached.opp, record);
+                append_frame(out, WS_BINARY, (const char*)record, sizeof(record));
+            } else {
+                json.clear();
+                write_opportunity_json(json, &cached.opp, cached.seq);
+                append_frame(out, WS_TEXT, json.data(), json.size());
+            }
+            opportunities++;
         }
+        ++it;
+    }
+    
+    append_marker(out, format, SNAPSHOT_END, reason, markets, opportunities, ss->sequence);
+}
+
+// (Re)joins the broadcast list with the given wire format and subscription,
+// with `preamble` sent ahead of anything queued. Given a SnapshotReason,
+// the client's backlog is replaced by a snapshot for the new subscription;
+// it is built under the sequence lock, so the live messages queued after
+// it carry on exactly where it ends. A binary client gets the whole symbol
+// dictionary first when it moves to binary or is sent a snapshot; it is
+// built under the dictionary lock, so every later delta reaches the client
+// too.
+static bool open_as(Shard* shard, Connection* conn, int format, const Subscription& subscription,
+                    const std::string& preamble, int snapshot_reason) {
+    ServerState* ss = shard->owner;
+    bool snapshot = snapshot_reason != NO_SNAPSHOT;
+    bool to_binary = format == WIRE_BINARY &&
+                     (conn->format != WIRE_BINARY || conn->state == CONN_HTTP || snapshot);
+    if (to_binary) {
+        pthread_mutex_lock(&ss->dictionary_lock);
+    }
+    if (snapshot) {
+        pthread_mutex_lock(&ss->sequence_lock);
+    }
+    
+    // Read after the sequence lock is taken, so the dictionary names every
+    // ID a cached message uses
+    std::string dictionary;
+    if (to_binary) {
+        SymbolId markets = (SymbolId)market_symbols().size();
+        SymbolId events = (SymbolId)event_symbols().size();
+        std::string message;
+        encode_symbols(message, true, 0, markets, 0, events);
+        append_frame(dictionary, WS_BINARY, message.data(), message.size());
         
-        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        // The first binary client needs no deltas for what it was just sent
+        if (ss->binary_clients.load() == 0) {
+            ss->markets_announced.store(markets, std::memory_order_release);
+            ss->events_announced.store(events, std::memory_order_release);
+        }
+    }
+    std::string framed;
+    if (snapshot) {
+        build_snapshot(ss, format, subscription, snapshot_reason, framed);
+    }
+    
+    pthread_mutex_lock(&shard->lock);
+    leave_open(shard, conn);
+    conn->state = CONN_OPEN;
+    conn->upgraded = true;
+    conn->format = format;
+    conn->subscription = subscription;
+    conn->control.append(preamble);
+    conn->control.append(dictionary);
+    if (snapshot) {
+        // Whatever is queued is older than the snapshot, and so is an
+        // earlier snapshot not yet being written
+        conn->queue.clear();
+        conn->snapshot.swap(framed);
+        conn->resync = false;
+        shard->counters.snapshots_sent++;
+    }
+    join_open(shard, conn);
+    bool alive = flush_locked(shard, conn);
+    pthread_mutex_unlock(&shard->lock);
+    
+    if (snapshot) {
+        pthread_mutex_unlock(&ss->sequence_lock);
+    }
+    if (to_binary) {
+        pthread_mutex_unlock(&ss->dictionary_lock);
+    }
+    return alive;
+}
+
+// Resolves the names (or numeric IDs) in a subscribe list to topics of the
+// given kind; names not interned yet are reported back to the client
+static void add_topics(const Json::Value& list, SymbolTable& table, int kind, std::vector<uint64_t>& topics,
+                       std::vector<std::string>& unknown) {
+    for (Json::Value::ArrayIndex i = 0; i < list.size(); i++) {
+        const Json::Value& item = list[i];
+        SymbolId id = INVALID_SYMBOL;
+        if (item.isString()) {
+            id = table.find(item.asString());
+            if (id == INVALID_SYMBOL) {
+                unknown.push_back(item.asString());
+            }
+        } else if (item.isUInt() && item.asUInt() < table.size()) {
+            id = item.asUInt();
+        }
+        if (id != INVALID_SYMBOL) {
+            topics.push_back(topic_key(kind, id));
+        }
+    }
+}
+
+// Subscription changes, all fields optional:
+//
+//   {"type":"subscribe"|"unsubscribe",
+//    "channels":["market_data","opportunity"],  default: both
+//    "events":[...], "markets":[...],           names or interned IDs
+//    "min_profit_percentage":2.5,               subscribe only
+//    "format":"json"|"binary"}                  subscribe only
+//
+// Subscribing with events or markets narrows the listed channels to those
+// topics, adding to any already chosen; with only channels it reopens them
+// unfiltered, and with neither (say, just a format) it leaves them as they
+// are. Unsubscribing removes the listed topics, or without any turns the
+// channels off. markets apply to market_data only. Answered
+// with {"type":"subscribed"|"unsubscribed","format":...}, plus "unknown"
+// listing names that matched nothing.
+static bool handle_subscribe(Shard* shard, Connection* conn, const Json::Value& message, bool subscribe) {
+    bool channels[CHANNELS] = {true, true};
+    const Json::Value& channel_list = message["channels"];
+    if (channel_list.isArray()) {
+        channels[CHANNEL_MARKET_DATA] = false;
+        channels[CHANNEL_OPPORTUNITY] = false;
+        for (Json::Value::ArrayIndex i = 0; i < channel_list.size(); i++) {
+            if (channel_list[i] == Json::Value("market_data")) {
+                channels[CHANNEL_MARKET_DATA] = true;
+            } else if (channel_list[i] == Json::Value("opportunity")) {
+                channels[CHANNEL_OPPORTUNITY] = true;
+            }
+        }
+    }
+    
+    const Json::Value& events = message["events"];
+    const Json::Value& markets = message["markets"];
+    bool filtered = events.isArray() || markets.isArray();
+    std::vector<uint64_t> topics;
+    std::vector<std::string> unknown;
+    if (events.isArray()) {
+        if (channels[CHANNEL_MARKET_DATA]) {
+            add_topics(events, event_symbols(), TOPIC_EVENT_DATA, topics, unknown);
+        }
+        if (channels[CHANNEL_OPPORTUNITY]) {
+            add_topics(events, event_symbols(), TOPIC_EVENT_OPPORTUNITY, topics, unknown);
+        }
+    }
+    if (markets.isArray() && channels[CHANNEL_MARKET_DATA]) {
+        add_topics(markets, market_symbols(), TOPIC_MARKET, topics, unknown);
+    }
+    
+    // Only the reactor writes the subscription, so it can be read unlocked.
+    // A subscribe that names no channels or topics leaves them alone.
+    Subscription next = conn->subscription;
+    bool touches = !subscribe || filtered || channel_list.isArray();
+    for (int channel = 0; channel < CHANNELS && touches; channel++) {
+        if (!channels[channel]) {
+            continue;
+        }
+        if (subscribe && filtered && !next.everything[channel]) {
+            continue;  // adding to the topics already chosen
+        }
+        if (!subscribe && filtered) {
+            continue;  // removing topics; an unfiltered channel has none
+        }
         
-        for (int i = 0; i < 80; i++) {
-            uint32_t f, k;
-            if (i < 20) {
-                f = (b & c) | ((~b) & d);
-                k = 0x5A827999;
-            } else if (i < 40) {
-                f = b ^ c ^ d;
-                k = 0x6ED9EBA1;
-            } else if (i < 60) {
-                f = (b & c) | (b & d) | (c & d);
-                k = 0x8F1BBCDC;
+        std::set<uint64_t>::iterator it = next.topics.begin();
+        while (it != next.topics.end()) {
+            if (topic_channel(*it) == channel) {
+                next.topics.erase(it++);
             } else {
-                f = b ^ c ^ d;
-                k = 0xCA62C1D6;
+                ++it;
             }
-            
-            uint32_t temp = ((a << 5) | (a >> 27)) + f + e + k + w[i];
-            e = d;
-            d = c;
-            c = ((b << 30) | (b >> 2));
-            b = a;
-            a = temp;
+        }
+        next.everything[channel] = subscribe && !filtered;
+    }
+    for (size_t i = 0; i < topics.size(); i++) {
+        if (subscribe) {
+            next.topics.insert(topics[i]);
+        } else {
+            next.topics.erase(topics[i]);
+        }
+    }
+    
+    int format = conn->format;
+    if (subscribe) {
+        if (message["min_profit_percentage"].isNumeric()) {
+            next.min_profit = message["min_profit_percentage"].asDouble() / 100.0;
+        }
+        if (message["format"] == Json::Value("binary")) {
+            format = WIRE_BINARY;
+        } else if (message["format"] == Json::Value("json")) {
+            format = WIRE_JSON;
+        }
+    }
+    
+    JsonWriter ack;
+    ack.begin_object();
+    ack.key("type");
+    ack.string(subscribe ? "subscribed" : "unsubscribed");
+    ack.key("format");
+    ack.string(format == WIRE_BINARY ? "binary" : "json");
+    if (!unknown.empty()) {
+        ack.key("unknown");
+        ack.begin_array();
+        for (size_t i = 0; i < unknown.size(); i++) {
+            ack.string(unknown[i]);
+        }
+        ack.end_array();
+    }
+    ack.end_object();
+    
+    std::string frame;
+    append_frame(frame, WS_TEXT, ack.data(), ack.size());
+    return open_as(shard, conn, format, next, frame, subscribe ? SNAPSHOT_SUBSCRIBE : NO_SNAPSHOT);
+}
+
+// Subscription changes (above); {"type":"resync"}, answered with a fresh
+// snapshot; and an application-level keep-alive, {"type":"ping",
+// "timestamp":N}, answered with {"type":"pong","timestamp":N}
+static bool handle_text(Shard* shard, Connection* conn, const std::string& payload) {
+    Json::Value message;
+    Json::Reader reader;
+    if (!reader.parse(payload, message) || !message.isObject()) {
+        return true;
+    }
+    
+    const Json::Value& type = message["type"];
+    if (type == Json::Value("subscribe")) {
+        return handle_subscribe(shard, conn, message, true);
+    }
+    if (type == Json::Value("unsubscribe")) {
+        return handle_subscribe(shard, conn, message, false);
+    }
+    if (type == Json::Value("resync")) {
+        // A snapshot still waiting to go out already answers it
+        if (!conn->snapshot.empty()) {
+            return true;
+        }
+        Subscription subscription = conn->subscription;
+        return open_as(shard, conn, conn->format, subscription, "", SNAPSHOT_REQUEST);
+    }
+    if (type != Json::Value("ping")) {
+        return true;
+    }
+    
+    JsonWriter pong;
+    pong.begin_object();
+    pong.key("type");
+    pong.string("pong");
+    const Json::Value& timestamp = message["timestamp"];
+    if (timestamp.isIntegral()) {
+        pong.key("timestamp");
+        pong.integer((long long)timestamp.asInt64());
+    } else if (timestamp.isNumeric()) {
+        pong.key("timestamp");
+        pong.number(timestamp.asDouble());
+    } else if (timestamp.isString()) {
+        pong.key("timestamp");
+        pong.string(timestamp.asString());
+    }
+    pong.end_object();
+    
+    std::string frame;
+    append_frame(frame, WS_TEXT, pong.data(), pong.size());
+    return send_now(shard, conn, frame);
+}
+
+static bool handle_message(Shard* shard, Connection* conn, const WebSocketMessage& message) {
+    switch (message.opcode) {
+        case WS_TEXT:
+            return handle_text(shard, conn, message.payload);
+        case WS_PING: {
+            std::string frame;
+            append_frame(frame, WS_PONG, message.payload.data(), message.payload.size());
+            return send_now(shard, conn, frame);
+        }
+        case WS_CLOSE: {
+            // Echo the peer's status code, then close once it's sent. A
+            // one-byte body or a code no peer may send is itself an error.
+            int code = WS_CLOSE_NORMAL;
+            if (message.payload.size() >= 2) {
+                code = ((unsigned char)message.payload[0] << 8) | (unsigned char)message.payload[1];
+            }
+            if (message.payload.size() == 1 || (message.payload.size() >= 2 && !websocket_valid_close_code(code))) {
+                code = WS_CLOSE_PROTOCOL_ERROR;
+            }
+            return start_close(shard, conn, code);
+        }
+        default:
+            // Pongs and binary messages carry nothing we act on
+            return true;
+    }
+}
+
+// Handles every complete message the decoder has; a partial frame stays
+// buffered in it until the rest arrives
+static bool handle_frames(Shard* shard, Connection* conn) {
+    WebSocketMessage& message = shard->message;
+    while (conn->state == CONN_OPEN) {
+        int result = conn->decoder.next(message);
+        if (result == DECODE_MORE) {
+            return true;
+        }
+        if (result == DECODE_ERROR) {
+            return start_close(shard, conn, conn->decoder.error_code());
         }
         
-        h[0] += a;
-        h[1] += b;
-        h[2] += c;
-        h[3] += d;
-        h[4] += e;
+        if (message.compressed) {
+            if (!shard->inflater.decompress(message.payload.data(), message.payload.size(), shard->inflated,
+                                            MAX_MESSAGE_SIZE)) {
+                bool too_big = shard->inflated.size() > MAX_MESSAGE_SIZE;
+                return start_close(shard, conn, too_big ? WS_CLOSE_TOO_BIG : WS_CLOSE_PROTOCOL_ERROR);
+            }
+            message.payload.swap(shard->inflated);
+        }
+        if (!handle_message(shard, conn, message)) {
+            return false;
+        }
     }
+    return true;
+}
+
+// Picks the subprotocol to confirm from a Sec-WebSocket-Protocol offer,
+// preferring binary; NULL if the client offered neither of ours
+static const char* select_subprotocol(const std::string& offered) {
+    bool json = false;
+    size_t start = 0;
+    while (start < offered.size()) {
+        size_t end = offered.find(',', start);
+        if (end == std::string::npos) {
+            end = offered.size();
+        }
+        size_t first = offered.find_first_not_of(" \t", start);
+        size_t last = offered.find_last_not_of(" \t", end - 1);
+        if (first < end && last != std::string::npos && last >= first) {
+            std::string token = offered.substr(first, last - first + 1);
+            if (token == BINARY_SUBPROTOCOL) {
+                return BINARY_SUBPROTOCOL;
+            }
+            json = json || token == JSON_SUBPROTOCOL;
+        }
+        start = end + 1;
+    }
+    return json ? JSON_SUBPROTOCOL : NULL;
+}
+
+static bool handle_request(Shard* shard, Connection* conn) {
+    size_t end = conn->in.find("\r\n\r\n");
+    if (end == std::string::npos) {
+        return conn->in.size() <= MAX_REQUEST_SIZE;
+    }
+    
+    std::string request = conn->in.substr(0, end + 4);
+    conn->in.erase(0, end + 4);
     
-    for (int i = 0; i < 5; i++) {
-        hash[i * 4] = (h[i] >> 24) & 0xFF;
-        hash[i * 4 + 1] = (h[i] >> 16) & 0xFF;
-        hash[i * 4 + 2] = (h[i] >> 8) & 0xFF;
-        hash[i * 4 + 3] = h[i] & 0xFF;
+    if (!equals_ignore_case(header_value(request, "Upgrade"), "websocket")) {
+        std::string response = "HTTP/1.1 200 OK\r\n"
+                               "Content-Type: application/json\r\n"
+                               "Access-Control-Allow-Origin: *\r\n"
+                               "Content-Length: 15\r\n"
+                               "Connection: close\r\n"
+                               "\r\n"
+                               "{\"status\":\"ok\"}";
+        conn->state = CONN_CLOSING;
+        return send_now(shard, conn, response);
+    }
+    
+    std::string key = header_value(request, "Sec-WebSocket-Key");
+    if (key.empty()) {
+        conn->state = CONN_CLOSING;
+        return send_now(shard, conn, "HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n");
+    }
+    
+    std::string response = "HTTP/1.1 101 Switching Protocols\r\n"
+                           "Upgrade: websocket\r\n"
+                           "Connection: Upgrade\r\n"
+                           "Sec-WebSocket-Accept: " + websocket_accept_key(key) + "\r\n";
+    const char* protocol = select_subprotocol(header_value(request, "Sec-WebSocket-Protocol"));
+    if (protocol != NULL) {
+        response += "Sec-WebSocket-Protocol: " + std::string(protocol) + "\r\n";
     }
+    std::string extension;
+    ServerState* ss = shard->owner;
+    if (ss->deflate && negotiate_permessage_deflate(header_value(request, "Sec-WebSocket-Extensions"),
+                                                    ss->deflate_takeover, extension, conn->takeover)) {
+        response += "Sec-WebSocket-Extensions: " + extension + "\r\n";
+        conn->deflate = true;
+        conn->decoder.allow_compression(true);
+    }
+    response += "\r\n";
+    
+    // The 101 is queued before the connection joins the broadcast list, so
+    // nothing can overtake it
+    int format = protocol == BINARY_SUBPROTOCOL ? WIRE_BINARY : WIRE_JSON;
+    bool alive = open_as(shard, conn, format, Subscription(), response, SNAPSHOT_CONNECT);
     
-    delete[] msg;
+    if (alive && shard->owner->on_connect) {
+        shard->owner->on_connect(conn->fd);
+    }
+    return alive;
 }
 
-struct ClientInfo {
-    int fd;
-    bool websocket;
-};
+static bool on_readable(Shard* shard, Connection* conn) {
+    char buffer[READ_CHUNK];
+    while (true) {
+        ssize_t received = recv(conn->fd, buffer, sizeof(buffer), 0);
+        if (received > 0) {
+            // Input after a close has started is read only to see the EOF
+            if (conn->state == CONN_HTTP) {
+                conn->in.append(buffer, received);
+            } else if (conn->state == CONN_OPEN) {
+                conn->decoder.feed(buffer, received);
+            }
+            continue;
+        }
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        return false;
+    }
+    
+    if (conn->state == CONN_HTTP) {
+        if (!handle_request(shard, conn)) {
+            return false;
+        }
+        if (conn->state != CONN_OPEN) {
+            return true;
+        }
+        // Frames the client sent right behind its request
+        conn->decoder.feed(conn->in.data(), conn->in.size());
+        conn->in.clear();
+    }
+    if (conn->state == CONN_OPEN && conn->decoder.buffered() > 0) {
+        return handle_frames(shard, conn);
+    }
+    return true;
+}
+
+static void accept_clients(Shard* shard) {
+    while (true) {
+        struct sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+        int fd = accept(shard->listen_fd, (struct sockaddr*)&client_addr, &client_len);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                std::cerr << "accept failed: " << strerror(errno) << std::endl;
+            }
+            return;
+        }
+        
+        int opt = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+        if (!set_nonblocking(fd) || !shard->poller.add(fd, POLL_READABLE)) {
+            close(fd);
+            continue;
+        }
+        shard->connections[fd] = new Connection(fd, shard->owner->queue_limit, shard->owner->slow_policy);
+    }
+}
 
-static std::vector<int> clients;
-static pthread_mutex_t clients_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Sends whatever broadcasters queued since the last wake, and snapshots
+// to the connections that lost messages
+static void flush_queued(Shard* shard) {
+    char drain[64];
+    while (read(shard->wake_fds[0], drain, sizeof(drain)) > 0) {
+    }
+    
+    std::vector<Connection*> dead;
+    std::vector<Connection*> behind;
+    pthread_mutex_lock(&shard->lock);
+    shard->wake_pending = false;
+    for (size_t i = 0; i < shard->flush_list.size(); i++) {
+        Connection* conn = shard->flush_list[i];
+        conn->queued = false;
+        if (conn->evict || !flush_locked(shard, conn)) {
+            dead.push_back(conn);
+        } else if (conn->resync && conn->state == CONN_OPEN) {
+            behind.push_back(conn);
+        }
+    }
+    shard->flush_list.clear();
+    pthread_mutex_unlock(&shard->lock);
+    
+    // Outside the shard lock: the sequence lock comes first
+    for (size_t i = 0; i < behind.size(); i++) {
+        Subscription subscription = behind[i]->subscription;
+        if (!open_as(shard, behind[i], behind[i]->format, subscription, "", SNAPSHOT_OVERFLOW)) {
+            dead.push_back(behind[i]);
+        }
+    }
+    
+    for (size_t i = 0; i < dead.size(); i++) {
+        close_connection(shard, dead[i]);
+    }
+}
 
-void* server_thread_func(void* arg) {
-    WebSocketServer* server = (WebSocketServer*)arg;
-    server->server_loop();
+static void* shard_thread_func(void* arg) {
+    Shard* shard = (Shard*)arg;
+    WebSocketServer* server = shard->owner->server;
+    std::vector<PollEvent> ready;
+    
+    while (server->is_running()) {
+        if (shard->poller.wait(ready, POLL_TIMEOUT_MS) < 0) {
+            std::cerr << "Event poll failed: " << strerror(errno) << std::endl;
+            break;
+        }
+        
+        for (size_t i = 0; i < ready.size(); i++) {
+            int fd = ready[i].fd;
+            if (fd == shard->listen_fd) {
+                accept_clients(shard);
+                continue;
+            }
+            if (fd == shard->wake_fds[0]) {
+                flush_queued(shard);
+                continue;
+            }
+            
+            std::map<int, Connection*>::iterator it = shard->connections.find(fd);
+            if (it == shard->connections.end()) {
+                continue;
+            }
+            Connection* conn = it->second;
+            
+            bool alive = true;
+            if (ready[i].events & POLL_WRITABLE) {
+                pthread_mutex_lock(&shard->lock);
+                alive = flush_locked(shard, conn);
+                pthread_mutex_unlock(&shard->lock);
+            }
+            if (alive && (ready[i].events & (POLL_READABLE | POLL_CLOSED))) {
+                alive = on_readable(shard, conn);
+            }
+            if (!alive) {
+                close_connection(shard, conn);
+            }
+        }
+    }
     return NULL;
 }
 
-WebSocketServer::WebSocketServer(int port) {
+static void destroy_shard(Shard* shard) {
+    std::map<int, Connection*>::iterator it;
+    for (it = shard->connections.begin(); it != shard->connections.end(); ++it) {
+        close(it->first);
+        delete it->second;
+    }
+    if (shard->listen_fd >= 0) {
+        close(shard->listen_fd);
+    }
+    if (shard->wake_fds[0] >= 0) {
+        close(shard->wake_fds[0]);
+        close(shard->wake_fds[1]);
+    }
+    delete shard;
+}
+
+WebSocketServer::WebSocketServer(int port, Config* config) {
     this->port = port;
-    this->server_fd = -1;
+    this->config = config;
     this->running = false;
-    this->server_thread = NULL;
+    this->state = NULL;
 }
 
 WebSocketServer::~WebSocketServer() {
@@ -158,361 +1268,546 @@ bool WebSocketServer::start() {
         return true;
     }
     
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd < 0) {
-        std::cerr << "Failed to create socket" << std::endl;
-        return false;
-    }
+    int shard_count = config->server_io_threads < 1 ? 1 : config->server_io_threads;
+#ifndef SO_REUSEPORT
+    shard_count = 1;
+#endif
     
-    int opt = 1;
-    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-    
-    struct sockaddr_in address;
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(port);
+    ServerState* ss = new ServerState();
+    ss->server = this;
+    ss->queue_limit = config->server_queue_limit;
+    ss->slow_policy = config->server_slow_policy;
+    ss->on_connect = on_connect;
+    ss->on_disconnect = on_disconnect;
+    ss->dictionary_interval_ms = (long long)config->server_dictionary_interval_s * 1000;
+    ss->last_full_dictionary_ms = monotonic_ms();
+    ss->deflate = config->server_deflate;
+    ss->deflate_takeover = config->server_deflate_context_takeover;
+    ss->deflate_min_size = config->server_deflate_min_size;
+    ss->max_markets = config->max_markets;
+    ss->opportunity_ttl_ms = (long long)config->server_opportunity_ttl_s * 1000;
     
-    if (bind(server_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
-        std::cerr << "Failed to bind to port " << port << std::endl;
-        close(server_fd);
-        server_fd = -1;
-        return false;
+    bool ok = true;
+    for (int i = 0; i < shard_count && ok; i++) {
+        Shard* shard = new Shard(ss);
+        ss->shards.push_back(shard);
+        if (ss->deflate) {
+            shard->deflater = new MessageDeflater(config->server_deflate_level, true);
+            if (ss->deflate_takeover) {
+                shard->group_deflater = new MessageDeflater(config->server_deflate_level, false);
+            }
+        }
+        
+        shard->listen_fd = open_listener(port, shard_count > 1);
+        ok = shard->listen_fd >= 0 && pipe(shard->wake_fds) == 0;
+        if (ok) {
+            set_nonblocking(shard->wake_fds[0]);
+            set_nonblocking(shard->wake_fds[1]);
+            ok = shard->poller.add(shard->listen_fd, POLL_READABLE) &&
+                 shard->poller.add(shard->wake_fds[0], POLL_READABLE);
+        }
     }
     
-    if (listen(server_fd, 10) < 0) {
-        std::cerr << "Failed to listen" << std::endl;
-        close(server_fd);
-        server_fd = -1;
-        return false;
+    running = ok;
+    for (size_t i = 0; i < ss->shards.size() && ok; i++) {
+        Shard* shard = ss->shards[i];
+        if (pthread_create(&shard->thread, NULL, shard_thread_func, shard) != 0) {
+            std::cerr << "Failed to start server thread" << std::endl;
+            ok = false;
+        } else {
+            shard->thread_started = true;
+        }
     }
     
-    running = true;
-    
-    pthread_t* thread = new pthread_t;
-    if (pthread_create(thread, NULL, server_thread_func, this) != 0) {
-        std::cerr << "Failed to start server thread" << std::endl;
+    state = ss;
+    if (!ok) {
+        stop();
         running = false;
-        close(server_fd);
-        server_fd = -1;
-        delete thread;
         return false;
     }
     
-    server_thread = thread;
-    std::cout << "WebSocket server started on port " << port << std::endl;
+    std::cout << "WebSocket server started on port " << port << " ("
+              << shard_count << " " << EventPoller::backend() << " reactor"
+              << (shard_count > 1 ? "s" : "") << ")" << std::endl;
     return true;
 }
 
 void WebSocketServer::stop() {
-    if (!running) {
+    ServerState* ss = (ServerState*)state;
+    if (ss == NULL) {
         return;
     }
     
     running = false;
     
-    if (server_fd >= 0) {
-        close(server_fd);
-        server_fd = -1;
+    for (size_t i = 0; i < ss->shards.size(); i++) {
+        Shard* shard = ss->shards[i];
+        if (shard->thread_started) {
+            char wake = 1;
+            ssize_t ignored = write(shard->wake_fds[1], &wake, 1);
+            (void)ignored;
+            pthread_join(shard->thread, NULL);
+        }
+        destroy_shard(shard);
     }
     
-    if (server_thread != NULL) {
-        pthread_join(*(pthread_t*)server_thread, NULL);
-        delete (pthread_t*)server_thread;
-        server_thread = NULL;
-    }
+    delete ss;
+    state = NULL;
 }
 
 bool WebSocketServer::is_running() {
     return running;
 }
 
-void WebSocketServer::server_loop() {
-    while (running) {
-        struct sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
-        
-        fd_set read_fds;
-        FD_ZERO(&read_fds);
-        FD_SET(server_fd, &read_fds);
-        
-        struct timeval timeout;
-        timeout.tv_sec = 1;
-        timeout.tv_usec = 0;
-        
-        int activity = select(server_fd + 1, &read_fds, NULL, NULL, &timeout);
-        
-        if (activity > 0 && FD_ISSET(server_fd, &read_fds)) {
-            int client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &client_len);
-            if (client_fd >= 0) {
-                struct ThreadClientData {
-                    WebSocketServer* server;
-                    int fd;
-                };
-                
-                ThreadClientData* thread_data = new ThreadClientData;
-                thread_data->server = this;
-                thread_data->fd = client_fd;
-                
-                pthread_t client_thread;
-                pthread_create(&client_thread, NULL, [](void* arg) -> void* {
-                    ThreadClientData* td = (ThreadClientData*)arg;
-                    td->server->handle_client(td->fd);
-                    delete td;
-                    return NULL;
-                }, thread_data);
-                pthread_detach(client_thread);
-            }
-        }
-    }
-}
-
-void WebSocketServer::handle_client(int client_fd) {
-    char buffer[4096];
-    std::string request;
-    
-    int bytes_read = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
-    if (bytes_read <= 0) {
-        close(client_fd);
-        return;
+size_t WebSocketServer::client_count() {
+    ServerState* ss = (ServerState*)state;
+    if (ss == NULL) {
+        return 0;
     }
     
-    buffer[bytes_read] = '\0';
-    request = buffer;
+    size_t count = 0;
+    for (size_t i = 0; i < ss->shards.size(); i++) {
+        pthread_mutex_lock(&ss->shards[i]->lock);
+        count += ss->shards[i]->open.size();
+        pthread_mutex_unlock(&ss->shards[i]->lock);
+    }
+    return count;
+}
+
+ServerStats WebSocketServer::stats() {
+    ServerStats result;
+    ServerState* ss = (ServerState*)state;
+    if (ss == NULL) {
+        return result;
+    }
     
-    if (request.find("Upgrade: websocket") != std::string::npos ||
-        request.find("upgrade: websocket") != std::string::npos) {
-        if (handle_websocket_upgrade(client_fd, request)) {
-            if (on_connect) {
-                on_connect(client_fd);
+    for (size_t i = 0; i < ss->shards.size(); i++) {
+        Shard* shard = ss->shards[i];
+        pthread_mutex_lock(&shard->lock);
+        result.clients += shard->open.size();
+        result.messages_queued += shard->counters.messages_queued;
+        result.messages_coalesced += shard->counters.messages_coalesced;
+        result.messages_dropped += shard->counters.messages_dropped;
+        result.slow_disconnects += shard->counters.slow_disconnects;
+        result.resyncs += shard->counters.resyncs;
+        result.snapshots_sent += shard->counters.snapshots_sent;
+        result.messages_filtered += shard->counters.messages_filtered;
+        result.write_calls += shard->counters.write_calls;
+        result.bytes_sent += shard->counters.bytes_sent;
+        result.messages_compressed += shard->counters.messages_compressed;
+        result.compress_bytes_in += shard->counters.compress_bytes_in;
+        result.compress_bytes_out += shard->counters.compress_bytes_out;
+        for (size_t c = 0; c < shard->open.size(); c++) {
+            if (shard->open[c]->format == WIRE_BINARY) {
+                result.binary_clients++;
             }
-            
-            pthread_mutex_lock(&clients_mutex);
-            clients.push_back(client_fd);
-            pthread_mutex_unlock(&clients_mutex);
-            
-            while (running) {
-                fd_set read_fds;
-                FD_ZERO(&read_fds);
-                FD_SET(client_fd, &read_fds);
-                
-                struct timeval timeout;
-                timeout.tv_sec = 1;
-                timeout.tv_usec = 0;
-                
-                int activity = select(client_fd + 1, &read_fds, NULL, NULL, &timeout);
-                
-                if (activity > 0 && FD_ISSET(client_fd, &read_fds)) {
-                    bytes_read = recv(client_fd, buffer, sizeof(buffer), 0);
-                    if (bytes_read <= 0) {
-                        break;
-                    }
-                    
-                    // Parse WebSocket frame
-                    if (bytes_read >= 2) {
-                        unsigned char first_byte = buffer[0];
-                        unsigned char second_byte = buffer[1];
-                        unsigned char opcode = first_byte & 0x0F;
-                        bool masked = (second_byte & 0x80) != 0;
-                        size_t payload_len = second_byte & 0x7F;
-                        
-                        size_t mask_offset = 2;
-                        if (payload_len == 126) {
-                            if (bytes_read < 4) continue;
-                            payload_len = ((unsigned char)buffer[2] << 8) | (unsigned char)buffer[3];
-                            mask_offset = 4;
-                        } else if (payload_len == 127) {
-                            if (bytes_read < 10) continue;
-                            // Skip 64-bit length for simplicity
-                            mask_offset = 10;
-                            payload_len = 0; // Too large, skip
-                        }
-                        
-                        if (masked && bytes_read >= mask_offset + 4) {
-                            unsigned char mask[4];
-                            memcpy(mask, buffer + mask_offset, 4);
-                            size_t payload_offset = mask_offset + 4;
-                            
-                            if (bytes_read >= payload_offset + payload_len && payload_len > 0 && payload_len < 4096) {
-                                std::string payload;
-                                payload.resize(payload_len);
-                                
-                                for (size_t i = 0; i < payload_len; i++) {
-                                    payload[i] = buffer[payload_offset + i] ^ mask[i % 4];
-                                }
-                                
-                                // Handle ping message (opcode 0x9 or JSON ping)
-                                if (opcode == 0x9 || (opcode == 0x1 && payload.find("\"type\":\"ping\"") != std::string::npos)) {
-                                    // Send pong response
-                                    if (opcode == 0x9) {
-                                        // WebSocket ping frame - send pong frame (opcode 0xA)
-                                        unsigned char pong_frame[10];
-                                        size_t pong_frame_len = 2;
-                                        pong_frame[0] = 0x8A; // FIN + Pong opcode
-                                        pong_frame[1] = payload_len;
-                                        if (payload_len < 126) {
-                                            pong_frame[1] = payload_len;
-                                            pong_frame_len = 2;
-                                        } else if (payload_len < 65536) {
-                                            pong_frame[1] = 126;
-                                            pong_frame[2] = (payload_len >> 8) & 0xFF;
-                                            pong_frame[3] = payload_len & 0xFF;
-                                            pong_frame_len = 4;
-                                        }
-                                        send(client_fd, pong_frame, pong_frame_len, 0);
-                                        send(client_fd, payload.c_str(), payload_len, 0);
-                                    } else {
-                                        // JSON ping - respond with JSON pong
-                                        std::string pong_msg = "{\"type\":\"pong\"";
-                                        size_t ts_pos = payload.find("\"timestamp\":");
-                                        if (ts_pos != std::string::npos) {
-                                            size_t ts_start = payload.find(":", ts_pos) + 1;
-                                            size_t ts_end = payload.find_first_of(",}", ts_start);
-                                            if (ts_end != std::string::npos) {
-                                                std::string timestamp = payload.substr(ts_start, ts_end - ts_start);
-                                                pong_msg += ",\"timestamp\":" + timestamp;
-                                            }
-                                        }
-                                        pong_msg += "}";
-                                        send_message(client_fd, pong_msg);
-                                    }
-                                }
-                            }
-                        }
-                    }
-                } else if (activity < 0) {
-                    break;
-                }
-            }
-            
-            pthread_mutex_lock(&clients_mutex);
-            clients.erase(std::remove(clients.begin(), clients.end(), client_fd), clients.end());
-            pthread_mutex_unlock(&clients_mutex);
-            
-            if (on_disconnect) {
-                on_disconnect(client_fd);
+            if (shard->open[c]->deflate) {
+                result.deflate_clients++;
             }
+            const SendQueue& queue = shard->open[c]->queue;
+            result.queued += queue.size();
+            result.max_queue_depth = std::max(result.max_queue_depth, queue.size());
+            result.peak_queue_depth = std::max(result.peak_queue_depth, queue.peak());
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+    return result;
+}
+
+// Who a broadcast is for: connections taking `channel` unfiltered or
+// subscribed to any of `topics`. Opportunities must also clear each
+// subscriber's minimum profit.
+struct Route {
+    int channel;
+    uint64_t topics[2];
+    size_t topic_count;
+    double profit;
+};
+
+// One broadcast, in each wire format clients might take it in. Frames are
+// built on first use, so a variant no recipient needs costs nothing, and
+// each one is shared by every queue it goes on.
+struct Outgoing {
+    const char* payload[WIRE_FORMATS];   // NULL: not sent in that format
+    size_t length[WIRE_FORMATS];
+    int opcode[WIRE_FORMATS];
+    SharedFrame plain[WIRE_FORMATS];
+    SharedFrame deflated[WIRE_FORMATS];  // compressed from an empty window
+    SharedFrame grouped;                 // compressed in the current shard's shared context
+    
+    Outgoing() {
+        for (int i = 0; i < WIRE_FORMATS; i++) {
+            payload[i] = NULL;
+            length[i] = 0;
+            opcode[i] = WS_TEXT;
         }
-    } else {
-        std::string response = "HTTP/1.1 200 OK\r\n"
-                              "Content-Type: application/json\r\n"
-                              "Access-Control-Allow-Origin: *\r\n"
-                              "\r\n"
-                              "{\"status\":\"ok\"}";
-        send(client_fd, response.c_str(), response.length(), 0);
     }
     
-    close(client_fd);
+    void set(int format, int op, const char* data, size_t size) {
+        payload[format] = data;
+        length[format] = size;
+        opcode[format] = op;
+    }
+};
+
+// Null if compression fails, which leaves the caller to send it plain
+static SharedFrame deflate_frame(Shard* shard, MessageDeflater* deflater, const Outgoing& msg, int format,
+                                 bool reset) {
+    shard->compressed.clear();
+    if (!deflater->compress(msg.payload[format], msg.length[format], shard->compressed, reset)) {
+        return SharedFrame();
+    }
+    shard->counters.messages_compressed++;
+    shard->counters.compress_bytes_in += msg.length[format];
+    shard->counters.compress_bytes_out += shard->compressed.size();
+    return make_frame(msg.opcode[format] | WS_RSV1, shard->compressed.data(), shard->compressed.size());
 }
 
-bool WebSocketServer::handle_websocket_upgrade(int client_fd, const std::string& request) {
-    std::string key;
-    size_t key_pos = request.find("Sec-WebSocket-Key:");
-    if (key_pos == std::string::npos) {
-        key_pos = request.find("sec-websocket-key:");
+// The frame a connection takes a broadcast as: compressed once per shard
+// for the shared-context group, once overall for other deflate clients,
+// plain for the rest and for messages too short to gain anything. Caller
+// holds the shard lock.
+static const SharedFrame& frame_for(Shard* shard, Outgoing& msg, const Connection* conn) {
+    static const SharedFrame none;
+    int format = conn->format;
+    if (msg.payload[format] == NULL) {
+        return none;
     }
     
-    if (key_pos != std::string::npos) {
-        size_t key_start = request.find(" ", key_pos) + 1;
-        size_t key_end = request.find("\r\n", key_start);
-        if (key_end != std::string::npos) {
-            key = request.substr(key_start, key_end - key_start);
+    if (conn->deflate && msg.length[format] >= shard->owner->deflate_min_size) {
+        if (conn->in_group) {
+            if (!msg.grouped) {
+                msg.grouped = deflate_frame(shard, shard->group_deflater, msg, format, shard->group_reset);
+                shard->group_reset = !msg.grouped;  // after a failure the window is unknown
+            }
+            if (msg.grouped) {
+                return msg.grouped;
+            }
+        } else {
+            if (!msg.deflated[format]) {
+                msg.deflated[format] = deflate_frame(shard, shard->deflater, msg, format, true);
+            }
+            if (msg.deflated[format]) {
+                return msg.deflated[format];
+            }
         }
     }
     
-    if (key.empty()) {
+    if (!msg.plain[format]) {
+        msg.plain[format] = make_frame(msg.opcode[format], msg.payload[format], msg.length[format]);
+    }
+    return msg.plain[format];
+}
+
+// Queues the message for one connection, once per broadcast however many
+// of its topics matched. Group members never coalesce. A connection that
+// loses a message to its queue limit has its backlog discarded and is
+// skipped until the reactor has queued a snapshot to replace it; for a
+// group member that also restarts the shared context, whose history its
+// decoder no longer has. Caller holds the shard lock. Returns whether the
+// connection took the message.
+static bool deliver(Shard* shard, Connection* conn, Outgoing& msg, uint64_t key, const Route* route,
+                    std::vector<Connection*>& evicted) {
+    if (conn->stamp == shard->stamp || conn->evict || conn->resync) {
         return false;
     }
+    conn->stamp = shard->stamp;
     
-    const std::string magic = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
-    std::string accept_key = key + magic;
-    
-    unsigned char hash[20];
-    sha1((unsigned char*)accept_key.c_str(), accept_key.length(), hash);
-    
-    std::string base64 = base64_encode(hash, 20);
+    if (route != NULL && route->channel == CHANNEL_OPPORTUNITY && route->profit < conn->subscription.min_profit) {
+        return false;
+    }
+    const SharedFrame& frame = frame_for(shard, msg, conn);
+    if (!frame) {
+        return false;
+    }
     
-    std::string response = "HTTP/1.1 101 Switching Protocols\r\n"
-                          "Upgrade: websocket\r\n"
-                          "Connection: Upgrade\r\n"
-                          "Sec-WebSocket-Accept: " + base64 + "\r\n"
-                          "\r\n";
+    int result = conn->queue.push(frame, conn->in_group ? 0 : key);
+    if (result == PUSH_OVERFLOW) {
+        // The reactor closes it; it gets nothing further meanwhile
+        conn->evict = true;
+        evicted.push_back(conn);
+        shard->counters.slow_disconnects++;
+    } else {
+        shard->counters.messages_queued++;
+        if (result == PUSH_COALESCED) {
+            shard->counters.messages_coalesced++;
+        } else if (result == PUSH_DROPPED) {
+            conn->queue.clear();
+            conn->resync = true;
+            shard->counters.messages_dropped++;
+            shard->counters.resyncs++;
+        }
+    }
     
-    send(client_fd, response.c_str(), response.length(), 0);
+    if (!conn->queued) {
+        conn->queued = true;
+        shard->flush_list.push_back(conn);
+    }
     return true;
 }
 
-void WebSocketServer::send_message(int client_fd, const std::string& message) {
-    unsigned char frame[10];
-    size_t frame_len = 2;
-    size_t msg_len = message.length();
+// Queues the message for every open connection the route selects (a null
+// route means everyone; formats the message has no payload for are skipped)
+// and wakes the reactors, which do the actual writes. Only the subscriber
+// lists a route names are visited.
+static void push_frames(ServerState* ss, Outgoing& msg, uint64_t key, const Route* route) {
+    std::vector<Connection*> evicted;
+    for (size_t i = 0; i < ss->shards.size(); i++) {
+        Shard* shard = ss->shards[i];
+        pthread_mutex_lock(&shard->lock);
+        shard->stamp++;
+        msg.grouped.reset();
+        
+        if (route == NULL) {
+            for (size_t c = 0; c < shard->open.size(); c++) {
+                deliver(shard, shard->open[c], msg, key, route, evicted);
+            }
+        } else {
+            size_t delivered = 0;
+            const std::vector<Connection*>& everyone = shard->everything[route->channel];
+            for (size_t c = 0; c < everyone.size(); c++) {
+                delivered += deliver(shard, everyone[c], msg, key, route, evicted);
+            }
+            for (size_t t = 0; t < route->topic_count; t++) {
+                std::unordered_map<uint64_t, std::vector<Connection*> >::const_iterator topic =
+                    shard->topics.find(route->topics[t]);
+                if (topic == shard->topics.end()) {
+                    continue;
+                }
+                for (size_t c = 0; c < topic->second.size(); c++) {
+                    delivered += deliver(shard, topic->second[c], msg, key, route, evicted);
+                }
+            }
+            shard->counters.messages_filtered += shard->open.size() - delivered;
+        }
+        
+        for (size_t c = 0; c < evicted.size(); c++) {
+            leave_open(shard, evicted[c]);
+        }
+        evicted.clear();
+        
+        if (!shard->flush_list.empty() && !shard->wake_pending) {
+            char wake = 1;
+            ssize_t ignored = write(shard->wake_fds[1], &wake, 1);
+            (void)ignored;
+            shard->wake_pending = true;
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+// Makes sure binary clients can resolve the IDs a record is about to use:
+// queues a delta naming every symbol interned since the last announcement,
+// or the whole dictionary once the refresh interval is up. The announced
+// counters move only after the frame is queued, so a broadcaster that sees
+// its IDs as announced is ordered behind the frame naming them.
+static void announce_symbols(ServerState* ss, SymbolId market_id, SymbolId event_id) {
+    long long now = monotonic_ms();
+    bool unknown = (market_id != INVALID_SYMBOL && market_id >= ss->markets_announced.load(std::memory_order_acquire)) ||
+                   (event_id != INVALID_SYMBOL && event_id >= ss->events_announced.load(std::memory_order_acquire));
+    bool refresh = now - ss->last_full_dictionary_ms.load(std::memory_order_relaxed) >= ss->dictionary_interval_ms;
+    if (!unknown && !refresh) {
+        return;
+    }
     
-    frame[0] = 0x81;
+    pthread_mutex_lock(&ss->dictionary_lock);
+    SymbolId markets = (SymbolId)market_symbols().size();
+    SymbolId events = (SymbolId)event_symbols().size();
+    SymbolId market_begin = ss->markets_announced.load(std::memory_order_relaxed);
+    SymbolId event_begin = ss->events_announced.load(std::memory_order_relaxed);
+    bool full = now - ss->last_full_dictionary_ms.load(std::memory_order_relaxed) >= ss->dictionary_interval_ms;
+    if (full) {
+        market_begin = 0;
+        event_begin = 0;
+        ss->last_full_dictionary_ms.store(now, std::memory_order_relaxed);
+    }
     
-    if (msg_len < 126) {
-        frame[1] = msg_len;
-    } else if (msg_len < 65536) {
-        frame[1] = 126;
-        frame[2] = (msg_len >> 8) & 0xFF;
-        frame[3] = msg_len & 0xFF;
-        frame_len = 4;
-    } else {
-        frame[1] = 127;
-        for (int i = 0; i < 8; i++) {
-            frame[2 + i] = (msg_len >> (56 - i * 8)) & 0xFF;
-        }
-        frame_len = 10;
+    if (full || market_begin < markets || event_begin < events) {
+        std::string message;
+        encode_symbols(message, full, market_begin, markets, event_begin, events);
+        Outgoing msg;
+        msg.set(WIRE_BINARY, WS_BINARY, message.data(), message.size());
+        push_frames(ss, msg, 0, NULL);
+    }
+    ss->markets_announced.store(markets, std::memory_order_release);
+    ss->events_announced.store(events, std::memory_order_release);
+    pthread_mutex_unlock(&ss->dictionary_lock);
+}
+
+// Text goes to every client, whatever its format
+void WebSocketServer::broadcast_text(const std::string& message) {
+    ServerState* ss = (ServerState*)state;
+    if (ss == NULL || !running) {
+        return;
     }
     
-    send(client_fd, frame, frame_len, 0);
-    send(client_fd, message.c_str(), msg_len, 0);
+    Outgoing msg;
+    msg.set(WIRE_JSON, WS_TEXT, message.data(), message.size());
+    msg.set(WIRE_BINARY, WS_TEXT, message.data(), message.size());
+    push_frames(ss, msg, 0, NULL);
 }
 
-std::string WebSocketServer::create_opportunity_json(ArbitrageOpportunity* opp) {
-    std::ostringstream oss;
-    oss << "{\"type\":\"opportunity\",\"data\":{"
-        << "\"event_id\":\"" << opp->event_id << "\","
-        << "\"buy_market\":" << opp->buy_market << ","
-        << "\"sell_market\":" << opp->sell_market << ","
-        << "\"buy_price\":" << opp->buy_price << ","
-        << "\"sell_price\":" << opp->sell_price << ","
-        << "\"profit_percentage\":" << (opp->profit_percentage * 100.0) << ","
-        << "\"max_size\":" << opp->max_size
-        << "}}";
-    return oss.str();
+void write_opportunity_json(JsonWriter& out, const ArbitrageOpportunity* opp, uint64_t seq) {
+    out.begin_object();
+    out.key("type");
+    out.string("opportunity", 11);
+    out.key("seq");
+    out.integer((long long)seq);
+    out.key("data");
+    out.begin_object();
+    out.key("event_id");
+    out.string(event_symbols().name(opp->event_id));
+    out.key("buy_market");
+    out.integer(opp->buy_market);
+    out.key("sell_market");
+    out.integer(opp->sell_market);
+    out.key("buy_price");
+    out.number(opp->buy_price);
+    out.key("sell_price");
+    out.number(opp->sell_price);
+    out.key("profit_percentage");
+    out.number(opp->profit_percentage * 100.0);
+    out.key("max_size");
+    out.number(opp->max_size);
+    out.key("avg_buy_price");
+    out.number(opp->avg_buy_price);
+    out.key("avg_sell_price");
+    out.number(opp->avg_sell_price);
+    out.key("legs");
+    out.integer(opp->legs);
+    out.end_object();
+    out.end_object();
+}
+
+void write_market_data_json(JsonWriter& out, const MarketData* data, uint64_t seq) {
+    out.begin_object();
+    out.key("type");
+    out.string("market_data", 11);
+    out.key("seq");
+    out.integer((long long)seq);
+    out.key("data");
+    out.begin_object();
+    out.key("market_id");
+    out.string(market_symbols().name(data->market_id));
+    out.key("market");
+    out.integer(data->market);
+    out.key("event_name");
+    out.string(event_symbols().name(data->event_id));
+    out.key("best_bid");
+    out.number(data->best_bid);
+    out.key("best_ask");
+    out.number(data->best_ask);
+    out.key("bid_size");
+    out.number(data->bid_size);
+    out.key("ask_size");
+    out.number(data->ask_size);
+    out.end_object();
+    out.end_object();
+}
+
+// One writer per broadcasting thread; its buffer is reused message to
+// message, so steady-state serialization doesn't allocate
+static JsonWriter& thread_writer() {
+    static thread_local JsonWriter writer;
+    writer.clear();
+    return writer;
+}
+
+// Caller holds the sequence lock
+static void cache_market_data(ServerState* ss, const MarketData* data, uint64_t seq) {
+    if (data->market_id >= ss->max_markets) {
+        return;  // beyond the markets we track; snapshots go without it
+    }
+    if (data->market_id >= ss->quotes.size()) {
+        ss->quotes.resize(data->market_id + 1);
+    }
+    CachedQuote& quote = ss->quotes[data->market_id];
+    if (quote.seq == 0) {
+        ss->quoted.push_back(data->market_id);
+    }
+    quote.data = *data;
+    quote.data.book = NULL;
+    quote.seq = seq;
 }
 
-std::string WebSocketServer::create_market_data_json(MarketData* data) {
-    std::ostringstream oss;
-    oss << "{\"type\":\"market_data\",\"data\":{"
-        << "\"market_id\":\"" << data->market_id << "\","
-        << "\"market\":" << data->market << ","
-        << "\"event_name\":\"" << data->event_name << "\","
-        << "\"best_bid\":" << data->best_bid << ","
-        << "\"best_ask\":" << data->best_ask << ","
-        << "\"bid_size\":" << data->bid_size << ","
-        << "\"ask_size\":" << data->ask_size
-        << "}}";
-    return oss.str();
+// Caller holds the sequence lock
+static void cache_opportunity(ServerState* ss, const ArbitrageOpportunity* opp, uint64_t seq) {
+    uint64_t key = ((uint64_t)opp->event_id << 16) | ((uint64_t)(opp->buy_market & 0xFF) << 8) |
+                   (uint64_t)(opp->sell_market & 0xFF);
+    CachedOpportunity& cached = ss->opportunities[key];
+    cached.opp = *opp;
+    cached.seq = seq;
+    cached.time_ms = monotonic_ms();
 }
 
+// Each message is serialized once per format in use: JSON always, the
+// binary record only while binary clients are connected. Numbering,
+// caching and queueing happen under the sequence lock; symbols are
+// announced before it, and a client that turned binary since then was
+// sent a dictionary naming them.
 void WebSocketServer::broadcast_opportunity(ArbitrageOpportunity* opp) {
-    std::string message = create_opportunity_json(opp);
+    ServerState* ss = (ServerState*)state;
+    if (ss == NULL || !running) {
+        return;
+    }
     
-    pthread_mutex_lock(&clients_mutex);
-    for (int fd : clients) {
-        send_message(fd, message);
+    if (ss->binary_clients.load(std::memory_order_relaxed) > 0) {
+        announce_symbols(ss, INVALID_SYMBOL, opp->event_id);
     }
-    pthread_mutex_unlock(&clients_mutex);
+    
+    pthread_mutex_lock(&ss->sequence_lock);
+    uint64_t seq = ++ss->sequence;
+    cache_opportunity(ss, opp, seq);
+    JsonWriter& out = thread_writer();
+    write_opportunity_json(out, opp, seq);
+    Outgoing msg;
+    msg.set(WIRE_JSON, WS_TEXT, out.data(), out.size());
+    unsigned char record[BINARY_RECORD_SIZE];
+    if (ss->binary_clients.load(std::memory_order_relaxed) > 0) {
+        encode_opportunity(*opp, record);
+        msg.set(WIRE_BINARY, WS_BINARY, (const char*)record, sizeof(record));
+    }
+    
+    Route route;
+    route.channel = CHANNEL_OPPORTUNITY;
+    route.topics[0] = topic_key(TOPIC_EVENT_OPPORTUNITY, opp->event_id);
+    route.topic_count = 1;
+    route.profit = opp->profit_percentage;
+    push_frames(ss, msg, 0, &route);
+    pthread_mutex_unlock(&ss->sequence_lock);
 }
 
 void WebSocketServer::broadcast_market_data(MarketData* data) {
-    std::string message = create_market_data_json(data);
+    ServerState* ss = (ServerState*)state;
+    if (ss == NULL || !running) {
+        return;
+    }
+    
+    if (ss->binary_clients.load(std::memory_order_relaxed) > 0) {
+        announce_symbols(ss, data->market_id, data->event_id);
+    }
     
-    pthread_mutex_lock(&clients_mutex);
-    for (int fd : clients) {
-        send_message(fd, message);
+    pthread_mutex_lock(&ss->sequence_lock);
+    uint64_t seq = ++ss->sequence;
+    cache_market_data(ss, data, seq);
+    JsonWriter& out = thread_writer();
+    write_market_data_json(out, data, seq);
+    Outgoing msg;
+    msg.set(WIRE_JSON, WS_TEXT, out.data(), out.size());
+    unsigned char record[BINARY_RECORD_SIZE];
+    if (ss->binary_clients.load(std::memory_order_relaxed) > 0) {
+        encode_market_data(*data, record);
+        msg.set(WIRE_BINARY, WS_BINARY, (const char*)record, sizeof(record));
     }
-    pthread_mutex_unlock(&clients_mutex);
+    
+    Route route;
+    route.channel = CHANNEL_MARKET_DATA;
+    route.topics[0] = topic_key(TOPIC_MARKET, data->market_id);
+    route.topics[1] = topic_key(TOPIC_EVENT_DATA, data->event_id);
+    route.topic_count = 2;
+    route.profit = 0.0;
+    push_frames(ss, msg, KEY_MARKET_DATA | data->market_id, &route);
+    pthread_mutex_unlock(&ss->sequence_lock);
 }
 
 void WebSocketServer::set_on_connect(std::function<void(int)> callback) {
@@ -522,4 +1817,3 @@ void WebSocketServer::set_on_connect(std::function<void(int)> callback) {
 void WebSocketServer::set_on_disconnect(std::function<void(int)> callback) {
     on_disconnect = callback;
 }
-